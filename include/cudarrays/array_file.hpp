@@ -0,0 +1,214 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_ARRAY_FILE_HPP_
+#define CUDARRAYS_ARRAY_FILE_HPP_
+
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "common.hpp"
+#include "dynarray_view.hpp"
+#include "host.hpp"
+
+namespace cudarrays {
+
+// Dimensions of the arrays held in files
+static constexpr unsigned ARRAY_FILE_MAX_DIMS = 3;
+
+/**
+ * Header of the files that hold arrays. The host copy of the array follows the
+ * header at an offset aligned to the system page size, with the layout of the
+ * host copy: dimensions in storage order and the innermost one padded to the
+ * alignment. Fields are stored in the byte order of the host
+ */
+struct array_file_header {
+    char     magic[8];                          // "CUDARRAY"
+    uint32_t version;
+    uint32_t elemBytes;                         // Size of the elements
+    uint32_t dims;
+    uint32_t order[ARRAY_FILE_MAX_DIMS];        // Position of every dimension of the array in the host copy
+    uint64_t extents[ARRAY_FILE_MAX_DIMS];      // Extents of the dimensions of the array
+    uint64_t alignment;                         // Alignment in elements of the innermost dimension
+    uint64_t alignOffset;                       // Offset in elements of the aligned element
+    uint64_t dataOffset;                        // Offset in bytes of the host copy in the file
+    uint64_t dataBytes;                         // Size in bytes of the host copy
+};
+
+std::string to_string(const array_file_header &header);
+
+namespace detail {
+/**
+ * Open a file that holds an array and read its header
+ * @param path Path of the file
+ * @param mode Access to the file
+ * @param header Output: header of the file
+ * @return The descriptor of the file, or -1 if it cannot be opened or its
+ *         header is not valid
+ */
+int array_file_open(const std::string &path, file_mode mode, array_file_header &header);
+
+/**
+ * Create a file that holds an array. The host copy is zero-filled
+ * @param path Path of the file, which is truncated if it exists
+ * @param header Header of the file. Its offset to the host copy is set
+ * @return The descriptor of the file, opened for reading and writing, or -1
+ *         on error
+ */
+int array_file_create(const std::string &path, array_file_header &header);
+
+/**
+ * Header that describes the host copy of an array type
+ */
+template <typename Array>
+array_file_header
+array_file_header_of(const extents<Array::dimensions> &ext)
+{
+    static_assert(Array::dimensions <= ARRAY_FILE_MAX_DIMS, "Too many dimensions");
+
+    using permuter_type = typename Array::permuter_type;
+    using alignment_type = typename Array::alignment_type;
+    using value_type = typename Array::value_type;
+
+    array_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CUDARRAY", sizeof(header.magic));
+    header.version   = 1;
+    header.elemBytes = sizeof(value_type);
+    header.dims      = Array::dimensions;
+    for (unsigned dim = 0; dim < Array::dimensions; ++dim) {
+        header.order[dim]   = permuter_type::dim_index(dim);
+        header.extents[dim] = ext[dim];
+    }
+    header.alignment   = alignment_type::alignment;
+    header.alignOffset = uint64_t(alignment_type::offset);
+
+    dim_manager<value_type, alignment_type, Array::dimensions> dims(permuter_type::reorder(ext));
+    header.dataBytes = dims.get_elems_align() * sizeof(value_type);
+
+    return header;
+}
+}
+
+/**
+ * Create an out-of-core array whose host copy is backed by a file that holds
+ * an array with the same element type, layout and alignment. Only a window of
+ * the host copy is resident: tiles are loaded from the file on first access
+ * and written back when they are evicted
+ * @param path Path of the file
+ * @param mode Access to the file. Writes to shared files reach the file,
+ *             including the contents transferred back from the devices
+ * @param window Resident part of the host copy. A budget of 0 maps the whole
+ *               file, whose pages are loaded on first access
+ * @return The array. Fails if the file cannot be opened or holds an array of
+ *         another type
+ */
+template <typename Array>
+dynarray_view<Array>
+open_array_file(const std::string &path, file_mode mode, const host_window &window,
+                const typename Array::coherence_policy_type &coherence = typename Array::coherence_policy_type{})
+{
+    static_assert(Array::array_traits_type::dynamic_dimensions == Array::dimensions,
+                  "Arrays held in files must have dynamic extents");
+
+    array_file_header header;
+    int fd = detail::array_file_open(path, mode, header);
+    if (fd < 0)
+        FATAL("Unable to open array file %s", path.c_str());
+
+    extents<Array::dimensions> ext;
+    for (unsigned dim = 0; dim < Array::dimensions; ++dim)
+        ext[dim] = array_size_t(header.extents[dim]);
+
+    array_file_header expected = detail::array_file_header_of<Array>(ext);
+    expected.dataOffset = header.dataOffset;
+    if (memcmp(&header, &expected, sizeof(header)) != 0) {
+        close(fd);
+        FATAL("%s holds %s, expected %s", path.c_str(), to_string(header).c_str(), to_string(expected).c_str());
+    }
+
+    auto *ret = Array::make(ext, coherence, host_file{fd, off_t(header.dataOffset), mode}, window);
+    // The host copy keeps its own descriptor
+    close(fd);
+    return dynarray_view<Array>{ret};
+}
+
+/**
+ * Create an array whose host copy is backed by a file that holds an array
+ * with the same element type, layout and alignment. Pages are loaded from the
+ * file on first access
+ */
+template <typename Array>
+dynarray_view<Array>
+open_array_file(const std::string &path, file_mode mode,
+                const typename Array::coherence_policy_type &coherence = typename Array::coherence_policy_type{})
+{
+    return open_array_file<Array>(path, mode, host_window{0, 0}, coherence);
+}
+
+/**
+ * Create a file that holds a zero-filled array and an array backed by it.
+ * The file is mapped shared
+ * @param path Path of the file, which is truncated if it exists
+ * @param ext Extents of the array
+ * @param window Resident part of the host copy (see open_array_file)
+ */
+template <typename Array>
+dynarray_view<Array>
+make_array_file(const std::string &path, const extents<Array::dimensions> &ext, const host_window &window,
+                const typename Array::coherence_policy_type &coherence = typename Array::coherence_policy_type{})
+{
+    static_assert(Array::array_traits_type::dynamic_dimensions == Array::dimensions,
+                  "Arrays held in files must have dynamic extents");
+
+    array_file_header header = detail::array_file_header_of<Array>(ext);
+    int fd = detail::array_file_create(path, header);
+    if (fd < 0)
+        FATAL("Unable to create array file %s", path.c_str());
+
+    auto *ret = Array::make(ext, coherence, host_file{fd, off_t(header.dataOffset), file_mode::shared}, window);
+    close(fd);
+    return dynarray_view<Array>{ret};
+}
+
+template <typename Array>
+dynarray_view<Array>
+make_array_file(const std::string &path, const extents<Array::dimensions> &ext,
+                const typename Array::coherence_policy_type &coherence = typename Array::coherence_policy_type{})
+{
+    return make_array_file<Array>(path, ext, host_window{0, 0}, coherence);
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
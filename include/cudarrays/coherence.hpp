@@ -33,19 +33,51 @@
 #include <vector>
 
 #include "detail/utils/base.hpp"
+#include "detail/coherence/dependencies.hpp"
 
 namespace cudarrays {
 
 class coherent;
 
+/**
+ * How the kernels of a launch access an array. Used by the coherence policies
+ * to skip the transfers that are not needed
+ */
+enum class access_intent {
+    read,          // Only read: the host copy stays up to date
+    write_discard, // Every element is written before being read: the current
+                   // contents are not transferred to the devices
+    read_write,    // Read and written
+    accumulate     // Updated from the current contents
+};
+
+const char *to_string(access_intent intent);
+
 class coherence_policy {
 public:
     virtual ~coherence_policy() noexcept {}
-    virtual void release(const std::vector<unsigned> &gpus, bool Const) = 0;
+    virtual void release(const std::vector<unsigned> &gpus, access_intent intent) = 0;
     virtual void acquire() = 0;
 
+    /**
+     * Transfer to the host the parts of the array whose host copy is stale
+     */
+    virtual void update_host() = 0;
+
     virtual void bind(coherent &obj) = 0;
     virtual void unbind() = 0;
+
+    /**
+     * Launches that accessed the array, used to order the launches that
+     * access it next
+     */
+    access_dependencies &get_dependencies() noexcept
+    {
+        return deps_;
+    }
+
+private:
+    access_dependencies deps_;
 };
 
 class coherent :
@@ -61,10 +93,58 @@ public:
     virtual void to_device() = 0;
     virtual void to_host() = 0;
 
+    /**
+     * Transfer a part of the array to the host
+     * @param offset Offset in bytes of the part from host_addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the array can only be transferred as a whole
+     */
+    virtual bool to_host(size_t offset, size_t bytes) = 0;
+
+    /**
+     * Transfer a part of the array to its staging copy instead of the host
+     * copy. The staging copy has the layout of the host copy and is allocated
+     * on first use
+     * @param offset Offset in bytes of the part from host_addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the array can only be transferred as a whole
+     */
+    virtual bool to_staging(size_t offset, size_t bytes) = 0;
+
+    /**
+     * Transfer a part of the array to the devices
+     * @param offset Offset in bytes of the part from host_addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the array can only be transferred as a whole
+     */
+    virtual bool to_device(size_t offset, size_t bytes) = 0;
+
+    /**
+     * Transfer a part of the array to one of the devices. Empty parts only
+     * check if the copies of the devices can be updated separately
+     * @param gpu Device whose copy is updated
+     * @param offset Offset in bytes of the part from host_addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the copies of all the devices can only be updated together
+     */
+    virtual bool to_device(unsigned gpu, size_t offset, size_t bytes) = 0;
+
     virtual void *host_addr() noexcept = 0;
     virtual const void *host_addr() const noexcept = 0;
 
+    /**
+     * Address of the staging copy that corresponds to host_addr()
+     * @return nullptr if the staging copy has not been allocated
+     */
+    virtual void *staging_addr() noexcept = 0;
+
     virtual size_t size() const noexcept = 0;
+
+    /**
+     * Size of the pages of the host copy. Protections of the host copy are
+     * changed in multiples of it
+     */
+    virtual size_t host_page_size() const noexcept = 0;
 };
 
 }
@@ -30,21 +30,159 @@
 #ifndef CUDARRAYS_DETAIL_COHERENCE_DEFAULT_HPP_
 #define CUDARRAYS_DETAIL_COHERENCE_DEFAULT_HPP_
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <cuda_runtime_api.h>
 
 #include "../../coherence.hpp"
+#include "../../memory.hpp"
+#include "../utils/misc.hpp"
+#include "../utils/option.hpp"
 
 namespace cudarrays {
 
+// Size in bytes of the parts of the arrays whose state is tracked, which are
+// transferred on CPU faults. Rounded up to the page size of the host copy, so
+// that huge pages are not split. 0 tracks the whole array as a single part
+extern utils::option<size_t> COHERENCE_FAULT_GRANULARITY;
+// Track the pages written by the CPU, so that only those are transferred to
+// the GPUs
+extern utils::option<bool> COHERENCE_DIRTY_TRACKING;
+// Number of transitions kept in the transition log of every array. 0 disables
+// the log
+extern utils::option<size_t> COHERENCE_LOG;
+// Transfer to the host in the background, part by part, the arrays written by
+// the kernels once they complete, instead of on CPU faults
+extern utils::option<bool> COHERENCE_EAGER_WRITEBACK;
+// Print the coherence statistics of every array and of all of them at exit
+extern utils::option<bool> COHERENCE_STATS;
+
+// State of a copy of a part of an array
+enum class copy_state : uint8_t {
+    invalid  = 0, // Stale: another copy has been written
+    shared   = 1, // Up to date
+    modified = 2  // Written: the other copies are stale
+};
+
+const char *to_string(copy_state state);
+
+// Entry of the transition log of an array
+struct coherence_transition {
+    enum : int {
+        HOST    = -1,
+        DEVICES = -2 // All the devices, whose copies are updated together
+    };
+
+    int agent;      // Device whose copy changes, HOST or DEVICES
+    size_t offset;  // Part of the array, relative to its host address
+    size_t bytes;
+    copy_state from;
+    copy_state to;
+    size_t copied;  // Bytes transferred
+    size_t avoided; // Bytes not transferred because they were up to date
+};
+
+std::string to_string(const coherence_transition &transition);
+
+class default_coherence;
+
+// Coherence statistics of an array, or of all the arrays. Counters are
+// updated with relaxed atomic operations
+struct coherence_stats {
+    uint64_t readFaults;    // CPU faults handled by the policy
+    uint64_t writeFaults;
+    uint64_t stallNs;       // Time spent by the CPU threads in the faults
+    uint64_t toHost;        // Transfers to the host
+    uint64_t toHostBytes;
+    uint64_t toHostNs;
+    uint64_t toDevice;      // Transfers to the devices
+    uint64_t toDeviceBytes; // Bytes of the host copy transferred
+    uint64_t toDeviceNs;
+    // Transitions of the copies of the parts of the arrays, by copy_state
+    uint64_t transitions[3][3];
+
+    coherence_stats &operator+=(const coherence_stats &other);
+};
+
+std::string to_string(const coherence_stats &stats);
+
+/**
+ * Obtain the coherence statistics of all the arrays since initialization
+ */
+coherence_stats get_coherence_stats();
+
+/**
+ * Print the coherence statistics of every array, including the destroyed ones
+ * if CUDARRAYS_COHERENCE_STATS is set, of all of them and of the fault
+ * backend. Called at library finalization if CUDARRAYS_COHERENCE_STATS is set
+ * @param out Output stream
+ */
+void print_coherence_stats(FILE *out);
+
+namespace detail {
+extern coherence_stats GlobalCoherenceStats;
+
+inline void
+stats_add(uint64_t &counter, uint64_t value)
+{
+    __atomic_fetch_add(&counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Read the counters of a set of statistics that are being updated
+ */
+coherence_stats stats_snapshot(const coherence_stats &stats);
+
+/**
+ * Keep track of the statistics of an array, so that they are printed at exit
+ * @param name Name of the array in the output
+ */
+void stats_register(const default_coherence &policy, const std::string &name);
+
+/**
+ * Stop tracking the statistics of an array, keeping their last values
+ */
+void stats_unregister(const default_coherence &policy);
+}
+
+/**
+ * Queue the transfer to the host of the stale parts of an array. Parts are
+ * transferred one at a time by a background thread, which serves the queued
+ * arrays in turns
+ * @param policy Coherence policy of the array
+ */
+void writeback_start(default_coherence &policy);
+
+/**
+ * Remove an array from the background transfers, waiting for the transfer of
+ * the part in flight
+ * @param policy Coherence policy of the array
+ */
+void writeback_cancel(default_coherence &policy);
+
+/**
+ * Stop the thread of the background transfers. Called at library finalization
+ */
+void writeback_stop();
+
+/**
+ * MSI protocol between the host copy and the device copies of the parts of an
+ * array. Parts are only transferred to the host on CPU faults, and to the
+ * devices used by a kernel when their copies are stale. The copies of the
+ * devices are tracked one by one if the array can update them separately.
+ * Kernels that only read the array keep the host copy up to date, and kernels
+ * that overwrite it do not need the copies of the devices to be updated
+ */
 class default_coherence :
     public coherence_policy {
 public:
-    enum location : unsigned {
-        GPU    = 0b01,
-        CPU    = 0b10,
-        SHARED = 0b11
-    };
-
     enum class ownership {
         GPU,
         CPU
@@ -52,8 +190,28 @@ public:
 
     default_coherence() :
         obj_(nullptr),
-        location_(location::CPU),
-        owner_(ownership::CPU)
+        owner_(ownership::CPU),
+        pageBytes_(0),
+        chunkBytes_(0),
+        devices_(0),
+        perDevice_(true),
+        writebackNext_(0),
+        stats_()
+    {
+    }
+
+    default_coherence(const default_coherence &other) :
+        obj_(other.obj_),
+        owner_(other.owner_),
+        pageBytes_(other.pageBytes_),
+        chunkBytes_(other.chunkBytes_),
+        chunks_(other.chunks_),
+        devices_(other.devices_),
+        perDevice_(other.perDevice_),
+        dirty_(other.dirty_),
+        writebackNext_(0),
+        log_(other.log_),
+        stats_(other.get_stats())
     {
     }
 
@@ -67,16 +225,45 @@ public:
         if (!obj_) {
             obj_ = &obj;
 
+            // Parts and dirty pages are tracked in pages of the host copy
+            pageBytes_ = obj_->host_page_size();
+
             register_range(obj_->host_addr(),
-                           obj_->size());
+                           obj_->size(), pageBytes_);
+
+            if (COHERENCE_STATS) {
+                char name[64];
+                snprintf(name, sizeof(name), "%p (%zu bytes)", obj_->host_addr(), obj_->size());
+                detail::stats_register(*this, name);
+            }
+
+            if (obj_->size() == 0) return;
+
+            size_t page = pageBytes_;
+            size_t bytes = size_t(obj_->host_addr()) % page + obj_->size();
+
+            chunkBytes_ = utils::div_ceil(COHERENCE_FAULT_GRANULARITY.value(), page) * page;
+            if (chunkBytes_ == 0 || chunkBytes_ > bytes)
+                chunkBytes_ = utils::div_ceil(bytes, page) * page;
+
+            // The host holds the only copy of the array
+            chunks_.assign(utils::div_ceil(bytes, chunkBytes_), chunk_info{copy_state::modified, 0, 0, true});
+
+            if (COHERENCE_DIRTY_TRACKING)
+                dirty_.assign(utils::div_ceil(utils::div_ceil(bytes, page), DIRTY_WORD_BITS), 0);
         }
     }
 
     void unbind()
     {
         if (obj_) {
+            writeback_cancel(*this);
+            if (COHERENCE_STATS)
+                detail::stats_unregister(*this);
             unregister_range(obj_->host_addr());
             obj_ = nullptr;
+            chunks_.clear();
+            dirty_.clear();
         }
     }
 
@@ -85,9 +272,11 @@ public:
         return obj_ != nullptr;
     }
 
-    void release(const std::vector<unsigned> &gpus, bool Const)
+    void release(const std::vector<unsigned> &gpus, access_intent intent)
     {
-        DEBUG("%s Release", *obj_);
+        DEBUG("%s Release (%s)", *obj_, to_string(intent));
+
+        writeback_cancel(*this);
 
         if (owner_ != ownership::GPU) {
             DEBUG("%s ownership -> GPU", *obj_);
@@ -99,58 +288,70 @@ public:
             ASSERT(ok, "Error while distributing array");
         }
 
-        mem_access_type prot;
-        if (location_ == location::CPU) {
-            DEBUG("%s obj TO DEVICE", *obj_);
-            obj_->to_device();
-
-            if (!Const) {
-                location_ = location::GPU;
-                DEBUG("%s transition: CPU -> GPU", *obj_);
-            } else {
-                location_ = location::SHARED;
-                DEBUG("%s transition: CPU -> SHARED", *obj_);
-            }
-        } else if (location_ == location::GPU) {
-            DEBUG("%s transition: GPU -> GPU", *obj_);
-        } else { // location_ == SHARED
-            if (!Const) {
-                location_ = location::GPU;
-                DEBUG("%s transition: SHARED -> GPU", *obj_);
-            } else {
-                DEBUG("%s transition: SHARED -> SHARED", *obj_);
-            }
+        uint64_t launch = 0;
+        for (unsigned gpu : gpus) {
+            ASSERT(gpu < MAX_DEVICES, "Too many devices for the coherence of %s", *obj_);
+            launch |= uint64_t(1) << gpu;
         }
+        devices_ |= launch;
 
-        if (Const) {
-            prot = mem_access_type::MEM_READ;
-        } else {
-            prot = mem_access_type::MEM_NONE;
+        if (perDevice_)
+            perDevice_ = obj_->to_device(unsigned(__builtin_ctzll(devices_)), 0, 0);
+
+        // The copies of replicated arrays are merged element by element
+        // against the host copy when they are transferred to the host, so
+        // all of them must hold the current contents
+        if (intent == access_intent::write_discard && perDevice_ && __builtin_popcountll(devices_) > 1) {
+            DEBUG("%s write_discard -> read_write: device copies merged", *obj_);
+            intent = access_intent::read_write;
         }
 
-        // Protect memory so that it is not accessible during GPU execution
-        protect_range(obj_->host_addr(),
-                      obj_->size(), prot,
-                      [this](bool write) -> bool
-                      {
-                          protect_range(this->obj_->host_addr(),
-                                        this->obj_->size(), mem_access_type::MEM_READ_WRITE);
+        handler_fn handler = [this](bool write, void *addr) -> bool
+        {
+            auto start = clock_type::now();
+            std::unique_lock<std::mutex> lock(faultMutex_);
+
+            size_t idx = this->chunk_of(addr);
+            if (chunks_[idx].host == copy_state::invalid)
+                this->to_host_chunk(idx);
+            if (write)
+                this->mark_dirty(idx, addr);
+
+            this->count(write? &coherence_stats::writeFaults: &coherence_stats::readFaults, 1);
+            this->count(&coherence_stats::stallNs, elapsed_ns(start));
+            return true;
+        };
+
+        if (intent == access_intent::read) {
+            update_devices(launch);
+            protect_chunks(handler);
+            return;
+        }
 
-                          if (location::GPU) {
-                              this->obj_->to_host();
-                              DEBUG("%s obj TO HOST", *this->obj_);
+        // Kernels that write need all the copies of the devices up to date.
+        // Kernels that overwrite the array need none of them: the writes of
+        // the host are discarded
+        if (intent == access_intent::write_discard)
+            discard_host();
+        else
+            update_devices(devices_);
 
-                              if (write) {
-                                location_ = location::CPU;
-                                DEBUG("%s transition: GPU -> CPU", *this->obj_);
-                              } else {
-                                location_ = location::SHARED;
-                                DEBUG("%s transition: GPU -> SHARED", *this->obj_);
-                              }
-                          }
+        // The host copy is stale once the kernel writes the array
+        for (size_t idx = 0; idx < chunks_.size(); ++idx) {
+            size_t begin, end;
+            chunk_bounds(idx, begin, end);
 
-                          return true;
-                      });
+            chunk_info &chunk = chunks_[idx];
+            uint64_t valid = chunk.host == copy_state::modified? 0: chunk.devices;
+            record(coherence_transition::HOST, begin, end - begin, chunk.host, copy_state::invalid, 0, 0);
+            record_devices(devices_ & valid, begin, end - begin, copy_state::shared, copy_state::modified, 0, 0);
+            chunk.host    = copy_state::invalid;
+            chunk.devices = devices_;
+        }
+
+        // Protect memory so that it is not accessible during GPU execution
+        protect_range(obj_->host_addr(),
+                      obj_->size(), mem_access_type::MEM_NONE, handler);
     }
 
     void acquire()
@@ -161,12 +362,544 @@ public:
 
         DEBUG("%s ownership -> CPU", *obj_);
         owner_ = ownership::CPU;
+
+        if (COHERENCE_EAGER_WRITEBACK &&
+            std::any_of(chunks_.begin(), chunks_.end(),
+                        [](const chunk_info &chunk) { return chunk.host == copy_state::invalid; })) {
+            writebackNext_ = 0;
+            writeback_start(*this);
+        }
+    }
+
+    void update_host()
+    {
+        if (!obj_) return;
+
+        std::unique_lock<std::mutex> lock(faultMutex_);
+        for (size_t idx = 0; idx < chunks_.size(); ++idx) {
+            if (chunks_[idx].host == copy_state::invalid)
+                to_host_chunk(idx);
+        }
+    }
+
+    /**
+     * Transfer to the host the next stale part of the array. The part is
+     * transferred to the staging copy and its pages are then moved to the
+     * host copy, so that CPU accesses never see it partially transferred.
+     * Faults wait for the part in flight. Used by the background transfers
+     * @return false if no part is left, or the rest of the array is
+     *         transferred on CPU faults
+     */
+    bool writeback_chunk()
+    {
+        std::unique_lock<std::mutex> lock(faultMutex_);
+
+        while (writebackNext_ < chunks_.size() && chunks_[writebackNext_].host != copy_state::invalid)
+            ++writebackNext_;
+        if (writebackNext_ == chunks_.size()) return false;
+
+        size_t idx = writebackNext_++;
+
+        size_t begin, end;
+        chunk_bounds(idx, begin, end);
+
+        auto start = clock_type::now();
+        if (!obj_->to_staging(begin, end - begin)) return false;
+
+        size_t page = pageBytes_;
+        char *host    = static_cast<char *>(obj_->host_addr());
+        char *staging = static_cast<char *>(obj_->staging_addr());
+        size_t skew = size_t(host) % page;
+        size_t first = begin + skew - (begin + skew) % page;
+        size_t last  = utils::div_ceil(end + skew, page) * page;
+
+        if (!move_range(host - skew + first, staging - skew + first, last - first, mem_access_type::MEM_READ)) {
+            DEBUG("%s chunk %zd cannot be moved", *obj_, idx);
+            return false;
+        }
+        DEBUG("%s chunk %zd TO HOST (background)", *obj_, idx);
+        count_transfer(true, end - begin, start);
+
+        record(coherence_transition::HOST, begin, end - begin, copy_state::invalid, copy_state::shared,
+               end - begin, 0);
+        chunks_[idx].host = copy_state::shared;
+
+        return writebackNext_ < chunks_.size();
+    }
+
+    /**
+     * Transitions of the copies of the array, oldest first. Only the last
+     * CUDARRAYS_COHERENCE_LOG transitions are kept
+     */
+    const std::deque<coherence_transition> &get_transitions() const
+    {
+        return log_;
+    }
+
+    /**
+     * Coherence statistics of the array
+     */
+    coherence_stats get_stats() const
+    {
+        return detail::stats_snapshot(stats_);
     }
 
 private:
+    // Devices tracked in the masks of the parts of the array
+    static constexpr unsigned MAX_DEVICES = 64;
+    static constexpr size_t DIRTY_WORD_BITS = 64;
+    // Pages that can be dirty before the writes of the host stop being
+    // tracked, as a fraction of the pages of a part of the array
+    static constexpr size_t DIRTY_TRACKING_FRACTION = 4;
+    // Clean pages between dirty runs that are transferred anyway, so that
+    // the runs are coalesced into larger copies
+    static constexpr size_t DIRTY_RUN_GAP = 8;
+
+    // State of a part of the array
+    struct chunk_info {
+        copy_state host;
+        // Devices with an up-to-date copy. While the host copy is modified:
+        // devices whose copy only lacks the dirty pages
+        uint64_t devices;
+        size_t dirtyPages;
+        // All the part is transferred to the devices
+        bool allDirty;
+    };
+
+    // Transfer to the devices being accumulated, so that contiguous parts
+    // that go to the same devices are transferred with a single copy
+    struct pending_copy {
+        uint64_t devices;
+        size_t begin;
+        size_t end;
+    };
+
+    using clock_type = std::chrono::steady_clock;
+
+    static uint64_t elapsed_ns(clock_type::time_point start)
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count());
+    }
+
+    /**
+     * Add a value to a counter of the statistics of the array and of all the
+     * arrays
+     */
+    void count(uint64_t coherence_stats::*counter, uint64_t value)
+    {
+        detail::stats_add(stats_.*counter, value);
+        detail::stats_add(detail::GlobalCoherenceStats.*counter, value);
+    }
+
+    /**
+     * Account a transfer that started at the given time
+     * @param toHost Direction of the transfer
+     * @param bytes Bytes of the host copy transferred
+     */
+    void count_transfer(bool toHost, size_t bytes, clock_type::time_point start)
+    {
+        uint64_t ns = elapsed_ns(start);
+        if (toHost) {
+            count(&coherence_stats::toHost, 1);
+            count(&coherence_stats::toHostBytes, bytes);
+            count(&coherence_stats::toHostNs, ns);
+        } else {
+            count(&coherence_stats::toDevice, 1);
+            count(&coherence_stats::toDeviceBytes, bytes);
+            count(&coherence_stats::toDeviceNs, ns);
+        }
+    }
+
+    /**
+     * Bounds of a part of the array, as offsets from its host address
+     */
+    void chunk_bounds(size_t idx, size_t &begin, size_t &end) const
+    {
+        size_t skew = size_t(obj_->host_addr()) % pageBytes_;
+
+        begin = std::max(idx * chunkBytes_, skew) - skew;
+        end   = std::min((idx + 1) * chunkBytes_ - skew, obj_->size());
+    }
+
+    size_t chunk_of(void *addr) const
+    {
+        char *begin = static_cast<char *>(obj_->host_addr());
+        char *first = begin - size_t(begin) % pageBytes_;
+
+        return size_t(static_cast<char *>(addr) - first) / chunkBytes_;
+    }
+
+    void record(int agent, size_t offset, size_t bytes, copy_state from, copy_state to,
+                size_t copied, size_t avoided)
+    {
+        if (from != to) {
+            detail::stats_add(stats_.transitions[int(from)][int(to)], 1);
+            detail::stats_add(detail::GlobalCoherenceStats.transitions[int(from)][int(to)], 1);
+        }
+
+        if (COHERENCE_LOG.value() == 0) return;
+
+        // Extend the last transition of the agent if it is contiguous
+        size_t scanned = 0;
+        for (auto it = log_.rbegin(); it != log_.rend() && scanned <= MAX_DEVICES; ++it, ++scanned) {
+            if (it->agent != agent) continue;
+            if (it->from == from && it->to == to && it->offset + it->bytes == offset) {
+                it->bytes   += bytes;
+                it->copied  += copied;
+                it->avoided += avoided;
+                return;
+            }
+            break;
+        }
+
+        if (log_.size() == COHERENCE_LOG.value())
+            log_.pop_front();
+        log_.push_back(coherence_transition{agent, offset, bytes, from, to, copied, avoided});
+        DEBUG("%s %s", *obj_, to_string(log_.back()));
+    }
+
+    void record_devices(uint64_t devices, size_t offset, size_t bytes, copy_state from, copy_state to,
+                        size_t copied, size_t avoided)
+    {
+        if (!perDevice_) {
+            if (devices != 0)
+                record(coherence_transition::DEVICES, offset, bytes, from, to, copied, avoided);
+            return;
+        }
+        for (unsigned gpu = 0; devices != 0; ++gpu, devices >>= 1) {
+            if (devices & 1)
+                record(int(gpu), offset, bytes, from, to, copied, avoided);
+        }
+    }
+
+    /**
+     * Transfer a part of the array to some devices
+     * @return The devices whose copies have been updated, or 0 if the whole
+     *         array has been transferred to all of them
+     */
+    uint64_t upload(uint64_t devices, size_t offset, size_t bytes)
+    {
+        if (perDevice_) {
+            for (unsigned gpu = 0; gpu < MAX_DEVICES && perDevice_; ++gpu) {
+                if (devices & (uint64_t(1) << gpu)) {
+                    auto start = clock_type::now();
+                    perDevice_ = obj_->to_device(gpu, offset, bytes);
+                    if (perDevice_) count_transfer(false, bytes, start);
+                }
+            }
+            if (perDevice_) return devices;
+            DEBUG("%s device copies updated together", *obj_);
+        }
+
+        auto start = clock_type::now();
+        if (obj_->to_device(offset, bytes)) {
+            count_transfer(false, bytes, start);
+            return devices_;
+        }
+
+        // Arrays that cannot transfer parts of the array cannot transfer
+        // parts to the host either: none of the parts of the host copy is stale
+        ASSERT(std::none_of(chunks_.begin(), chunks_.end(),
+                            [](const chunk_info &chunk) { return chunk.host == copy_state::invalid; }));
+        start = clock_type::now();
+        obj_->to_device();
+        count_transfer(false, obj_->size(), start);
+        return 0;
+    }
+
+    /**
+     * Transfer the accumulated copy if the given part cannot be merged with it
+     * @return false if the whole array has been transferred
+     */
+    bool flush(pending_copy &pending, uint64_t devices, size_t begin, size_t end)
+    {
+        if (pending.devices == devices && pending.end == begin) {
+            pending.end = end;
+            return true;
+        }
+
+        bool ok = true;
+        if (pending.devices != 0) {
+            DEBUG("%s %zd-%zd TO DEVICE", *obj_, pending.begin, pending.end);
+            ok = upload(pending.devices, pending.begin, pending.end - pending.begin) != 0;
+        }
+        pending = pending_copy{devices, begin, end};
+        return ok;
+    }
+
+    /**
+     * Update the stale copies of the devices with the host copy. Parts of
+     * the host copy that are stale are transferred from the devices first.
+     * Only the dirty pages of the parts written by the host are transferred
+     * to the devices whose copy lacks nothing else
+     * @param needed Devices that need an up-to-date copy
+     */
+    void update_devices(uint64_t needed)
+    {
+        size_t page = pageBytes_;
+        size_t skew = size_t(obj_->host_addr()) % page;
+
+        pending_copy pending{0, 0, 0};
+        bool whole = false;
+
+        for (size_t idx = 0; idx < chunks_.size() && !whole; ++idx) {
+            size_t begin, end;
+            chunk_bounds(idx, begin, end);
+            size_t bytes = end - begin;
+
+            chunk_info &chunk = chunks_[idx];
+            uint64_t valid = chunk.host == copy_state::modified? 0: chunk.devices;
+            uint64_t stale = needed & ~valid;
+
+            record_devices(needed & valid, begin, bytes, copy_state::shared, copy_state::shared, 0, bytes);
+            if (stale == 0) continue;
+
+            if (chunk.host == copy_state::invalid)
+                to_host_chunk(idx);
+
+            bool modified = chunk.host == copy_state::modified;
+            // Devices whose copy only lacks the dirty pages
+            uint64_t partial = (modified && !chunk.allDirty && !dirty_.empty())? stale & chunk.devices: 0;
+            if (!perDevice_ && partial != stale) partial = 0;
+
+            size_t copied = 0;
+            if (partial != 0) {
+                size_t firstPage = (begin + skew) / page;
+                size_t lastPage  = utils::div_ceil(end + skew, page);
+                size_t p = firstPage;
+                while (!whole && (p = next_dirty(p, lastPage)) < lastPage) {
+                    // Extend the run while the next dirty page is close enough
+                    size_t last = p;
+                    size_t next;
+                    while ((next = next_dirty(last + 1, lastPage)) < lastPage &&
+                           next - last <= DIRTY_RUN_GAP)
+                        last = next;
+
+                    size_t runBegin = std::max(begin, p * page - std::min(p * page, skew));
+                    size_t runEnd   = std::min(end, (last + 1) * page - skew);
+                    whole = !flush(pending, partial, runBegin, runEnd);
+                    copied += runEnd - runBegin;
+
+                    p = last + 1;
+                }
+            }
+            if (!whole && (stale & ~partial) != 0)
+                whole = !flush(pending, stale & ~partial, begin, end);
+
+            record_devices(partial, begin, bytes, copy_state::invalid, copy_state::shared, copied, bytes - copied);
+            record_devices(stale & ~partial, begin, bytes, copy_state::invalid, copy_state::shared, bytes, 0);
+            if (modified)
+                record(coherence_transition::HOST, begin, bytes, copy_state::modified, copy_state::shared, 0, 0);
+
+            chunk.host       = copy_state::shared;
+            chunk.devices    = (modified? 0: chunk.devices) | (perDevice_? stale: devices_);
+            chunk.dirtyPages = 0;
+            chunk.allDirty   = false;
+        }
+
+        if (!whole && pending.devices != 0)
+            whole = upload(pending.devices, pending.begin, pending.end - pending.begin) == 0;
+
+        if (whole) {
+            DEBUG("%s obj TO DEVICE", *obj_);
+            for (auto &chunk : chunks_) {
+                chunk.host       = copy_state::shared;
+                chunk.devices    = devices_;
+                chunk.dirtyPages = 0;
+                chunk.allDirty   = false;
+            }
+        }
+
+        std::fill(dirty_.begin(), dirty_.end(), 0);
+    }
+
+    /**
+     * Skip the update of the stale copies of the devices, since the next
+     * kernel overwrites the array. The writes of the host are discarded
+     */
+    void discard_host()
+    {
+        for (size_t idx = 0; idx < chunks_.size(); ++idx) {
+            size_t begin, end;
+            chunk_bounds(idx, begin, end);
+
+            chunk_info &chunk = chunks_[idx];
+            uint64_t valid = chunk.host == copy_state::modified? 0: chunk.devices;
+            record_devices(devices_ & ~valid, begin, end - begin, copy_state::invalid, copy_state::modified,
+                           0, end - begin);
+
+            chunk.dirtyPages = 0;
+            chunk.allDirty   = false;
+        }
+
+        std::fill(dirty_.begin(), dirty_.end(), 0);
+    }
+
+    /**
+     * @return The first dirty page starting at a page, or pages if there is none
+     */
+    size_t next_dirty(size_t idx, size_t pages) const
+    {
+        while (idx < pages) {
+            uint64_t word = dirty_[idx / DIRTY_WORD_BITS] >> (idx % DIRTY_WORD_BITS);
+            if (word != 0)
+                return std::min(pages, idx + size_t(__builtin_ctzll(word)));
+            idx = (idx / DIRTY_WORD_BITS + 1) * DIRTY_WORD_BITS;
+        }
+        return pages;
+    }
+
+    /**
+     * Protect the parts of the array according to the state of their host
+     * copy: stale parts are not accessible and up-to-date parts are read-only,
+     * so that the writes of the host are detected
+     */
+    void protect_chunks(const handler_fn &handler)
+    {
+        char *base = static_cast<char *>(obj_->host_addr());
+
+        size_t idx = 0;
+        while (idx < chunks_.size()) {
+            bool stale = chunks_[idx].host == copy_state::invalid;
+            size_t last = idx + 1;
+            while (last < chunks_.size() && (chunks_[last].host == copy_state::invalid) == stale)
+                ++last;
+
+            size_t begin, end, tmp;
+            chunk_bounds(idx, begin, tmp);
+            chunk_bounds(last - 1, tmp, end);
+            protect_range(base + begin, end - begin,
+                          stale? mem_access_type::MEM_NONE: mem_access_type::MEM_READ, handler);
+
+            idx = last;
+        }
+    }
+
+    /**
+     * Record that the page that contains an address has been written by the
+     * host, and make it writable. Parts whose pages are not tracked are made
+     * writable as a whole
+     * @param idx Part of the array that contains the address
+     * @param addr Faulting address
+     */
+    void mark_dirty(size_t idx, void *addr)
+    {
+        size_t page = pageBytes_;
+
+        char *base = static_cast<char *>(obj_->host_addr());
+        char *first = base - size_t(base) % page;
+
+        size_t begin, end;
+        chunk_bounds(idx, begin, end);
+
+        chunk_info &chunk = chunks_[idx];
+        if (chunk.host != copy_state::modified) {
+            // The host copy is up to date: nothing is transferred
+            record(coherence_transition::HOST, begin, end - begin, chunk.host, copy_state::modified, 0, end - begin);
+            record_devices(chunk.devices, begin, end - begin, copy_state::shared, copy_state::invalid, 0, 0);
+            chunk.host = copy_state::modified;
+        }
+
+        size_t pages = utils::div_ceil(size_t(base + end - first), page) - size_t(base + begin - first) / page;
+        if (dirty_.empty() || chunk.allDirty ||
+            (chunk.dirtyPages + 1) * DIRTY_TRACKING_FRACTION > pages) {
+            // Most of the part is being written: stop the faults and
+            // transfer the whole part
+            DEBUG("%s chunk %zd all pages dirty", *obj_, idx);
+            chunk.allDirty = true;
+            protect_range(base + begin, end - begin, mem_access_type::MEM_READ_WRITE);
+            return;
+        }
+
+        size_t pageIdx = size_t(static_cast<char *>(addr) - first) / page;
+        uint64_t bit = uint64_t(1) << (pageIdx % DIRTY_WORD_BITS);
+        if (!(dirty_[pageIdx / DIRTY_WORD_BITS] & bit)) {
+            dirty_[pageIdx / DIRTY_WORD_BITS] |= bit;
+            ++chunk.dirtyPages;
+        }
+
+        char *pageBegin = std::max(base,       first + pageIdx * page);
+        char *pageEnd   = std::min(base + end, first + (pageIdx + 1) * page);
+        protect_range(pageBegin, pageEnd - pageBegin, mem_access_type::MEM_READ_WRITE);
+    }
+
+    /**
+     * Transfer to the host the whole array and make it readable. Used by
+     * arrays that cannot transfer parts of the array
+     */
+    void to_host_all()
+    {
+        ASSERT(std::none_of(chunks_.begin(), chunks_.end(),
+                            [](const chunk_info &chunk) { return chunk.host == copy_state::modified; }));
+
+        protect_range(obj_->host_addr(), obj_->size(), mem_access_type::MEM_READ_WRITE);
+        auto start = clock_type::now();
+        obj_->to_host();
+        count_transfer(true, obj_->size(), start);
+        DEBUG("%s obj TO HOST", *obj_);
+        protect_range(obj_->host_addr(), obj_->size(), mem_access_type::MEM_READ);
+
+        for (size_t idx = 0; idx < chunks_.size(); ++idx) {
+            size_t begin, end;
+            chunk_bounds(idx, begin, end);
+
+            chunk_info &chunk = chunks_[idx];
+            if (chunk.host == copy_state::invalid) {
+                record(coherence_transition::HOST, begin, end - begin, chunk.host, copy_state::shared,
+                       end - begin, 0);
+                chunk.host = copy_state::shared;
+            }
+        }
+    }
+
+    /**
+     * Transfer to the host a part of the array and make it readable
+     * @param idx Part of the array
+     */
+    void to_host_chunk(size_t idx)
+    {
+        char *base = static_cast<char *>(obj_->host_addr());
+
+        size_t begin, end;
+        chunk_bounds(idx, begin, end);
+
+        protect_range(base + begin, end - begin, mem_access_type::MEM_READ_WRITE);
+        auto start = clock_type::now();
+        if (!obj_->to_host(begin, end - begin)) {
+            to_host_all();
+            return;
+        }
+        count_transfer(true, end - begin, start);
+        DEBUG("%s chunk %zd TO HOST", *obj_, idx);
+        protect_range(base + begin, end - begin, mem_access_type::MEM_READ);
+
+        record(coherence_transition::HOST, begin, end - begin, copy_state::invalid, copy_state::shared,
+               end - begin, 0);
+        chunks_[idx].host = copy_state::shared;
+    }
+
     coherent *obj_;
-    location location_;
     ownership owner_;
+
+    // Pages of the host copy, in which it is protected
+    size_t pageBytes_;
+    // Parts of the array
+    size_t chunkBytes_;
+    std::vector<chunk_info> chunks_;
+    // Devices used by the kernels that accessed the array
+    uint64_t devices_;
+    // The copies of the devices can be updated separately
+    bool perDevice_;
+
+    // Pages written by the host since the devices were last updated
+    std::vector<uint64_t> dirty_;
+    // Next part transferred in the background
+    size_t writebackNext_;
+
+    std::deque<coherence_transition> log_;
+    coherence_stats stats_;
+
+    std::mutex faultMutex_;
 };
 
 }
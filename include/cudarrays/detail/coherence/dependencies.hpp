@@ -0,0 +1,85 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_COHERENCE_DEPENDENCIES_HPP_
+#define CUDARRAYS_DETAIL_COHERENCE_DEPENDENCIES_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <cuda_runtime_api.h>
+
+namespace cudarrays {
+
+// Event recorded after the kernels of a launch. Events are recycled once no
+// array or launcher refers to them
+struct launch_event {
+    cudaEvent_t event;
+};
+
+using launch_event_ptr = std::shared_ptr<const launch_event>;
+
+/**
+ * Obtain an event from the pool of the library
+ * @return A new reference to an unused event
+ */
+launch_event_ptr make_launch_event();
+
+/**
+ * Events of the launches that accessed an array. Launches wait only for the
+ * previous launches whose accesses conflict with theirs:
+ *  - Read-after-write and write-after-write: the last launch that wrote it
+ *  - Write-after-read: the launches that read it after the last write
+ */
+class access_dependencies {
+public:
+    /**
+     * Make a stream wait for the previous conflicting accesses to the array
+     * @param stream Stream in which the new launch is enqueued
+     * @param Const The new launch only reads the array
+     */
+    void wait(cudaStream_t stream, bool Const) const;
+
+    /**
+     * Register the access of a launch to the array
+     * @param events Events recorded after the kernels of the launch
+     * @param Const The launch only reads the array
+     */
+    void record(const std::vector<launch_event_ptr> &events, bool Const);
+
+private:
+    std::vector<launch_event_ptr> writers_;
+    std::vector<launch_event_ptr> readers_;
+};
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,83 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_BLOCK_HPP_
+#define CUDARRAYS_DETAIL_CPU_BLOCK_HPP_
+
+#include <cstddef>
+
+#include <cuda_runtime_api.h>
+
+#include "../utils/option.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+// Size of the stack of the fibers that execute the emulated CUDA threads
+extern utils::option<size_t> FIBER_STACK;
+// Size of the shared memory arena of each worker
+extern utils::option<size_t> SHARED_MEMORY;
+
+// Function that executes one emulated CUDA thread
+using thread_fn = void (*)(void *);
+
+/**
+ * Execute all the threads of the block of the calling worker. Each thread
+ * runs as a fiber that yields to the next one when it reaches a barrier, so
+ * that all the threads of the block reach the barrier before any of them
+ * proceeds. threadIdx is updated before resuming every fiber. In lane mode
+ * every invocation of fn executes several consecutive threads in X
+ * @param block Dimensions of the block
+ * @param sharedBytes Dynamic shared memory requested for the block
+ * @param lanes Threads in X executed by each invocation of fn
+ * @param fn Function that executes one thread (or group of lanes) of the kernel
+ * @param arg Argument passed to fn
+ */
+void run_block(dim3 block, size_t sharedBytes, unsigned lanes, thread_fn fn, void *arg);
+
+/**
+ * Allocate shared memory for a statically sized shared array. All the
+ * threads of a block get the same storage, which is reused by the next block
+ * executed by the worker
+ * @param bytes Size of the array
+ * @param align Required alignment
+ * @param cache Pointer returned to the last block that requested this array
+ * @param block Id of the last block that requested this array
+ * @return Pointer to the storage of the array within the shared memory arena
+ */
+void *shared_alloc(size_t bytes, size_t align, void *&cache, unsigned long &block);
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,94 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_BLOCK_ORDER_HPP_
+#define CUDARRAYS_DETAIL_CPU_BLOCK_ORDER_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime_api.h>
+
+#include "../utils/option.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+// Order in which the blocks of a grid are handed out to the CPU workers
+enum class block_order {
+    raster  = 0, // x, then y, then z
+    tiled   = 1, // Square tiles of blocks in XY, tiles in raster order
+    morton  = 2, // Z-order curve in XY
+    hilbert = 3  // Hilbert curve in XY
+};
+
+// Default block order ("raster", "tiled", "morton" or "hilbert")
+extern utils::option<std::string> BLOCK_ORDER;
+// Side of the tiles used by block_order::tiled
+extern utils::option<unsigned> BLOCK_TILE;
+// Maximum number of block sequences cached. The cache is flushed when full
+extern utils::option<unsigned> BLOCK_ORDER_CACHE_SIZE;
+
+/**
+ * Parse the name of a block order
+ * @param name Name of the order
+ * @param order Parsed order
+ * @return true if the name is valid
+ */
+bool parse_block_order(const std::string &name, block_order &order);
+
+const char *to_string(block_order order);
+
+/**
+ * Obtain the block order configured through CUDARRAYS_CPU_BLOCK_ORDER
+ * @return The default block order
+ */
+block_order get_default_block_order();
+
+/**
+ * Obtain the sequence of linear block ids in which the blocks of a grid are
+ * executed. Curves are applied on XY slices, which are visited in Z order.
+ * Sequences are cached, so that subsequent launches of the same grid do not
+ * have to compute them again. Launches hold references to their sequences, so
+ * the cache can be flushed at any time
+ * @param order Block order
+ * @param grid Dimensions of the grid
+ * @return The sequence of block ids or nullptr for block_order::raster
+ */
+std::shared_ptr<const std::vector<size_t>> get_block_sequence(block_order order, dim3 grid);
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,93 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_FIBER_HPP_
+#define CUDARRAYS_DETAIL_CPU_FIBER_HPP_
+
+#include <cstddef>
+
+namespace cudarrays {
+
+namespace cpu {
+
+/**
+ * User-level execution context with its own stack. Switching between fibers
+ * only saves and restores the callee-saved registers, so it is orders of
+ * magnitude cheaper than switching between OS threads
+ */
+class fiber {
+public:
+    using entry_fn = void (*)(void *);
+
+    /**
+     * Fiber that represents the context of the calling OS thread. It has
+     * no stack of its own and can only be used to switch back to the thread
+     */
+    fiber();
+
+    /**
+     * Create a fiber that executes fn(arg) the first time it is switched to.
+     * fn must never return
+     * @param fn Entry point of the fiber
+     * @param arg Argument passed to the entry point
+     * @param stackSize Size of the stack of the fiber in bytes
+     */
+    fiber(entry_fn fn, void *arg, size_t stackSize);
+
+    ~fiber();
+
+    fiber(const fiber &) = delete;
+    fiber &operator=(const fiber &) = delete;
+
+    /**
+     * Save the current context into this fiber and resume next
+     * @param next Fiber to be resumed
+     */
+    void switch_to(fiber &next);
+
+private:
+    // Saved stack pointer (or ucontext_t on unsupported architectures)
+    void *ctx_;
+
+    void *stack_;
+    size_t stackSize_;
+
+    entry_fn fn_;
+    void *arg_;
+
+    static void start(fiber *f);
+};
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
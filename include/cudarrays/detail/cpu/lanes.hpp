@@ -0,0 +1,534 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_LANES_HPP_
+#define CUDARRAYS_DETAIL_CPU_LANES_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "../../common.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+//
+// Kernels can be instantiated with a lane-vector index type (cpu::lanes) to
+// be executed by launch_cpu_lanes. Every invocation then executes W
+// consecutive values of threadIdx.x as SIMD lanes. Array accesses with lane
+// indices return lane references that load and store all the active lanes
+// at once, and comparisons between lane values return lane masks that
+// deactivate lanes when used as if conditions. The traits below are also
+// visible to device code, where they always describe scalar indices
+//
+
+// Number of lanes of an index type (0: scalar)
+template <typename T>
+struct lane_count :
+    std::integral_constant<unsigned, 0> {
+};
+
+// Number of lanes of an access with the given indices
+template <typename... Idxs>
+struct lane_width;
+
+template <>
+struct lane_width<> :
+    std::integral_constant<unsigned, 0> {
+};
+
+template <typename Idx, typename... Idxs>
+struct lane_width<Idx, Idxs...> :
+    std::integral_constant<unsigned, (lane_count<typename std::decay<Idx>::type>::value > lane_width<Idxs...>::value)?
+                                         lane_count<typename std::decay<Idx>::type>::value:
+                                         lane_width<Idxs...>::value> {
+};
+
+// Type returned by an array access with W lanes (Ref for scalar accesses)
+template <typename Ref, typename T, unsigned W, bool Lanes = (W > 0)>
+struct lane_access {
+    using type = Ref;
+};
+
+// Type used by kernels to hold values computed from an Index
+template <typename T, typename Index>
+struct lane_value {
+    using type = T;
+};
+
+// Builds thread indices of type Index
+template <typename Index>
+struct lane_index {
+    static inline __host__ __device__
+    Index make(unsigned idx)
+    {
+        return Index(idx);
+    }
+};
+
+#ifndef __CUDACC__
+// Mask of the lanes of the current invocation that correspond to existing
+// threads and have not been disabled by a lane_mask condition. The rest of
+// lanes are masked out in loads and stores
+extern thread_local uint64_t ActiveMask;
+
+// Mask with the first n lanes set
+static inline uint64_t
+lane_bits(unsigned n)
+{
+    return n >= 64? ~uint64_t(0): (uint64_t(1) << n) - 1;
+}
+
+/**
+ * SIMD vector of W values of type T
+ */
+template <typename T, unsigned W>
+class lanes {
+    static_assert(W > 0 && (W & (W - 1)) == 0, "The number of lanes must be a power of two");
+    static_assert(W <= 64, "Lane masks hold up to 64 lanes");
+
+public:
+    using value_type  = T;
+    typedef T vector_type __attribute__((vector_size(sizeof(T) * W)));
+
+    static constexpr unsigned width = W;
+
+    lanes() :
+        v_(vector_type{})
+    {
+    }
+
+    // Broadcast
+    lanes(T val) :
+        v_(vector_type{} + val)
+    {
+    }
+
+    static inline lanes
+    from_vector(const vector_type &v)
+    {
+        lanes ret;
+        ret.v_ = v;
+        return ret;
+    }
+
+    static inline lanes
+    iota(T base)
+    {
+        vector_type v{};
+        for (unsigned w = 0; w < W; ++w)
+            v[w] = T(w);
+        return from_vector(v + base);
+    }
+
+    // Convert the lanes to a different element type
+    template <typename U>
+    inline lanes<U, W>
+    convert() const
+    {
+        return lanes<U, W>::from_vector(__builtin_convertvector(v_, typename lanes<U, W>::vector_type));
+    }
+
+    inline T
+    operator[](unsigned w) const
+    {
+        return v_[w];
+    }
+
+    inline void
+    set(unsigned w, T val)
+    {
+        v_[w] = val;
+    }
+
+    inline const vector_type &
+    vector() const
+    {
+        return v_;
+    }
+
+    inline lanes
+    operator-() const
+    {
+        return from_vector(-v_);
+    }
+
+#define CUDARRAYS_LANES_ASSIGN_OP(op)                      \
+    inline lanes &operator op##=(const lanes &val)         \
+    {                                                      \
+        v_ = v_ op val.v_;                                 \
+        return *this;                                      \
+    }
+
+    CUDARRAYS_LANES_ASSIGN_OP(+)
+    CUDARRAYS_LANES_ASSIGN_OP(-)
+    CUDARRAYS_LANES_ASSIGN_OP(*)
+    CUDARRAYS_LANES_ASSIGN_OP(/)
+
+#undef CUDARRAYS_LANES_ASSIGN_OP
+
+private:
+    vector_type v_;
+};
+
+/**
+ * Result of a comparison between lane values (one bit per lane). As the
+ * condition of an if statement it holds if any active lane satisfies the
+ * comparison, and it masks out the rest of lanes for the remainder of the
+ * invocation. Thus, guards must enclose the code they protect: an early return
+ * or an else branch would apply to all the lanes
+ */
+template <unsigned W>
+class lane_mask {
+public:
+    explicit lane_mask(uint64_t bits) :
+        bits_(bits & lane_bits(W))
+    {
+    }
+
+    // Build the mask from the result of a vector comparison (0 or -1 per lane)
+    template <typename V>
+    static inline lane_mask
+    from_vector(const V &v)
+    {
+        uint64_t bits = 0;
+        for (unsigned w = 0; w < W; ++w)
+            bits |= uint64_t(v[w] != 0) << w;
+        return lane_mask(bits);
+    }
+
+    inline uint64_t
+    bits() const
+    {
+        return bits_;
+    }
+
+    inline bool
+    test(unsigned w) const
+    {
+        return (bits_ >> w) & 1;
+    }
+
+    explicit operator bool() const
+    {
+        ActiveMask &= bits_;
+        return ActiveMask != 0;
+    }
+
+    inline lane_mask
+    operator!() const
+    {
+        return lane_mask(~bits_);
+    }
+
+private:
+    uint64_t bits_;
+};
+
+template <unsigned W>
+static inline lane_mask<W>
+operator&&(const lane_mask<W> &a, const lane_mask<W> &b)
+{
+    return lane_mask<W>(a.bits() & b.bits());
+}
+
+template <unsigned W>
+static inline lane_mask<W>
+operator&&(const lane_mask<W> &a, bool b)
+{
+    return lane_mask<W>(b? a.bits(): 0);
+}
+
+template <unsigned W>
+static inline lane_mask<W>
+operator&&(bool a, const lane_mask<W> &b)
+{
+    return b && a;
+}
+
+template <unsigned W>
+static inline lane_mask<W>
+operator||(const lane_mask<W> &a, const lane_mask<W> &b)
+{
+    return lane_mask<W>(a.bits() | b.bits());
+}
+
+template <unsigned W>
+static inline lane_mask<W>
+operator||(const lane_mask<W> &a, bool b)
+{
+    return lane_mask<W>(b? ~uint64_t(0): a.bits());
+}
+
+template <unsigned W>
+static inline lane_mask<W>
+operator||(bool a, const lane_mask<W> &b)
+{
+    return b || a;
+}
+
+/**
+ * Reference to W elements of an array accessed with lane indices
+ */
+template <typename T, unsigned W>
+class lane_ref {
+public:
+    using value_type = typename std::remove_const<T>::type;
+    using lanes_type = lanes<value_type, W>;
+
+    lane_ref(T *base, const lanes<array_index_t, W> &pos) :
+        base_(base),
+        pos_(pos)
+    {
+    }
+
+    lane_ref(const lane_ref &) = default;
+
+    lanes_type
+    load() const
+    {
+        // Masked out lanes are not read and hold zero
+        lanes_type ret;
+        if (ActiveMask == lane_bits(W) && is_contiguous()) {
+            typename lanes_type::vector_type v;
+            memcpy(&v, base_ + pos_[0], sizeof(v));
+            ret = lanes_type::from_vector(v);
+        } else {
+            for (unsigned w = 0; w < W; ++w) {
+                if ((ActiveMask >> w) & 1)
+                    ret.set(w, base_[pos_[w]]);
+            }
+        }
+        return ret;
+    }
+
+    operator lanes_type() const
+    {
+        return load();
+    }
+
+    lane_ref &
+    operator=(const lanes_type &val)
+    {
+        static_assert(!std::is_const<T>::value, "Store to a read-only array");
+
+        if (ActiveMask == lane_bits(W) && is_contiguous()) {
+            memcpy(base_ + pos_[0], &val.vector(), sizeof(val.vector()));
+        } else {
+            for (unsigned w = 0; w < W; ++w) {
+                if ((ActiveMask >> w) & 1)
+                    base_[pos_[w]] = val[w];
+            }
+        }
+        return *this;
+    }
+
+    lane_ref &
+    operator=(const lane_ref &ref)
+    {
+        return *this = ref.load();
+    }
+
+    template <typename U>
+    lane_ref &
+    operator=(const lane_ref<U, W> &ref)
+    {
+        return *this = ref.load();
+    }
+
+#define CUDARRAYS_LANE_REF_ASSIGN_OP(op)                   \
+    inline lane_ref &operator op##=(const lanes_type &val) \
+    {                                                      \
+        lanes_type tmp = load();                           \
+        tmp op##= val;                                     \
+        return *this = tmp;                                \
+    }
+
+    CUDARRAYS_LANE_REF_ASSIGN_OP(+)
+    CUDARRAYS_LANE_REF_ASSIGN_OP(-)
+    CUDARRAYS_LANE_REF_ASSIGN_OP(*)
+    CUDARRAYS_LANE_REF_ASSIGN_OP(/)
+
+#undef CUDARRAYS_LANE_REF_ASSIGN_OP
+
+private:
+    inline bool
+    is_contiguous() const
+    {
+        auto diff = pos_.vector() - lanes<array_index_t, W>::iota(pos_[0]).vector();
+
+        // Reduce the differences in word-sized chunks
+        uint64_t words[sizeof(diff) / sizeof(uint64_t)];
+        memcpy(words, &diff, sizeof(diff));
+        uint64_t ret = 0;
+        for (auto word : words)
+            ret |= word;
+        return ret == 0;
+    }
+
+    T *base_;
+    lanes<array_index_t, W> pos_;
+};
+
+template <typename T, unsigned W>
+struct lane_count<lanes<T, W>> :
+    std::integral_constant<unsigned, W> {
+};
+
+template <typename T, unsigned W>
+struct lane_count<lane_ref<T, W>> :
+    std::integral_constant<unsigned, W> {
+};
+
+template <typename T, typename U, unsigned W>
+struct lane_access<T &, U, W, true> {
+    using type = lane_ref<T, W>;
+};
+
+template <typename T, typename U, unsigned W>
+struct lane_value<T, lanes<U, W>> {
+    using type = lanes<T, W>;
+};
+
+template <typename T, unsigned W>
+struct lane_index<lanes<T, W>> {
+    static inline
+    lanes<T, W> make(unsigned idx)
+    {
+        return lanes<T, W>::iota(T(idx));
+    }
+};
+
+// Value of the lane w of an index (scalars are the same in all lanes)
+template <typename T>
+static inline T
+lane_get(const T &idx, unsigned)
+{
+    return idx;
+}
+
+template <typename T, unsigned W>
+static inline T
+lane_get(const lanes<T, W> &idx, unsigned w)
+{
+    return idx[w];
+}
+
+// Offset of every lane of an index with respect to its first lane
+template <unsigned W, typename T>
+static inline lanes<array_index_t, W>
+lane_offsets(const T &)
+{
+    return lanes<array_index_t, W>(0);
+}
+
+template <unsigned W, typename T>
+static inline lanes<array_index_t, W>
+lane_offsets(const lanes<T, W> &idx)
+{
+    return (idx - idx[0]).template convert<array_index_t>();
+}
+
+//
+// Arithmetic between lane values, lane references and scalars
+//
+template <typename T>
+struct lane_operand {
+    using lanes_type = void;
+};
+
+template <typename T, unsigned W>
+struct lane_operand<lanes<T, W>> {
+    using lanes_type = lanes<T, W>;
+};
+
+template <typename T, unsigned W>
+struct lane_operand<lane_ref<T, W>> {
+    using lanes_type = typename lane_ref<T, W>::lanes_type;
+};
+
+template <typename A, typename B,
+          typename LA = typename lane_operand<A>::lanes_type,
+          typename LB = typename lane_operand<B>::lanes_type>
+struct lane_binary {
+    using type = LA;
+};
+
+template <typename A, typename B, typename LB>
+struct lane_binary<A, B, void, LB> {
+    using type = LB;
+};
+
+template <typename A, typename B>
+struct lane_binary<A, B, void, void> {
+};
+
+#define CUDARRAYS_LANES_BINARY_OP(op)                                                 \
+template <typename A, typename B>                                                     \
+static inline typename lane_binary<A, B>::type                                        \
+operator op(const A &a, const B &b)                                                   \
+{                                                                                     \
+    using lanes_type = typename lane_binary<A, B>::type;                              \
+    return lanes_type::from_vector(lanes_type(a).vector() op lanes_type(b).vector());  \
+}
+
+CUDARRAYS_LANES_BINARY_OP(+)
+CUDARRAYS_LANES_BINARY_OP(-)
+CUDARRAYS_LANES_BINARY_OP(*)
+CUDARRAYS_LANES_BINARY_OP(/)
+
+#undef CUDARRAYS_LANES_BINARY_OP
+
+#define CUDARRAYS_LANES_COMPARE_OP(op)                                                          \
+template <typename A, typename B, typename L = typename lane_binary<A, B>::type>               \
+static inline lane_mask<L::width>                                                              \
+operator op(const A &a, const B &b)                                                            \
+{                                                                                              \
+    return lane_mask<L::width>::from_vector(L(a).vector() op L(b).vector());                   \
+}
+
+CUDARRAYS_LANES_COMPARE_OP(<)
+CUDARRAYS_LANES_COMPARE_OP(<=)
+CUDARRAYS_LANES_COMPARE_OP(>)
+CUDARRAYS_LANES_COMPARE_OP(>=)
+CUDARRAYS_LANES_COMPARE_OP(==)
+CUDARRAYS_LANES_COMPARE_OP(!=)
+
+#undef CUDARRAYS_LANES_COMPARE_OP
+#endif // __CUDACC__
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
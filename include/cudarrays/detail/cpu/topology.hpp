@@ -0,0 +1,75 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_TOPOLOGY_HPP_
+#define CUDARRAYS_DETAIL_CPU_TOPOLOGY_HPP_
+
+#include <vector>
+
+namespace cudarrays {
+
+namespace cpu {
+
+// Set of cores assigned to a virtual device of the CPU launcher
+struct core_set {
+    // NUMA node of the cores (-1 if unknown)
+    int node;
+    std::vector<unsigned> cpus;
+};
+
+/**
+ * Number of NUMA nodes that contain cores usable by the process
+ * @return The number of nodes (1 if the topology cannot be read)
+ */
+unsigned get_numa_nodes();
+
+/**
+ * Split the cores usable by the process in sets. Cores are ordered by NUMA
+ * node before splitting, so that sets do not straddle nodes whenever the
+ * number of sets is a multiple of the number of nodes. If there are more sets
+ * than cores, cores are shared round-robin
+ * @param sets Number of sets
+ * @return The core sets
+ */
+std::vector<core_set> get_core_sets(unsigned sets);
+
+/**
+ * Group the cores usable by the process by NUMA node
+ * @return One core set per node, in node order. Empty if the topology cannot
+ *         be read
+ */
+std::vector<core_set> get_node_core_sets();
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,197 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_CPU_WORKER_POOL_HPP_
+#define CUDARRAYS_DETAIL_CPU_WORKER_POOL_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../utils/option.hpp"
+
+#include "topology.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+// Number of workers used to execute kernels on the CPU (0: one per core)
+extern utils::option<unsigned> THREADS;
+// Pin the workers of each virtual device to its own core set
+extern utils::option<bool> BIND;
+
+/**
+ * Persistent pool of threads that execute the blocks of the grids launched on
+ * the CPU. Each worker owns a contiguous range of the blocks of the grid and
+ * takes chunks from its front, so that consecutive blocks run on the same
+ * core. Workers that run out of blocks steal the back half of the range of
+ * another worker. A block is always executed from beginning to end by a
+ * single worker. Jobs can be restricted to a group of consecutive workers,
+ * which is used to emulate several devices concurrently
+ */
+class worker_pool {
+public:
+    // Function executed for every block. Receives the worker id and the
+    // linear index of the block within the grid
+    using block_fn = std::function<void (unsigned, size_t)>;
+
+private:
+    struct job;
+
+public:
+    using job_handle = std::shared_ptr<job>;
+
+    // Execution times of a job, in milliseconds
+    struct job_times {
+        // From the submission of the job to the completion of its last block
+        float wall;
+        // First worker of the group that executed the job
+        unsigned first;
+        // Time spent executing blocks by each worker of the group
+        std::vector<float> busy;
+    };
+
+    // Workers assigned to a virtual device
+    struct group {
+        unsigned first;
+        unsigned workers;
+        // NUMA node of the cores of the group (-1 if unknown)
+        int node;
+    };
+
+    /**
+     * Obtain the pool used by the CPU launchers. The pool is created on
+     * first use
+     * @return The process-wide worker pool
+     */
+    static worker_pool &get();
+
+    ~worker_pool();
+
+    /**
+     * Execute fn for all the blocks in [0, blocks) and wait for completion
+     * @param blocks Number of blocks in the grid
+     * @param fn Function executed for every block
+     */
+    void run(size_t blocks, const block_fn &fn);
+
+    /**
+     * Enqueue the execution of fn for all the blocks in [0, blocks) on the
+     * workers [first, first + workers)
+     * @param blocks Number of blocks in the grid
+     * @param fn Function executed for every block
+     * @param first First worker of the group
+     * @param workers Number of workers in the group (0: all the workers)
+     * @return Handle to wait for the completion of the job
+     */
+    job_handle submit(size_t blocks, const block_fn &fn, unsigned first = 0, unsigned workers = 0);
+
+    /**
+     * Wait for the completion of a job
+     * @param j Handle returned by submit
+     */
+    void wait(const job_handle &j);
+
+    /**
+     * Check whether a job has completed. Wait-free
+     * @param j Handle returned by submit
+     * @return true if all the blocks of the job have been executed
+     */
+    static bool finished(const job_handle &j);
+
+    /**
+     * Obtain the execution times of a completed job
+     * @param j Handle returned by submit
+     * @return Wall time of the job and busy time of each worker
+     */
+    static job_times get_times(const job_handle &j);
+
+    /**
+     * Split the workers in groups of consecutive workers, one per virtual
+     * device. If BIND is set, the workers of each group are pinned to the
+     * cores of one core set (see get_core_sets). Workers are only pinned
+     * while no job is running, so that jobs submitted for another partition
+     * keep their cores. Can be called concurrently with other launches
+     * @param groups Number of groups
+     * @return The groups
+     */
+    std::vector<group> partition(unsigned groups);
+
+    /**
+     * Change the number of workers. Must not be called while a grid is
+     * being executed
+     * @param workers Number of workers (0: one per core)
+     */
+    void resize(unsigned workers);
+
+    unsigned size() const
+    {
+        return unsigned(threads_.size());
+    }
+
+private:
+    explicit worker_pool(unsigned workers);
+
+    void start(unsigned workers);
+    void stop();
+
+    void worker_main(unsigned id);
+
+    // Compute the groups of a partition and pin their workers to their cores.
+    // Called with mutex_ held
+    void split(unsigned groups);
+    void pin_groups();
+
+    std::vector<std::thread> threads_;
+    // Groups of the last partition and the cores of each one (protected by mutex_)
+    std::vector<group> groups_;
+    std::vector<core_set> groupCores_;
+    bool pinned_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::shared_ptr<job>> jobs_;
+    // Jobs submitted and not completed yet
+    unsigned active_;
+    bool stop_;
+};
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -69,6 +69,50 @@ public:
     virtual void to_device(host_storage_type &host) = 0;
     virtual void to_host(host_storage_type &host) = 0;
 
+    /**
+     * Transfer a part of the host image of the array
+     * @param offset Offset in bytes of the part from host.addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the storage can only transfer the whole array
+     */
+    virtual bool to_host(host_storage_type &/*host*/, size_t /*offset*/, size_t /*bytes*/)
+    {
+        return false;
+    }
+
+    /**
+     * Transfer a part of the host image of the array to the devices
+     * @param offset Offset in bytes of the part from host.addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the storage can only transfer the whole array
+     */
+    virtual bool to_device(host_storage_type &/*host*/, size_t /*offset*/, size_t /*bytes*/)
+    {
+        return false;
+    }
+
+    /**
+     * Transfer a part of the host image of the array to one of the devices
+     * @param gpu Device whose copy is updated
+     * @param offset Offset in bytes of the part from host.addr()
+     * @param bytes Size in bytes of the part
+     * @return false if the copies of all the devices can only be updated together
+     */
+    virtual bool to_device(host_storage_type &/*host*/, unsigned /*gpu*/, size_t /*offset*/, size_t /*bytes*/)
+    {
+        return false;
+    }
+
+    /**
+     * Parts of the host image of the array that hold the tile of each device
+     * @param tiles Filled with the parts, with their offsets from host.addr()
+     * @return false if the array is not distributed in tiles
+     */
+    virtual bool host_tiles(std::vector<host_tile> &/*tiles*/) const
+    {
+        return false;
+    }
+
 private:
     dim_manager_type dimManager_;
 };
@@ -49,6 +49,10 @@ helper_distribution_get_gpu_grid(const cudarrays::compute_conf<DimsComp> &comp)
 
     // Check if we can map the arrayPartitionGrid on the GPUs
     std::vector<unsigned> factorsGpus = utils::get_factors(comp.procs);
+    // Every partitioned dimension takes at least one factor (as in grid_tiling)
+    while (factorsGpus.size() < comp.get_part_dims()) {
+        factorsGpus.push_back(1);
+    }
     utils::sort(factorsGpus, std::greater<unsigned>());
 
 #if 0
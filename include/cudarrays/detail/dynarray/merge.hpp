@@ -0,0 +1,93 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_DETAIL_DYNARRAY_MERGE_HPP_
+#define CUDARRAYS_DETAIL_DYNARRAY_MERGE_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "../utils/option.hpp"
+
+namespace cudarrays {
+
+// Size in bytes of the parts of the replicated arrays merged at once when they
+// are transferred to the host. The next part is transferred from the devices
+// while a part is merged
+extern utils::option<size_t> MERGE_CHUNK;
+
+namespace detail {
+
+/**
+ * Merge replicas of a buffer into it in place, element by element. Elements
+ * that differ in some replica take the value of the last replica in which they
+ * differ. Blocks of elements that are equal in all the replicas are detected
+ * with wide comparisons and skipped. Blocks are merged in parallel
+ * @param dst Buffer, which holds the contents the replicas are compared with
+ * @param replicas Replicas of the buffer
+ * @param count Number of replicas
+ * @param elemBytes Size of the elements
+ * @param bytes Size of the buffer, multiple of the size of the elements
+ * @return true if some element differs in some replica
+ */
+bool merge_replicas(void *dst, const void *const *replicas, unsigned count, size_t elemBytes, size_t bytes);
+
+// Transfer a part of a replica from (fetch) or to (upload) a host buffer
+using replica_copy_fn = std::function<void (unsigned replica, size_t offset, size_t bytes, void *host)>;
+
+// Staging buffers of the parts of the replicas being merged, kept between merges
+struct merge_buffers {
+    std::unique_ptr<char[]> data;
+    size_t bytes = 0;
+};
+
+/**
+ * Merge the replicas of an array into its host copy in place, part by part,
+ * and update the replicas with the parts that changed. A transfer thread
+ * fetches the next part of all the replicas, and uploads the parts already
+ * merged, while a part is merged
+ * @param host Host copy
+ * @param bytes Size of the host copy, multiple of the size of the elements
+ * @param elemBytes Size of the elements
+ * @param replicas Number of replicas
+ * @param fetch Transfers a part of a replica to a staging buffer
+ * @param upload Transfers a part of the host copy to a replica
+ * @param buffers Staging buffers
+ */
+void merge_pipeline(void *host, size_t bytes, size_t elemBytes, unsigned replicas,
+                    const replica_copy_fn &fetch, const replica_copy_fn &upload, merge_buffers &buffers);
+
+}
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -36,6 +36,7 @@
 #include "../../system.hpp"
 
 #include "base.hpp"
+#include "merge.hpp"
 
 namespace cudarrays {
 
@@ -77,8 +78,7 @@ private:
         std::vector<unsigned> gpus;
         std::vector<value_type *> allocsDev;
 
-        std::unique_ptr<value_type[]> mergeTmp;
-        std::unique_ptr<value_type[]> mergeFinal;
+        detail::merge_buffers mergeBuffers;
 
         storage_host_info(const std::vector<unsigned> &_gpus) :
             gpus(_gpus),
@@ -223,43 +223,107 @@ public:
                 }
             }
         } else {
-            if (hostInfo_->mergeTmp == nullptr) {
-                hostInfo_->mergeTmp.reset(new value_type[this->get_dim_manager().get_elems_align()]);
-                hostInfo_->mergeFinal.reset(new value_type[this->get_dim_manager().get_elems_align()]);
+            std::vector<value_type *> replicas;
+            for (unsigned gpu : utils::make_range(system::gpu_count())) {
+                if (hostInfo_->allocsDev[gpu] != nullptr) {
+                    DEBUG("gpu %u > to host: %p", gpu, hostInfo_->allocsDev[gpu] - this->get_dim_manager().offset());
+                    replicas.push_back(hostInfo_->allocsDev[gpu] - this->get_dim_manager().offset());
+                }
             }
 
-            std::copy(host.addr(),
-                      host.addr() + this->get_dim_manager().get_elems_align(),
-                      hostInfo_->mergeFinal.get());
+            // Merge copies in place, part by part. Only the parts that changed are copied back to the devices
+            auto fetch = [&replicas](unsigned replica, size_t offset, size_t bytes, void *dst)
+            {
+                CUDA_CALL(cudaMemcpy(dst,
+                                     reinterpret_cast<const char *>(replicas[replica]) + offset,
+                                     bytes,
+                                     cudaMemcpyDeviceToHost));
+            };
+            auto upload = [&replicas](unsigned replica, size_t offset, size_t bytes, void *src)
+            {
+                CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(replicas[replica]) + offset,
+                                     src,
+                                     bytes,
+                                     cudaMemcpyHostToDevice));
+            };
+
+            detail::merge_pipeline(host.base_addr(), this->get_dim_manager().get_bytes(), sizeof(value_type),
+                                   unsigned(replicas.size()), fetch, upload, hostInfo_->mergeBuffers);
+        }
+    }
 
-            // Merge copies
-            for (unsigned gpu : utils::make_range(system::gpu_count())) {
-                if (hostInfo_->allocsDev[gpu] != nullptr) {
-                    CUDA_CALL(cudaMemcpy(hostInfo_->mergeTmp.get(),
-                                         hostInfo_->allocsDev[gpu] - this->get_dim_manager().offset(),
-                                         this->get_dim_manager().get_bytes(),
-                                         cudaMemcpyDeviceToHost));
+    bool to_host(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        TRACE_FUNCTION();
 
-                    DEBUG("gpu %u > to host: %p", gpu, hostInfo_->allocsDev[gpu] - this->get_dim_manager().offset());
+        ASSERT(this->get_ngpus() != 0);
 
-                    // Merge step
-                    #pragma omp parallel for
-                    for (array_size_t j = 0; j < this->get_dim_manager().get_elems_align(); ++j) {
-                        if (memcmp(hostInfo_->mergeTmp.get() + j, host.base_addr() + j, sizeof(value_type)) != 0) {
-                            hostInfo_->mergeFinal[j] = hostInfo_->mergeTmp[j];
-                        }
-                    }
-                }
+        // Copies in several GPUs need to be merged
+        if (this->get_ngpus() != 1) return false;
+
+        size_t total = this->get_dim_manager().get_bytes() -
+                       this->get_dim_manager().offset() * sizeof(value_type);
+        if (offset >= total) return true;
+        bytes = std::min(bytes, total - offset);
+
+        for (unsigned gpu : utils::make_range(system::gpu_count())) {
+            if (hostInfo_->allocsDev[gpu] != nullptr) {
+                DEBUG("gpu %u > to host: %p (%zd)", gpu, hostInfo_->allocsDev[gpu], bytes);
+                CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(host.addr()) + offset,
+                                     reinterpret_cast<const char *>(hostInfo_->allocsDev[gpu]) + offset,
+                                     bytes,
+                                     cudaMemcpyDeviceToHost));
             }
+        }
 
-            DEBUG("Updating main host copy");
-            std::copy(hostInfo_->mergeFinal.get(),
-                      hostInfo_->mergeFinal.get() + this->get_dim_manager().get_elems_align(),
-                      host.base_addr());
+        return true;
+    }
+
+    bool to_device(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        TRACE_FUNCTION();
+
+        ASSERT(this->get_ngpus() != 0);
 
-            // Request copy-to-device
-            to_device(host);
+        size_t total = this->get_dim_manager().get_bytes() -
+                       this->get_dim_manager().offset() * sizeof(value_type);
+        if (offset >= total) return true;
+        bytes = std::min(bytes, total - offset);
+
+        // Update all the copies
+        for (unsigned gpu : utils::make_range(system::gpu_count())) {
+            if (hostInfo_->allocsDev[gpu] != nullptr) {
+                DEBUG("Index %u > to dev: %p (%zd)", gpu, hostInfo_->allocsDev[gpu], bytes);
+                CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(hostInfo_->allocsDev[gpu]) + offset,
+                                     reinterpret_cast<const char *>(host.addr()) + offset,
+                                     bytes,
+                                     cudaMemcpyHostToDevice));
+            }
         }
+
+        return true;
+    }
+
+    bool to_device(host_storage_type &host, unsigned gpu, size_t offset, size_t bytes)
+    {
+        TRACE_FUNCTION();
+
+        ASSERT(this->get_ngpus() != 0);
+
+        if (gpu >= hostInfo_->allocsDev.size() || hostInfo_->allocsDev[gpu] == nullptr) return false;
+
+        size_t total = this->get_dim_manager().get_bytes() -
+                       this->get_dim_manager().offset() * sizeof(value_type);
+        if (offset >= total || bytes == 0) return true;
+        bytes = std::min(bytes, total - offset);
+
+        DEBUG("Index %u > to dev: %p (%zd)", gpu, hostInfo_->allocsDev[gpu], bytes);
+        CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(hostInfo_->allocsDev[gpu]) + offset,
+                             reinterpret_cast<const char *>(host.addr()) + offset,
+                             bytes,
+                             cudaMemcpyHostToDevice));
+
+        return true;
     }
 
     void to_device(host_storage_type &host)
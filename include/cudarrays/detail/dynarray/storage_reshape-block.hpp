@@ -417,11 +417,86 @@ public:
         }
     }
 
+    __host__
+    bool to_host(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        TRACE_FUNCTION();
+
+        transfer_range(host, offset, bytes, cudaMemcpyDeviceToHost);
+        return true;
+    }
+
+    __host__
+    bool to_device(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        TRACE_FUNCTION();
+
+        transfer_range(host, offset, bytes, cudaMemcpyHostToDevice);
+        return true;
+    }
+
+    // Parts of the array are only held by one device: they are updated together
+    using base_storage_type::to_device;
+
     unsigned get_ngpus() const
     {
         return hostInfo_->gpus;
     }
 
+    __host__
+    bool host_tiles(std::vector<host_tile> &tiles) const
+    {
+        if (!is_distributed()) return false;
+
+        auto &dimMgr = this->get_dim_manager();
+
+        array_size_t dimZ = dimensions > 2? dimMgr.dim_align(dim_manager_type::DimIdxZ): 1;
+        array_size_t dimY = dimensions > 1? dimMgr.dim_align(dim_manager_type::DimIdxY): 1;
+        array_size_t dimX =                 dimMgr.dim_align(dim_manager_type::DimIdxX);
+
+        array_size_t localZ = dimensions > 2? this->localDims_[dim_manager_type::DimIdxZ]: 1;
+        array_size_t localY = dimensions > 1? this->localDims_[dim_manager_type::DimIdxY]: 1;
+        array_size_t localX =                 this->localDims_[dim_manager_type::DimIdxX];
+
+        unsigned partZ = (dimensions > 2)? hostInfo_->arrayPartitionGrid[dim_manager_type::DimIdxZ]: 1;
+        unsigned partY = (dimensions > 1)? hostInfo_->arrayPartitionGrid[dim_manager_type::DimIdxY]: 1;
+        unsigned partX =                   hostInfo_->arrayPartitionGrid[dim_manager_type::DimIdxX];
+
+        unsigned gpuDimForArrayZ = (dimensions > 2)? hostInfo_->arrayDimToGpus[dim_manager_type::DimIdxZ]: 1;
+        unsigned gpuDimForArrayY = (dimensions > 1)? hostInfo_->arrayDimToGpus[dim_manager_type::DimIdxY]: 1;
+        unsigned gpuDimForArrayX =                   hostInfo_->arrayDimToGpus[dim_manager_type::DimIdxX];
+
+        // Rows of the tiles, merged when they are contiguous in the host image
+        for (unsigned pZ : utils::make_range(partZ)) {
+            for (unsigned pY : utils::make_range(partY)) {
+                for (unsigned pX : utils::make_range(partX)) {
+                    unsigned gpu = pZ * gpuDimForArrayZ + pY * gpuDimForArrayY + pX * gpuDimForArrayX;
+
+                    array_size_t zEnd = std::min(dimZ, (pZ + 1) * localZ);
+                    array_size_t yEnd = std::min(dimY, (pY + 1) * localY);
+                    array_size_t x0   = pX * localX;
+                    array_size_t xEnd = std::min(dimX, x0 + localX);
+                    if (x0 >= xEnd) continue;
+
+                    for (array_size_t z = pZ * localZ; z < zEnd; ++z) {
+                        for (array_size_t y = pY * localY; y < yEnd; ++y) {
+                            size_t offset = size_t((z * dimY + y) * dimX + x0) * sizeof(value_type);
+                            size_t bytes  = size_t(xEnd - x0) * sizeof(value_type);
+
+                            if (!tiles.empty() && tiles.back().part == gpu &&
+                                tiles.back().offset + tiles.back().bytes == offset)
+                                tiles.back().bytes += bytes;
+                            else
+                                tiles.push_back(host_tile{offset, bytes, gpu});
+                        }
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
     template <typename... Idxs>
     __device__ inline
     value_type &access_pos(Idxs... idxs)
@@ -443,6 +518,121 @@ public:
     }
 
 private:
+    /**
+     * Transfer a part of the host image
+     * @param offset Offset in bytes of the part from host.addr()
+     * @param bytes Size in bytes of the part
+     * @param kind Direction of the transfer
+     */
+    __host__
+    void transfer_range(host_storage_type &host, size_t offset, size_t bytes, cudaMemcpyKind kind)
+    {
+        auto &dimMgr = this->get_dim_manager();
+
+        array_size_t rowElems   = dimMgr.dim_align(dim_manager_type::DimIdxX);
+        array_size_t planeRows  = dimensions > 1? dimMgr.dim_align(dim_manager_type::DimIdxY): 1;
+        array_size_t totalElems = dimMgr.get_elems_align() - dimMgr.offset();
+
+        // Partial elements are transferred whole
+        array_size_t begin = offset / sizeof(value_type);
+        array_size_t end   = std::min(totalElems, array_size_t(utils::div_ceil(offset + bytes, sizeof(value_type))));
+
+        // Split the part in boxes of rows within a plane, and transfer the
+        // piece of each box that lives in each tile
+        while (begin < end) {
+            array_size_t row = begin / rowElems;
+            array_size_t z = row / planeRows;
+            array_size_t y = row % planeRows;
+            array_size_t x = begin % rowElems;
+
+            if (x != 0 || end - begin < rowElems) {
+                array_size_t xEnd = std::min(rowElems, x + (end - begin));
+                transfer_box(host, kind, z, y, y + 1, x, xEnd);
+                begin += xEnd - x;
+            } else {
+                array_size_t rows = std::min((end - begin) / rowElems, planeRows - y);
+                transfer_box(host, kind, z, y, y + rows, 0, rowElems);
+                begin += rows * rowElems;
+            }
+        }
+    }
+
+    /**
+     * Transfer a box of rows of a plane of the host image
+     * @param kind Direction of the transfer
+     * @param z Plane of the box
+     * @param y0 First row of the box
+     * @param y1 Row past the end of the box
+     * @param x0 First column of the box
+     * @param x1 Column past the end of the box
+     */
+    __host__
+    void transfer_box(host_storage_type &host, cudaMemcpyKind kind, array_size_t z,
+                      array_size_t y0, array_size_t y1,
+                      array_size_t x0, array_size_t x1)
+    {
+        auto &dimMgr = this->get_dim_manager();
+
+        array_index_t localZ = dimensions > 2? this->localDims_[dim_manager_type::DimIdxZ]: 1;
+        array_index_t localY = dimensions > 1? this->localDims_[dim_manager_type::DimIdxY]: 1;
+        array_index_t localX =                 this->localDims_[dim_manager_type::DimIdxX];
+
+        cudaPitchedPtr hostPtr = make_cudaPitchedPtr(host.addr(),
+                                                     sizeof(value_type) * dimMgr.dim_align(dim_manager_type::DimIdxX),
+                                                                 dimMgr.dim_align(dim_manager_type::DimIdxX),
+                                                     dimensions > 1? dimMgr.dim_align(dim_manager_type::DimIdxY): 1);
+
+        cudaMemcpy3DParms myParms;
+        memset(&myParms, 0, sizeof(myParms));
+        myParms.kind = kind;
+
+        array_size_t pZ = z / localZ;
+        for (array_size_t pY = y0 / localY; pY * localY < y1; ++pY) {
+            for (array_size_t pX = x0 / localX; pX * localX < x1; ++pX) {
+                array_index_t blockOff = pZ * (dimensions > 2? gpuOffs_[dim_manager_type::DimIdxZ]: 0) +
+                                         pY * (dimensions > 1? gpuOffs_[dim_manager_type::DimIdxY]: 0) +
+                                         pX *                  gpuOffs_[dim_manager_type::DimIdxX];
+
+                // Intersection of the box and the tile
+                array_size_t yBegin = std::max(y0, pY * localY);
+                array_size_t yEnd   = std::min(y1, (pY + 1) * localY);
+                array_size_t xBegin = std::max(x0, pX * localX);
+                array_size_t xEnd   = std::min(x1, (pX + 1) * localX);
+
+                DEBUG("TRANSFER: Block (%zd, %zd, %zd) rows %zd-%zd cols %zd-%zd",
+                      size_t(pZ), size_t(pY), size_t(pX),
+                      size_t(yBegin), size_t(yEnd), size_t(xBegin), size_t(xEnd));
+
+                cudaPitchedPtr tilePtr = make_cudaPitchedPtr(dataDev_ + blockOff,
+                                                             sizeof(value_type) * localDims_[dim_manager_type::DimIdxX],
+                                                                                  localDims_[dim_manager_type::DimIdxX],
+                                                             dimensions > 1? localDims_[dim_manager_type::DimIdxY]: 1);
+                cudaPos tilePos = make_cudaPos(sizeof(value_type) * (xBegin - pX * localX),
+                                               yBegin - pY * localY,
+                                               z - pZ * localZ);
+                cudaPos hostPos = make_cudaPos(sizeof(value_type) * xBegin, yBegin, z);
+
+                if (kind == cudaMemcpyDeviceToHost) {
+                    myParms.srcPtr = tilePtr;
+                    myParms.srcPos = tilePos;
+                    myParms.dstPtr = hostPtr;
+                    myParms.dstPos = hostPos;
+                } else {
+                    myParms.srcPtr = hostPtr;
+                    myParms.srcPos = hostPos;
+                    myParms.dstPtr = tilePtr;
+                    myParms.dstPos = tilePos;
+                }
+
+                myParms.extent = make_cudaExtent(sizeof(value_type) * (xEnd - xBegin),
+                                                 yEnd - yBegin,
+                                                 1);
+
+                CUDA_CALL(cudaMemcpy3D(&myParms));
+            }
+        }
+    }
+
     CUDARRAYS_TESTED(lib_storage_test, host_reshape_block)
 };
 
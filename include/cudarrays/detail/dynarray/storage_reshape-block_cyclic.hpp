@@ -397,6 +397,10 @@ public:
         }
     }
 
+    // Partial transfers are not supported: the whole array is transferred
+    using base_storage_type::to_host;
+    using base_storage_type::to_device;
+
     __host__
     void to_host(host_storage_type &host)
     {
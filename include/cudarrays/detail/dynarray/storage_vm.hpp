@@ -323,6 +323,44 @@ public:
         }
     }
 
+    __host__
+    bool to_host(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        // The allocations of all the GPUs form a single linear image
+        size_t total = host.size() - this->get_dim_manager().offset() * sizeof(value_type);
+        if (offset >= total) return true;
+        bytes = std::min(bytes, total - offset);
+
+        DEBUG("COPYING TO HOST: %p -> %p (%zd)", reinterpret_cast<char *>(dataDev_) + offset,
+                                                 reinterpret_cast<char *>(host.addr()) + offset,
+                                                 bytes);
+        CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(host.addr()) + offset,
+                             reinterpret_cast<const char *>(dataDev_) + offset,
+                             bytes, cudaMemcpyDeviceToHost));
+
+        return true;
+    }
+
+    __host__
+    bool to_device(host_storage_type &host, size_t offset, size_t bytes)
+    {
+        size_t total = host.size() - this->get_dim_manager().offset() * sizeof(value_type);
+        if (offset >= total) return true;
+        bytes = std::min(bytes, total - offset);
+
+        DEBUG("COPYING TO DEVICE: %p -> %p (%zd)", reinterpret_cast<char *>(host.addr()) + offset,
+                                                   reinterpret_cast<char *>(dataDev_) + offset,
+                                                   bytes);
+        CUDA_CALL(cudaMemcpy(reinterpret_cast<char *>(dataDev_) + offset,
+                             reinterpret_cast<const char *>(host.addr()) + offset,
+                             bytes, cudaMemcpyHostToDevice));
+
+        return true;
+    }
+
+    // Parts of the array are only held by one device: they are updated together
+    using base_storage_type::to_device;
+
     __host__
     void to_device(host_storage_type &host)
     {
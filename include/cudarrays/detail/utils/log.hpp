@@ -243,37 +243,28 @@ namespace cudarrays {
         fprintf(out, "%s ", header.c_str());
     }
 
+    // Names are only formatted when tracing is enabled, so that traced
+    // functions do not allocate memory otherwise
     class trace_scope {
-        std::string file_;
-        unsigned line_;
-        std::string tag_;
-        function_name fun_;
-        std::string msg_;
-
     public:
         template <typename... Args>
         trace_scope(bool enable,
-                    const std::string &file,
+                    const char *file,
                     unsigned line,
-                    const std::string &tag,
-                    const function_name &fun,
-                    const std::string &msg, const Args &...args) :
-            file_(file),
-            line_(line),
-            tag_(tag),
-            fun_(fun),
-            msg_(format_str(msg, args...))
+                    const char *tag,
+                    const char *fun,
+                    const std::string &msg, const Args &...args)
         {
             if (!enable) return;
 
-            print(stdout, file_, line_, tag_, fun_, msg_);
+            print(stdout, file, line, tag, format_function_name(fun), msg, args...);
         }
 
         trace_scope(bool enable,
-                    const std::string &file,
+                    const char *file,
                     unsigned line,
-                    const std::string &tag,
-                    const function_name &fun) :
+                    const char *tag,
+                    const char *fun) :
             trace_scope(enable, file, line, tag, fun, "")
         {}
     };
@@ -281,7 +272,7 @@ namespace cudarrays {
 #define TRACE_FUNCTION()                                               \
     cudarrays::trace_scope                                             \
         tracer__{LOG_TRACE, __FILE__, __LINE__, "TRACE",               \
-                 cudarrays::format_function_name(__PRETTY_FUNCTION__)}
+                 __PRETTY_FUNCTION__}
 
 #define DEBUG(...)                                                                            \
     do {                                                                                      \
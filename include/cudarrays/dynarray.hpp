@@ -47,6 +47,7 @@
 
 #include "gpu.cuh"
 
+#include "detail/cpu/lanes.hpp"
 #include "detail/dynarray/iterator.hpp"
 #include "detail/dynarray/dim_iterator.hpp"
 #include "detail/coherence/default.hpp"
@@ -103,6 +104,20 @@ public:
         return new dynarray(ext, coherence);
     }
 
+    /**
+     * Create an array whose host copy is backed by a file
+     * @param ext Extents of the array
+     * @param coherence Coherence policy of the array
+     * @param file Part of the file that holds the host copy, with its layout
+     * @param window Resident part of the host copy
+     */
+    static dynarray *make(const extents<array_traits_type::dynamic_dimensions> &ext,
+                          coherence_policy_type coherence, const host_file &file,
+                          const host_window &window = host_window{0, 0})
+    {
+        return new dynarray(ext, coherence, file, window);
+    }
+
 private:
     __host__
     explicit dynarray(const extents<array_traits_type::dynamic_dimensions> &extents,
@@ -115,7 +130,23 @@ private:
 
         // Alloc host memory
         host_.alloc(device_.get_dim_manager().get_elems_align() * sizeof(value_type));
+        host_.place(get_numa_placement(), row_bytes(), {}, true);
+        coherencePolicy_.bind(*this);
+    }
+
+    __host__
+    explicit dynarray(const extents<array_traits_type::dynamic_dimensions> &extents,
+                      coherence_policy_type coherence, const host_file &file, const host_window &window) :
+        coherencePolicy_{coherence},
+        device_(permuter_type::reorder(array_traits_type::make_extents(extents)))
+    {
+        // LIBRARY ENTRY POINT
+        cudarrays_entry_point();
+
+        // Map the host copy from the file. Its pages are placed by the page cache
+        host_.alloc(device_.get_dim_manager().get_elems_align() * sizeof(value_type), file, window);
         coherencePolicy_.bind(*this);
+        host_.attach_window();
     }
 
     __host__
@@ -129,6 +160,13 @@ public:
     __host__
     virtual ~dynarray()
     {
+        // The contents of the devices reach shared files. The written tiles
+        // of windowed host copies are written back before the window is removed
+        if (host_.file_shared()) {
+            coherencePolicy_.update_host();
+            if (host_.windowed())
+                host_.sync_file();
+        }
         coherencePolicy_.unbind();
     }
 
@@ -139,13 +177,17 @@ public:
         auto mapping2 = mapping;
         mapping2.info = permuter_type::reorder(mapping2.info);
 
-        return device_.template distribute<DimsComp>(mapping2);
+        bool ret = device_.template distribute<DimsComp>(mapping2);
+        if (ret) place_tiles();
+        return ret;
     }
 
     __host__ bool
     distribute(const std::vector<unsigned> &gpus) override final
     {
-        return device_.distribute(gpus);
+        bool ret = device_.distribute(gpus);
+        if (ret) place_tiles();
+        return ret;
     }
 
     __host__ bool
@@ -154,6 +196,31 @@ public:
         return device_.is_distributed();
     }
 
+    /**
+     * Place the host copy in the NUMA nodes. Pages already touched are
+     * migrated. With the partition policy, pages follow the tiles of the
+     * devices once the array is distributed
+     * @param placement Placement of the pages
+     * @return false if the pages cannot be placed
+     */
+    __host__ bool
+    place_host(const numa_placement &placement)
+    {
+        return host_.place(placement, row_bytes(), host_tiles());
+    }
+
+    /**
+     * Write the array to the file that backs its host copy, if it is shared.
+     * The stale parts of the host copy are transferred from the devices first
+     * @return false on error
+     */
+    __host__ bool
+    sync_file()
+    {
+        coherencePolicy_.update_host();
+        return host_.sync_file();
+    }
+
     template <unsigned Orig>
     __array_bounds__
     array_size_t dim() const
@@ -192,11 +259,21 @@ public:
         return host_.addr();
     }
 
+    void *staging_addr() noexcept override final
+    {
+        return staging_.addr();
+    }
+
     size_t size() const noexcept override final
     {
         return host_.size();
     }
 
+    size_t host_page_size() const noexcept override final
+    {
+        return host_.page_size();
+    }
+
     void to_device() override final
     {
         device_.to_device(host_);
@@ -207,6 +284,33 @@ public:
         device_.to_host(host_);
     }
 
+    bool to_host(size_t offset, size_t bytes) override final
+    {
+        return device_.to_host(host_, offset, bytes);
+    }
+
+    bool to_staging(size_t offset, size_t bytes) override final
+    {
+        // The pages of the file cannot be replaced
+        if (host_.file_backed()) return false;
+
+        if (staging_.addr() == nullptr) {
+            staging_.alloc(host_.size(), nullptr, host_.pages());
+            staging_.place(host_.placement(), row_bytes(), host_tiles(), true);
+        }
+        return device_.to_host(staging_, offset, bytes);
+    }
+
+    bool to_device(size_t offset, size_t bytes) override final
+    {
+        return device_.to_device(host_, offset, bytes);
+    }
+
+    bool to_device(unsigned gpu, size_t offset, size_t bytes) override final
+    {
+        return device_.to_device(host_, gpu, offset, bytes);
+    }
+
     inline
     const dim_manager<value_type, alignment_type, dimensions> &
     get_dim_manager() const
@@ -237,16 +341,18 @@ public:
 
     template <typename ...Idxs>
     __array_index__
-    value_type &operator()(Idxs &&...idxs)
+    typename cpu::lane_access<value_type &, value_type, cpu::lane_width<Idxs...>::value>::type
+    operator()(Idxs &&...idxs)
     {
-        return at(std::forward<Idxs>(idxs)...);
+        return access(typename cpu::lane_width<Idxs...>::type(), std::forward<Idxs>(idxs)...);
     }
 
     template <typename ...Idxs>
     __array_index__
-    const value_type &operator()(Idxs &&...idxs) const
+    typename cpu::lane_access<const value_type &, value_type, cpu::lane_width<Idxs...>::value>::type
+    operator()(Idxs &&...idxs) const
     {
-        return at(std::forward<Idxs>(idxs)...);
+        return access(typename cpu::lane_width<Idxs...>::type(), std::forward<Idxs>(idxs)...);
     }
 
     //
@@ -278,6 +384,70 @@ public:
     friend const_dim_iterator_type;
 
 private:
+    // Parts of the host copy that hold the tile of each device. Empty if the
+    // array is not distributed in tiles
+    std::vector<host_tile> host_tiles() const
+    {
+        std::vector<host_tile> tiles;
+        if (!device_.host_tiles(tiles)) tiles.clear();
+        return tiles;
+    }
+
+    // Move the pages of the host copies to the nodes of the tiles they hold
+    void place_tiles()
+    {
+        if (host_.placement().policy != numa_policy::partition) return;
+
+        std::vector<host_tile> tiles = host_tiles();
+        if (tiles.empty()) return;
+
+        host_.place(host_.placement(), row_bytes(), tiles);
+        if (staging_.addr() != nullptr)
+            staging_.place(host_.placement(), row_bytes(), tiles);
+    }
+
+    // Size of the rows of the slowest dimension of the host copy
+    size_t row_bytes() const
+    {
+        array_size_t rows = device_.get_dim_manager().dim_align(0);
+        return rows == 0? 0: size_t(device_.get_dim_manager().get_elems_align() / rows) * sizeof(value_type);
+    }
+
+    template <typename ...Idxs>
+    __array_index__
+    value_type &access(std::integral_constant<unsigned, 0>, Idxs &&...idxs)
+    {
+        return at(std::forward<Idxs>(idxs)...);
+    }
+
+    template <typename ...Idxs>
+    __array_index__
+    const value_type &access(std::integral_constant<unsigned, 0>, Idxs &&...idxs) const
+    {
+        return at(std::forward<Idxs>(idxs)...);
+    }
+
+#ifndef __CUDACC__
+    // Accesses with lane indices (see launch_cpu_lanes)
+    template <unsigned W, typename ...Idxs>
+    cpu::lane_ref<value_type, W>
+    access(std::integral_constant<unsigned, W>, Idxs &&...idxs)
+    {
+        static_assert(sizeof...(Idxs) == dimensions, "Wrong number of indexes");
+
+        return access_element_helper<SEQ_GEN_INC(dimensions)>::template at_lanes<W>(device_, host_.addr(), idxs...);
+    }
+
+    template <unsigned W, typename ...Idxs>
+    cpu::lane_ref<const value_type, W>
+    access(std::integral_constant<unsigned, W>, Idxs &&...idxs) const
+    {
+        static_assert(sizeof...(Idxs) == dimensions, "Wrong number of indexes");
+
+        return access_element_helper<SEQ_GEN_INC(dimensions)>::template at_lanes<W>(device_, host_.addr(), idxs...);
+    }
+#endif
+
     template <typename Selector>
     struct access_element_helper;
 
@@ -317,11 +487,44 @@ private:
 #endif
         }
 
+#ifndef __CUDACC__
+        // Linear position of the first lane with the index K incremented by one
+        template <unsigned K, typename... Idxs>
+        static inline
+        array_index_t lane_pos_next(const device_storage_type &device, const Idxs &...idxs)
+        {
+            return indexer_type::access_pos(device.get_dim_manager().get_strides(),
+                                            permuter_type::template select<Vals>((array_index_t(cpu::lane_get(idxs, 0)) +
+                                                                                  array_index_t(Vals == K))...)...);
+        }
+
+        template <unsigned W, typename U, typename... Idxs>
+        static
+        cpu::lane_ref<U, W> at_lanes(const device_storage_type &device,
+                                     U *base,
+                                     const Idxs &...idxs)
+        {
+            // The linear position is affine in every index. Compute the
+            // position of the first lane and add the offsets of the rest of
+            // lanes scaled by the stride of each lane index
+            array_index_t first = indexer_type::access_pos(device.get_dim_manager().get_strides(),
+                                                           permuter_type::template select<Vals>(array_index_t(cpu::lane_get(idxs, 0))...)...);
+            cpu::lanes<array_index_t, W> pos(first);
+            int dummy[] = { 0, (cpu::lane_count<Idxs>::value > 0?
+                                    (pos += cpu::lane_offsets<W>(idxs) * (lane_pos_next<Vals>(device, idxs...) - first), 0):
+                                    0)... };
+            (void) dummy;
+
+            return cpu::lane_ref<U, W>(base, pos);
+        }
+#endif
     };
 
     coherence_policy_type coherencePolicy_;
     device_storage_type   device_;
     host_storage<storage_traits_type> host_;
+    // Destination of the background transfers to the host
+    host_storage<storage_traits_type> staging_;
 };
 
 }
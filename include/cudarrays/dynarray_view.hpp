@@ -104,6 +104,8 @@ private:
     dynarray_type *array_gpu_;
     shared_ptr_type<dynarray_type *> arrays_gpu_;
 
+    access_intent intent_;
+
 public:
     __host__ __device__
     inline
@@ -153,9 +155,21 @@ public:
         }
     }
 
+    // Keep the pointers but release the ownership of the array. Copies of the
+    // view do not update the reference counters anymore, so the array must be
+    // kept alive by another view. Used by the CPU launcher, which copies the
+    // kernel arguments once per emulated thread
+    __host__
+    void drop_ownership() noexcept
+    {
+        array_ = shared_ptr_type<dynarray_type>(shared_ptr_type<dynarray_type>(), array_.get());
+        arrays_gpu_ = shared_ptr_type<dynarray_type *>(shared_ptr_type<dynarray_type *>(), arrays_gpu_.get());
+    }
+
     dynarray_view_common(dynarray_type *a) noexcept :
         array_{a},
-        array_gpu_{nullptr}
+        array_gpu_{nullptr},
+        intent_{access_intent::read_write}
     {}
 
     __host__ __device__
@@ -164,7 +178,8 @@ public:
         array_gpu_{a.array_gpu_}
   #else
         array_{a.array_},
-        arrays_gpu_{a.arrays_gpu_}
+        arrays_gpu_{a.arrays_gpu_},
+        intent_{a.intent_}
   #endif
     {
     }
@@ -182,6 +197,24 @@ public:
         return get_array().get_coherence_policy();
     }
 
+    /**
+     * Declare how the kernels launched with this view access the array. The
+     * intent is kept by the view and its copies until it is changed.
+     * Read-only kernel parameters are always read
+     * @param intent Access of the next launches
+     */
+    __host__
+    void set_access_intent(access_intent intent) noexcept
+    {
+        intent_ = intent;
+    }
+
+    __host__
+    access_intent get_access_intent() const noexcept
+    {
+        return intent_;
+    }
+
     void set_current_gpu(unsigned idx) noexcept override final
     {
         array_gpu_ = arrays_gpu_.get()[idx];
@@ -214,6 +247,18 @@ public:
         return ret;
     }
 
+    __host__
+    bool place_host(const numa_placement &placement)
+    {
+        return get_array().place_host(placement);
+    }
+
+    __host__
+    bool sync_file()
+    {
+        return get_array().sync_file();
+    }
+
     void to_device() override final
     {
         get_array().to_device();
@@ -224,6 +269,26 @@ public:
         get_array().to_host();
     }
 
+    bool to_host(size_t offset, size_t bytes) override final
+    {
+        return get_array().to_host(offset, bytes);
+    }
+
+    bool to_staging(size_t offset, size_t bytes) override final
+    {
+        return get_array().to_staging(offset, bytes);
+    }
+
+    bool to_device(size_t offset, size_t bytes) override final
+    {
+        return get_array().to_device(offset, bytes);
+    }
+
+    bool to_device(unsigned gpu, size_t offset, size_t bytes) override final
+    {
+        return get_array().to_device(gpu, offset, bytes);
+    }
+
     void *host_addr() noexcept override final
     {
         return get_array().host_addr();
@@ -234,11 +299,21 @@ public:
         return get_array().host_addr();
     }
 
+    void *staging_addr() noexcept override final
+    {
+        return get_array().staging_addr();
+    }
+
     size_t size() const noexcept override final
     {
         return get_array().size();
     }
 
+    size_t host_page_size() const noexcept override final
+    {
+        return get_array().host_page_size();
+    }
+
     template <unsigned Dim>
     __array_bounds__
     array_size_t dim() const noexcept
@@ -295,14 +370,16 @@ public:
     // Forward calls to the parent array
     template <typename... T>
     __array_index__
-    value_type &operator()(T &&... indices)
+    typename cpu::lane_access<value_type &, value_type, cpu::lane_width<T...>::value>::type
+    operator()(T &&... indices)
     {
         return this->get_array()(std::forward<T>(indices)...);
     }
 
     template <typename... T>
     __array_index__
-    const value_type &operator()(T &&... indices) const
+    typename cpu::lane_access<const value_type &, value_type, cpu::lane_width<T...>::value>::type
+    operator()(T &&... indices) const
     {
         return this->get_array()(std::forward<T>(indices)...);
     }
@@ -356,7 +433,8 @@ public:
     // Forward calls to the parent array
     template <typename... T>
     __array_index__
-    const value_type &operator()(T &&... indices) const
+    typename cpu::lane_access<const value_type &, value_type, cpu::lane_width<T...>::value>::type
+    operator()(T &&... indices) const
     {
         return this->get_array()(std::forward<T>(indices)...);
     }
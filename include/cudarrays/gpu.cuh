@@ -34,6 +34,55 @@
 
 #include "common.hpp"
 
+#ifndef __CUDACC__
+//
+// Kernels compiled by the host compiler are executed by launcher_cpu (see
+// launch_cpu.hpp). CUDA built-in variables are emulated with per-thread state
+// that the CPU workers update before running each emulated CUDA thread.
+// blockIdx and gridDim already contain the global offsets of the grid.
+//
+// The threads of a block run as fibers on the same worker, so __shared__
+// variables become thread_local variables of the worker, which executes one
+// block at a time. __syncthreads() switches to the next fiber of the block.
+// Dynamic shared memory is obtained with cuda_block_get_shared_memory().
+//
+#include <cuda_runtime.h>
+
+extern thread_local uint3 threadIdx;
+extern thread_local uint3 blockIdx;
+extern thread_local uint3 blockDim;
+extern thread_local uint3 gridDim;
+
+void cuda_block_synchronize();
+
+extern "C"
+void *cuda_block_get_shared_memory();
+
+#undef  __global__
+#define __global__
+#undef  __shared__
+#define __shared__ __attribute__((aligned(64))) static thread_local
+
+#define __syncthreads() cuda_block_synchronize()
+
+namespace cudarrays {
+
+#define blockIdx_yx  dim3(blockIdx.y, blockIdx.x)
+#define blockIdx_yxz dim3(blockIdx.y, blockIdx.x, blockIdx.z)
+#define blockIdx_yzx dim3(blockIdx.y, blockIdx.z, blockIdx.x)
+#define blockIdx_zxy dim3(blockIdx.z, blockIdx.x, blockIdx.y)
+#define blockIdx_zyx dim3(blockIdx.z, blockIdx.y, blockIdx.x)
+
+#define gridDim_yx   dim3(gridDim.y, gridDim.x)
+#define gridDim_yxz  dim3(gridDim.y, gridDim.x, gridDim.z)
+#define gridDim_yzx  dim3(gridDim.y, gridDim.z, gridDim.x)
+#define gridDim_zxy  dim3(gridDim.z, gridDim.x, gridDim.y)
+#define gridDim_zyx  dim3(gridDim.z, gridDim.y, gridDim.x)
+
+}
+
+#else // __CUDACC__
+
 namespace cudarrays {
 
 #ifdef CUDARRAYS_DONT_OVERRIDE_BLOCK_IDX
@@ -92,6 +141,27 @@ unsigned long long *tracer_tstamps_end;
 
 }
 
+#endif // __CUDACC__
+
+#include "detail/cpu/lanes.hpp"
+
+namespace cudarrays {
+
+/**
+ * Index of the calling thread in the X dimension of the block. Kernels
+ * instantiated with a cpu::lanes index type get the indices of all the lanes
+ * of the invocation (see launch_cpu_lanes)
+ * @return Index of the thread
+ */
+template <typename Index = unsigned>
+__device__ inline
+Index thread_idx_x()
+{
+    return cpu::lane_index<Index>::make(threadIdx.x);
+}
+
+}
+
 #endif
 
 /* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -30,12 +30,222 @@
 #ifndef CUDARRAYS_HOST_HPP_
 #define CUDARRAYS_HOST_HPP_
 
+#include <string>
+#include <vector>
+
 #include <sys/mman.h>
+#include <sys/types.h>
 
 #include "common.hpp"
 
+#include "detail/utils/option.hpp"
+
 namespace cudarrays {
 
+// Pages that back the host copies of the arrays
+enum class host_pages {
+    base    = 0, // Pages of the system page size
+    thp     = 1, // Transparent huge pages, requested with madvise
+    hugetlb = 2  // Pages of the huge page pool (MAP_HUGETLB). Falls back to
+                 // transparent huge pages if the pool is exhausted
+};
+
+// Pages of the host copies of the arrays ("base", "thp" or "hugetlb")
+extern utils::option<std::string> HOST_PAGES;
+
+const char *to_string(host_pages pages);
+
+/**
+ * Obtain the pages selected through CUDARRAYS_HOST_PAGES
+ */
+host_pages get_host_pages();
+
+/**
+ * Size of the pages of a kind. Host copies backed by huge pages are protected
+ * in multiples of the huge page size, so that the pages are not split
+ */
+size_t host_page_bytes(host_pages pages);
+
+// Placement of the host copies of the arrays in the NUMA nodes
+enum class numa_policy {
+    first_touch = 0, // Pages are placed in the node of the thread that first touches them
+    interleave  = 1, // Pages are interleaved across the nodes
+    partition   = 2, // Pages are placed in the node of the device whose tile of
+                     // the distributed array they hold, devices spread in node
+                     // order. Until the array is distributed, or if its storage
+                     // is not split in tiles, the host copy is split in slabs
+                     // along its slowest dimension, one per node in node order
+    node        = 3  // Pages are placed in a single node
+};
+
+struct numa_placement {
+    numa_policy policy;
+    int node; // Node of the node policy
+};
+
+// Part of the host copy of a distributed array that holds (a piece of) the
+// tile of a device
+struct host_tile {
+    size_t offset; // Offset in bytes from the start of the array
+    size_t bytes;
+    unsigned part; // Index of the device in the distribution
+};
+
+// Placement of the host copies of the arrays ("first_touch", "interleave",
+// "partition" or "node:<n>")
+extern utils::option<std::string> HOST_NUMA;
+
+std::string to_string(const numa_placement &placement);
+
+/**
+ * Obtain the placement selected through CUDARRAYS_HOST_NUMA
+ */
+numa_placement get_numa_placement();
+
+// Maximum size in bytes of the host mappings that are kept for reuse once their
+// arrays are destroyed. Mappings are kept in size classes, with their pages
+// populated and their ranges registered, and the least recently freed ones are
+// unmapped when the pool exceeds the limit. 0 disables the pool
+extern utils::option<size_t> HOST_POOL;
+
+// Activity of the pool of host mappings since initialization
+struct host_pool_stats {
+    uint64_t hits;    // Mappings taken from the pool
+    uint64_t misses;  // Mappings created while the pool was enabled
+    uint64_t trimmed; // Mappings unmapped to keep the pool under its limit
+    size_t   bytes;   // Size of the mappings in the pool
+};
+
+host_pool_stats get_host_pool_stats();
+
+/**
+ * Unmap the mappings kept in the pool, least recently freed first
+ * @param keepBytes Size of the mappings that are kept
+ */
+void host_pool_trim(size_t keepBytes = 0);
+
+// Access to the file that backs the host copy of an array
+enum class file_mode {
+    read_only = 0, // Private mapping: the host copy can be written, but the
+                   // writes never reach the file
+    shared    = 1  // Shared mapping: the host copy is the contents of the file
+};
+
+// Part of a file that backs the host copy of an array
+struct host_file {
+    int fd;         // Descriptor of the file, duplicated by the host copy
+    off_t offset;   // Offset of the host copy, aligned to the system page size
+    file_mode mode;
+};
+
+// Size in bytes of the tiles of the out-of-core host copies, loaded from and
+// written back to their files at once. Multiple of the system page size
+extern utils::option<size_t> HOST_WINDOW_TILE;
+
+// Resident part of the host copy of an out-of-core array. The rest of the
+// host copy stays in its file, and the tiles faulted least recently are
+// written back to make room for the ones accessed. Tiles of read-only files
+// that have been written are written back to a temporary file
+struct host_window {
+    size_t budget;    // Bytes of the host copy kept resident. 0 keeps all of it
+    size_t tileBytes; // Size of the tiles. 0 for CUDARRAYS_HOST_WINDOW_TILE
+};
+
+namespace detail {
+/**
+ * Place the pages of a host copy in the NUMA nodes. Pages are bound with
+ * mbind, which also migrates the pages already touched. If mbind is not
+ * available, untouched pages are populated by threads that run in the cores
+ * of their nodes
+ * @param addr Start of the host copy, aligned to its pages
+ * @param bytes Size of the host copy
+ * @param pageBytes Size of the pages of the host copy
+ * @param rowBytes Size of the rows of the slowest dimension, where slabs are
+ *                 split. Slabs are then aligned to the pages
+ * @param tiles Tiles of the devices, with their offsets from addr. Each page
+ *              is placed in the node of the device that owns most of its
+ *              bytes. Slabs are used if there are no tiles
+ * @param placement Placement of the pages
+ * @param untouched The pages have not been touched yet
+ * @return false if the pages cannot be placed
+ */
+bool host_place(void *addr, size_t bytes, size_t pageBytes, size_t rowBytes, const std::vector<host_tile> &tiles,
+                const numa_placement &placement, bool untouched);
+
+/**
+ * Map anonymous memory for the host copy of an array. Mappings backed by huge
+ * pages are aligned to the huge page size and rounded up to it
+ * @param bytes Requested size
+ * @param addr Fixed address of the mapping or nullptr. Huge pages are only
+ *             used if it is aligned to the huge page size
+ * @param pages Input: requested pages. Output: pages of the mapping
+ * @param mapped Output: size of the mapping
+ * @param recycled Output: the mapping is taken from the pool. Its contents
+ *                 are not cleared
+ * @return The address of the mapping, or nullptr on error
+ */
+void *host_map(size_t bytes, void *addr, host_pages &pages, size_t &mapped, bool &recycled);
+
+/**
+ * Return a mapping obtained with host_map to the pool, or unmap it
+ * @param pooled The mapping was requested without a fixed address
+ */
+void host_unmap(void *addr, size_t mapped, host_pages pages, bool pooled);
+
+/**
+ * Map a part of a file as the host copy of an array. Pages are loaded from
+ * the file on first access. The userfaultfd backend cannot track file
+ * mappings, so with it the part is read into anonymous memory instead
+ * @param bytes Size of the host copy
+ * @param addr Fixed address of the host copy or nullptr
+ * @param file Part of the file. Its descriptor is duplicated
+ * @param mapped Output: size of the mapping
+ * @param copied Output: the part has been read into anonymous memory
+ * @return The address of the mapping, or nullptr on error
+ */
+void *host_map_file(size_t bytes, void *addr, host_file &file, size_t &mapped, bool &copied);
+
+/**
+ * Write the host copy of an array to its file
+ * @param copied The host copy has been read into anonymous memory
+ * @return false on error
+ */
+bool host_sync_file(void *addr, size_t bytes, size_t mapped, const host_file &file, bool copied);
+
+/**
+ * Unmap the host copy of an array backed by a file. Shared host copies read
+ * into anonymous memory are written to the file first
+ */
+void host_unmap_file(void *addr, size_t bytes, size_t mapped, const host_file &file, bool copied);
+
+/**
+ * Reserve the host copy of an out-of-core array. None of its pages is
+ * resident until they are accessed through the window. The window needs the
+ * SIGSEGV fault backend: with other backends the part of the file is mapped
+ * as a whole (see host_map_file)
+ * @param bytes Size of the host copy
+ * @param addr Fixed address of the host copy or nullptr
+ * @param file Part of the file. Its descriptor is duplicated
+ * @param mapped Output: size of the mapping
+ * @param windowed Output: the host copy is reserved for a window
+ * @param copied Output: see host_map_file
+ * @return The address of the mapping, or nullptr on error
+ */
+void *host_map_window(size_t bytes, void *addr, host_file &file, size_t &mapped, bool &windowed, bool &copied);
+
+/**
+ * Keep resident only a window of the tiles of a host copy reserved by
+ * host_map_window. The range of the host copy must be registered
+ */
+void host_attach_window(void *addr, size_t bytes, const host_file &file, const host_window &window);
+
+/**
+ * Write back the tiles of a windowed host copy that have been written
+ * @return false on error
+ */
+bool host_sync_window(void *addr, const host_file &file);
+}
+
 template <typename StorageTraits>
 class host_storage {
 public:
@@ -49,30 +259,118 @@ public:
 
     virtual ~host_storage()
     {
-        if (data_ != nullptr) {
-            int ret = munmap(this->base_addr(), hostSize_);
-            ASSERT(ret == 0);
+        if (data_ != nullptr && file_.fd >= 0) {
+            detail::host_unmap_file(this->base_addr(), hostSize_, mapSize_, file_, fileCopy_);
+            data_ = nullptr;
+        } else if (data_ != nullptr) {
+            detail::host_unmap(this->base_addr(), mapSize_, pages_, pooled_);
             data_ = nullptr;
         }
     }
 
-    void alloc(array_size_t bytes, value_type *addr = nullptr)
+    /**
+     * Map the host copy
+     * @param bytes Size of the host copy
+     * @param addr Fixed address of the host copy or nullptr
+     * @param pages Pages requested for the host copy
+     */
+    void alloc(array_size_t bytes, value_type *addr = nullptr, host_pages pages = get_host_pages())
     {
-        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
-        if (addr != nullptr) flags |= MAP_FIXED;
         hostSize_ = bytes;
-        data_ = (value_type *) mmap(addr, hostSize_,
-                                    PROT_READ | PROT_WRITE,
-                                    flags, -1, 0);
+        pages_    = pages;
+        pooled_   = addr == nullptr;
+        data_ = (value_type *) detail::host_map(hostSize_, addr, pages_, mapSize_, recycled_);
 
-        if (addr != nullptr && data_ != addr) {
+        if (data_ == nullptr || (addr != nullptr && data_ != addr)) {
             FATAL("Unable to map memory at %p", addr);
         }
-        DEBUG("host> mmapped: %p (%zd)", data_, hostSize_);
+        DEBUG("host> mmapped: %p (%zd, %s pages%s)", data_, mapSize_, to_string(pages_),
+              recycled_? ", recycled": "");
 
         data_ = data_ + alignment_type::get_offset();
     }
 
+    /**
+     * Map the host copy from a file. The file holds the host copy with its
+     * layout, including the padding of the alignment
+     * @param bytes Size of the host copy
+     * @param file Part of the file that holds the host copy
+     * @param window Resident part of the host copy. The window is attached
+     *               once the host copy is registered (see attach_window)
+     * @param addr Fixed address of the host copy or nullptr
+     */
+    void alloc(array_size_t bytes, const host_file &file, const host_window &window = host_window{0, 0},
+               value_type *addr = nullptr)
+    {
+        hostSize_ = bytes;
+        pages_    = host_pages::base;
+        file_     = file;
+        window_   = window;
+        if (window_.budget != 0)
+            data_ = (value_type *) detail::host_map_window(hostSize_, addr, file_, mapSize_, windowed_, fileCopy_);
+        else
+            data_ = (value_type *) detail::host_map_file(hostSize_, addr, file_, mapSize_, fileCopy_);
+
+        if (data_ == nullptr || (addr != nullptr && data_ != addr)) {
+            FATAL("Unable to map file at %p", addr);
+        }
+        DEBUG("host> mmapped: %p (%zd, file %s%s)", data_, mapSize_,
+              file_.mode == file_mode::shared? "shared": "read-only",
+              windowed_? ", windowed": fileCopy_? ", copied": "");
+
+        data_ = data_ + alignment_type::get_offset();
+    }
+
+    /**
+     * Keep resident only the window of the host copy requested to alloc. The
+     * range of the host copy must be registered
+     */
+    void attach_window()
+    {
+        if (windowed_)
+            detail::host_attach_window(base_addr(), hostSize_, file_, window_);
+    }
+
+    /**
+     * Only a window of the host copy is resident
+     */
+    inline bool
+    windowed() const
+    {
+        return windowed_;
+    }
+
+    /**
+     * The host copy is backed by a file
+     */
+    inline bool
+    file_backed() const
+    {
+        return file_.fd >= 0;
+    }
+
+    /**
+     * The host copy is backed by a file with a shared mapping
+     */
+    inline bool
+    file_shared() const
+    {
+        return file_.fd >= 0 && file_.mode == file_mode::shared;
+    }
+
+    /**
+     * Write the host copy to its file, if it is shared. The written tiles of
+     * windowed host copies are written back even if it is not
+     * @return false on error
+     */
+    bool sync_file()
+    {
+        if (windowed_)
+            return detail::host_sync_window(base_addr(), file_);
+        if (!file_shared()) return true;
+        return detail::host_sync_file(base_addr(), hostSize_, mapSize_, file_, fileCopy_);
+    }
+
     inline const value_type *
     addr() const
     {
@@ -103,9 +401,70 @@ public:
         return hostSize_;
     }
 
+    /**
+     * Pages that back the host copy
+     */
+    inline host_pages
+    pages() const
+    {
+        return pages_;
+    }
+
+    inline size_t
+    page_size() const
+    {
+        return host_page_bytes(pages_);
+    }
+
+    /**
+     * The host copy reuses a mapping of the pool, whose pages are populated
+     */
+    inline bool
+    recycled() const
+    {
+        return recycled_;
+    }
+
+    /**
+     * Place the host copy in the NUMA nodes
+     * @param placement Placement of the pages
+     * @param rowBytes Size of the rows of the slowest dimension of the array
+     * @param tiles Tiles of the devices, if the array is distributed
+     * @param untouched The host copy has not been touched since it was mapped
+     * @return false if the pages cannot be placed
+     */
+    bool place(const numa_placement &placement, size_t rowBytes, const std::vector<host_tile> &tiles,
+               bool untouched = false)
+    {
+        placement_ = placement;
+
+        // The array starts after the alignment offset of the mapping
+        std::vector<host_tile> mapped(tiles);
+        for (auto &tile : mapped)
+            tile.offset += size_t(data_ - base_addr()) * sizeof(value_type);
+
+        return detail::host_place(base_addr(), mapSize_, page_size(), rowBytes, mapped, placement,
+                                  untouched && !recycled_);
+    }
+
+    inline const numa_placement &
+    placement() const
+    {
+        return placement_;
+    }
+
 private:
     value_type *data_ = nullptr;
     size_t hostSize_  = 0;
+    size_t mapSize_   = 0;
+    host_pages pages_ = host_pages::base;
+    bool pooled_      = false;
+    bool recycled_    = false;
+    host_file file_   = host_file{-1, 0, file_mode::read_only};
+    bool fileCopy_    = false;
+    host_window window_ = host_window{0, 0};
+    bool windowed_    = false;
+    numa_placement placement_ = numa_placement{numa_policy::first_touch, 0};
 
     CUDARRAYS_TESTED(storage_test, host_storage)
 };
@@ -30,9 +30,12 @@
 #ifndef CUDARRAYS_LAUNCH_HPP_
 #define CUDARRAYS_LAUNCH_HPP_
 
+#include <array>
 #include <fstream>
 #include <future>
+#include <memory>
 #include <sstream>
+#include <tuple>
 #include <vector>
 
 #include <cxxabi.h>
@@ -40,12 +43,38 @@
 #include "common.hpp"
 // #include "trace.hpp"
 #include "dynarray.hpp"
+#include "launch_sequence.hpp"
 
 namespace cudarrays {
 
 void update_gpu_global_grid(dim3);
 void update_gpu_offset(dim3);
 
+// Reuse launch plans and skip the updates of unchanged grid constants
+extern utils::option<bool> LAUNCH_CACHE;
+// Maximum number of cached launch plans
+extern utils::option<unsigned> LAUNCH_CACHE_SIZE;
+
+/**
+ * Update the global grid and offset constants of the current GPU. Copies to
+ * the constant symbols are skipped if they already hold the given values
+ * @param total_grid Global grid of the kernel
+ * @param off Offset of the tile executed by the GPU
+ */
+void update_gpu_constants(dim3 total_grid, dim3 off);
+
+// Streams used to launch kernels in each GPU
+extern utils::option<unsigned> LAUNCH_STREAMS;
+
+/**
+ * Obtain the stream for the next launch in a GPU. Launches are spread
+ * round-robin among LAUNCH_STREAMS streams, so that launches that do not
+ * depend on each other can overlap
+ * @param gpu GPU index
+ * @return The stream
+ */
+cudaStream_t get_launch_stream(unsigned gpu);
+
 template <typename T>
 static inline void *mycudaAddressOf(T &val)
 {
@@ -122,7 +151,7 @@ struct cuda_conf {
     }
 };
 
-using coherence_info = std::pair<coherent *, bool>;
+using coherence_info = std::pair<coherent *, access_intent>;
 
 template <typename To>
 struct check_arg_type {
@@ -144,38 +173,90 @@ struct check_arg_type <To *> {
     }
 };
 
+template <typename T>
+struct is_coherent_arg :
+    std::false_type {
+};
+
+template <typename Array>
+struct is_coherent_arg<dynarray_view<Array>> :
+    std::true_type {
+};
+
+template <typename Array>
+struct is_coherent_arg<dynarray_cview<Array>> :
+    std::true_type {
+};
+
+/**
+ * Number of arguments of a kernel that are subject to coherence
+ */
+template <typename... Args>
+struct count_coherent_args;
+
+template <>
+struct count_coherent_args<> {
+    static constexpr unsigned value = 0;
+};
+
+template <typename T, typename... Args>
+struct count_coherent_args<T, Args...> {
+    static constexpr unsigned value = is_coherent_arg<typename std::decay<T>::type>::value +
+                                      count_coherent_args<Args...>::value;
+};
+
 template <typename... Args>
 struct argument_manager {
+    static constexpr unsigned NumCoherent = count_coherent_args<Args...>::value;
+    // Coherent objects passed to a launch. Its size is known at compile time,
+    // so that launches do not allocate memory to track them
+    using coherent_params = std::array<coherence_info, NumCoherent>;
+
     static thread_local void *CurrentKernel;
     static thread_local void *Params[sizeof...(Args)];
-    static thread_local std::vector<coherence_info> CoherentParams;
 
-    template <typename T>
+    template <unsigned CIdx, typename T>
     static void
-    set_coherent_arg(T &&/*arg*/, bool /*Const*/)
+    set_coherent_arg(coherent_params &/*objects*/, T &&/*arg*/, bool /*Const*/)
     {
         // Not coherent. Do nothing
     }
 
-    template <typename Array>
+    template <unsigned CIdx, typename Array>
     static void
-    set_coherent_arg(dynarray_view<Array> &arg, bool Const)
+    set_coherent_arg(coherent_params &objects, dynarray_view<Array> &arg, bool Const)
     {
-        // Store dynarray arguments in the vector of coherent objects
-        CoherentParams.push_back(coherence_info{&arg, Const});
+        // Store dynarray arguments in the array of coherent objects. Kernels
+        // cannot write through read-only parameters, whatever the view declares
+        objects[CIdx] = coherence_info{&arg, Const? access_intent::read: arg.get_access_intent()};
     }
 
-    template <typename Array>
+    template <unsigned CIdx, typename Array>
     static void
-    set_coherent_arg(dynarray_cview<Array> &arg, bool Const)
+    set_coherent_arg(coherent_params &objects, dynarray_cview<Array> &arg, bool /*Const*/)
     {
-        // Store dynarray arguments in the vector of coherent objects
-        CoherentParams.push_back(coherence_info{&arg, Const});
+        // Store dynarray arguments in the array of coherent objects
+        objects[CIdx] = coherence_info{&arg, access_intent::read};
     }
 
-    template <unsigned Idx, typename T>
+    template <unsigned CIdx, typename Array>
+    static void
+    set_coherent_arg(coherent_params &objects, const dynarray_view<Array> &arg, bool /*Const*/)
+    {
+        // Const views can only be read. Coherence state is kept in the array
+        objects[CIdx] = coherence_info{const_cast<dynarray_view<Array> *>(&arg), access_intent::read};
+    }
+
+    template <unsigned CIdx, typename Array>
+    static void
+    set_coherent_arg(coherent_params &objects, const dynarray_cview<Array> &arg, bool /*Const*/)
+    {
+        objects[CIdx] = coherence_info{const_cast<dynarray_cview<Array> *>(&arg), access_intent::read};
+    }
+
+    template <unsigned Idx, unsigned CIdx, typename T>
     static void
-    parse_args(T &arg)
+    parse_args(coherent_params &objects, T &arg)
     {
         using Type = typename std::tuple_element<Idx,
                                                  std::tuple<Args...>>::type;
@@ -183,27 +264,29 @@ struct argument_manager {
         bool Const = std::is_const<Type>::value;
 
         check_arg_type<Type>::against(arg);
-        set_coherent_arg(arg, Const);
+        set_coherent_arg<CIdx>(objects, arg, Const);
 
         Params[Idx] = mycudaAddressOf(arg);
     }
 
-    template <unsigned Idx, typename T, typename... ArgsPassed>
+    template <unsigned Idx, unsigned CIdx, typename T, typename... ArgsPassed>
     static void
-    parse_args(T &arg, ArgsPassed&... args2)
+    parse_args(coherent_params &objects, T &arg, ArgsPassed&... args2)
     {
-        parse_args<Idx, T>(arg); // Process current argument
+        parse_args<Idx, CIdx, T>(objects, arg); // Process current argument
 
-        parse_args<Idx + 1, ArgsPassed...>(args2...); // Process next arguments
+        // Process next arguments
+        parse_args<Idx + 1, CIdx + count_coherent_args<T>::value, ArgsPassed...>(objects, args2...);
     }
 
     template <typename... ArgsPassed>
     static void
-    parse_args(ArgsPassed&... args2)
+    parse_args(coherent_params &objects, ArgsPassed&... args2)
     {
-        CoherentParams.clear();
+        static_assert(count_coherent_args<ArgsPassed...>::value == NumCoherent,
+                      "Coherent arguments must be passed as coherent kernel parameters");
 
-        parse_args<0, ArgsPassed...>(args2...);
+        parse_args<0, 0, ArgsPassed...>(objects, args2...);
     }
 
 #if 0 // TODO: implement
@@ -263,8 +346,7 @@ template <typename... Args>
 thread_local
 void *argument_manager<Args...>::Params[sizeof...(Args)];
 template <typename... Args>
-thread_local
-std::vector<coherence_info> argument_manager<Args...>::CoherentParams;
+constexpr unsigned argument_manager<Args...>::NumCoherent;
 
 static void init_streams(unsigned gpus)
 {
@@ -289,26 +371,257 @@ static void init_streams(unsigned gpus)
     }
 }
 
+/**
+ * Decomposition of a grid in tiles, one per GPU. The GPUs are arranged in a
+ * grid whose dimensions are built from the prime factors of the number of GPUs
+ * and only span the partitioned dimensions of the computation. Shared by the
+ * GPU launchers and the virtual devices of the CPU launcher
+ */
+class grid_tiling {
+    unsigned dims_;
+    unsigned gpus_;
+    dim3 total_;
+    dim3 gpuGrid_;
+    dim3 step_;
+    dim3 grid_;
+
+public:
+    /**
+     * @param gpus Number of GPUs used to execute the grid
+     * @param gpuConf Partitioned dimensions of the computation
+     * @param total Grid to be decomposed
+     */
+    template <unsigned Dims>
+    grid_tiling(unsigned gpus, const compute_conf<Dims> &gpuConf, dim3 total) :
+        dims_(Dims),
+        gpus_(gpus),
+        total_(total)
+    {
+        static constexpr unsigned DimIdxX = 2 - (3 - Dims);
+        static constexpr unsigned DimIdxY = 1 - (3 - Dims);
+        static constexpr unsigned DimIdxZ = 0 - (3 - Dims);
+
+        std::vector<unsigned> gpuGrid;
+
+        unsigned partDims = utils::count(gpuConf.info, true);
+
+        auto factorsGPUs = utils::get_factors(gpus_);
+        if (gpus_ == 1) {
+            factorsGPUs.push_back(1);
+        }
+        // Every partitioned dimension takes at least one factor
+        while (factorsGPUs.size() < partDims) {
+            factorsGPUs.push_back(1);
+        }
+        utils::sort(factorsGPUs, std::greater<unsigned>());
+
+        unsigned j = 0;
+        for (unsigned i : utils::make_range(Dims)) {
+            unsigned partition = 1;
+            if (gpuConf.info[i]) {
+                auto pos = factorsGPUs.begin() + j;
+                size_t inc = (j == 0)? factorsGPUs.size() - partDims + 1: 1;
+
+                partition = std::accumulate(pos, pos + inc, 1, std::multiplies<unsigned>());
+                j += inc;
+            }
+
+            gpuGrid.push_back(partition);
+        }
+
+        gpuGrid_.x = gpuGrid[DimIdxX];
+        gpuGrid_.y = Dims > 1? gpuGrid[DimIdxY]: 1;
+        gpuGrid_.z = Dims > 2? gpuGrid[DimIdxZ]: 1;
+
+        step_ = dim3{0, 0, 0};
+        grid_ = dim3{1, 1, 1};
+
+        if (Dims > 2) {
+            grid_.z = utils::div_ceil(total_.z, gpuGrid_.z);
+            if (gpuGrid_.z > 1) {
+                step_.z = grid_.z;
+            }
+        }
+        if (Dims > 1) {
+            grid_.y = utils::div_ceil(total_.y, gpuGrid_.y);
+            if (gpuGrid_.y > 1) {
+                step_.y = grid_.y;
+            }
+        }
+
+        grid_.x = utils::div_ceil(total_.x, gpuGrid_.x);
+        if (gpuGrid_.x > 1) {
+            step_.x = grid_.x;
+        }
+    }
+
+    unsigned get_gpus() const
+    {
+        return gpus_;
+    }
+
+    dim3 get_total_grid() const
+    {
+        return total_;
+    }
+
+    /**
+     * @return The offset increment between consecutive tiles and the
+     * dimensions of a full tile
+     */
+    std::tuple<dim3, dim3> get_tiles() const
+    {
+        return std::make_tuple(step_, grid_);
+    }
+
+    /**
+     * Call fn(gpu, off, local) for every GPU in the GPU grid, where off is the
+     * global offset of its tile and local its dimensions. The tiles of the
+     * GPUs beyond the end of the grid are empty
+     */
+    template <typename F>
+    void for_each_tile(F &&fn) const
+    {
+        unsigned gpu = 0;
+        dim3 off{0, 0, 0};
+        for (unsigned i : utils::make_range(gpuGrid_.z)) {
+            off.y = 0;
+            for (unsigned j : utils::make_range(gpuGrid_.y)) {
+                off.x = 0;
+                for (unsigned k : utils::make_range(gpuGrid_.x)) {
+                    dim3 local = grid_;
+                    DEBUG("local: %u %u %u", local.z, local.y, local.x);
+                    DEBUG("off: %u %u %u", off.z, off.y, off.x);
+
+                    // Trim the tiles that cross the end of the grid in any dimension
+                    if (off.z + step_.z > total_.z) {
+                        if (off.z <= total_.z)
+                            local.z = total_.z - off.z;
+                        else
+                            local.z = 0;
+                    }
+                    if (off.y + step_.y > total_.y) {
+                        if (off.y <= total_.y)
+                            local.y = total_.y - off.y;
+                        else
+                            local.y = 0;
+                    }
+                    if (off.x + step_.x > total_.x) {
+                        if (off.x <= total_.x)
+                            local.x = total_.x - off.x;
+                        else
+                            local.x = 0;
+                    }
+
+                    DEBUG("gpu %u: %u %u %u", gpu, i, j, k);
+                    fn(gpu, off, local);
+
+                    off.x += step_.x;
+                    ++gpu;
+                }
+                off.y += step_.y;
+            }
+            off.z += step_.z;
+        }
+    }
+};
+
+// Identifies launches that share the same decomposition among GPUs
+struct launch_plan_key {
+    const void *kernel;
+    dim3 grid;
+    dim3 block;
+    size_t shared;
+    cudaStream_t stream;
+    unsigned dims;
+    unsigned partition;
+    unsigned procs;
+    bool transposeXY;
+
+    bool operator==(const launch_plan_key &key) const
+    {
+        return kernel == key.kernel &&
+               grid.x  == key.grid.x  && grid.y  == key.grid.y  && grid.z  == key.grid.z &&
+               block.x == key.block.x && block.y == key.block.y && block.z == key.block.z &&
+               shared == key.shared && stream == key.stream &&
+               dims == key.dims && partition == key.partition && procs == key.procs &&
+               transposeXY == key.transposeXY;
+    }
+};
+
+/**
+ * Decomposition of a kernel launch among GPUs. Computed once for every
+ * launch_plan_key and reused by all the launches with the same key
+ */
+struct launch_plan {
+    struct tile {
+        unsigned gpu;
+        // Global offset of the tile
+        dim3 off;
+        // Grid used to launch the tile
+        dim3 grid;
+    };
+
+    unsigned gpus;
+    dim3 total_grid;
+    // GPUs in the GPU grid, including those with empty tiles
+    std::vector<unsigned> activeGPUs;
+    // Non-empty tiles
+    std::vector<tile> tiles;
+
+    launch_plan(const grid_tiling &tiling, bool transposeXY) :
+        gpus(tiling.get_gpus()),
+        total_grid(tiling.get_total_grid())
+    {
+        tiling.for_each_tile([&](unsigned gpu, dim3 off, dim3 local)
+        {
+            if (local.z > 0 && local.y > 0 && local.x > 0) {
+                if (transposeXY) {
+                    std::swap(local.x, local.y);
+                }
+                tiles.push_back(tile{gpu, off, local});
+            }
+
+            activeGPUs.push_back(gpu);
+        });
+    }
+};
+
+using launch_plan_ptr = std::shared_ptr<const launch_plan>;
+
+/**
+ * Look up a launch plan in the cache of the calling thread
+ * @param key Key of the launch
+ * @return The plan, or nullptr if it is not cached
+ */
+launch_plan_ptr find_launch_plan(const launch_plan_key &key);
+
+/**
+ * Store a launch plan in the cache of the calling thread. The cache is
+ * flushed when it reaches LAUNCH_CACHE_SIZE entries
+ * @param key Key of the launch
+ * @param plan Plan computed for the launch
+ */
+void insert_launch_plan(const launch_plan_key &key, launch_plan_ptr plan);
+
 template <unsigned Dims, typename R, typename... Args>
 class launcher_common {
-    static constexpr unsigned DimIdxX = 2 - (3 - Dims);
-    static constexpr unsigned DimIdxY = 1 - (3 - Dims);
-    static constexpr unsigned DimIdxZ = 0 - (3 - Dims);
-
     R(&f_)(Args...);
     const char *funName_;
     cuda_conf conf_;
-    unsigned gpus_;
-    bool transposeXY_;
-    std::vector<unsigned> gpuGrid_;
+    launch_plan_ptr plan_;
 
 protected:
-    std::vector<coherence_info> coherentParams_;
-    std::vector<unsigned> activeGPUs_;
+    using my_arguments = argument_manager<Args...>;
+    using coherent_params = typename my_arguments::coherent_params;
+
+    coherent_params coherentParams_;
+    // Events recorded after the kernels of the last execution
+    std::vector<launch_event_ptr> events_;
 
 private:
     static void
-    set_args_current_gpu(const std::vector<coherence_info> &objects, unsigned gpu)
+    set_args_current_gpu(const coherent_params &objects, unsigned gpu)
     {
         // Set current GPU in all coherent objects
         for (auto object : objects) {
@@ -317,91 +630,87 @@ private:
     }
 
     static void
-    release_args(const std::vector<coherence_info> &objects, const std::vector<unsigned> &gpus)
+    release_args(const coherent_params &objects, const std::vector<unsigned> &gpus)
     {
+        // The arguments are protected together once all of them are released
+        protection_batch batch;
         for (auto object : objects) {
             object.first->get_coherence_policy().release(gpus, object.second);
         }
     }
 
     static void
-    acquire_args(const std::vector<coherence_info> &objects)
+    acquire_args(const coherent_params &objects)
     {
         for (auto object : objects) {
             object.first->get_coherence_policy().acquire();
         }
     }
 
-protected:
-    using my_arguments = argument_manager<Args...>;
+    static void
+    wait_args(const coherent_params &objects, cudaStream_t stream)
+    {
+        for (auto object : objects) {
+            object.first->get_coherence_policy().get_dependencies().wait(stream, object.second == access_intent::read);
+        }
+    }
 
-    launcher_common(R(&f)(Args...), const char *funName, const cuda_conf &conf, compute_conf<Dims> gpuConf, bool transposeXY) :
-        f_(f),
-        funName_(funName),
-        conf_(conf),
-        transposeXY_(transposeXY)
+    static void
+    record_args(const coherent_params &objects, const std::vector<launch_event_ptr> &events)
+    {
+        for (auto object : objects) {
+            object.first->get_coherence_policy().get_dependencies().record(events, object.second == access_intent::read);
+        }
+    }
+
+protected:
+    static unsigned
+    get_gpus(const compute_conf<Dims> &gpuConf)
     {
         if (gpuConf.procs > system::gpu_count()) {
             printf("WARNING: # requested GPUs > # installed GPUs\n");
         }
         // TODO: use peer GPUS for those array implementations that require remote access
         if (gpuConf.procs == 0) {
-            gpus_ = system::gpu_count();
+            return system::gpu_count();
         } else {
-            gpus_ = std::min(gpuConf.procs, system::gpu_count());
-        }
-
-        init_streams(gpus_);
-
-        unsigned partDims = utils::count(gpuConf.info, true);
-
-        auto factorsGPUs = utils::get_factors(gpus_);
-        if (gpus_ == 1) {
-            factorsGPUs.push_back(1);
-        }
-        utils::sort(factorsGPUs, std::greater<unsigned>());
-
-        unsigned j = 0;
-        for (unsigned i : utils::make_range(Dims)) {
-            unsigned partition = 1;
-            if (gpuConf.info[i]) {
-                auto pos = factorsGPUs.begin() + j;
-                size_t inc = (j == 0)? factorsGPUs.size() - partDims + 1: 1;
-
-                partition = std::accumulate(pos, pos + inc, 1, std::multiplies<unsigned>());
-                j += inc;
-            }
-
-            gpuGrid_.push_back(partition);
+            return std::min(gpuConf.procs, system::gpu_count());
         }
     }
 
-    std::tuple<dim3, dim3> compute_tiles()
+    static launch_plan_ptr
+    get_plan(R(&f)(Args...), const cuda_conf &conf, const compute_conf<Dims> &gpuConf, bool transposeXY)
     {
-        dim3 step{0, 0, 0};
-        dim3 grid{1, 1, 1};
+        unsigned partition = 0;
+        for (unsigned i : utils::make_range(Dims)) {
+            if (gpuConf.info[i])
+                partition |= 1u << i;
+        }
 
-        dim3 total_grid = conf_.grid;
+        launch_plan_key key{(const void *) f, conf.grid, conf.block, conf.shared, conf.stream,
+                            Dims, partition, gpuConf.procs, transposeXY};
 
-        if (Dims > 2) {
-            grid.z = utils::div_ceil(total_grid.z, gpuGrid_[DimIdxZ]);
-            if (gpuGrid_[DimIdxZ] > 1) {
-                step.z = grid.z;
-            }
-        }
-        if (Dims > 1) {
-            grid.y = utils::div_ceil(total_grid.y, gpuGrid_[DimIdxY]);
-            if (gpuGrid_[DimIdxY] > 1) {
-                step.y = grid.y;
-            }
+        launch_plan_ptr plan;
+        if (LAUNCH_CACHE) {
+            plan = find_launch_plan(key);
+            if (plan) return plan;
         }
 
-        grid.x = utils::div_ceil(total_grid.x, gpuGrid_[DimIdxX]);
-        if (gpuGrid_[DimIdxX] > 1) {
-            step.x = grid.x;
+        plan = std::make_shared<launch_plan>(grid_tiling{get_gpus(gpuConf), gpuConf, conf.grid}, transposeXY);
+        if (LAUNCH_CACHE) {
+            insert_launch_plan(key, plan);
         }
 
-        return std::make_tuple(step, grid);
+        return plan;
+    }
+
+    launcher_common(R(&f)(Args...), const char *funName, const cuda_conf &conf, compute_conf<Dims> gpuConf, bool transposeXY) :
+        f_(f),
+        funName_(funName),
+        conf_(conf),
+        plan_(get_plan(f, conf, gpuConf, transposeXY))
+    {
+        init_streams(plan_->gpus);
     }
 
     template <typename... ArgsPassed>
@@ -410,17 +719,10 @@ protected:
     {
         static_assert(sizeof...(Args) == sizeof...(ArgsPassed),
                       "Wrong number of passed arguments to the kernel");
-        dim3 total_grid = conf_.grid;
-
-        DEBUG("GPUS: %u", gpus_);
-        DEBUG("orig: %zd %zd %zd", total_grid.z, total_grid.y, total_grid.x);
-
-        dim3 step;
-        dim3 grid;
-
-        std::tie(step, grid) = compute_tiles();
+        dim3 total_grid = plan_->total_grid;
 
-        DEBUG("step: %zd %zd %zd", step.z, step.y, step.x);
+        DEBUG("GPUS: %u", plan_->gpus);
+        DEBUG("orig: %u %u %u", total_grid.z, total_grid.y, total_grid.x);
 
         if (CUDARRAYS_COMPILER_INFO) {
             // TODO: implement
@@ -428,155 +730,95 @@ protected:
             // my_arguments::compiler_layout_args(total_grid, VALID_VAL_MAX(arg));
         }
 
-        my_arguments::parse_args(std::forward<ArgsPassed>(args2)...);
-
-        coherentParams_ = my_arguments::CoherentParams;
-
-        activeGPUs_.clear();
+        my_arguments::parse_args(coherentParams_, std::forward<ArgsPassed>(args2)...);
 
-        for (unsigned i : utils::make_range(gpus_)) {
-            cudaError_t err = cudaSetDevice(1);
-            ASSERT(err == cudaSuccess);
-            err = cudaDeviceSynchronize();
-            ASSERT(err == cudaSuccess);
-        }
+        events_.clear();
+        events_.reserve(plan_->tiles.size());
 
-        unsigned gpu = 0;
-        dim3 off{0, 0, 0};
-        for (unsigned i : utils::make_range(Dims > 2? gpuGrid_[DimIdxZ]: 1)) {
-            off.y = 0;
-            for (unsigned j : utils::make_range(Dims > 1? gpuGrid_[DimIdxY]: 1)) {
-                off.x = 0;
-                for (unsigned k : utils::make_range(gpuGrid_[DimIdxX])) {
-                    dim3 local = grid;
-                    DEBUG("local: %zd %zd %zd", local.z, local.y, local.x);
-                    DEBUG("off: %zd %zd %zd", off.z, off.y, off.x);
-
-                    if (off.z + step.z > total_grid.z) {
-                        if (off.z <= total_grid.z)
-                            local.z = total_grid.z - off.z;
-                        else
-                            local.z = 0;
-                    } else if (off.y + step.y > total_grid.y) {
-                        if (off.y <= total_grid.y)
-                            local.y = total_grid.y - off.y;
-                        else
-                            local.y = 0;
-                    } else if (off.x + step.x > total_grid.x) {
-                        if (off.x <= total_grid.x)
-                            local.x = total_grid.x - off.x;
-                        else
-                            local.x = 0;
-                    }
+        update_constants(*plan_);
 
-                    if (local.z > 0 && local.y > 0 && local.x > 0) {
-                        cudaError_t err = cudaSetDevice(1);
-                        ASSERT(err == cudaSuccess);
+        release_args(coherentParams_, plan_->activeGPUs);
 
-                        DEBUG("gpu %zd: %zd %zd %zd", gpu, i, j, k);
-                        DEBUG("grid: %zd %zd %zd", local.z, local.y, local.x);
+        enqueue_tiles(f_, conf_, *plan_, my_arguments::Params, coherentParams_, events_);
 
-                        update_gpu_global_grid(total_grid);
-                        update_gpu_offset(off);
-                    }
+        return true;
+    }
 
-                    activeGPUs_.push_back(gpu);
+    static void
+    update_constants(const launch_plan &plan)
+    {
+        for (auto &tile : plan.tiles) {
+            cudaError_t err = cudaSetDevice(1);
+            ASSERT(err == cudaSuccess);
 
-                    off.x += step.x;
-                    ++gpu;
-                }
-                off.y += step.y;
-            }
-            off.z += step.z;
+            update_gpu_constants(plan.total_grid, tile.off);
         }
+    }
 
-        release_args(coherentParams_, activeGPUs_);
-
-        gpu = 0;
-        off.z = 0;
-        for (unsigned i : utils::make_range(Dims > 2? gpuGrid_[DimIdxZ]: 1)) {
-            off.y = 0;
-            for (unsigned j : utils::make_range(Dims > 1? gpuGrid_[DimIdxY]: 1)) {
-                off.x = 0;
-                for (unsigned k : utils::make_range(gpuGrid_[DimIdxX])) {
-                    dim3 local = grid;
-                    DEBUG("local: %zd %zd %zd", local.z, local.y, local.x);
-                    DEBUG("off: %zd %zd %zd", off.z, off.y, off.x);
-
-                    if (off.z + step.z > total_grid.z) {
-                        if (off.z <= total_grid.z)
-                            local.z = total_grid.z - off.z;
-                        else
-                            local.z = 0;
-                    } else if (off.y + step.y > total_grid.y) {
-                        if (off.y <= total_grid.y)
-                            local.y = total_grid.y - off.y;
-                        else
-                            local.y = 0;
-                    } else if (off.x + step.x > total_grid.x) {
-                        if (off.x <= total_grid.x)
-                            local.x = total_grid.x - off.x;
-                        else
-                            local.x = 0;
-                    }
+    /**
+     * Enqueue the kernels of a launch in the GPUs of its plan. Kernels only
+     * wait for the previous launches that access the same arrays
+     * @param params Addresses of the kernel arguments
+     * @param objects Coherent objects passed to the kernel
+     * @param events Output: events recorded after the kernels
+     */
+    static void
+    enqueue_tiles(R(&f)(Args...), const cuda_conf &conf, const launch_plan &plan, void **params,
+                  const coherent_params &objects, std::vector<launch_event_ptr> &events)
+    {
+        for (auto &tile : plan.tiles) {
+            unsigned gpu = tile.gpu;
 
-                    if (local.z > 0 && local.y > 0 && local.x > 0) {
-                        cudaError_t err = cudaSetDevice(1);
-                        ASSERT(err == cudaSuccess);
-                        DEBUG("gpu %zd: %zd %zd %zd", gpu, i, j, k);
-                        DEBUG("grid: %zd %zd %zd", local.z, local.y, local.x);
+            cudaError_t err = cudaSetDevice(1);
+            ASSERT(err == cudaSuccess);
+            DEBUG("gpu %u grid: %u %u %u", gpu, tile.grid.z, tile.grid.y, tile.grid.x);
 
-                        if (transposeXY_) {
-                            std::swap(local.x, local.y);
-                        }
+            // Set arguments
+            set_args_current_gpu(objects, gpu);
 
-                        // Set arguments
-                        set_args_current_gpu(coherentParams_, gpu);
+            // Only wait for the previous launches that access the same arrays
+            cudaStream_t stream = get_launch_stream(gpu);
+            wait_args(objects, stream);
 
-                        err = cudaEventRecord(EventsBegin[gpu], StreamsIn[gpu]);
-                        ASSERT(err == cudaSuccess);
+            err = cudaEventRecord(EventsBegin[gpu], stream);
+            ASSERT(err == cudaSuccess);
 
 #if 0
 // #ifdef CUDARRAYS_TRACE
-                        if (funName_.size() == 0) {
-                            FATAL("You must provide a function name");
-                            abort();
-                        }
-                        static int kernelCount = 0;
-                        std::stringstream path;
-                        path << "trace-";
-                        path << funName_ << "-";
-                        path << kernelCount++;
-
-                        std::ofstream out(path.str());
-                        TRACER_DRIVER driver(local, block);
-#endif
-                        err = cudaLaunchKernel((const char *)(const void *) f_,
-                                               local, conf_.block,
-                                               my_arguments::Params,
-                                               conf_.shared,
-                                               StreamsIn[gpu]);
-                        ASSERT(err == cudaSuccess);
-
-                        err = cudaEventRecord(EventsEnd[gpu], StreamsIn[gpu]);
-                        ASSERT(err == cudaSuccess);
-                    }
-                    off.x += step.x;
-                    ++gpu;
-                }
-                off.y += step.y;
+            if (funName_.size() == 0) {
+                FATAL("You must provide a function name");
+                abort();
             }
-            off.z += step.z;
+            static int kernelCount = 0;
+            std::stringstream path;
+            path << "trace-";
+            path << funName_ << "-";
+            path << kernelCount++;
+
+            std::ofstream out(path.str());
+            TRACER_DRIVER driver(local, block);
+#endif
+            err = cudaLaunchKernel((const char *)(const void *) f,
+                                   tile.grid, conf.block,
+                                   params,
+                                   conf.shared,
+                                   stream);
+            ASSERT(err == cudaSuccess);
+
+            auto end = make_launch_event();
+            err = cudaEventRecord(end->event, stream);
+            ASSERT(err == cudaSuccess);
+            events.push_back(end);
         }
 
-        return true;
+        record_args(objects, events);
     }
 
 public:
-    static bool wait(const std::vector<unsigned> &activeGPUs, const std::vector<coherence_info> &coherentParams)
+    static bool wait(const std::vector<launch_event_ptr> &events, const coherent_params &coherentParams)
     {
-        for (unsigned i : activeGPUs) {
-            cudaError_t err = cudaEventSynchronize(EventsEnd[i]);
+        for (auto &e : events) {
+            cudaError_t err = cudaEventSynchronize(e->event);
             ASSERT(err == cudaSuccess);
         }
 
@@ -584,6 +826,78 @@ public:
 
         return true;
     }
+
+private:
+    // Launch recorded in a launch_sequence. Coherence is handled by the
+    // sequence
+    class sequence_step :
+        public launch_sequence::step {
+        R(&f_)(Args...);
+        cuda_conf conf_;
+        launch_plan_ptr plan_;
+        coherent_params objects_;
+        std::array<void *, sizeof...(Args)> params_;
+        std::vector<launch_event_ptr> events_;
+
+    public:
+        sequence_step(R(&f)(Args...), const cuda_conf &conf, launch_plan_ptr plan, const coherent_params &objects) :
+            f_(f),
+            conf_(conf),
+            plan_(plan),
+            objects_(objects)
+        {
+            // Parameters point to the arguments passed to the sequence
+            for (unsigned i = 0; i < sizeof...(Args); ++i)
+                params_[i] = my_arguments::Params[i];
+
+            events_.reserve(plan_->tiles.size());
+        }
+
+        launch_sequence::backend get_backend() const override
+        {
+            return launch_sequence::backend::GPU;
+        }
+
+        bool enqueue() override
+        {
+            events_.clear();
+
+            update_constants(*plan_);
+            enqueue_tiles(f_, conf_, *plan_, params_.data(), objects_, events_);
+
+            return true;
+        }
+
+        void wait() override
+        {
+            for (auto &e : events_) {
+                cudaError_t err = cudaEventSynchronize(e->event);
+                ASSERT(err == cudaSuccess);
+            }
+        }
+    };
+
+public:
+    /**
+     * Record the launch in a sequence instead of executing it
+     * @param seq Sequence
+     * @param args2 Arguments of the kernel, bound by reference
+     */
+    template <typename... ArgsPassed>
+    void
+    record(launch_sequence &seq, ArgsPassed &...args2)
+    {
+        static_assert(sizeof...(Args) == sizeof...(ArgsPassed),
+                      "Wrong number of passed arguments to the kernel");
+
+        coherent_params objects;
+        my_arguments::parse_args(objects, args2...);
+
+        seq.add_step(std::unique_ptr<launch_sequence::step>(new sequence_step(f_, conf_, plan_, objects)));
+        for (auto &o : objects) {
+            seq.add_object(*o.first, o.second, plan_->activeGPUs);
+        }
+    }
 };
 
 template <unsigned Dims, typename R, typename... Args>
@@ -603,9 +917,7 @@ public:
     {
         auto ret = this->execute(std::forward<ArgsPassed>(args2)...);
         if (ret) {
-            auto gpus = this->activeGPUs_;
-            auto params = this->coherentParams_;
-            ret = common_parent::wait(gpus, params);
+            ret = common_parent::wait(this->events_, this->coherentParams_);
         }
 
         return ret;
@@ -628,9 +940,10 @@ public:
     {
         auto ret = this->execute(std::forward<ArgsPassed>(args2)...);
         if (ret) {
-            auto gpus = this->activeGPUs_;
-            auto params = this->coherentParams_;
-            return std::async(std::launch::async, [=]() { return common_parent::wait(gpus, params); });
+            // The events are moved and the coherent objects copied by value
+            // into the state of the task
+            return std::async(std::launch::async, &common_parent::wait,
+                              std::move(this->events_), this->coherentParams_);
         } else {
             auto task = std::packaged_task<bool()>([]() { return false; });
             task();
@@ -30,11 +30,24 @@
 #ifndef CUDARRAYS_LAUNCH_CPU_HPP_
 #define CUDARRAYS_LAUNCH_CPU_HPP_
 
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <cxxabi.h>
 
 #include "common.hpp"
 #include "dynarray.hpp"
+#include "gpu.cuh"
+#include "launch.hpp"
+#include "launch_sequence.hpp"
+
+#include "detail/cpu/block.hpp"
+#include "detail/cpu/block_order.hpp"
+#include "detail/cpu/topology.hpp"
+#include "detail/cpu/worker_pool.hpp"
 
 extern "C"
 int cuda_grid_get_size_x();
@@ -66,120 +79,478 @@ int cuda_thread_get_idx_z();
 
 void cuda_block_synchronize();
 
+extern "C"
+void *cuda_block_get_shared_memory();
+
 namespace cudarrays {
 
-struct cuda_conf :
-    protected std::tuple<dim3, dim3, size_t, cudaStream_t> {
-    using parent_tuple = std::tuple<dim3, dim3, size_t, cudaStream_t>;
+void
+init_grid(dim3 grid, dim3 block);
+
+namespace detail {
+
+// Views are copied for every emulated thread. Make them non-owning so that the
+// copies do not hammer the shared reference counters from all the workers
+template <typename T>
+static inline auto
+cpu_drop_ownership(T &arg, int) -> decltype(arg.drop_ownership(), void())
+{
+    arg.drop_ownership();
+}
 
-    cuda_conf(dim3 grid, dim3 block) :
-        parent_tuple(grid, block, 0, 0)
+template <typename T>
+static inline void
+cpu_drop_ownership(T &, long)
+{
+}
+
+// Update the copy of an argument held by a recorded launch. Views always refer
+// to the same array, so they are only copied when the launch is recorded
+template <typename T>
+static inline auto
+cpu_refresh_arg(T &dst, const T &, int) -> decltype(dst.drop_ownership(), void())
+{
+}
+
+template <typename T>
+static inline void
+cpu_refresh_arg(T &dst, const T &src, long)
+{
+    dst = src;
+}
+
+template <typename Selector>
+struct cpu_kernel_caller;
+
+template <unsigned ...Vals>
+struct cpu_kernel_caller<SEQ_WITH_TYPE(unsigned, Vals...)> {
+    template <typename... T>
+    static inline void
+    prepare(std::tuple<T...> &args)
     {
+        int dummy[] = { 0, (cpu_drop_ownership(std::get<Vals>(args), 0), 0)... };
+        (void) dummy;
     }
 
-    dim3 get_grid() const
+    template <typename... T, typename... U>
+    static inline void
+    refresh(std::tuple<T...> &args, const std::tuple<U &...> &src)
     {
-        return std::get<0>(*this);
+        int dummy[] = { 0, (cpu_refresh_arg(std::get<Vals>(args), std::get<Vals>(src), 0), 0)... };
+        (void) dummy;
     }
 
-    dim3 get_block() const
+    template <typename F, typename... T>
+    static inline void
+    call(F &f, std::tuple<T...> &args)
     {
-        return std::get<1>(*this);
+        f(std::get<Vals>(args)...);
     }
 };
 
-template <typename... Args>
-struct argument_manager {
-    template <unsigned Idx, typename T>
-    static void
-    set_args(T &arg)
-    {
-        using Type = typename std::tuple_element<Idx,
-                                                 std::tuple<Args...>>::type;
+}
+
+/**
+ * Completion of a kernel launched on the CPU. Polling is wait-free
+ */
+class launch_cpu_future {
+    std::vector<cpu::worker_pool::job_handle> jobs_;
+
+public:
+    // Execution times of a launch, in milliseconds
+    struct times {
+        // From the launch to the completion of the last block
+        float wall;
+        // Execution time of each virtual device
+        std::vector<float> devices;
+        // Time spent executing blocks of the launch by each worker of the pool
+        std::vector<float> busy;
+    };
 
-        //std::cout << abi::__cxa_demangle(typeid(Type).name(), 0, 0, 0) << std::endl;
-        static_assert(std::is_cuda_convertible<T, Type>::value == true,
-                      "Types are not compatible");
+    launch_cpu_future() = default;
+
+    explicit launch_cpu_future(std::vector<cpu::worker_pool::job_handle> jobs) :
+        jobs_(std::move(jobs))
+    {
     }
 
-    template <unsigned Idx, typename T, typename... Args2>
-    static void
-    set_args(T &arg, Args2&... args2)
+    /**
+     * Check whether the launch has completed without blocking
+     * @return true if all the blocks of the grid have been executed
+     */
+    bool ready() const
     {
-        using Type = typename std::tuple_element<Idx,
-                                                 std::tuple<Args...>>::type;
+        for (auto &j : jobs_) {
+            if (!cpu::worker_pool::finished(j)) return false;
+        }
+        return true;
+    }
 
-        //std::cout << abi::__cxa_demangle(typeid(Type).name(), 0, 0, 0) << std::endl;
-        static_assert(std::is_cuda_convertible<T, Type>::value == true,
-                      "Types are not compatible");
+    void wait() const
+    {
+        for (auto &j : jobs_)
+            cpu::worker_pool::get().wait(j);
     }
 
-    template <typename... Args2>
-    static void
-    set_args(Args2&... args2)
+    /**
+     * Wait for the completion of the launch
+     * @return Execution times of the launch
+     */
+    times get() const
     {
-        set_args<0, Args2...>(args2...);
+        wait();
+
+        times ret;
+        ret.wall = 0.f;
+        ret.busy.assign(cpu::worker_pool::get().size(), 0.f);
+        for (auto &j : jobs_) {
+            auto jobTimes = cpu::worker_pool::get_times(j);
+
+            ret.wall = std::max(ret.wall, jobTimes.wall);
+            ret.devices.push_back(jobTimes.wall);
+            for (unsigned w = 0; w < jobTimes.busy.size(); ++w)
+                ret.busy[jobTimes.first + w] += jobTimes.busy[w];
+        }
+
+        return ret;
     }
 };
 
-void
-init_grid(dim3 grid, dim3 block);
-
+/**
+ * Executes kernels compiled by the host compiler on the CPU. Blocks are
+ * distributed across the threads of cpu::worker_pool and the CUDA threads of
+ * each block are executed as fibers by the worker that owns the block (see
+ * cpu::run_block).
+ * The grid is split in tiles among virtual devices exactly like the GPU
+ * launchers do (see grid_tiling). Each virtual device executes its tile on its
+ * own group of workers, bound to its own core set, and its blocks see the
+ * global block indexes and grid dimensions
+ */
 template <typename R, typename... Args>
 class launcher_cpu {
     R(&f_)(Args...);
     const char *funName_;
     cuda_conf conf_;
+    unsigned lanes_;
+    cpu::block_order order_;
+    grid_tiling tiling_;
+    bool transposeXY_;
+
+    using kernel_caller = detail::cpu_kernel_caller<SEQ_GEN_INC_WITH_TYPE(unsigned, unsigned(sizeof...(Args)))>;
+
+    // Kernel and arguments of a launch. Kept alive by the blocks of the grid
+    // until the launch completes
+    template <typename Tuple>
+    struct thread_closure {
+        R(*f)(Args...);
+        Tuple args;
+    };
+
+    template <typename Tuple>
+    static void
+    run_thread(void *arg)
+    {
+        auto &closure = *static_cast<thread_closure<Tuple> *>(arg);
+        kernel_caller::call(closure.f, closure.args);
+    }
+
+    template <typename... ArgsPassed>
+    static void
+    check_args(ArgsPassed &...args2)
+    {
+        int dummy[] = { 0, (check_arg_type<Args>::against(args2), 0)... };
+        (void) dummy;
+    }
+
+    template <unsigned Dims>
+    static unsigned
+    get_devices(const compute_conf<Dims> &gpuConf)
+    {
+        // By default, one virtual device per NUMA node
+        return gpuConf.procs == 0? cpu::get_numa_nodes(): gpuConf.procs;
+    }
+
+    // Non-empty tile of the grid executed by a virtual device
+    struct device_tile {
+        unsigned device;
+        dim3 off;
+        dim3 local;
+        std::shared_ptr<const std::vector<size_t>> sequence;
+    };
+
+    std::vector<device_tile>
+    get_tiles() const
+    {
+        std::vector<device_tile> tiles;
+
+        tiling_.for_each_tile([&](unsigned gpu, dim3 off, dim3 local)
+        {
+            if (local.z == 0 || local.y == 0 || local.x == 0) return;
+
+            if (transposeXY_) {
+                std::swap(local.x, local.y);
+            }
+
+            DEBUG("Launch> device %u: %u %u %u", gpu, local.x, local.y, local.z);
+
+            tiles.push_back(device_tile{gpu, off, local, cpu::get_block_sequence(order_, local)});
+        });
+
+        return tiles;
+    }
+
+    // Submit one job per tile to the group of workers of its virtual device
+    template <typename Tuple>
+    std::vector<cpu::worker_pool::job_handle>
+    submit(const std::shared_ptr<thread_closure<Tuple>> &closure, const std::vector<device_tile> &tiles) const
+    {
+        dim3 grid  = conf_.grid;
+        dim3 block = conf_.block;
+        size_t shared = conf_.shared;
+        unsigned lanes = lanes_;
+
+        auto &pool = cpu::worker_pool::get();
+        auto groups = pool.partition(tiling_.get_gpus());
+
+        std::vector<cpu::worker_pool::job_handle> jobs;
+
+        for (auto &tile : tiles) {
+            dim3 off   = tile.off;
+            dim3 local = tile.local;
+            auto sequence = tile.sequence;
+
+            size_t blocks = size_t(local.x) * local.y * local.z;
+
+            jobs.push_back(pool.submit(blocks, [=](unsigned /*worker*/, size_t pos)
+            {
+                size_t id = sequence? (*sequence)[pos]: pos;
+
+                init_grid(grid, block);
+
+                blockIdx.x = off.x + unsigned(id % local.x);
+                blockIdx.y = off.y + unsigned((id / local.x) % local.y);
+                blockIdx.z = off.z + unsigned(id / (size_t(local.x) * local.y));
+
+                cpu::run_block(block, shared, lanes, &run_thread<Tuple>, closure.get());
+            }, groups[tile.device].first, groups[tile.device].workers));
+        }
+
+        return jobs;
+    }
+
+    // Launch recorded in a launch_sequence. Arguments that are not views are
+    // copied from the bound references at every replay
+    template <typename... ArgsPassed>
+    class sequence_step :
+        public launch_sequence::step {
+        using tuple_type = std::tuple<typename std::decay<ArgsPassed>::type...>;
+
+        launcher_cpu launcher_;
+        std::vector<device_tile> tiles_;
+        std::tuple<ArgsPassed &...> args_;
+        std::shared_ptr<thread_closure<tuple_type>> closure_;
+
+    public:
+        sequence_step(const launcher_cpu &launcher, ArgsPassed &...args2) :
+            launcher_(launcher),
+            tiles_(launcher.get_tiles()),
+            args_(args2...),
+            closure_(std::make_shared<thread_closure<tuple_type>>(thread_closure<tuple_type>{&launcher.f_,
+                                                                                              tuple_type{args2...}}))
+        {
+            kernel_caller::prepare(closure_->args);
+        }
+
+        launch_sequence::backend get_backend() const override
+        {
+            return launch_sequence::backend::CPU;
+        }
+
+        bool enqueue() override
+        {
+            kernel_caller::refresh(closure_->args, args_);
+
+            // Launches of the sequence are executed one after the other
+            launch_cpu_future(launcher_.submit(closure_, tiles_)).wait();
+
+            return true;
+        }
+
+        void wait() override
+        {
+        }
+    };
 
 public:
-    launcher_cpu(R(&f)(Args...), const cuda_conf &conf) :
+    template <unsigned Dims>
+    launcher_cpu(R(&f)(Args...), const cuda_conf &conf, compute_conf<Dims> gpuConf, bool transposeXY,
+                 unsigned lanes = 1) :
         f_(f),
         funName_(typeid(f).name()),
-        conf_(conf)
+        conf_(conf),
+        lanes_(lanes),
+        order_(cpu::get_default_block_order()),
+        tiling_(get_devices(gpuConf), gpuConf, conf.grid),
+        transposeXY_(transposeXY)
+    {
+    }
+
+    launcher_cpu(R(&f)(Args...), const cuda_conf &conf, unsigned lanes = 1) :
+        launcher_cpu(f, conf, compute_conf<3>{compute::none, 1}, false, lanes)
+    {
+    }
+
+    /**
+     * Select the order in which the blocks of the grid are executed
+     * @param order Block order
+     * @return This launcher
+     */
+    launcher_cpu &
+    set_block_order(cpu::block_order order)
+    {
+        order_ = order;
+        return *this;
+    }
+
+    /**
+     * Enqueue the execution of the kernel and return immediately. The arrays
+     * passed to the kernel must not be destroyed before the launch completes
+     * @return Future to poll or wait for the completion of the launch
+     */
+    template <typename... ArgsPassed>
+    launch_cpu_future
+    enqueue(ArgsPassed &&...args2)
+    {
+        static_assert(sizeof...(Args) == sizeof...(ArgsPassed),
+                      "Wrong number of passed arguments to the kernel");
+
+        DEBUG("Launch> orig: %u %u %u", conf_.grid.x, conf_.grid.y, conf_.grid.z);
+
+        check_args(args2...);
+
+        // Arguments are shared by all the workers
+        using tuple_type = std::tuple<typename std::decay<ArgsPassed>::type...>;
+        auto closure = std::make_shared<thread_closure<tuple_type>>(thread_closure<tuple_type>{&f_, tuple_type{args2...}});
+        kernel_caller::prepare(closure->args);
+
+        return launch_cpu_future(submit(closure, get_tiles()));
+    }
+
+    /**
+     * Record the launch in a sequence instead of executing it
+     * @param seq Sequence
+     * @param args2 Arguments of the kernel, bound by reference
+     */
+    template <typename... ArgsPassed>
+    void
+    record(launch_sequence &seq, ArgsPassed &...args2)
     {
+        static_assert(sizeof...(Args) == sizeof...(ArgsPassed),
+                      "Wrong number of passed arguments to the kernel");
+
+        check_args(args2...);
+
+        seq.add_step(std::unique_ptr<launch_sequence::step>(new sequence_step<ArgsPassed...>(*this, args2...)));
     }
 
-    template <typename... Args2>
+    /**
+     * Execute the kernel and wait for its completion
+     * @return Execution time of each virtual device in milliseconds
+     */
+    template <typename... ArgsPassed>
     std::vector<float>
-    operator()(Args2 &...args2)
-    {
-        size_t dimSize = 0;
-        std::vector<float> times;
-
-        dim3 grid  = conf_.get_grid();
-        dim3 block = conf_.get_block();
-
-        DEBUG("Launch> orig: %zd %zd %zd", grid.x, grid.y, grid.z);
-
-        using my_arguments = argument_manager<Args..., dim3, dim3>;
-        my_arguments::set_args(args2...);
-
-        for (int bz = 0; bz < grid.z; ++bz) {
-            for (int by = 0; by < grid.y; ++by) {
-                for (int bx = 0; bx < grid.x; ++bx) {
-                    for (int tz = 0; tz < block.z; ++tz) {
-                        for (int ty = 0; ty < block.y; ++ty) {
-                            for (int tx = 0; tx < block.x; ++tx) {
-                                f_(args2...);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    operator()(ArgsPassed &&...args2)
+    {
+        auto future = enqueue(std::forward<ArgsPassed>(args2)...);
 
-        return times;
+        return future.get().devices;
     }
 };
 
+/**
+ * CPU launcher whose invocations return immediately (see launcher_cpu::enqueue)
+ */
+template <typename R, typename... Args>
+class launcher_cpu_async :
+    public launcher_cpu<R, Args...> {
+    using parent = launcher_cpu<R, Args...>;
+public:
+    using parent::parent;
+
+    template <typename... ArgsPassed>
+    launch_cpu_future
+    operator()(ArgsPassed &&...args2)
+    {
+        return this->enqueue(std::forward<ArgsPassed>(args2)...);
+    }
+};
+
+/**
+ * Launch a kernel on the CPU. The grid is split among gpus virtual devices
+ * along the dimension dim of the grid (0: X, 1: Y, 2: Z, -1: no partitioning)
+ */
 template <typename R, typename... Args>
 launcher_cpu<R, Args...>
 launch_cpu(R(&f)(Args...), const cuda_conf &conf, unsigned gpus = 1, int dim = -1, bool transposeXY = false)
 {
-    // int status;
-    // char *realname = abi::__cxa_demangle(typeid(f).name(), 0, 0, &status);
-    // printf("Func: %s\n", typeid(f).name());
-    return launcher_cpu<R, Args...>(f, conf);
+    compute c = compute::none;
+    if (dim == 0)
+        c = compute::x;
+    else if (dim == 1)
+        c = compute::y;
+    else if (dim == 2)
+        c = compute::z;
+    else if (dim != -1)
+        FATAL("Invalid partition dimension: %d", dim);
+
+    return launcher_cpu<R, Args...>(f, conf, compute_conf<3>{c, gpus}, transposeXY);
+}
+
+/**
+ * Launch a kernel on the CPU. The grid is split among the virtual devices
+ * requested in gpuConf (0: one per NUMA node) like in launch
+ */
+template <unsigned DimsComp, typename R, typename... Args>
+launcher_cpu<R, Args...>
+launch_cpu(R(&f)(Args...), const cuda_conf &conf, compute_conf<DimsComp> gpuConf, bool transposeXY = false)
+{
+    return launcher_cpu<R, Args...>(f, conf, gpuConf, transposeXY);
+}
+
+/**
+ * Launch a kernel on the CPU asynchronously. Invocations of the returned
+ * launcher return a launch_cpu_future
+ */
+template <unsigned DimsComp, typename R, typename... Args>
+launcher_cpu_async<R, Args...>
+launch_cpu_async(R(&f)(Args...), const cuda_conf &conf, compute_conf<DimsComp> gpuConf, bool transposeXY = false)
+{
+    return launcher_cpu_async<R, Args...>(f, conf, gpuConf, transposeXY);
+}
+
+template <typename R, typename... Args>
+launcher_cpu_async<R, Args...>
+launch_cpu_async(R(&f)(Args...), const cuda_conf &conf)
+{
+    return launcher_cpu_async<R, Args...>(f, conf);
+}
+
+/**
+ * Launch a kernel on the CPU in lane mode. Each invocation of the kernel
+ * executes Lanes consecutive threads in X as SIMD lanes, so the kernel must be
+ * instantiated with a cpu::lanes<T, Lanes> index type and obtain its X index
+ * through thread_idx_x. Lanes beyond the X dimension of the block are masked
+ * out. Conditions on lane values (e.g. bounds guards) must enclose the code
+ * they protect, since they mask out the lanes that do not satisfy them (see
+ * cpu::lane_mask)
+ */
+template <unsigned Lanes, typename R, typename... Args>
+launcher_cpu<R, Args...>
+launch_cpu_lanes(R(&f)(Args...), const cuda_conf &conf)
+{
+    static_assert(Lanes > 0 && (Lanes & (Lanes - 1)) == 0, "The number of lanes must be a power of two");
+
+    return launcher_cpu<R, Args...>(f, conf, Lanes);
 }
 
 }
@@ -0,0 +1,149 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_LAUNCH_SEQUENCE_HPP_
+#define CUDARRAYS_LAUNCH_SEQUENCE_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "coherence.hpp"
+
+namespace cudarrays {
+
+/**
+ * Series of kernel launches recorded once and replayed many times. Recording
+ * resolves the decomposition of each launch and the addresses of its
+ * arguments. Replays only enqueue the kernels of each device and apply the
+ * coherence transitions once per array for the whole sequence: arrays are
+ * released before the first launch and acquired after the last one.
+ *
+ * Arguments are bound by reference: replays use the values that the
+ * arguments passed to add hold at the time of the replay, so they must
+ * outlive the sequence. The sequence is recorded with the launchers of a
+ * single backend (launch or launch_cpu), and launches are executed in
+ * recording order unless they do not access the same arrays.
+ *
+ * @code
+ * launch_sequence step;
+ * step.add(launch(jacobi_kernel, conf, gpus), B, A)
+ *     .add(launch(jacobi_kernel, conf, gpus), A, B);
+ * for (unsigned i = 0; i < iters; ++i)
+ *     step();
+ * @endcode
+ */
+class launch_sequence {
+public:
+    enum class backend {
+        GPU,
+        CPU
+    };
+
+    // Launch recorded in a sequence. Created by the launchers
+    class step {
+    public:
+        virtual ~step() {}
+
+        virtual backend get_backend() const = 0;
+
+        /**
+         * Enqueue the kernels of the launch
+         * @return false if the launch failed
+         */
+        virtual bool enqueue() = 0;
+
+        /**
+         * Wait for the completion of the kernels enqueued by the last call
+         * to enqueue
+         */
+        virtual void wait() = 0;
+    };
+
+    /**
+     * Record a launch at the end of the sequence. The kernel is not executed
+     * @param launcher Launcher returned by launch or launch_cpu
+     * @param args Arguments of the kernel, bound by reference
+     * @return This sequence
+     */
+    template <typename Launcher, typename... ArgsPassed>
+    launch_sequence &
+    add(Launcher &&launcher, ArgsPassed &...args)
+    {
+        launcher.record(*this, args...);
+        return *this;
+    }
+
+    /**
+     * Replay the launches of the sequence and wait for their completion
+     * @return false if any of the launches failed
+     */
+    bool operator()();
+
+    /**
+     * Number of launches in the sequence
+     */
+    size_t size() const
+    {
+        return steps_.size();
+    }
+
+    /**
+     * Append a recorded launch. Used by the launchers
+     * @param s Launch
+     */
+    void add_step(std::unique_ptr<step> s);
+
+    /**
+     * Register an access to a coherent object by the last recorded launch.
+     * Used by the launchers
+     * @param obj Object accessed by the launch
+     * @param intent Access of the launch to the object
+     * @param gpus GPUs on which the launch is executed
+     */
+    void add_object(coherent &obj, access_intent intent, const std::vector<unsigned> &gpus);
+
+private:
+    // Coherent object accessed by the sequence
+    struct object {
+        coherent *obj;
+        // Access of all the launches of the sequence
+        access_intent intent;
+        // GPUs of all the launches that access the object, sorted
+        std::vector<unsigned> gpus;
+    };
+
+    std::vector<std::unique_ptr<step>> steps_;
+    std::vector<object> objects_;
+};
+
+}
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
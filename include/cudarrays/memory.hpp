@@ -30,7 +30,11 @@
 #ifndef CUDARRAYS_MEMORY_HPP_
 #define CUDARRAYS_MEMORY_HPP_
 
+#include <cstdint>
 #include <functional>
+#include <string>
+
+#include "detail/utils/option.hpp"
 
 namespace cudarrays {
 
@@ -41,19 +45,148 @@ enum mem_access_type : int {
     MEM_READ_WRITE = MEM_READ | MEM_WRITE
 };
 
-// Handler takes a bool that says if the range is accessed for write
-using handler_fn = std::function<bool (bool)>;
+// Handler takes a bool that says if the range is accessed for write and the
+// faulting address
+using handler_fn = std::function<bool (bool, void *)>;
 
 static handler_fn no_handler = nullptr;
 
-void register_range(void *addr, size_t count);
+// Mechanism used to catch the invalid accesses to the registered ranges
+enum class fault_backend {
+    sigsegv     = 0, // mprotect and a process-wide SIGSEGV handler
+    userfaultfd = 1  // Linux userfaultfd, serviced by a dedicated thread
+};
+
+// Fault backend selected at initialization ("sigsegv" or "userfaultfd")
+extern utils::option<std::string> FAULT_BACKEND;
+
+const char *to_string(fault_backend backend);
+
+/**
+ * Obtain the fault backend in use. The userfaultfd backend falls back to the
+ * SIGSEGV one if the kernel does not support write-protect notifications.
+ * With the userfaultfd backend protections are applied to whole pages, and
+ * handlers run in the handler thread instead of the faulting one
+ * @return The fault backend
+ */
+fault_backend get_fault_backend();
+
+/**
+ * Register a range whose protection can be changed
+ * @param pageBytes Size of the pages that back the range, multiple of the
+ *                  system page size. 0 for the system page size
+ */
+void register_range(void *addr, size_t count, size_t pageBytes = 0);
 void unregister_range(void *addr);
 
+/**
+ * Check if an address belongs to a registered range. Parked ranges are not
+ * considered registered
+ */
+bool is_registered(const void *addr);
+
+/**
+ * Keep the ranges of a mapping registered when they are unregistered. Kept
+ * ranges are parked: their handlers are removed and their protection is reset,
+ * but they stay registered with the fault backend, and registering the same
+ * range again reuses them without system calls
+ * @param keep false to stop keeping the ranges of the mapping and remove its
+ *             parked ranges, before the mapping is unmapped
+ */
+void keep_ranges(void *addr, size_t count, bool keep);
+
+/**
+ * Change the protection of a registered range. Can be called from handlers
+ * @param addr Start of the range or of a subset of its pages
+ * @param count Size in bytes of the range or of the subset of its pages
+ * @param fn Handler called from the fault backend on invalid accesses to the
+ *           range. An empty handler keeps the current one
+ */
 void protect_range(void *addr, size_t count, mem_access_type access_type, handler_fn fn = no_handler);
 
+/**
+ * Replace the pages of a part of a registered range with the pages of a
+ * buffer and change their protection. Threads that access the part either
+ * fault or see the new contents, never a partial copy. Can be called from
+ * handlers
+ * @param addr Page-aligned start of the part
+ * @param src Page-aligned buffer, which is left zero-filled
+ * @param count Size in bytes of the part, multiple of the page size
+ * @return false if the pages cannot be replaced: the range is not modified
+ */
+bool move_range(void *addr, void *src, size_t count, mem_access_type access_type);
+
+// Loads (store == false) or writes back (store == true) a tile of a windowed
+// range. The offset is relative to the page-aligned start of the range
+using tile_io_fn = std::function<bool (bool store, void *addr, size_t offset, size_t count)>;
+
+/**
+ * Keep resident only a window of the tiles of a registered range. Tiles that
+ * are not resident are protected with MEM_NONE and loaded on their first
+ * access. To make room, the resident tile faulted least recently is evicted:
+ * written back if it has been written, and its pages released. Protection
+ * changes of the range apply to the resident tiles, and to the rest when they
+ * are loaded. The current contents of the range are discarded. Only supported
+ * by the SIGSEGV backend, for ranges of system pages
+ * @param tileBytes Size of the tiles, multiple of the system page size
+ * @param budgetBytes Bytes of the range kept resident. At least one tile
+ * @param io Loads and writes back the tiles. Called from the fault handler,
+ *           with the window locked
+ * @return false if the range cannot be windowed
+ */
+bool window_range(void *addr, size_t tileBytes, size_t budgetBytes, tile_io_fn io);
+
+/**
+ * Write back the resident tiles of a windowed range that have been written
+ * @return false if the range is not windowed
+ */
+bool flush_window(void *addr);
+
+// Apply together the protection changes deferred by a protection_batch
+extern utils::option<bool> PROTECT_BATCHING;
+
+/**
+ * Batch of the protection changes of the calling thread. While a batch is
+ * open, changes to MEM_NONE or MEM_READ are deferred until the outermost batch
+ * is closed, and then adjacent pages changed to the same protection are
+ * applied with a single system call. Other changes, and the removal or
+ * replacement of the pages of a range, apply the deferred changes first. The
+ * thread sees the previous protection of the deferred ranges until then
+ */
+class protection_batch {
+    bool active_;
+
+public:
+    protection_batch();
+    ~protection_batch();
+
+    protection_batch(const protection_batch &) = delete;
+    protection_batch &operator=(const protection_batch &) = delete;
+};
+
+// Activity of the fault backend since initialization
+struct fault_stats {
+    uint64_t readFaults;   // Accesses not allowed by the protection of a range
+    uint64_t writeFaults;
+    uint64_t populated;    // Pages populated on first touch (userfaultfd backend)
+    uint64_t handlerNs;    // Time spent in the handlers of the ranges
+    uint64_t protectCalls; // Protection changes issued to the kernel
+    uint64_t tileLoads;    // Tiles of windowed ranges loaded, written back and evicted
+    uint64_t tileStores;
+    uint64_t tileEvictions;
+};
+
+fault_stats get_fault_stats();
+
 void handler_sigsegv_overload();
 void handler_sigsegv_restore();
 
+/**
+ * Install/uninstall the fault backend selected through CUDARRAYS_FAULT_BACKEND
+ */
+void handler_faults_install();
+void handler_faults_uninstall();
+
 }
 
 #endif
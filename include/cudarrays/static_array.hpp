@@ -36,6 +36,10 @@
 
 #include "detail/dynarray/indexing.hpp"
 
+#ifndef __CUDACC__
+#include "detail/cpu/block.hpp"
+#endif
+
 namespace cudarrays {
 
 enum memory_space {
@@ -70,6 +74,12 @@ public:
 #ifdef __CUDA_ARCH__
         __shared__ T data[Elems] __align__(Align::alignment * sizeof(T));
         return data + Align::get_offset();
+#elif !defined(__CUDACC__)
+        // Kernel executed by launcher_cpu: storage comes from the shared memory arena of the block
+        static thread_local void *data = nullptr;
+        static thread_local unsigned long block = 0;
+        return static_cast<T *>(cpu::shared_alloc(Elems * sizeof(T), Align::alignment * sizeof(T),
+                                                  data, block)) + Align::get_offset();
 #else
         return nullptr;
 #endif
@@ -0,0 +1,130 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/array_file.hpp"
+
+#include "cudarrays/detail/utils/log.hpp"
+
+namespace cudarrays {
+
+std::string
+to_string(const array_file_header &header)
+{
+    std::string ret = std::to_string(header.elemBytes) + "-byte elements, extents {";
+    for (unsigned dim = 0; dim < header.dims && dim < ARRAY_FILE_MAX_DIMS; ++dim)
+        ret += (dim > 0? ", ": "") + std::to_string(header.extents[dim]);
+    ret += "}, order {";
+    for (unsigned dim = 0; dim < header.dims && dim < ARRAY_FILE_MAX_DIMS; ++dim)
+        ret += (dim > 0? ", ": "") + std::to_string(header.order[dim]);
+    ret += "}, alignment " + std::to_string(header.alignment) + "+" + std::to_string(header.alignOffset);
+    return ret;
+}
+
+namespace detail {
+
+// Offset of the host copy: the first page after the header
+static uint64_t
+data_offset()
+{
+    uint64_t page = uint64_t(sysconf(_SC_PAGESIZE));
+    return utils::div_ceil(uint64_t(sizeof(array_file_header)), page) * page;
+}
+
+int
+array_file_open(const std::string &path, file_mode mode, array_file_header &header)
+{
+    int fd = open(path.c_str(), mode == file_mode::shared? O_RDWR: O_RDONLY);
+    if (fd < 0) {
+        INFO("array_file> Unable to open %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) || fstat(fd, &st) != 0) {
+        INFO("array_file> Unable to read the header of %s", path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    if (memcmp(header.magic, "CUDARRAY", sizeof(header.magic)) != 0 || header.version != 1 ||
+        header.dims == 0 || header.dims > ARRAY_FILE_MAX_DIMS ||
+        header.dataOffset % uint64_t(sysconf(_SC_PAGESIZE)) != 0 || header.dataOffset < sizeof(header)) {
+        INFO("array_file> %s does not hold an array", path.c_str());
+        close(fd);
+        return -1;
+    }
+
+    // Pages past the end of the file cannot be accessed
+    if (uint64_t(st.st_size) < header.dataOffset + header.dataBytes) {
+        INFO("array_file> %s is truncated: %zd bytes, %zd expected", path.c_str(),
+             size_t(st.st_size), size_t(header.dataOffset + header.dataBytes));
+        close(fd);
+        return -1;
+    }
+
+    DEBUG("array_file> %s: %s", path.c_str(), to_string(header).c_str());
+    return fd;
+}
+
+int
+array_file_create(const std::string &path, array_file_header &header)
+{
+    header.dataOffset = data_offset();
+
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        INFO("array_file> Unable to create %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    // The host copy is left as a hole, read as zeros
+    if (pwrite(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header)) ||
+        ftruncate(fd, off_t(header.dataOffset + header.dataBytes)) != 0) {
+        INFO("array_file> Unable to write %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,200 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <utility>
+
+#include "cudarrays/detail/cpu/block_order.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+utils::option<std::string> BLOCK_ORDER{"CUDARRAYS_CPU_BLOCK_ORDER", "raster"};
+utils::option<unsigned> BLOCK_TILE{"CUDARRAYS_CPU_BLOCK_TILE", 4};
+utils::option<unsigned> BLOCK_ORDER_CACHE_SIZE{"CUDARRAYS_CPU_BLOCK_ORDER_CACHE_SIZE", 64};
+
+static const char *BlockOrderNames[] = {
+    "raster",
+    "tiled",
+    "morton",
+    "hilbert"
+};
+
+bool
+parse_block_order(const std::string &name, block_order &order)
+{
+    for (unsigned i = 0; i < sizeof(BlockOrderNames) / sizeof(BlockOrderNames[0]); ++i) {
+        if (name == BlockOrderNames[i]) {
+            order = block_order(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+to_string(block_order order)
+{
+    return BlockOrderNames[unsigned(order)];
+}
+
+block_order
+get_default_block_order()
+{
+    block_order order = block_order::raster;
+    if (!parse_block_order(BLOCK_ORDER.value(), order))
+        FATAL("Invalid value for CUDARRAYS_CPU_BLOCK_ORDER: %s", BLOCK_ORDER.value().c_str());
+    return order;
+}
+
+// Interleave the bits of a 32-bit value with zeros
+static inline uint64_t
+spread_bits(uint32_t val)
+{
+    uint64_t x = val;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x <<  8)) & 0x00ff00ff00ff00ffull;
+    x = (x | (x <<  4)) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x <<  2)) & 0x3333333333333333ull;
+    x = (x | (x <<  1)) & 0x5555555555555555ull;
+    return x;
+}
+
+static inline uint64_t
+morton_key(uint32_t x, uint32_t y)
+{
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+// Distance of (x, y) along the Hilbert curve that fills a n x n square
+static inline uint64_t
+hilbert_key(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+static void
+append_curve(std::vector<size_t> &seq, block_order order, dim3 grid, size_t base)
+{
+    std::vector<std::pair<uint64_t, size_t>> keys;
+    keys.reserve(size_t(grid.x) * grid.y);
+
+    uint32_t n = 1;
+    while (n < std::max(grid.x, grid.y)) n *= 2;
+
+    for (unsigned y = 0; y < grid.y; ++y) {
+        for (unsigned x = 0; x < grid.x; ++x) {
+            uint64_t key = order == block_order::morton? morton_key(x, y):
+                                                         hilbert_key(n, x, y);
+            keys.emplace_back(key, base + size_t(y) * grid.x + x);
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    for (auto &key : keys)
+        seq.push_back(key.second);
+}
+
+static void
+append_tiled(std::vector<size_t> &seq, dim3 grid, size_t base)
+{
+    unsigned tile = std::max(1u, BLOCK_TILE.value());
+
+    for (unsigned ty = 0; ty < grid.y; ty += tile) {
+        for (unsigned tx = 0; tx < grid.x; tx += tile) {
+            for (unsigned y = ty; y < std::min(ty + tile, grid.y); ++y) {
+                for (unsigned x = tx; x < std::min(tx + tile, grid.x); ++x) {
+                    seq.push_back(base + size_t(y) * grid.x + x);
+                }
+            }
+        }
+    }
+}
+
+std::shared_ptr<const std::vector<size_t>>
+get_block_sequence(block_order order, dim3 grid)
+{
+    if (order == block_order::raster)
+        return nullptr;
+
+    using key_type = std::tuple<unsigned, unsigned, unsigned, unsigned>;
+    static std::map<key_type, std::shared_ptr<const std::vector<size_t>>> cache;
+    static std::mutex mutex;
+
+    key_type key{unsigned(order), grid.x, grid.y, grid.z};
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end())
+        return it->second;
+
+    auto seq = std::make_shared<std::vector<size_t>>();
+    seq->reserve(size_t(grid.x) * grid.y * grid.z);
+
+    for (unsigned z = 0; z < grid.z; ++z) {
+        size_t base = size_t(z) * grid.x * grid.y;
+        if (order == block_order::tiled)
+            append_tiled(*seq, grid, base);
+        else
+            append_curve(*seq, order, grid, base);
+    }
+
+    DEBUG("cpu> %s block order for grid %u %u %u", to_string(order), grid.x, grid.y, grid.z);
+
+    if (cache.size() >= BLOCK_ORDER_CACHE_SIZE)
+        cache.clear();
+    cache.emplace(key, seq);
+    return seq;
+}
+
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,324 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/memory.hpp"
+#include "cudarrays/detail/coherence/default.hpp"
+
+namespace cudarrays {
+
+utils::option<size_t> COHERENCE_FAULT_GRANULARITY{"CUDARRAYS_COHERENCE_FAULT_GRANULARITY", 64 * 1024};
+utils::option<bool> COHERENCE_DIRTY_TRACKING{"CUDARRAYS_COHERENCE_DIRTY_TRACKING", true};
+utils::option<size_t> COHERENCE_LOG{"CUDARRAYS_COHERENCE_LOG", 0};
+utils::option<bool> COHERENCE_EAGER_WRITEBACK{"CUDARRAYS_COHERENCE_EAGER_WRITEBACK", false};
+utils::option<bool> COHERENCE_STATS{"CUDARRAYS_COHERENCE_STATS", false};
+
+const char *
+to_string(access_intent intent)
+{
+    switch (intent) {
+    case access_intent::read:          return "read";
+    case access_intent::write_discard: return "write_discard";
+    case access_intent::read_write:    return "read_write";
+    case access_intent::accumulate:    return "accumulate";
+    };
+    abort();
+}
+
+const char *
+to_string(copy_state state)
+{
+    switch (state) {
+    case copy_state::invalid:  return "I";
+    case copy_state::shared:   return "S";
+    case copy_state::modified: return "M";
+    };
+    abort();
+}
+
+// State of the background transfers to the host. Never destroyed, so that
+// arrays destroyed at exit can still cancel their transfers. The thread is
+// started on first use
+struct writeback_state {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<default_coherence *> queue;
+    // Array whose part is being transferred
+    default_coherence *current = nullptr;
+    // The current array has been cancelled while its part was transferred
+    bool cancelled = false;
+    bool stop = false;
+    std::thread *thread = nullptr;
+};
+
+static writeback_state &
+get_writeback()
+{
+    static writeback_state *state = new writeback_state();
+    return *state;
+}
+
+static void
+writeback_main()
+{
+    writeback_state &wb = get_writeback();
+    std::unique_lock<std::mutex> lock(wb.mutex);
+
+    while (true) {
+        wb.cond.wait(lock, [&wb] { return wb.stop || !wb.queue.empty(); });
+        if (wb.stop) break;
+
+        default_coherence *policy = wb.queue.front();
+        wb.queue.pop_front();
+        wb.current   = policy;
+        wb.cancelled = false;
+
+        // One part per turn, so that all the queued arrays progress
+        lock.unlock();
+        bool more = policy->writeback_chunk();
+        lock.lock();
+
+        if (more && !wb.cancelled)
+            wb.queue.push_back(policy);
+        wb.current = nullptr;
+        wb.cond.notify_all();
+    }
+}
+
+void
+writeback_start(default_coherence &policy)
+{
+    writeback_state &wb = get_writeback();
+    std::unique_lock<std::mutex> lock(wb.mutex);
+
+    if (!wb.thread) {
+        wb.stop   = false;
+        wb.thread = new std::thread(writeback_main);
+    }
+
+    if (wb.current != &policy && std::find(wb.queue.begin(), wb.queue.end(), &policy) == wb.queue.end())
+        wb.queue.push_back(&policy);
+    wb.cond.notify_all();
+}
+
+void
+writeback_cancel(default_coherence &policy)
+{
+    writeback_state &wb = get_writeback();
+    std::unique_lock<std::mutex> lock(wb.mutex);
+
+    wb.queue.erase(std::remove(wb.queue.begin(), wb.queue.end(), &policy), wb.queue.end());
+    if (wb.current == &policy) {
+        wb.cancelled = true;
+        wb.cond.wait(lock, [&wb, &policy] { return wb.current != &policy; });
+    }
+}
+
+void
+writeback_stop()
+{
+    writeback_state &wb = get_writeback();
+    std::unique_lock<std::mutex> lock(wb.mutex);
+
+    if (!wb.thread) return;
+
+    wb.stop = true;
+    wb.cond.notify_all();
+    lock.unlock();
+
+    wb.thread->join();
+
+    lock.lock();
+    delete wb.thread;
+    wb.thread = nullptr;
+    wb.queue.clear();
+}
+
+std::string
+to_string(const coherence_transition &transition)
+{
+    std::string agent;
+    if (transition.agent == coherence_transition::HOST)
+        agent = "host";
+    else if (transition.agent == coherence_transition::DEVICES)
+        agent = "gpus";
+    else
+        agent = "gpu " + std::to_string(transition.agent);
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s [%zu, %zu) %s -> %s copied %zu avoided %zu",
+             agent.c_str(), transition.offset, transition.offset + transition.bytes,
+             to_string(transition.from), to_string(transition.to), transition.copied, transition.avoided);
+    return buf;
+}
+
+coherence_stats &
+coherence_stats::operator+=(const coherence_stats &other)
+{
+    readFaults    += other.readFaults;
+    writeFaults   += other.writeFaults;
+    stallNs       += other.stallNs;
+    toHost        += other.toHost;
+    toHostBytes   += other.toHostBytes;
+    toHostNs      += other.toHostNs;
+    toDevice      += other.toDevice;
+    toDeviceBytes += other.toDeviceBytes;
+    toDeviceNs    += other.toDeviceNs;
+    for (unsigned from = 0; from < 3; ++from)
+        for (unsigned to = 0; to < 3; ++to)
+            transitions[from][to] += other.transitions[from][to];
+    return *this;
+}
+
+static const char StateLetters[] = { 'I', 'S', 'M' };
+
+std::string
+to_string(const coherence_stats &stats)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "faults %llu read %llu write stall %.3f ms | "
+             "to host %llu %.2f MiB %.3f ms | to device %llu %.2f MiB %.3f ms |",
+             (unsigned long long) stats.readFaults, (unsigned long long) stats.writeFaults, stats.stallNs / 1e6,
+             (unsigned long long) stats.toHost, stats.toHostBytes / double(1 << 20), stats.toHostNs / 1e6,
+             (unsigned long long) stats.toDevice, stats.toDeviceBytes / double(1 << 20), stats.toDeviceNs / 1e6);
+    std::string ret(buf);
+
+    for (unsigned from = 0; from < 3; ++from) {
+        for (unsigned to = 0; to < 3; ++to) {
+            if (from == to) continue;
+            snprintf(buf, sizeof(buf), " %c>%c %llu", StateLetters[from], StateLetters[to],
+                     (unsigned long long) stats.transitions[from][to]);
+            ret += buf;
+        }
+    }
+    return ret;
+}
+
+namespace detail {
+
+coherence_stats GlobalCoherenceStats;
+
+coherence_stats
+stats_snapshot(const coherence_stats &stats)
+{
+    // Counters are only incremented, so a snapshot taken while they are
+    // updated is still meaningful
+    coherence_stats ret;
+    const uint64_t *src = reinterpret_cast<const uint64_t *>(&stats);
+    uint64_t *dst = reinterpret_cast<uint64_t *>(&ret);
+    for (size_t i = 0; i < sizeof(coherence_stats) / sizeof(uint64_t); ++i)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    return ret;
+}
+
+// Arrays tracked with CUDARRAYS_COHERENCE_STATS. Never destroyed, so that
+// arrays with static storage can be unregistered at exit
+struct stats_registry {
+    std::mutex mutex;
+    std::vector<std::pair<const default_coherence *, std::string>> live;
+    std::vector<std::pair<std::string, coherence_stats>> dead;
+};
+
+static stats_registry &
+get_stats_registry()
+{
+    static stats_registry *registry = new stats_registry();
+    return *registry;
+}
+
+void
+stats_register(const default_coherence &policy, const std::string &name)
+{
+    stats_registry &registry = get_stats_registry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    registry.live.emplace_back(&policy, name);
+}
+
+void
+stats_unregister(const default_coherence &policy)
+{
+    stats_registry &registry = get_stats_registry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    auto it = std::find_if(registry.live.begin(), registry.live.end(),
+                           [&policy](const std::pair<const default_coherence *, std::string> &entry)
+                           {
+                               return entry.first == &policy;
+                           });
+    if (it == registry.live.end()) return;
+
+    registry.dead.emplace_back(it->second, policy.get_stats());
+    registry.live.erase(it);
+}
+
+}
+
+coherence_stats
+get_coherence_stats()
+{
+    return detail::stats_snapshot(detail::GlobalCoherenceStats);
+}
+
+void
+print_coherence_stats(FILE *out)
+{
+    detail::stats_registry &registry = detail::get_stats_registry();
+    {
+        std::unique_lock<std::mutex> lock(registry.mutex);
+        for (auto &entry : registry.dead)
+            fprintf(out, "coherence> %s: %s\n", entry.first.c_str(), to_string(entry.second).c_str());
+        for (auto &entry : registry.live)
+            fprintf(out, "coherence> %s: %s\n", entry.second.c_str(), to_string(entry.first->get_stats()).c_str());
+    }
+    fprintf(out, "coherence> total: %s\n", to_string(get_coherence_stats()).c_str());
+
+    fault_stats faults = get_fault_stats();
+    fprintf(out, "coherence> %s faults: %llu read %llu write %llu populated, handlers %.3f ms, "
+            "%llu protection changes, tiles: %llu loaded %llu written back %llu evicted\n",
+            to_string(get_fault_backend()),
+            (unsigned long long) faults.readFaults, (unsigned long long) faults.writeFaults,
+            (unsigned long long) faults.populated, faults.handlerNs / 1e6,
+            (unsigned long long) faults.protectCalls, (unsigned long long) faults.tileLoads,
+            (unsigned long long) faults.tileStores, (unsigned long long) faults.tileEvictions);
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
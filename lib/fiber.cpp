@@ -0,0 +1,249 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cudarrays/detail/cpu/fiber.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define CUDARRAYS_FIBER_ASM 1
+#else
+#define CUDARRAYS_FIBER_ASM 0
+#include <ucontext.h>
+#endif
+
+#if CUDARRAYS_FIBER_ASM == 1
+// Saves the callee-saved registers on the current stack, stores the stack
+// pointer in *from and restores the context saved in the stack pointed by to
+extern "C" void cudarrays_fiber_switch(void **from, void *to);
+// First code executed by a fiber. Calls the entry point stored in the initial
+// register frame
+extern "C" void cudarrays_fiber_start();
+
+#if defined(__x86_64__)
+asm(R"(
+    .text
+    .globl  cudarrays_fiber_switch
+    .type   cudarrays_fiber_switch, @function
+cudarrays_fiber_switch:
+    pushq   %rbp
+    pushq   %rbx
+    pushq   %r12
+    pushq   %r13
+    pushq   %r14
+    pushq   %r15
+    subq    $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw  4(%rsp)
+    movq    %rsp, (%rdi)
+    movq    %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw   4(%rsp)
+    addq    $8, %rsp
+    popq    %r15
+    popq    %r14
+    popq    %r13
+    popq    %r12
+    popq    %rbx
+    popq    %rbp
+    ret
+    .size   cudarrays_fiber_switch, .-cudarrays_fiber_switch
+
+    .globl  cudarrays_fiber_start
+    .type   cudarrays_fiber_start, @function
+cudarrays_fiber_start:
+    movq    %r12, %rdi
+    callq   *%r13
+    ud2
+    .size   cudarrays_fiber_start, .-cudarrays_fiber_start
+)");
+
+// csr, r15, r14, r13, r12, rbx, rbp, return address
+static const unsigned FRAME_WORDS = 8;
+#else
+asm(R"(
+    .text
+    .globl  cudarrays_fiber_switch
+    .type   cudarrays_fiber_switch, %function
+cudarrays_fiber_switch:
+    sub     sp, sp, #176
+    stp     x19, x20, [sp, #0]
+    stp     x21, x22, [sp, #16]
+    stp     x23, x24, [sp, #32]
+    stp     x25, x26, [sp, #48]
+    stp     x27, x28, [sp, #64]
+    stp     x29, x30, [sp, #80]
+    stp     d8,  d9,  [sp, #96]
+    stp     d10, d11, [sp, #112]
+    stp     d12, d13, [sp, #128]
+    stp     d14, d15, [sp, #144]
+    mov     x2, sp
+    str     x2, [x0]
+    mov     sp, x1
+    ldp     x19, x20, [sp, #0]
+    ldp     x21, x22, [sp, #16]
+    ldp     x23, x24, [sp, #32]
+    ldp     x25, x26, [sp, #48]
+    ldp     x27, x28, [sp, #64]
+    ldp     x29, x30, [sp, #80]
+    ldp     d8,  d9,  [sp, #96]
+    ldp     d10, d11, [sp, #112]
+    ldp     d12, d13, [sp, #128]
+    ldp     d14, d15, [sp, #144]
+    add     sp, sp, #176
+    ret
+    .size   cudarrays_fiber_switch, .-cudarrays_fiber_switch
+
+    .globl  cudarrays_fiber_start
+    .type   cudarrays_fiber_start, %function
+cudarrays_fiber_start:
+    mov     x0, x19
+    blr     x20
+    brk     #0
+    .size   cudarrays_fiber_start, .-cudarrays_fiber_start
+)");
+
+// x19-x30, d8-d15 and padding
+static const unsigned FRAME_WORDS = 22;
+#endif
+#else
+// Entry point of the fiber being started through makecontext
+static thread_local void (*StartFn)(void *) = nullptr;
+static thread_local void *StartArg = nullptr;
+
+static void
+fiber_trampoline()
+{
+    StartFn(StartArg);
+
+    FATAL("CPU fiber returned from its entry point");
+}
+#endif
+
+namespace cudarrays {
+
+namespace cpu {
+
+fiber::fiber() :
+#if CUDARRAYS_FIBER_ASM == 1
+    ctx_(nullptr),
+#else
+    ctx_(new ucontext_t),
+#endif
+    stack_(nullptr),
+    stackSize_(0),
+    fn_(nullptr),
+    arg_(nullptr)
+{
+}
+
+fiber::fiber(entry_fn fn, void *arg, size_t stackSize) :
+    fiber()
+{
+    fn_  = fn;
+    arg_ = arg;
+
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    stackSize_ = (stackSize + page - 1) / page * page + page;
+
+    stack_ = mmap(nullptr, stackSize_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    ASSERT(stack_ != MAP_FAILED, "Error allocating fiber stack");
+    // Guard page to catch stack overflows in the emulated threads
+    int ret = mprotect(stack_, page, PROT_NONE);
+    ASSERT(ret == 0);
+
+    uintptr_t top = (uintptr_t(stack_) + stackSize_) & ~uintptr_t(15);
+
+#if CUDARRAYS_FIBER_ASM == 1
+    uintptr_t *frame = reinterpret_cast<uintptr_t *>(top) - FRAME_WORDS;
+    for (unsigned i = 0; i < FRAME_WORDS; ++i)
+        frame[i] = 0;
+#if defined(__x86_64__)
+    frame[0] = uintptr_t(0x1f80) | (uintptr_t(0x037f) << 32); // Default MXCSR and x87 control word
+    frame[3] = uintptr_t(&fiber::start);                     // r13
+    frame[4] = uintptr_t(this);                              // r12
+    frame[7] = uintptr_t(&cudarrays_fiber_start);            // Return address
+#else
+    frame[0]  = uintptr_t(this);                             // x19
+    frame[1]  = uintptr_t(&fiber::start);                    // x20
+    frame[11] = uintptr_t(&cudarrays_fiber_start);           // x30
+#endif
+    ctx_ = frame;
+#else
+    ucontext_t *uc = static_cast<ucontext_t *>(ctx_);
+    getcontext(uc);
+    uc->uc_stack.ss_sp   = reinterpret_cast<char *>(stack_) + page;
+    uc->uc_stack.ss_size = top - uintptr_t(uc->uc_stack.ss_sp);
+    uc->uc_link          = nullptr;
+    makecontext(uc, fiber_trampoline, 0);
+#endif
+}
+
+fiber::~fiber()
+{
+    if (stack_ != nullptr)
+        munmap(stack_, stackSize_);
+#if CUDARRAYS_FIBER_ASM == 0
+    delete static_cast<ucontext_t *>(ctx_);
+#endif
+}
+
+void
+fiber::switch_to(fiber &next)
+{
+#if CUDARRAYS_FIBER_ASM == 1
+    cudarrays_fiber_switch(&ctx_, next.ctx_);
+#else
+    if (next.fn_ != nullptr) {
+        // First switch to the fiber: pass the entry point to the trampoline
+        StartFn  = next.fn_;
+        StartArg = next.arg_;
+        next.fn_ = nullptr;
+    }
+    swapcontext(static_cast<ucontext_t *>(ctx_), static_cast<ucontext_t *>(next.ctx_));
+#endif
+}
+
+void
+fiber::start(fiber *f)
+{
+    f->fn_(f->arg_);
+
+    FATAL("CPU fiber returned from its entry point");
+}
+
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,747 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/host.hpp"
+#include "cudarrays/memory.hpp"
+
+#include "cudarrays/detail/cpu/topology.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+
+namespace cudarrays {
+
+utils::option<std::string> HOST_PAGES{"CUDARRAYS_HOST_PAGES", "base"};
+utils::option<std::string> HOST_NUMA{"CUDARRAYS_HOST_NUMA", "first_touch"};
+utils::option<size_t> HOST_POOL{"CUDARRAYS_HOST_POOL", 0};
+utils::option<size_t> HOST_WINDOW_TILE{"CUDARRAYS_HOST_WINDOW_TILE", size_t(2) << 20};
+
+static const char *HostPagesNames[] = {
+    "base",
+    "thp",
+    "hugetlb"
+};
+
+const char *
+to_string(host_pages pages)
+{
+    return HostPagesNames[unsigned(pages)];
+}
+
+host_pages
+get_host_pages()
+{
+    static const host_pages pages = []()
+    {
+        for (unsigned i = 0; i < sizeof(HostPagesNames) / sizeof(HostPagesNames[0]); ++i) {
+            if (HOST_PAGES.value() == HostPagesNames[i])
+                return host_pages(i);
+        }
+        FATAL("Invalid value for CUDARRAYS_HOST_PAGES: %s", HOST_PAGES.value().c_str());
+    }();
+
+    return pages;
+}
+
+// Size of the huge pages, read from /proc/meminfo
+static size_t
+huge_page_bytes()
+{
+    static const size_t bytes = []()
+    {
+        size_t kb = 2048;
+        FILE *meminfo = fopen("/proc/meminfo", "r");
+        if (meminfo) {
+            char line[256];
+            while (fgets(line, sizeof(line), meminfo)) {
+                if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1)
+                    break;
+            }
+            fclose(meminfo);
+        }
+        return kb * 1024;
+    }();
+
+    return bytes;
+}
+
+size_t
+host_page_bytes(host_pages pages)
+{
+    if (pages == host_pages::base)
+        return size_t(sysconf(_SC_PAGESIZE));
+    return huge_page_bytes();
+}
+
+static const char *NumaPolicyNames[] = {
+    "first_touch",
+    "interleave",
+    "partition",
+    "node"
+};
+
+std::string
+to_string(const numa_placement &placement)
+{
+    if (placement.policy == numa_policy::node)
+        return std::string("node:") + std::to_string(placement.node);
+    return NumaPolicyNames[unsigned(placement.policy)];
+}
+
+numa_placement
+get_numa_placement()
+{
+    static const numa_placement placement = []()
+    {
+        int node;
+        if (sscanf(HOST_NUMA.value().c_str(), "node:%d", &node) == 1 && node >= 0)
+            return numa_placement{numa_policy::node, node};
+
+        for (unsigned i = 0; i < unsigned(numa_policy::node); ++i) {
+            if (HOST_NUMA.value() == NumaPolicyNames[i])
+                return numa_placement{numa_policy(i), 0};
+        }
+        FATAL("Invalid value for CUDARRAYS_HOST_NUMA: %s", HOST_NUMA.value().c_str());
+    }();
+
+    return placement;
+}
+
+// Pages of a host copy placed in a node
+struct numa_segment {
+    char *begin;
+    char *end;
+    const cpu::core_set *cores;
+};
+
+// Nodes are numbered up to 64 * NODE_MASK_WORDS
+static const unsigned NODE_MASK_WORDS = 16;
+
+static long
+bind_pages(char *begin, char *end, int mode, const std::vector<int> &nodes, bool move)
+{
+    unsigned long mask[NODE_MASK_WORDS] = {};
+    for (int node : nodes) {
+        if (node >= int(NODE_MASK_WORDS * 64)) return -1;
+        mask[node / 64] |= 1UL << (node % 64);
+    }
+    return syscall(SYS_mbind, begin, size_t(end - begin), mode, mask, NODE_MASK_WORDS * 64 + 1,
+                   move? MPOL_MF_MOVE: 0);
+}
+
+// Pages populated by a thread that runs in the cores of a node
+struct touch_task {
+    char *begin;
+    char *end;
+    size_t step;
+};
+
+// Populate pages that have not been touched, with the contents they already
+// have (zeros)
+static void
+touch_pages(const cpu::core_set &cores, const std::vector<touch_task> &tasks)
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (unsigned cpu : cores.cpus)
+        CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(mask), &mask);
+
+    for (auto &task : tasks) {
+        for (char *page = task.begin; page < task.end; page += task.step)
+            *(volatile char *) page = 0;
+    }
+}
+
+namespace detail {
+
+bool
+host_place(void *addr, size_t bytes, size_t pageBytes, size_t rowBytes, const std::vector<host_tile> &tiles,
+           const numa_placement &placement, bool untouched)
+{
+    if (placement.policy == numa_policy::first_touch || bytes == 0) return true;
+
+    std::vector<cpu::core_set> nodes = cpu::get_node_core_sets();
+    if (nodes.empty()) {
+        DEBUG("host> NUMA topology not available: %s placement ignored", to_string(placement).c_str());
+        return false;
+    }
+
+    char *begin = static_cast<char *>(addr);
+    char *end   = begin + utils::div_ceil(bytes, pageBytes) * pageBytes;
+
+    std::vector<numa_segment> segments;
+    if (placement.policy == numa_policy::interleave) {
+        segments.push_back(numa_segment{begin, end, nullptr});
+    } else if (placement.policy == numa_policy::node) {
+        auto it = std::find_if(nodes.begin(), nodes.end(),
+                               [&placement](const cpu::core_set &set) { return set.node == placement.node; });
+        if (it == nodes.end()) {
+            INFO("host> NUMA node %d has no usable cores", placement.node);
+            return false;
+        }
+        segments.push_back(numa_segment{begin, end, &*it});
+    } else if (!tiles.empty()) {
+        // Bytes of every page held by the tiles of the devices of each node
+        size_t pages = size_t(end - begin) / pageBytes;
+        unsigned parts = 0;
+        for (auto &tile : tiles)
+            parts = std::max(parts, tile.part + 1);
+
+        std::vector<size_t> owned(pages * nodes.size(), 0);
+        for (auto &tile : tiles) {
+            size_t node = size_t(tile.part) * nodes.size() / parts;
+            size_t tileEnd = std::min(tile.offset + tile.bytes, pages * pageBytes);
+            for (size_t off = tile.offset; off < tileEnd; ) {
+                size_t page = off / pageBytes;
+                size_t next = std::min(tileEnd, (page + 1) * pageBytes);
+                owned[page * nodes.size() + node] += next - off;
+                off = next;
+            }
+        }
+
+        // Runs of pages with the same owner. Pages of no tile (padding) stay
+        // with the previous run
+        size_t node = 0;
+        for (size_t page = 0; page < pages; ++page) {
+            auto first = owned.begin() + page * nodes.size();
+            auto most  = std::max_element(first, first + nodes.size());
+            if (*most != 0) node = size_t(most - first);
+
+            char *pageBegin = begin + page * pageBytes;
+            if (!segments.empty() && segments.back().cores == &nodes[node] && segments.back().end == pageBegin)
+                segments.back().end = pageBegin + pageBytes;
+            else
+                segments.push_back(numa_segment{pageBegin, pageBegin + pageBytes, &nodes[node]});
+        }
+    } else {
+        // Slabs split at rows, aligned down to the pages
+        size_t row  = rowBytes != 0? rowBytes: pageBytes;
+        size_t rows = utils::div_ceil(bytes, row);
+        auto slab_begin = [&](size_t n) -> char *
+        {
+            if (n == nodes.size()) return end;
+            return begin + rows * n / nodes.size() * row / pageBytes * pageBytes;
+        };
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            if (slab_begin(n) < slab_begin(n + 1))
+                segments.push_back(numa_segment{slab_begin(n), slab_begin(n + 1), &nodes[n]});
+        }
+    }
+
+    bool bound = true;
+    for (auto &segment : segments) {
+        std::vector<int> ids;
+        if (segment.cores) {
+            ids.push_back(segment.cores->node);
+        } else {
+            for (auto &set : nodes)
+                ids.push_back(set.node);
+        }
+        int mode = segment.cores? MPOL_PREFERRED: MPOL_INTERLEAVE;
+        if (bind_pages(segment.begin, segment.end, mode, ids, !untouched) != 0) {
+            bound = false;
+            break;
+        }
+    }
+    if (bound) {
+        DEBUG("host> %p (%zd) placed: %s%s", addr, bytes, to_string(placement).c_str(),
+              placement.policy == numa_policy::partition && !tiles.empty()? " (device tiles)": "");
+        return true;
+    }
+
+    INFO("host> mbind not available (%s)%s", strerror(errno), untouched? ": placing pages on first touch": "");
+    if (!untouched) return false;
+
+    // One thread per node populates the pages of the node
+    std::vector<std::vector<touch_task>> tasks(nodes.size());
+    for (auto &segment : segments) {
+        if (segment.cores) {
+            tasks[size_t(segment.cores - nodes.data())].push_back(touch_task{segment.begin, segment.end, pageBytes});
+        } else {
+            for (size_t n = 0; n < nodes.size(); ++n)
+                tasks[n].push_back(touch_task{segment.begin + n * pageBytes, segment.end, nodes.size() * pageBytes});
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        if (!tasks[n].empty())
+            threads.emplace_back(touch_pages, std::cref(nodes[n]), std::cref(tasks[n]));
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    return true;
+}
+
+}
+
+// Pages that can back a mapping at an address
+static host_pages
+usable_pages(host_pages pages, void *addr)
+{
+    if (pages != host_pages::base && size_t(addr) % huge_page_bytes() != 0) {
+        DEBUG("host> %p not aligned to huge pages: using base pages", addr);
+        pages = host_pages::base;
+    }
+    // The userfaultfd backend resolves faults in pages of the system page size
+    if (pages == host_pages::hugetlb && get_fault_backend() == fault_backend::userfaultfd)
+        pages = host_pages::thp;
+
+    return pages;
+}
+
+static void *
+map_pages(size_t bytes, void *addr, host_pages &pages, size_t &mapped)
+{
+    size_t huge = huge_page_bytes();
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (addr != nullptr) flags |= MAP_FIXED;
+
+    pages = usable_pages(pages, addr);
+
+    if (pages == host_pages::hugetlb) {
+        mapped = utils::div_ceil(bytes, huge) * huge;
+        void *ret = mmap(addr, mapped, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (ret != MAP_FAILED) return ret;
+
+        DEBUG("host> huge page pool exhausted (%s): using transparent huge pages", strerror(errno));
+        pages = host_pages::thp;
+    }
+
+    if (pages == host_pages::thp) {
+        mapped = utils::div_ceil(bytes, huge) * huge;
+
+        char *ret;
+        if (addr != nullptr) {
+            ret = (char *) mmap(addr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (ret == MAP_FAILED) return nullptr;
+        } else {
+            // Map an extra huge page and trim the mapping to align it
+            char *raw = (char *) mmap(nullptr, mapped + huge, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (raw == MAP_FAILED) return nullptr;
+
+            ret = raw + (huge - size_t(raw) % huge) % huge;
+            if (ret != raw)
+                munmap(raw, size_t(ret - raw));
+            munmap(ret + mapped, size_t(raw + huge - ret));
+        }
+
+        if (madvise(ret, mapped, MADV_HUGEPAGE) != 0)
+            DEBUG("host> transparent huge pages not available (%s)", strerror(errno));
+        return ret;
+    }
+
+    mapped = bytes;
+    void *ret = mmap(addr, mapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return ret == MAP_FAILED? nullptr: ret;
+}
+
+// Pool of host mappings
+struct pooled_mapping {
+    void *addr;
+    size_t mapped;
+    host_pages pages;
+};
+
+using pool_lru = std::list<pooled_mapping>;
+
+struct pool_state {
+    std::mutex mutex;
+    // Mappings in the pool, most recently freed first
+    pool_lru lru;
+    // Mappings of every size class, most recently freed last
+    std::map<std::pair<host_pages, size_t>, std::vector<pool_lru::iterator>> classes;
+    host_pool_stats stats = host_pool_stats{0, 0, 0, 0};
+};
+
+// Never destroyed: the pool is trimmed when the library is finalized, after
+// the static objects are destroyed
+static pool_state &
+get_pool()
+{
+    static pool_state *pool = new pool_state();
+    return *pool;
+}
+
+// Size class of a mapping: multiples of the page size up to 4 pages, and then
+// 4 classes for every power of two, so that at most 25% of a mapping is unused
+static size_t
+size_class(size_t bytes, size_t pageBytes)
+{
+    size_t pages = std::max<size_t>(utils::div_ceil(bytes, pageBytes), 1);
+    size_t step = 1;
+    while (pages > 4 * step)
+        step *= 2;
+    return utils::div_ceil(pages, step) * step * pageBytes;
+}
+
+// Take the least recently freed mappings out of the pool until the pool fits
+// in a size. Must be called with the mutex of the pool held
+static void
+pool_evict(pool_state &pool, size_t keepBytes, std::vector<pooled_mapping> &evicted)
+{
+    while (pool.stats.bytes > keepBytes) {
+        auto it = std::prev(pool.lru.end());
+        auto &sizeClass = pool.classes[std::make_pair(it->pages, it->mapped)];
+        ASSERT(!sizeClass.empty() && sizeClass.front() == it);
+        sizeClass.erase(sizeClass.begin());
+
+        evicted.push_back(*it);
+        pool.stats.bytes -= it->mapped;
+        ++pool.stats.trimmed;
+        pool.lru.erase(it);
+    }
+}
+
+static void
+unmap_pages(void *addr, size_t mapped)
+{
+    // Ranges parked in the mapping are removed first
+    keep_ranges(addr, mapped, false);
+    int ret = munmap(addr, mapped);
+    ASSERT(ret == 0);
+}
+
+host_pool_stats
+get_host_pool_stats()
+{
+    pool_state &pool = get_pool();
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    return pool.stats;
+}
+
+void
+host_pool_trim(size_t keepBytes)
+{
+    pool_state &pool = get_pool();
+    std::vector<pooled_mapping> evicted;
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool_evict(pool, keepBytes, evicted);
+    }
+    for (auto &mapping : evicted)
+        unmap_pages(mapping.addr, mapping.mapped);
+}
+
+namespace detail {
+
+void *
+host_map(size_t bytes, void *addr, host_pages &pages, size_t &mapped, bool &recycled)
+{
+    recycled = false;
+    if (addr != nullptr || HOST_POOL == 0)
+        return map_pages(bytes, addr, pages, mapped);
+
+    pages = usable_pages(pages, nullptr);
+    size_t classBytes = size_class(bytes, host_page_bytes(pages));
+
+    pool_state &pool = get_pool();
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        auto sizeClass = pool.classes.find(std::make_pair(pages, classBytes));
+        if (sizeClass != pool.classes.end() && !sizeClass->second.empty()) {
+            auto it = sizeClass->second.back();
+            sizeClass->second.pop_back();
+
+            void *ret = it->addr;
+            mapped = it->mapped;
+            pool.stats.bytes -= mapped;
+            ++pool.stats.hits;
+            pool.lru.erase(it);
+
+            recycled = true;
+            return ret;
+        }
+        ++pool.stats.misses;
+    }
+
+    void *ret = map_pages(classBytes, nullptr, pages, mapped);
+    // The ranges of the arrays stay registered while the mapping is pooled
+    if (ret != nullptr)
+        keep_ranges(ret, mapped, true);
+    return ret;
+}
+
+void
+host_unmap(void *addr, size_t mapped, host_pages pages, bool pooled)
+{
+    if (!pooled || HOST_POOL == 0) {
+        int ret = munmap(addr, mapped);
+        ASSERT(ret == 0);
+        return;
+    }
+
+    if (mapped > HOST_POOL) {
+        unmap_pages(addr, mapped);
+        return;
+    }
+
+    pool_state &pool = get_pool();
+    std::vector<pooled_mapping> evicted;
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool_evict(pool, HOST_POOL - mapped, evicted);
+
+        pool.lru.push_front(pooled_mapping{addr, mapped, pages});
+        pool.classes[std::make_pair(pages, mapped)].push_back(pool.lru.begin());
+        pool.stats.bytes += mapped;
+    }
+    for (auto &mapping : evicted)
+        unmap_pages(mapping.addr, mapping.mapped);
+}
+
+// Read a part of a file, retrying short reads
+static bool
+read_file(int fd, void *dst, size_t bytes, off_t offset)
+{
+    char *buf = static_cast<char *>(dst);
+    for (size_t done = 0; done < bytes; ) {
+        ssize_t n = pread(fd, buf + done, bytes - done, offset + off_t(done));
+        if (n <= 0) {
+            DEBUG("host> Error reading the file: %s", n < 0? strerror(errno): "end of file");
+            return false;
+        }
+        done += size_t(n);
+    }
+    return true;
+}
+
+// Write a part of a file, retrying short writes
+static bool
+write_file(int fd, const void *src, size_t bytes, off_t offset)
+{
+    const char *buf = static_cast<const char *>(src);
+    for (size_t done = 0; done < bytes; ) {
+        ssize_t n = pwrite(fd, buf + done, bytes - done, offset + off_t(done));
+        if (n <= 0) {
+            DEBUG("host> Error writing the file: %s", strerror(errno));
+            return false;
+        }
+        done += size_t(n);
+    }
+    return true;
+}
+
+void *
+host_map_file(size_t bytes, void *addr, host_file &file, size_t &mapped, bool &copied)
+{
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    if (size_t(file.offset) % page != 0) {
+        DEBUG("host> file offset %zd not aligned to pages", size_t(file.offset));
+        return nullptr;
+    }
+
+    file.fd = dup(file.fd);
+    if (file.fd < 0) return nullptr;
+
+    mapped = utils::div_ceil(bytes, page) * page;
+    int flags = addr != nullptr? MAP_FIXED: 0;
+
+    copied = get_fault_backend() == fault_backend::userfaultfd;
+    if (copied) {
+        char *ret = (char *) mmap(addr, mapped, PROT_READ | PROT_WRITE, flags | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ret == MAP_FAILED) {
+            close(file.fd);
+            return nullptr;
+        }
+        if (!read_file(file.fd, ret, bytes, file.offset)) {
+            munmap(ret, mapped);
+            close(file.fd);
+            return nullptr;
+        }
+        return ret;
+    }
+
+    flags |= file.mode == file_mode::shared? MAP_SHARED: MAP_PRIVATE;
+    void *ret = mmap(addr, mapped, PROT_READ | PROT_WRITE, flags, file.fd, file.offset);
+    if (ret == MAP_FAILED) {
+        DEBUG("host> Error mapping the file: %s", strerror(errno));
+        close(file.fd);
+        return nullptr;
+    }
+    return ret;
+}
+
+bool
+host_sync_file(void *addr, size_t bytes, size_t mapped, const host_file &file, bool copied)
+{
+    if (!copied)
+        return msync(addr, mapped, MS_SYNC) == 0;
+
+    return write_file(file.fd, addr, bytes, file.offset);
+}
+
+void
+host_unmap_file(void *addr, size_t bytes, size_t mapped, const host_file &file, bool copied)
+{
+    // Writes to shared mappings reach the file through the page cache
+    if (copied && file.mode == file_mode::shared && !host_sync_file(addr, bytes, mapped, file, copied))
+        INFO("host> Unable to write %p (%zd) to its file", addr, bytes);
+
+    int ret = munmap(addr, mapped);
+    ASSERT(ret == 0);
+    close(file.fd);
+}
+
+// Backing store of the tiles of a windowed host copy
+struct window_store {
+    int fd;
+    off_t offset;
+    size_t bytes;
+    size_t tileBytes;
+    file_mode mode;
+    // Read-only files: temporary file that holds the tiles that have been
+    // written back, which are loaded from it afterwards
+    int scratch = -1;
+    std::vector<bool> spilled;
+
+    ~window_store()
+    {
+        if (scratch >= 0) close(scratch);
+    }
+
+    bool io(bool store, void *addr, size_t offset, size_t count)
+    {
+        // The padding of the last page is not in the file
+        if (offset >= this->bytes) return true;
+        count = std::min(count, this->bytes - offset);
+
+        int dst = fd;
+        off_t pos = this->offset + off_t(offset);
+        if (mode == file_mode::read_only) {
+            size_t tile = offset / tileBytes;
+            if (store && !spilled[tile]) {
+                if (scratch < 0 && (scratch = make_scratch()) < 0) return false;
+                spilled[tile] = true;
+            }
+            if (spilled[tile]) {
+                dst = scratch;
+                pos = off_t(offset);
+            }
+        }
+        return store? write_file(dst, addr, count, pos): read_file(dst, addr, count, pos);
+    }
+
+    static int make_scratch()
+    {
+        const char *dir = getenv("TMPDIR");
+        std::string path = std::string(dir != nullptr? dir: "/tmp") + "/cudarrays-XXXXXX";
+        int ret = mkstemp(&path[0]);
+        if (ret < 0) {
+            DEBUG("host> Error creating a temporary file: %s", strerror(errno));
+            return -1;
+        }
+        unlink(path.c_str());
+        return ret;
+    }
+};
+
+void *
+host_map_window(size_t bytes, void *addr, host_file &file, size_t &mapped, bool &windowed, bool &copied)
+{
+    windowed = get_fault_backend() == fault_backend::sigsegv;
+    if (!windowed) {
+        INFO("host> Out-of-core arrays need the %s fault backend: the file is mapped as a whole",
+             to_string(fault_backend::sigsegv));
+        return host_map_file(bytes, addr, file, mapped, copied);
+    }
+
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    if (size_t(file.offset) % page != 0) {
+        DEBUG("host> file offset %zd not aligned to pages", size_t(file.offset));
+        return nullptr;
+    }
+
+    file.fd = dup(file.fd);
+    if (file.fd < 0) return nullptr;
+
+    // Pages are only committed while their tiles are resident
+    mapped = utils::div_ceil(bytes, page) * page;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (addr != nullptr? MAP_FIXED: 0);
+    void *ret = mmap(addr, mapped, PROT_NONE, flags, -1, 0);
+    if (ret == MAP_FAILED) {
+        close(file.fd);
+        return nullptr;
+    }
+    copied = false;
+    return ret;
+}
+
+void
+host_attach_window(void *addr, size_t bytes, const host_file &file, const host_window &window)
+{
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t tileBytes = window.tileBytes != 0? window.tileBytes: HOST_WINDOW_TILE.value();
+    tileBytes = std::max(page, tileBytes / page * page);
+
+    std::shared_ptr<window_store> store(new window_store());
+    store->fd        = file.fd;
+    store->offset    = file.offset;
+    store->bytes     = bytes;
+    store->tileBytes = tileBytes;
+    store->mode      = file.mode;
+    store->spilled.assign(utils::div_ceil(bytes, tileBytes), false);
+
+    tile_io_fn io = [store](bool write, void *tile, size_t offset, size_t count) -> bool
+    {
+        return store->io(write, tile, offset, count);
+    };
+    if (!window_range(addr, tileBytes, window.budget, io))
+        FATAL("host> Unable to window %p (%zd)", addr, bytes);
+    DEBUG("host> windowed: %p (%zd, %zd bytes resident in tiles of %zd)", addr, bytes, window.budget, tileBytes);
+}
+
+bool
+host_sync_window(void *addr, const host_file &file)
+{
+    if (!flush_window(addr)) return false;
+    return file.mode != file_mode::shared || fdatasync(file.fd) == 0;
+}
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
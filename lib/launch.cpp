@@ -0,0 +1,253 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/launch.hpp"
+#include "cudarrays/system.hpp"
+
+namespace std {
+
+template <>
+struct hash<cudarrays::launch_plan_key> {
+    size_t operator()(const cudarrays::launch_plan_key &key) const
+    {
+        size_t ret = hash<const void *>()(key.kernel);
+        auto combine = [&ret](size_t val)
+        {
+            ret ^= val + 0x9e3779b9 + (ret << 6) + (ret >> 2);
+        };
+
+        combine(key.grid.x);
+        combine(key.grid.y);
+        combine(key.grid.z);
+        combine(key.block.x);
+        combine(key.block.y);
+        combine(key.block.z);
+        combine(key.shared);
+        combine(hash<const void *>()(key.stream));
+        combine(key.dims);
+        combine(key.partition);
+        combine(key.procs);
+        combine(key.transposeXY);
+
+        return ret;
+    }
+};
+
+}
+
+namespace cudarrays {
+
+utils::option<bool> LAUNCH_CACHE{"CUDARRAYS_LAUNCH_CACHE", true};
+utils::option<unsigned> LAUNCH_CACHE_SIZE{"CUDARRAYS_LAUNCH_CACHE_SIZE", 1024};
+utils::option<unsigned> LAUNCH_STREAMS{"CUDARRAYS_LAUNCH_STREAMS", 4};
+
+// Plans are cached per thread, like the kernel arguments
+static thread_local std::unordered_map<launch_plan_key, launch_plan_ptr> LaunchPlans;
+
+launch_plan_ptr
+find_launch_plan(const launch_plan_key &key)
+{
+    auto it = LaunchPlans.find(key);
+    if (it == LaunchPlans.end())
+        return nullptr;
+
+    return it->second;
+}
+
+void
+insert_launch_plan(const launch_plan_key &key, launch_plan_ptr plan)
+{
+    // Launchers hold references to their plans, so flushing is always safe
+    if (LaunchPlans.size() >= LAUNCH_CACHE_SIZE)
+        LaunchPlans.clear();
+
+    LaunchPlans.emplace(key, std::move(plan));
+}
+
+// Streams are created with cudaStreamCreate, so that they synchronize with the
+// legacy default stream used by the copies of the coherence policies
+struct launch_streams {
+    std::vector<cudaStream_t> streams;
+    unsigned next;
+};
+
+static std::mutex StreamsMutex;
+static std::vector<launch_streams> LaunchStreams;
+
+cudaStream_t
+get_launch_stream(unsigned gpu)
+{
+    std::unique_lock<std::mutex> lock(StreamsMutex);
+
+    if (LaunchStreams.size() <= gpu)
+        LaunchStreams.resize(gpu + 1, launch_streams{{}, 0});
+
+    auto &streams = LaunchStreams[gpu];
+    if (streams.streams.empty()) {
+        // The first stream is the one preallocated by the library
+        streams.streams.push_back(StreamsIn[gpu]);
+
+        cudaError_t err = cudaSetDevice(1);
+        ASSERT(err == cudaSuccess);
+        for (unsigned i = 1; i < std::max(1u, LAUNCH_STREAMS.value()); ++i) {
+            cudaStream_t stream;
+            err = cudaStreamCreate(&stream);
+            ASSERT(err == cudaSuccess);
+            streams.streams.push_back(stream);
+        }
+    }
+
+    cudaStream_t ret = streams.streams[streams.next];
+    streams.next = (streams.next + 1) % unsigned(streams.streams.size());
+
+    return ret;
+}
+
+// Events created by the library. The pool keeps a reference to each event, so
+// that an event is free when the pool holds its only reference. Events are
+// recycled without allocating memory
+static std::mutex EventsMutex;
+static std::vector<launch_event_ptr> Events;
+static size_t NextEvent = 0;
+
+launch_event_ptr
+make_launch_event()
+{
+    std::unique_lock<std::mutex> lock(EventsMutex);
+
+    // Start looking after the last event handed out, which is likely in use
+    for (size_t i = 0; i < Events.size(); ++i) {
+        size_t idx = (NextEvent + i) % Events.size();
+        if (Events[idx].use_count() == 1) {
+            NextEvent = idx + 1;
+            return Events[idx];
+        }
+    }
+
+    cudaEvent_t event;
+    cudaError_t err = cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+    ASSERT(err == cudaSuccess);
+
+    Events.push_back(std::make_shared<launch_event>(launch_event{event}));
+    NextEvent = Events.size();
+
+    return Events.back();
+}
+
+void
+access_dependencies::wait(cudaStream_t stream, bool Const) const
+{
+    for (auto &e : writers_) {
+        cudaError_t err = cudaStreamWaitEvent(stream, e->event, 0);
+        ASSERT(err == cudaSuccess);
+    }
+    if (!Const) {
+        for (auto &e : readers_) {
+            cudaError_t err = cudaStreamWaitEvent(stream, e->event, 0);
+            ASSERT(err == cudaSuccess);
+        }
+    }
+}
+
+void
+access_dependencies::record(const std::vector<launch_event_ptr> &events, bool Const)
+{
+    if (Const) {
+        // Forget the readers that already completed, so that arrays that are
+        // only read do not accumulate events
+        readers_.erase(std::remove_if(readers_.begin(), readers_.end(),
+                                      [](const launch_event_ptr &e)
+                                      {
+                                          return cudaEventQuery(e->event) == cudaSuccess;
+                                      }),
+                       readers_.end());
+        readers_.insert(readers_.end(), events.begin(), events.end());
+    } else {
+        writers_ = events;
+        readers_.clear();
+    }
+}
+
+// Values of the grid constants in each device, as seen by the host. Devices
+// are shared by all the threads
+struct gpu_constants {
+    bool valid;
+    dim3 total_grid;
+    dim3 off;
+};
+
+static std::mutex ConstantsMutex;
+static std::vector<gpu_constants> Constants;
+
+static inline bool
+operator!=(const dim3 &a, const dim3 &b)
+{
+    return a.x != b.x || a.y != b.y || a.z != b.z;
+}
+
+void
+update_gpu_constants(dim3 total_grid, dim3 off)
+{
+    if (!LAUNCH_CACHE) {
+        update_gpu_global_grid(total_grid);
+        update_gpu_offset(off);
+        return;
+    }
+
+    int device;
+    cudaError_t err = cudaGetDevice(&device);
+    ASSERT(err == cudaSuccess);
+
+    std::unique_lock<std::mutex> lock(ConstantsMutex);
+
+    if (Constants.size() <= size_t(device))
+        Constants.resize(device + 1, gpu_constants{false, dim3{}, dim3{}});
+
+    auto &constants = Constants[device];
+    if (!constants.valid || constants.total_grid != total_grid) {
+        update_gpu_global_grid(total_grid);
+        constants.total_grid = total_grid;
+    }
+    if (!constants.valid || constants.off != off) {
+        update_gpu_offset(off);
+        constants.off = off;
+    }
+    constants.valid = true;
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
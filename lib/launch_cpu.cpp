@@ -0,0 +1,733 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/launch_cpu.hpp"
+
+#include "cudarrays/detail/cpu/block.hpp"
+#include "cudarrays/detail/cpu/fiber.hpp"
+#include "cudarrays/detail/cpu/lanes.hpp"
+#include "cudarrays/detail/cpu/topology.hpp"
+#include "cudarrays/detail/cpu/worker_pool.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+
+// State of the emulated CUDA thread being executed by each worker
+thread_local uint3 threadIdx;
+thread_local uint3 blockIdx;
+thread_local uint3 blockDim;
+thread_local uint3 gridDim;
+
+extern "C"
+int cuda_grid_get_size_x()
+{
+    return gridDim.x;
+}
+
+extern "C"
+int cuda_grid_get_size_y()
+{
+    return gridDim.y;
+}
+
+extern "C"
+int cuda_grid_get_size_z()
+{
+    return gridDim.z;
+}
+
+extern "C"
+int cuda_block_get_size_x()
+{
+    return blockDim.x;
+}
+
+extern "C"
+int cuda_block_get_size_y()
+{
+    return blockDim.y;
+}
+
+extern "C"
+int cuda_block_get_size_z()
+{
+    return blockDim.z;
+}
+
+extern "C"
+int cuda_block_get_idx_x()
+{
+    return blockIdx.x;
+}
+
+extern "C"
+int cuda_block_get_idx_y()
+{
+    return blockIdx.y;
+}
+
+extern "C"
+int cuda_block_get_idx_z()
+{
+    return blockIdx.z;
+}
+
+extern "C"
+int cuda_thread_get_idx_x()
+{
+    return threadIdx.x;
+}
+
+extern "C"
+int cuda_thread_get_idx_y()
+{
+    return threadIdx.y;
+}
+
+extern "C"
+int cuda_thread_get_idx_z()
+{
+    return threadIdx.z;
+}
+
+namespace cudarrays {
+
+void
+init_grid(dim3 grid, dim3 block)
+{
+    gridDim  = grid;
+    blockDim = block;
+}
+
+namespace cpu {
+
+utils::option<unsigned> THREADS{"CUDARRAYS_CPU_THREADS", 0};
+utils::option<bool> BIND{"CUDARRAYS_CPU_BIND", true};
+utils::option<size_t> FIBER_STACK{"CUDARRAYS_CPU_FIBER_STACK", 128 * 1024};
+utils::option<size_t> SHARED_MEMORY{"CUDARRAYS_CPU_SHARED_MEMORY", 48 * 1024};
+
+thread_local uint64_t ActiveMask = 1;
+
+// Allocations in the shared memory arena are cache line aligned
+static const size_t SHARED_ALIGN = 64;
+
+static inline size_t
+align_up(size_t val, size_t align)
+{
+    return (val + align - 1) / align * align;
+}
+
+// Execution state of the block being run by a worker
+struct block_context {
+    // Context of the worker thread, resumed when a fiber finishes or waits
+    fiber worker;
+    // Fibers are reused by all the blocks executed by the worker
+    std::vector<std::unique_ptr<fiber>> fibers;
+    std::vector<char> finished;
+    // Active lanes of the threads waiting on a barrier
+    std::vector<uint64_t> masks;
+    unsigned current;
+
+    thread_fn fn;
+    void *arg;
+    bool running;
+    // Threads are being executed on the stack of the worker
+    bool direct;
+
+    char *shared;
+    size_t sharedSize;
+    size_t sharedUsed;
+
+    // Id of the block being executed (0: none)
+    unsigned long id;
+
+    block_context() :
+        current(0),
+        fn(nullptr),
+        arg(nullptr),
+        running(false),
+        direct(false),
+        shared(nullptr),
+        sharedSize(0),
+        sharedUsed(0),
+        id(0)
+    {
+    }
+
+    ~block_context()
+    {
+        free(shared);
+    }
+};
+
+static thread_local std::unique_ptr<block_context> Block;
+
+static inline block_context &
+get_block_context()
+{
+    ASSERT(Block && Block->running, "Function must be called from a kernel launched on the CPU");
+    return *Block;
+}
+
+static void
+fiber_main(void *arg)
+{
+    auto &ctx = *static_cast<block_context *>(arg);
+
+    for (;;) {
+        ctx.fn(ctx.arg);
+        ctx.finished[ctx.current] = 1;
+        ctx.fibers[ctx.current]->switch_to(ctx.worker);
+    }
+}
+
+void
+run_block(dim3 block, size_t sharedBytes, unsigned lanes, thread_fn fn, void *arg)
+{
+    if (!Block) Block.reset(new block_context);
+    auto &ctx = *Block;
+
+    // Dynamic shared memory is placed at the beginning of the arena
+    size_t dynamicBytes = align_up(sharedBytes, SHARED_ALIGN);
+    size_t arenaBytes   = align_up(std::max(SHARED_MEMORY.value(), dynamicBytes), SHARED_ALIGN);
+    if (arenaBytes > ctx.sharedSize) {
+        free(ctx.shared);
+        int ret = posix_memalign(reinterpret_cast<void **>(&ctx.shared), SHARED_ALIGN, arenaBytes);
+        ASSERT(ret == 0, "Error allocating shared memory arena");
+        ctx.sharedSize = arenaBytes;
+    }
+    ctx.sharedUsed = dynamicBytes;
+    ++ctx.id;
+
+    // Each emulated thread executes a group of lanes in X
+    unsigned groupsX = (block.x + lanes - 1) / lanes;
+    unsigned threads = groupsX * block.y * block.z;
+    while (ctx.fibers.size() < threads)
+        ctx.fibers.emplace_back(new fiber(fiber_main, &ctx, FIBER_STACK));
+    ctx.finished.assign(threads, 0);
+    ctx.masks.resize(threads);
+
+    ctx.fn      = fn;
+    ctx.arg     = arg;
+    ctx.running = true;
+    ctx.direct  = false;
+
+    auto set_thread_idx = [&block, groupsX, lanes](unsigned t)
+    {
+        threadIdx.x = (t % groupsX) * lanes;
+        threadIdx.y = (t / groupsX) % block.y;
+        threadIdx.z = t / (groupsX * block.y);
+
+        ActiveMask = lane_bits(std::min(lanes, block.x - threadIdx.x));
+    };
+
+    // All the threads of a block must reach the same barriers. If the first
+    // thread finishes without waiting on any barrier, the rest of threads run
+    // directly on the stack of the worker, with no context switches
+    set_thread_idx(0);
+    ctx.current = 0;
+    ctx.worker.switch_to(*ctx.fibers[0]);
+    ctx.masks[0] = ActiveMask;
+
+    if (ctx.finished[0]) {
+        ctx.direct = true;
+        for (unsigned t = 1; t < threads; ++t) {
+            set_thread_idx(t);
+            fn(arg);
+        }
+    } else {
+        // Every pass resumes the threads until they reach the next barrier.
+        // The first thread is already waiting on the first one
+        unsigned live = threads;
+        for (unsigned first = 1; live > 0; first = 0) {
+            for (unsigned t = first; t < threads; ++t) {
+                if (ctx.finished[t]) continue;
+
+                set_thread_idx(t);
+                // Lanes disabled before the barrier stay disabled
+                if (first == 0) ActiveMask = ctx.masks[t];
+                ctx.current = t;
+                ctx.worker.switch_to(*ctx.fibers[t]);
+                ctx.masks[t] = ActiveMask;
+
+                if (ctx.finished[t]) --live;
+            }
+        }
+    }
+
+    ctx.running = false;
+}
+
+void *
+shared_alloc(size_t bytes, size_t align, void *&cache, unsigned long &block)
+{
+    auto &ctx = get_block_context();
+
+    // The array has already been placed for this block
+    if (block == ctx.id) return cache;
+
+    size_t offset = align_up(ctx.sharedUsed, std::max(align, SHARED_ALIGN));
+    if (offset + bytes > ctx.sharedSize)
+        FATAL("Shared memory arena exhausted (%zd bytes). Increase CUDARRAYS_CPU_SHARED_MEMORY", ctx.sharedSize);
+
+    cache = ctx.shared + offset;
+    block = ctx.id;
+    ctx.sharedUsed = offset + bytes;
+
+    return cache;
+}
+
+// Range of blocks owned by a worker. The owner advances the front (low 32
+// bits) and thieves move the back (high 32 bits). Ranges are kept in separate
+// cache lines and must be allocated with allocate_ranges
+struct alignas(64) block_range {
+    std::atomic<uint64_t> bounds;
+
+    struct deleter {
+        unsigned count;
+
+        void operator()(block_range *ranges) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+                ranges[i].~block_range();
+            free(ranges);
+        }
+    };
+
+    static inline uint64_t
+    pack(size_t front, size_t back)
+    {
+        return uint64_t(front) | (uint64_t(back) << 32);
+    }
+
+    bool
+    take_front(size_t chunk, size_t &first, size_t &last)
+    {
+        uint64_t cur = bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t f = size_t(cur & 0xffffffffu), b = size_t(cur >> 32);
+            if (f >= b) return false;
+
+            size_t n = std::min(chunk, b - f);
+            if (bounds.compare_exchange_weak(cur, pack(f + n, b))) {
+                first = f;
+                last  = f + n;
+                return true;
+            }
+        }
+    }
+
+    bool
+    steal_back(size_t &first, size_t &last)
+    {
+        uint64_t cur = bounds.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t f = size_t(cur & 0xffffffffu), b = size_t(cur >> 32);
+            if (f >= b) return false;
+
+            // Half of the remaining blocks, so that the victim keeps its locality
+            size_t n = (b - f + 1) / 2;
+            if (bounds.compare_exchange_weak(cur, pack(f, b - n))) {
+                first = b - n;
+                last  = b;
+                return true;
+            }
+        }
+    }
+};
+
+using block_ranges = std::unique_ptr<block_range[], block_range::deleter>;
+
+// new[] does not honor the alignment of block_range in C++11
+static block_ranges
+allocate_ranges(unsigned count)
+{
+    void *mem;
+    int ret = posix_memalign(&mem, alignof(block_range), count * sizeof(block_range));
+    ASSERT(ret == 0, "Error allocating block ranges");
+
+    block_range *ranges = static_cast<block_range *>(mem);
+    for (unsigned i = 0; i < count; ++i)
+        new (&ranges[i]) block_range();
+
+    return block_ranges(ranges, block_range::deleter{count});
+}
+
+struct worker_pool::job {
+    size_t blocks;
+    size_t chunk;
+    block_fn fn;
+
+    // Group of workers that execute the job
+    unsigned first;
+    unsigned workers;
+    block_ranges ranges;
+
+    // All the blocks have been handed out (protected by the pool mutex)
+    bool exhausted;
+
+    // Number of blocks already executed
+    std::atomic<size_t> done;
+
+    // Time spent executing blocks by each worker of the group. Each worker
+    // only writes its own entry, before adding its blocks to done
+    std::unique_ptr<uint64_t[]> busy;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // Set after end, so that it can be polled without locking
+    std::atomic<bool> finished;
+
+    job(size_t _blocks, size_t _chunk, const block_fn &_fn, unsigned _first, unsigned _workers) :
+        blocks(_blocks),
+        chunk(_chunk),
+        fn(_fn),
+        first(_first),
+        workers(_workers),
+        ranges(allocate_ranges(_workers)),
+        exhausted(false),
+        done(0),
+        busy(new uint64_t[_workers]()),
+        start(std::chrono::steady_clock::now()),
+        end(start),
+        finished(false)
+    {
+        // Each worker starts with a contiguous range of the blocks
+        for (unsigned w = 0; w < workers; ++w) {
+            ranges[w].bounds.store(block_range::pack(blocks * w / workers,
+                                                     blocks * (w + 1) / workers));
+        }
+    }
+
+    bool has_worker(unsigned id) const
+    {
+        return id >= first && id < first + workers;
+    }
+};
+
+worker_pool &
+worker_pool::get()
+{
+    static worker_pool pool{THREADS};
+    return pool;
+}
+
+worker_pool::worker_pool(unsigned workers) :
+    pinned_(false),
+    active_(0),
+    stop_(false)
+{
+    start(workers);
+}
+
+worker_pool::~worker_pool()
+{
+    stop();
+}
+
+void
+worker_pool::start(unsigned workers)
+{
+    if (workers == 0)
+        workers = std::max(1u, std::thread::hardware_concurrency());
+
+    DEBUG("cpu> starting %u workers", workers);
+
+    stop_ = false;
+    for (unsigned id = 0; id < workers; ++id)
+        threads_.emplace_back(&worker_pool::worker_main, this, id);
+}
+
+void
+worker_pool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+
+    for (auto &thread : threads_)
+        thread.join();
+    threads_.clear();
+}
+
+void
+worker_pool::resize(unsigned workers)
+{
+    stop();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        groups_.clear();
+        groupCores_.clear();
+    }
+    start(workers);
+}
+
+void
+worker_pool::run(size_t blocks, const block_fn &fn)
+{
+    wait(submit(blocks, fn));
+}
+
+worker_pool::job_handle
+worker_pool::submit(size_t blocks, const block_fn &fn, unsigned first, unsigned workers)
+{
+    ASSERT(blocks <= 0xffffffffu, "Too many blocks in the grid");
+    ASSERT(first < threads_.size(), "Invalid worker group");
+
+    if (workers == 0 || first + workers > threads_.size())
+        workers = unsigned(threads_.size()) - first;
+
+    // Several chunks per worker to amortize the synchronizations
+    size_t chunk = std::max(size_t(1), blocks / (size_t(workers) * 32));
+
+    auto j = std::make_shared<job>(blocks, chunk, fn, first, workers);
+    if (blocks == 0) {
+        j->finished.store(true, std::memory_order_release);
+        return j;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        jobs_.push_back(j);
+        ++active_;
+    }
+    cond_.notify_all();
+
+    return j;
+}
+
+void
+worker_pool::wait(const job_handle &j)
+{
+    if (finished(j)) return;
+
+    std::unique_lock<std::mutex> lock(j->mutex);
+    j->cond.wait(lock, [&j]() { return finished(j); });
+}
+
+bool
+worker_pool::finished(const job_handle &j)
+{
+    return j->finished.load(std::memory_order_acquire);
+}
+
+worker_pool::job_times
+worker_pool::get_times(const job_handle &j)
+{
+    ASSERT(finished(j), "Job not completed");
+
+    job_times times;
+    times.wall  = std::chrono::duration<float, std::milli>(j->end - j->start).count();
+    times.first = j->first;
+    for (unsigned w = 0; w < j->workers; ++w)
+        times.busy.push_back(float(j->busy[w]) / 1e6f);
+
+    return times;
+}
+
+std::vector<worker_pool::group>
+worker_pool::partition(unsigned groups)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (groups_.size() != groups)
+        split(groups);
+
+    // Running jobs may belong to launches with other partitions
+    if (!pinned_ && active_ == 0) {
+        pin_groups();
+        pinned_ = true;
+    }
+
+    return groups_;
+}
+
+void
+worker_pool::split(unsigned groups)
+{
+    unsigned workers = unsigned(threads_.size());
+    // Groups share workers (and cores) if there are more devices than workers
+    auto sets = get_core_sets(std::min(groups, workers));
+
+    groups_.clear();
+    groupCores_.clear();
+    for (unsigned g = 0; g < groups; ++g) {
+        group grp;
+        unsigned set;
+        if (groups <= workers) {
+            grp.first   = workers * g / groups;
+            grp.workers = workers * (g + 1) / groups - grp.first;
+            set = g;
+        } else {
+            grp.first   = g % workers;
+            grp.workers = 1;
+            set = grp.first;
+        }
+        grp.node = sets[set].node;
+        groups_.push_back(grp);
+        groupCores_.push_back(sets[set]);
+    }
+
+    pinned_ = false;
+}
+
+void
+worker_pool::pin_groups()
+{
+    if (!BIND) return;
+
+    // Groups that share workers keep the cores of the first one
+    unsigned workers = unsigned(threads_.size());
+    for (unsigned g = 0; g < groups_.size() && g < workers; ++g) {
+        auto &grp = groups_[g];
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (unsigned cpu : groupCores_[g].cpus)
+            CPU_SET(cpu, &mask);
+
+        for (unsigned w = grp.first; w < grp.first + grp.workers; ++w) {
+            int err = pthread_setaffinity_np(threads_[w].native_handle(), sizeof(mask), &mask);
+            if (err != 0)
+                DEBUG("cpu> could not pin worker %u: %s", w, strerror(err));
+        }
+    }
+}
+
+void
+worker_pool::worker_main(unsigned id)
+{
+    for (;;) {
+        std::shared_ptr<job> j;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // First pending job whose group contains this worker
+            cond_.wait(lock, [this, id, &j]()
+            {
+                if (stop_) return true;
+                for (auto &pending : jobs_) {
+                    if (!pending->exhausted && pending->has_worker(id)) {
+                        j = pending;
+                        return true;
+                    }
+                }
+                return false;
+            });
+            if (stop_) return;
+        }
+
+        unsigned local = id - j->first;
+
+        size_t executed = 0;
+        size_t first, last;
+        block_range &own = j->ranges[local];
+        auto busyStart = std::chrono::steady_clock::now();
+        for (;;) {
+            while (own.take_front(j->chunk, first, last)) {
+                for (size_t block = first; block < last; ++block)
+                    j->fn(id, block);
+                executed += last - first;
+            }
+
+            // Move blocks from another worker into the range of this worker
+            bool stolen = false;
+            for (unsigned v = 1; v < j->workers && !stolen; ++v) {
+                stolen = j->ranges[(local + v) % j->workers].steal_back(first, last);
+            }
+            if (!stolen) break;
+
+            own.bounds.store(block_range::pack(first, last));
+        }
+
+        {
+            // All the blocks have been handed out. Let the workers move on
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!j->exhausted) {
+                j->exhausted = true;
+                jobs_.erase(std::find(jobs_.begin(), jobs_.end(), j));
+            }
+        }
+
+        if (executed == 0) continue;
+
+        auto now = std::chrono::steady_clock::now();
+        j->busy[local] = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - busyStart).count());
+
+        if (j->done.fetch_add(executed) + executed == j->blocks) {
+            j->end = now;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                --active_;
+            }
+
+            std::unique_lock<std::mutex> lock(j->mutex);
+            j->finished.store(true, std::memory_order_release);
+            j->cond.notify_all();
+        }
+    }
+}
+
+}
+
+}
+
+void
+cuda_block_synchronize()
+{
+    auto &ctx = cudarrays::cpu::get_block_context();
+
+    if (ctx.direct)
+        FATAL("__syncthreads() not reached by all the threads of the block");
+
+    ctx.fibers[ctx.current]->switch_to(ctx.worker);
+}
+
+extern "C"
+void *cuda_block_get_shared_memory()
+{
+    return cudarrays::cpu::get_block_context().shared;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
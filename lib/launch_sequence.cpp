@@ -0,0 +1,96 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/launch_sequence.hpp"
+#include "cudarrays/memory.hpp"
+
+namespace cudarrays {
+
+bool
+launch_sequence::operator()()
+{
+    {
+        protection_batch batch;
+        for (auto &o : objects_) {
+            o.obj->get_coherence_policy().release(o.gpus, o.intent);
+        }
+    }
+
+    bool ok = true;
+    for (auto &s : steps_) {
+        ok = s->enqueue();
+        if (!ok) break;
+    }
+
+    for (auto &s : steps_) {
+        s->wait();
+    }
+
+    for (auto &o : objects_) {
+        o.obj->get_coherence_policy().acquire();
+    }
+
+    return ok;
+}
+
+void
+launch_sequence::add_step(std::unique_ptr<step> s)
+{
+    if (!steps_.empty() && steps_.front()->get_backend() != s->get_backend())
+        FATAL("Launches of different backends cannot be recorded in the same sequence");
+
+    steps_.push_back(std::move(s));
+}
+
+void
+launch_sequence::add_object(coherent &obj, access_intent intent, const std::vector<unsigned> &gpus)
+{
+    // Views of the same array share the coherence policy
+    for (auto &o : objects_) {
+        if (&o.obj->get_coherence_policy() == &obj.get_coherence_policy()) {
+            // The first launch decides if the contents are needed by the
+            // devices. Later launches read what the sequence has written
+            if (o.intent != intent && o.intent != access_intent::write_discard)
+                o.intent = access_intent::read_write;
+            // Release the copies of every GPU used by the launches
+            o.gpus.insert(o.gpus.end(), gpus.begin(), gpus.end());
+            std::sort(o.gpus.begin(), o.gpus.end());
+            o.gpus.erase(std::unique(o.gpus.begin(), o.gpus.end()), o.gpus.end());
+            return;
+        }
+    }
+
+    objects_.push_back(object{&obj, intent, gpus});
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
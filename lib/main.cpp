@@ -34,10 +34,12 @@
 #include <cuda_runtime.h>
 
 #include "cudarrays/common.hpp"
+#include "cudarrays/host.hpp"
 #include "cudarrays/memory.hpp"
 #include "cudarrays/system.hpp"
 #include "cudarrays/utils.hpp"
 
+#include "cudarrays/detail/coherence/default.hpp"
 #include "cudarrays/detail/utils/log.hpp"
 
 namespace cudarrays {
@@ -65,7 +67,7 @@ void init_lib()
     else
         DEBUG("- Max GPUS: autodetect");
 
-    handler_sigsegv_overload();
+    handler_faults_install();
 
     DEBUG("- GPUS: %zd", system::GPUS);
     DEBUG("- Peer GPUS: %zd", system::PEER_GPUS);
@@ -84,7 +86,11 @@ void fini_lib()
         // Wait for other threads to finish library initialization
         while (initializing);
 
-        handler_sigsegv_restore();
+        writeback_stop();
+        if (COHERENCE_STATS)
+            print_coherence_stats(stderr);
+        host_pool_trim();
+        handler_faults_uninstall();
         return;
     }
 }
@@ -26,14 +26,29 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE. */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <csignal>
 #include <cstring>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stddef.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/userfaultfd.h>
 
 #include "cudarrays/common.hpp"
 #include "cudarrays/memory.hpp"
@@ -43,6 +58,28 @@
 
 namespace cudarrays {
 
+utils::option<std::string> FAULT_BACKEND{"CUDARRAYS_FAULT_BACKEND", "sigsegv"};
+utils::option<bool> PROTECT_BATCHING{"CUDARRAYS_PROTECT_BATCHING", true};
+
+static const char *FaultBackendNames[] = {
+    "sigsegv",
+    "userfaultfd"
+};
+
+const char *
+to_string(fault_backend backend)
+{
+    return FaultBackendNames[unsigned(backend)];
+}
+
+static fault_backend Backend = fault_backend::sigsegv;
+
+fault_backend
+get_fault_backend()
+{
+    return Backend;
+}
+
 static inline int
 mem_access_to_prot(mem_access_type access)
 {
@@ -70,28 +107,91 @@ to_string(mem_access_type access_type)
 
 using myptr = char *;
 
+// Protection recorded for ranges whose pages have different protections
+static const mem_access_type MEM_MIXED = mem_access_type(-1);
+
+// Tiles of a range of which only a window is resident (see window_range)
+struct range_window {
+    enum tile_state : uint8_t {
+        ABSENT = 0,
+        CLEAN  = 1, // Resident, and only readable until it is written
+        DIRTY  = 2
+    };
+
+    myptr first;        // Page-aligned start of the range
+    size_t pages;
+    size_t tileBytes;
+    size_t maxTiles;
+    tile_io_fn io;
+    // Protection requested for every page. Pages of resident tiles get it,
+    // without write access while the tile is clean
+    std::unique_ptr<uint8_t[]> prots;
+    std::vector<uint8_t> tiles;
+    // Resident tiles, the most recently faulted first
+    std::list<size_t> lru;
+    std::vector<std::list<size_t>::iterator> lruPos;
+    std::mutex mutex;
+};
+
+// Registered range. Ranges are never returned to the heap, so that the SIGSEGV
+// handler can use them without locks while other threads unregister them
 class handler_sigsegv {
     myptr begin_;
     size_t count_;
+    size_t pageBytes_;
     mem_access_type prot_;
-    std::shared_ptr<handler_fn> fn_;
-    bool set_;
+    // Handlers are double-buffered: a new handler is stored in the slot that
+    // is not in use and then published, so that a handler that is running
+    // (and may protect the range again) is never overwritten
+    handler_fn fns_[2];
+    std::atomic<int> fn_;
 
 public:
-    handler_sigsegv(myptr begin, size_t count, mem_access_type prot) :
-        begin_(begin),
-        count_(count),
-        prot_(prot),
-        fn_(nullptr),
-        set_(false)
+    // userfaultfd backend: protection of every page of the range, which is
+    // read without locks by the handler thread, and copy of the contents of
+    // the pages protected with MEM_NONE, which are removed from the range
+    std::unique_ptr<std::atomic<uint8_t>[]> pageProts;
+    size_t pages;
+    myptr shadow;
+    std::mutex protMutex;
+
+    // Unregistered range of a kept mapping. It stays in the page table and
+    // registered with userfaultfd until the range is registered again
+    bool parked;
+
+    // SIGSEGV backend: resident tiles of a windowed range
+    std::unique_ptr<range_window> window;
+
+    void reset(myptr begin, size_t count, size_t pageBytes, mem_access_type prot)
+    {
+        begin_ = begin;
+        count_ = count;
+        pageBytes_ = pageBytes;
+        prot_  = prot;
+        fns_[0] = nullptr;
+        fns_[1] = nullptr;
+        fn_.store(-1, std::memory_order_release);
+
+        pageProts.reset();
+        pages  = 0;
+        shadow = nullptr;
+        parked = false;
+        window.reset();
+    }
+
+    // Remove the handlers of a range that is parked or registered again
+    void clear_handler()
     {
+        fn_.store(-1, std::memory_order_release);
+        fns_[0] = nullptr;
+        fns_[1] = nullptr;
     }
 
-    bool operator()(bool b)
+    bool operator()(bool b, void *addr)
     {
-        ASSERT(set_, "memory> Function handler not set");
-        std::shared_ptr<handler_fn> fn = fn_;
-        return (*fn)(b);
+        int fn = fn_.load(std::memory_order_acquire);
+        if (fn < 0) return false;
+        return fns_[fn](b, addr);
     }
 
     myptr start()
@@ -109,6 +209,12 @@ public:
         return count_;
     }
 
+    // Granularity of the protection changes of the SIGSEGV backend
+    size_t page_bytes() const
+    {
+        return pageBytes_;
+    }
+
     mem_access_type protection() const
     {
         return prot_;
@@ -121,17 +227,126 @@ public:
 
     void set_handler(const handler_fn &fn)
     {
-        if (set_)
-            DEBUG("memory> Overwriting handler");
-        auto ptr = std::make_shared<handler_fn>(fn);
-        fn_.swap(ptr);
-        set_ = true;
+        // Empty handlers keep the current one: they are passed when a handler
+        // unprotects its own range
+        if (!fn) return;
+
+        int next = fn_.load(std::memory_order_relaxed) == 0? 1: 0;
+        fns_[next] = fn;
+        fn_.store(next, std::memory_order_release);
     }
 };
 
-using map_handler = std::map<myptr, handler_sigsegv>;
+// Page-indexed radix table that maps every page of the registered ranges to
+// its handler. Lookups only perform atomic loads, so they can be done from
+// the SIGSEGV handler concurrently with registrations. Registrations are
+// serialized by RangesMutex. Nodes are never freed
+static const unsigned PAGE_SHIFT = 12;
+static const unsigned LEVEL_BITS = 12;
+static const size_t   LEVEL_SIZE = size_t(1) << LEVEL_BITS;
+static const uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+// 48-bit virtual addresses
+static const uint64_t MAX_PAGE = uint64_t(1) << (48 - PAGE_SHIFT);
+
+struct page_leaf {
+    std::atomic<handler_sigsegv *> pages[LEVEL_SIZE];
+};
+
+struct page_node {
+    std::atomic<page_leaf *> leaves[LEVEL_SIZE];
+};
+
+static std::atomic<page_node *> PageRoot[LEVEL_SIZE];
+
+static std::mutex RangesMutex;
+// Unregistered ranges, reused by later registrations. Never destroyed: ranges
+// are removed when the library is finalized, after the static objects
+static std::vector<handler_sigsegv *> &FreeRanges = *new std::vector<handler_sigsegv *>();
+
+// Mappings whose ranges are parked when they are unregistered (begin -> end).
+// Never destroyed
+static std::map<myptr, myptr> &KeptMappings = *new std::map<myptr, myptr>();
+
+static inline uint64_t
+page_of(const void *addr)
+{
+    return uint64_t(addr) >> PAGE_SHIFT;
+}
+
+static inline handler_sigsegv *
+find_range(const void *addr)
+{
+    uint64_t page = page_of(addr);
+    if (page >= MAX_PAGE) return nullptr;
+
+    page_node *node = PageRoot[page >> (2 * LEVEL_BITS)].load(std::memory_order_acquire);
+    if (!node) return nullptr;
+    page_leaf *leaf = node->leaves[(page >> LEVEL_BITS) & LEVEL_MASK].load(std::memory_order_acquire);
+    if (!leaf) return nullptr;
+    handler_sigsegv *range = leaf->pages[page & LEVEL_MASK].load(std::memory_order_acquire);
+
+    // Partially used pages may belong to other ranges
+    if (range && (myptr(addr) < range->start() || myptr(addr) >= range->end()))
+        return nullptr;
+
+    return range;
+}
+
+// Must be called with RangesMutex held
+static std::atomic<handler_sigsegv *> &
+get_page_slot(uint64_t page)
+{
+    ASSERT(page < MAX_PAGE, "memory> Invalid page %p", (void *)(page << PAGE_SHIFT));
+
+    auto &nodeSlot = PageRoot[page >> (2 * LEVEL_BITS)];
+    page_node *node = nodeSlot.load(std::memory_order_relaxed);
+    if (!node) {
+        node = new page_node();
+        nodeSlot.store(node, std::memory_order_release);
+    }
+    auto &leafSlot = node->leaves[(page >> LEVEL_BITS) & LEVEL_MASK];
+    page_leaf *leaf = leafSlot.load(std::memory_order_relaxed);
+    if (!leaf) {
+        leaf = new page_leaf();
+        leafSlot.store(leaf, std::memory_order_release);
+    }
+    return leaf->pages[page & LEVEL_MASK];
+}
+
+static fault_stats FaultStats;
+
+fault_stats
+get_fault_stats()
+{
+    fault_stats stats;
+    stats.readFaults  = __atomic_load_n(&FaultStats.readFaults, __ATOMIC_RELAXED);
+    stats.writeFaults = __atomic_load_n(&FaultStats.writeFaults, __ATOMIC_RELAXED);
+    stats.populated   = __atomic_load_n(&FaultStats.populated, __ATOMIC_RELAXED);
+    stats.handlerNs   = __atomic_load_n(&FaultStats.handlerNs, __ATOMIC_RELAXED);
+    stats.protectCalls = __atomic_load_n(&FaultStats.protectCalls, __ATOMIC_RELAXED);
+    stats.tileLoads     = __atomic_load_n(&FaultStats.tileLoads, __ATOMIC_RELAXED);
+    stats.tileStores    = __atomic_load_n(&FaultStats.tileStores, __ATOMIC_RELAXED);
+    stats.tileEvictions = __atomic_load_n(&FaultStats.tileEvictions, __ATOMIC_RELAXED);
+    return stats;
+}
+
+// Call the handler of a range and account the fault. Lock-free, so that it
+// can be called from the signal handler
+static inline bool
+call_handler(handler_sigsegv &range, bool write, myptr addr)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool resolved = range(write, addr);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 
-map_handler handlers;
+    __atomic_fetch_add(write? &FaultStats.writeFaults: &FaultStats.readFaults, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&FaultStats.handlerNs, uint64_t(ns), __ATOMIC_RELAXED);
+    return resolved;
+}
+
+// Load the tile of a windowed range that contains an address, or make it
+// writable (defined below)
+static bool window_fault(handler_sigsegv &range, bool write, myptr addr);
 
 static struct sigaction defaultAction;
 
@@ -139,33 +354,34 @@ static const int Signum_{SIGSEGV};
 
 void handler_sigsegv_main(int s, siginfo_t *info, void *ctx)
 {
-    TRACE_FUNCTION();
-
+    // Only async-signal-safe operations until the handler of the range is
+    // called: no locks, no allocations, no logging
     mcontext_t *mCtx = &((ucontext_t *)ctx)->uc_mcontext;
 
     unsigned long isWrite = mCtx->gregs[REG_ERR] & 0x2;
 
     myptr addr = myptr(info->si_addr);
 
-    if (!isWrite) DEBUG("memory> Read SIGSEGV for %p", addr);
-    else          DEBUG("memory> Write SIGSEGV for %p", addr);
-
     bool resolved = false;
 
-    map_handler::iterator it = handlers.upper_bound(addr);
-    if (it == handlers.end())
-        FATAL("memory> Mapping %p NOT FOUND", addr);
-
-    handler_sigsegv &handler = it->second;
-
-    if (addr >= handler.start() &&
-        addr <  handler.end()) {
-        resolved = handler(isWrite);
+    handler_sigsegv *handler = find_range(addr);
+    if (handler && handler->window) {
+        // Faults due to the window of the range are not seen by its handler.
+        // The accesses of the handler to tiles that are not resident fault in
+        // turn, so that the tiles are loaded
+        resolved = window_fault(*handler, isWrite, addr);
+        if (!resolved) {
+            sigset_t segv;
+            sigemptyset(&segv);
+            sigaddset(&segv, Signum_);
+            pthread_sigmask(SIG_UNBLOCK, &segv, nullptr);
+            resolved = call_handler(*handler, isWrite, addr);
+        }
+    } else if (handler) {
+        resolved = call_handler(*handler, isWrite, addr);
     }
 
     if (resolved == false) {
-        DEBUG("memory> Uoops! I could not find a mapping for %p. Forwarding it to the OS.", addr);
-
         // TODO: set the signal mask and other stuff
         if (defaultAction.sa_flags & SA_SIGINFO)
             return defaultAction.sa_sigaction(s, info, ctx);
@@ -173,55 +389,844 @@ void handler_sigsegv_main(int s, siginfo_t *info, void *ctx)
     }
 }
 
+//
+// userfaultfd backend
+//
+// Pages protected with MEM_READ are write-protected and pages protected with
+// MEM_NONE are removed from the range, so that the accesses not allowed by the
+// protection notify the handler thread, which calls the handler of the range
+// and then wakes up the faulting thread. The contents of removed pages are
+// kept in the shadow of the range and copied back when they are unprotected.
+// Changes of protection never wake up faulting threads: they are woken up once
+// the handler of the range has returned
+//
+static const size_t PAGE_BYTES = size_t(1) << PAGE_SHIFT;
+// Page map entry bits for pages in memory or in swap
+static const uint64_t PAGEMAP_DATA = (uint64_t(1) << 63) | (uint64_t(1) << 62);
+
+static int Uffd = -1;
+static int PagemapFd = -1;
+// Pipe used to stop the handler thread
+static int UffdStop[2] = { -1, -1 };
+static std::thread *UffdThread = nullptr;
+
+// Contents of the pages populated on first touch
+alignas(4096) static char ZeroPage[PAGE_BYTES];
+
+static inline myptr
+first_page(handler_sigsegv *range)
+{
+    return myptr(page_of(range->start()) << PAGE_SHIFT);
+}
+
+// Range that contains the given page, including partially used pages
+static inline handler_sigsegv *
+find_page_range(uint64_t page)
+{
+    if (page >= MAX_PAGE) return nullptr;
+
+    page_node *node = PageRoot[page >> (2 * LEVEL_BITS)].load(std::memory_order_acquire);
+    if (!node) return nullptr;
+    page_leaf *leaf = node->leaves[(page >> LEVEL_BITS) & LEVEL_MASK].load(std::memory_order_acquire);
+    if (!leaf) return nullptr;
+    return leaf->pages[page & LEVEL_MASK].load(std::memory_order_acquire);
+}
+
+static void
+uffd_wake(myptr addr, size_t len)
+{
+    uffdio_range range;
+    range.start = uint64_t(addr);
+    range.len   = len;
+    if (ioctl(Uffd, UFFDIO_WAKE, &range) < 0)
+        FATAL("memory> Error waking up %p: %s", addr, strerror(errno));
+}
+
+// Atomically populate missing pages
+static void
+uffd_copy(myptr dst, myptr src, size_t len, bool writeProtect)
+{
+    while (len > 0) {
+        uffdio_copy copy;
+        copy.dst  = uint64_t(dst);
+        copy.src  = uint64_t(src);
+        copy.len  = len;
+        copy.mode = UFFDIO_COPY_MODE_DONTWAKE | (writeProtect? UFFDIO_COPY_MODE_WP: 0);
+        copy.copy = 0;
+        if (ioctl(Uffd, UFFDIO_COPY, &copy) == 0) return;
+        // Only pages populated on first touch can be populated concurrently
+        if (errno == EEXIST) return;
+        if (errno != EAGAIN)
+            FATAL("memory> Error populating %p-%p: %s", dst, dst + len, strerror(errno));
+        if (copy.copy > 0) {
+            dst += copy.copy;
+            src += copy.copy;
+            len -= copy.copy;
+        }
+    }
+}
+
+static void
+uffd_write_protect(myptr addr, size_t len, bool writeProtect)
+{
+    uffdio_writeprotect wp;
+    wp.range.start = uint64_t(addr);
+    wp.range.len   = len;
+    wp.mode        = writeProtect? UFFDIO_WRITEPROTECT_MODE_WP: UFFDIO_WRITEPROTECT_MODE_DONTWAKE;
+    while (ioctl(Uffd, UFFDIO_WRITEPROTECT, &wp) < 0) {
+        if (errno != EAGAIN)
+            FATAL("memory> Error write-protecting %p-%p: %s", addr, addr + len, strerror(errno));
+    }
+}
+
+// Copy the pages that hold data (in memory or in swap) to the shadow. Pages
+// that were never touched are not read, so that they are not populated and
+// the handler thread is never needed while the protection mutex is held
+static void
+uffd_save_pages(myptr addr, myptr shadow, size_t pages)
+{
+    static const size_t BATCH = 512;
+    uint64_t entries[BATCH];
+
+    for (size_t i = 0; i < pages; i += BATCH) {
+        size_t n = std::min(BATCH, pages - i);
+        off_t offset = off_t((page_of(addr) + i) * sizeof(uint64_t));
+        if (pread(PagemapFd, entries, n * sizeof(uint64_t), offset) != ssize_t(n * sizeof(uint64_t)))
+            FATAL("memory> Error reading the page map: %s", strerror(errno));
+
+        for (size_t j = 0; j < n; ++j) {
+            if (entries[j] & PAGEMAP_DATA)
+                memcpy(shadow + (i + j) * PAGE_BYTES, addr + (i + j) * PAGE_BYTES, PAGE_BYTES);
+        }
+    }
+}
+
+static void
+set_page_prots(handler_sigsegv *range, size_t first, size_t last, mem_access_type prot)
+{
+    for (size_t page = first; page < last; ++page)
+        range->pageProts[page].store(uint8_t(prot), std::memory_order_release);
+}
+
+// Change the protection of the pages [first, last) of a range, which have the
+// same protection. Must be called with the protection mutex of the range held
+static void
+uffd_protect_pages(handler_sigsegv *range, size_t first, size_t last, mem_access_type old, mem_access_type prot)
+{
+    myptr addr = first_page(range) + first * PAGE_BYTES;
+    size_t len = (last - first) * PAGE_BYTES;
+
+    if (prot == MEM_NONE) {
+        if (!range->shadow) {
+            void *shadow = mmap(nullptr, range->pages * PAGE_BYTES, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (shadow == MAP_FAILED)
+                FATAL("memory> Error allocating the shadow of %p-%p: %s",
+                      range->start(), range->end(), strerror(errno));
+            range->shadow = myptr(shadow);
+        }
+        // Writes issued while the pages are saved fault and wait for the
+        // handler of the range
+        set_page_prots(range, first, last, prot);
+        if (old == MEM_READ_WRITE)
+            uffd_write_protect(addr, len, true);
+        uffd_save_pages(addr, range->shadow + first * PAGE_BYTES, last - first);
+        if (madvise(addr, len, MADV_DONTNEED) != 0)
+            FATAL("memory> Error removing %p-%p: %s", addr, addr + len, strerror(errno));
+    } else if (old == MEM_NONE) {
+        myptr shadow = range->shadow + first * PAGE_BYTES;
+        uffd_copy(addr, shadow, len, prot == MEM_READ);
+        set_page_prots(range, first, last, prot);
+        madvise(shadow, len, MADV_DONTNEED);
+    } else {
+        set_page_prots(range, first, last, prot);
+        uffd_write_protect(addr, len, prot == MEM_READ);
+    }
+}
+
+static void
+uffd_protect(handler_sigsegv *range, myptr addr, size_t count, mem_access_type prot)
+{
+    // Library finalized
+    if (Uffd < 0) return;
+
+    // Write-only protections cannot be expressed
+    if (prot == MEM_WRITE) prot = MEM_READ_WRITE;
+
+    std::unique_lock<std::mutex> lock(range->protMutex);
+
+    myptr first = first_page(range);
+    size_t page = size_t(addr - first) >> PAGE_SHIFT;
+    size_t last = std::min(range->pages, (size_t(addr + count - first) + PAGE_BYTES - 1) >> PAGE_SHIFT);
+
+    // Pages are changed in runs with the same protection
+    while (page < last) {
+        uint8_t old = range->pageProts[page].load(std::memory_order_relaxed);
+        size_t next = page + 1;
+        while (next < last && range->pageProts[next].load(std::memory_order_relaxed) == old)
+            ++next;
+        if (old != uint8_t(prot))
+            uffd_protect_pages(range, page, next, mem_access_type(old), prot);
+        page = next;
+    }
+}
+
+// Populate pages protected with MEM_NONE with the contents of a buffer. The
+// buffer is left zero-filled
+static bool
+uffd_move(handler_sigsegv *range, myptr addr, myptr src, size_t count, mem_access_type prot)
+{
+    // Library finalized
+    if (Uffd < 0) return false;
+
+    if (prot == MEM_WRITE) prot = MEM_READ_WRITE;
+
+    std::unique_lock<std::mutex> lock(range->protMutex);
+
+    size_t first = size_t(addr - first_page(range)) >> PAGE_SHIFT;
+    size_t last  = first + count / PAGE_BYTES;
+    if (last > range->pages) return false;
+
+    // Present pages cannot be replaced atomically
+    for (size_t page = first; page < last; ++page) {
+        if (range->pageProts[page].load(std::memory_order_relaxed) != uint8_t(MEM_NONE))
+            return false;
+    }
+
+    uffd_copy(addr, src, count, prot == MEM_READ);
+    set_page_prots(range, first, last, prot);
+    if (range->shadow)
+        madvise(range->shadow + first * PAGE_BYTES, count, MADV_DONTNEED);
+    madvise(src, count, MADV_DONTNEED);
+
+    return true;
+}
+
+static void
+uffd_register(handler_sigsegv *range)
+{
+    range->pages = size_t(page_of(range->end() - 1) - page_of(range->start())) + 1;
+    range->pageProts.reset(new std::atomic<uint8_t>[range->pages]);
+    set_page_prots(range, 0, range->pages, MEM_READ_WRITE);
+
+    if (Uffd < 0) return;
+
+    uffdio_register reg;
+    reg.range.start = uint64_t(first_page(range));
+    reg.range.len   = range->pages * PAGE_BYTES;
+    reg.mode        = UFFDIO_REGISTER_MODE_MISSING | UFFDIO_REGISTER_MODE_WP;
+    if (ioctl(Uffd, UFFDIO_REGISTER, &reg) < 0)
+        FATAL("memory> Error registering %p-%p in userfaultfd: %s",
+              range->start(), range->end(), strerror(errno));
+    if (!(reg.ioctls & (uint64_t(1) << _UFFDIO_WRITEPROTECT)))
+        FATAL("memory> Write-protection not supported for %p-%p", range->start(), range->end());
+}
+
+static void
+uffd_unregister(handler_sigsegv *range)
+{
+    if (Uffd >= 0) {
+        uffdio_range reg;
+        reg.start = uint64_t(first_page(range));
+        reg.len   = range->pages * PAGE_BYTES;
+        // The memory may be unmapped already
+        if (ioctl(Uffd, UFFDIO_UNREGISTER, &reg) < 0)
+            DEBUG("memory> Error unregistering %p-%p from userfaultfd: %s",
+                  range->start(), range->end(), strerror(errno));
+    }
+
+    if (range->shadow) {
+        munmap(range->shadow, range->pages * PAGE_BYTES);
+        range->shadow = nullptr;
+    }
+}
+
+static void
+uffd_handle_fault(const uffd_msg &msg)
+{
+    myptr addr = myptr(msg.arg.pagefault.address);
+    bool write = msg.arg.pagefault.flags & (UFFD_PAGEFAULT_FLAG_WRITE | UFFD_PAGEFAULT_FLAG_WP);
+    bool wp    = msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP;
+    myptr page = myptr(page_of(addr) << PAGE_SHIFT);
+
+    handler_sigsegv *range = find_page_range(page_of(addr));
+    if (!range)
+        FATAL("memory> Mapping %p NOT FOUND", addr);
+
+    // Addresses are page-aligned if the kernel does not report exact addresses
+    if (addr < range->start())  addr = range->start();
+    if (addr >= range->end()) addr = range->end() - 1;
+
+    size_t idx = size_t(page - first_page(range)) >> PAGE_SHIFT;
+    uint8_t prot = range->pageProts[idx].load(std::memory_order_acquire);
+
+    if (prot == MEM_READ_WRITE || (prot == MEM_READ && !write)) {
+        // Allowed access: first touch of the page or notification raised
+        // before the protection of the page was changed
+        if (!wp) {
+            std::unique_lock<std::mutex> lock(range->protMutex);
+            prot = range->pageProts[idx].load(std::memory_order_relaxed);
+            if (prot != MEM_NONE) {
+                uffd_copy(page, ZeroPage, PAGE_BYTES, prot == MEM_READ);
+                __atomic_fetch_add(&FaultStats.populated, 1, __ATOMIC_RELAXED);
+            }
+        }
+    } else if (!call_handler(*range, write, addr)) {
+        FATAL("memory> Invalid %s access to %p", write? "write": "read", addr);
+    }
+
+    uffd_wake(page, PAGE_BYTES);
+}
+
+static void
+uffd_thread_main()
+{
+    pollfd fds[2];
+    fds[0].fd     = Uffd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = UffdStop[0];
+    fds[1].events = POLLIN;
+
+    uffd_msg msgs[16];
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            FATAL("memory> Error polling userfaultfd: %s", strerror(errno));
+        }
+        if (fds[1].revents) return;
+
+        ssize_t bytes = read(Uffd, msgs, sizeof(msgs));
+        if (bytes < 0) {
+            if (errno == EAGAIN) continue;
+            FATAL("memory> Error reading userfaultfd: %s", strerror(errno));
+        }
+        for (size_t i = 0; i < size_t(bytes) / sizeof(uffd_msg); ++i) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT)
+                uffd_handle_fault(msgs[i]);
+        }
+    }
+}
+
+static int
+uffd_open(uint64_t features, uint64_t &supported)
+{
+#ifdef SYS_userfaultfd
+    int fd = int(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+    if (fd < 0) return -1;
+
+    uffdio_api api;
+    api.api      = UFFD_API;
+    api.features = features;
+    api.ioctls   = 0;
+    if (ioctl(fd, UFFDIO_API, &api) < 0) {
+        close(fd);
+        return -1;
+    }
+    supported = api.features;
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static bool
+uffd_install()
+{
+    // The features are queried on a first descriptor: UFFDIO_API can only be
+    // called once per descriptor
+    uint64_t supported = 0;
+    int fd = uffd_open(0, supported);
+    if (fd < 0) {
+        INFO("memory> userfaultfd not available: %s", strerror(errno));
+        return false;
+    }
+    close(fd);
+
+    if (!(supported & UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+        INFO("memory> userfaultfd write-protection not supported");
+        return false;
+    }
+
+    uint64_t features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+#ifdef UFFD_FEATURE_EXACT_ADDRESS
+    features |= supported & UFFD_FEATURE_EXACT_ADDRESS;
+#endif
+    Uffd = uffd_open(features, supported);
+    if (Uffd < 0) {
+        INFO("memory> userfaultfd not available: %s", strerror(errno));
+        return false;
+    }
+
+    PagemapFd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (PagemapFd < 0 || pipe2(UffdStop, O_CLOEXEC) < 0) {
+        INFO("memory> userfaultfd backend cannot be initialized: %s", strerror(errno));
+        if (PagemapFd >= 0) close(PagemapFd);
+        close(Uffd);
+        Uffd = PagemapFd = -1;
+        return false;
+    }
+
+    UffdThread = new std::thread(uffd_thread_main);
+    DEBUG("memory> Install userfaultfd handler thread");
+    return true;
+}
+
+static void
+uffd_uninstall()
+{
+    // fini_lib runs again as a destructor after explicit calls
+    if (!UffdThread) return;
+
+    char stop = 0;
+    if (write(UffdStop[1], &stop, 1) != 1)
+        FATAL("memory> Error stopping the userfaultfd handler thread: %s", strerror(errno));
+    UffdThread->join();
+    delete UffdThread;
+    UffdThread = nullptr;
+
+    // Accesses to the pages removed from ranges read zeros from now on
+    close(UffdStop[0]);
+    close(UffdStop[1]);
+    close(PagemapFd);
+    close(Uffd);
+    UffdStop[0] = UffdStop[1] = PagemapFd = Uffd = -1;
+    DEBUG("memory> Uninstall userfaultfd handler thread");
+}
+
+//
+// Windows of the SIGSEGV backend
+//
+
+static inline mem_access_type
+window_effective(const range_window &window, size_t page, uint8_t state)
+{
+    mem_access_type prot = mem_access_type(window.prots[page]);
+    return state == range_window::DIRTY? prot: mem_access_type(prot & MEM_READ);
+}
+
+// Pages of a tile of a window
+static inline void
+window_tile_pages(const range_window &window, size_t tile, size_t &first, size_t &last)
+{
+    size_t tilePages = window.tileBytes / PAGE_BYTES;
+    first = tile * tilePages;
+    last  = std::min(window.pages, first + tilePages);
+}
+
+// Apply their requested protection to some pages of a resident tile, with a
+// call for every run of pages with the same protection
+static void
+window_apply(range_window &window, size_t tile, size_t first, size_t last)
+{
+    uint8_t state = window.tiles[tile];
+
+    size_t page = first;
+    while (page < last) {
+        mem_access_type prot = window_effective(window, page, state);
+        size_t next = page + 1;
+        while (next < last && window_effective(window, next, state) == prot)
+            ++next;
+
+        __atomic_fetch_add(&FaultStats.protectCalls, 1, __ATOMIC_RELAXED);
+        int err = mprotect(window.first + page * PAGE_BYTES, (next - page) * PAGE_BYTES, mem_access_to_prot(prot));
+        ASSERT(err == 0);
+        page = next;
+    }
+}
+
+// Write back a dirty tile. Writers fault until it has been written back
+static void
+window_store(range_window &window, size_t tile)
+{
+    size_t first, last;
+    window_tile_pages(window, tile, first, last);
+    myptr addr = window.first + first * PAGE_BYTES;
+    size_t count = (last - first) * PAGE_BYTES;
+
+    int err = mprotect(addr, count, PROT_READ);
+    ASSERT(err == 0);
+    if (!window.io(true, addr, first * PAGE_BYTES, count))
+        FATAL("memory> Error writing back tile %p-%p", addr, addr + count);
+    __atomic_fetch_add(&FaultStats.tileStores, 1, __ATOMIC_RELAXED);
+
+    window.tiles[tile] = range_window::CLEAN;
+}
+
+// Evict the resident tile faulted least recently
+static void
+window_evict(range_window &window)
+{
+    size_t tile = window.lru.back();
+    if (window.tiles[tile] == range_window::DIRTY)
+        window_store(window, tile);
+
+    size_t first, last;
+    window_tile_pages(window, tile, first, last);
+    myptr addr = window.first + first * PAGE_BYTES;
+    size_t count = (last - first) * PAGE_BYTES;
+
+    int err = mprotect(addr, count, PROT_NONE);
+    ASSERT(err == 0);
+    err = madvise(addr, count, MADV_DONTNEED);
+    ASSERT(err == 0);
+    DEBUG("memory> Evicted tile %p-%p", addr, addr + count);
+    __atomic_fetch_add(&FaultStats.tileEvictions, 1, __ATOMIC_RELAXED);
+
+    window.lru.pop_back();
+    window.tiles[tile] = range_window::ABSENT;
+}
+
+// Load a tile, evicting others if the window is full. The tile is loaded in
+// a buffer whose pages then replace the pages of the tile, so that threads
+// that access the tile never see it partially loaded
+static void
+window_load(range_window &window, size_t tile, bool dirty)
+{
+    while (window.lru.size() >= window.maxTiles)
+        window_evict(window);
+
+    size_t first, last;
+    window_tile_pages(window, tile, first, last);
+    myptr addr = window.first + first * PAGE_BYTES;
+    size_t count = (last - first) * PAGE_BYTES;
+
+    void *buf = mmap(nullptr, count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+        FATAL("memory> Error allocating tile %p-%p: %s", addr, addr + count, strerror(errno));
+    if (!window.io(false, buf, first * PAGE_BYTES, count))
+        FATAL("memory> Error loading tile %p-%p", addr, addr + count);
+    if (mprotect(buf, count, PROT_NONE) != 0 ||
+        mremap(buf, count, count, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED)
+        FATAL("memory> Error moving tile %p-%p: %s", addr, addr + count, strerror(errno));
+    DEBUG("memory> Loaded tile %p-%p", addr, addr + count);
+    __atomic_fetch_add(&FaultStats.tileLoads, 1, __ATOMIC_RELAXED);
+
+    window.tiles[tile] = dirty? range_window::DIRTY: range_window::CLEAN;
+    window.lru.push_front(tile);
+    window.lruPos[tile] = window.lru.begin();
+    window_apply(window, tile, first, last);
+}
+
+static bool
+window_fault(handler_sigsegv &range, bool write, myptr addr)
+{
+    range_window &window = *range.window;
+    std::unique_lock<std::mutex> lock(window.mutex);
+
+    size_t page = size_t(addr - window.first) / PAGE_BYTES;
+    size_t tile = page / (window.tileBytes / PAGE_BYTES);
+    bool writable = (window.prots[page] & MEM_WRITE) != 0;
+
+    if (window.tiles[tile] == range_window::ABSENT) {
+        window_load(window, tile, write && writable);
+        return true;
+    }
+
+    window.lru.splice(window.lru.begin(), window.lru, window.lruPos[tile]);
+
+    if (write && writable && window.tiles[tile] == range_window::CLEAN) {
+        window.tiles[tile] = range_window::DIRTY;
+        size_t first, last;
+        window_tile_pages(window, tile, first, last);
+        window_apply(window, tile, first, last);
+        return true;
+    }
+
+    // The tile has been loaded by another thread since the fault
+    mem_access_type prot = window_effective(window, page, window.tiles[tile]);
+    return (prot & (write? MEM_WRITE: MEM_READ)) != 0;
+}
+
+// Record the protection of some pages of a windowed range, and apply it to the
+// pages of the resident tiles
+static void
+window_protect(range_window &window, myptr begin, myptr end, mem_access_type prot)
+{
+    std::unique_lock<std::mutex> lock(window.mutex);
+
+    size_t first = size_t(std::max(begin, window.first) - window.first) / PAGE_BYTES;
+    size_t last  = std::min(window.pages, size_t(end - window.first) / PAGE_BYTES);
+    if (first >= last) return;
+
+    memset(&window.prots[first], int(prot), last - first);
+
+    size_t tilePages = window.tileBytes / PAGE_BYTES;
+    for (size_t tile = first / tilePages; tile * tilePages < last; ++tile) {
+        if (window.tiles[tile] == range_window::ABSENT) continue;
+
+        size_t tileFirst, tileLast;
+        window_tile_pages(window, tile, tileFirst, tileLast);
+        window_apply(window, tile, std::max(first, tileFirst), std::min(last, tileLast));
+    }
+}
+
+// Pages of a range changed by the SIGSEGV backend to protect a part of it.
+// Ranges backed by huge pages are protected in multiples of the huge page size
+static inline void
+page_bounds(handler_sigsegv *handler, myptr addr, size_t count, myptr &begin, myptr &end)
+{
+    size_t page = handler->page_bytes();
+    begin = myptr(size_t(addr) / page * page);
+    end   = myptr((size_t(addr + count) + page - 1) / page * page);
+}
+
+// Change the protection of the pages of a range in the fault backend
+static void
+apply_protection(handler_sigsegv *handler, myptr addr, size_t count, mem_access_type access_type)
+{
+    __atomic_fetch_add(&FaultStats.protectCalls, 1, __ATOMIC_RELAXED);
+
+    if (Backend == fault_backend::userfaultfd) {
+        uffd_protect(handler, addr, count, access_type);
+        DEBUG("memory> %p-%p -> %s", addr, addr + count,
+              to_string(access_type));
+        return;
+    }
+
+    myptr begin, end;
+    page_bounds(handler, addr, count, begin, end);
+    if (handler->window) {
+        window_protect(*handler->window, begin, end, access_type);
+        DEBUG("memory> %p-%p -> %s (windowed)", addr, addr + count,
+              to_string(access_type));
+        return;
+    }
+    int err = mprotect(begin, size_t(end - begin), mem_access_to_prot(access_type));
+    DEBUG("memory> %p-%p -> %s", addr, addr + count,
+          to_string(access_type));
+    assert(err == 0);
+}
+
+// Protection change deferred by a protection_batch
+struct pending_protection {
+    handler_sigsegv *range;
+    myptr begin;
+    myptr end;
+    mem_access_type prot;
+};
+
+static thread_local unsigned BatchDepth = 0;
+static thread_local std::vector<pending_protection> BatchPending;
+
+// Apply the deferred protection changes of the thread. Changes are sorted by
+// address, and the ones to adjacent pages with the same protection are merged.
+// The userfaultfd backend, and windowed ranges, only merge changes within a
+// range
+static void
+apply_pending()
+{
+    if (BatchPending.empty()) return;
+
+    std::sort(BatchPending.begin(), BatchPending.end(),
+              [](const pending_protection &a, const pending_protection &b)
+              {
+                  return a.begin < b.begin;
+              });
+
+    pending_protection cur = BatchPending[0];
+    for (size_t i = 1; i < BatchPending.size(); ++i) {
+        const pending_protection &next = BatchPending[i];
+        if (next.prot == cur.prot &&
+            page_of(next.begin) == page_of(cur.end - 1) + 1 &&
+            (next.range == cur.range ||
+             (Backend == fault_backend::sigsegv && !next.range->window && !cur.range->window))) {
+            cur.end = next.end;
+            continue;
+        }
+        apply_protection(cur.range, cur.begin, size_t(cur.end - cur.begin), cur.prot);
+        cur = next;
+    }
+    apply_protection(cur.range, cur.begin, size_t(cur.end - cur.begin), cur.prot);
+
+    BatchPending.clear();
+}
+
+// Defer a protection change. Changes to pages with a deferred change are not
+// reordered: the deferred ones are applied first
+static void
+defer_protection(handler_sigsegv *handler, myptr addr, size_t count, mem_access_type access_type)
+{
+    uint64_t first = page_of(addr);
+    uint64_t last  = page_of(addr + count - 1);
+
+    for (auto &pending : BatchPending) {
+        if (page_of(pending.begin) <= last && first <= page_of(pending.end - 1)) {
+            apply_pending();
+            break;
+        }
+    }
+
+    pending_protection pending{handler, addr, addr + count, access_type};
+    if (Backend == fault_backend::sigsegv)
+        page_bounds(handler, addr, count, pending.begin, pending.end);
+    BatchPending.push_back(pending);
+}
+
+protection_batch::protection_batch() :
+    active_(PROTECT_BATCHING)
+{
+    if (active_) ++BatchDepth;
+}
+
+protection_batch::~protection_batch()
+{
+    if (active_ && --BatchDepth == 0)
+        apply_pending();
+}
+
 void
 protect_range(void *_addr, size_t count, mem_access_type access_type, handler_fn fn)
 {
     TRACE_FUNCTION();
 
-    uint64_t page = (uint64_t(_addr) >> 12);
-    myptr align_addr = myptr(page << 12);
     myptr addr = myptr(_addr);
 
-    map_handler::iterator it = handlers.upper_bound(addr);
+    // Called from the SIGSEGV handler too, so the table is read without locks
+    handler_sigsegv *handler = find_range(addr);
 
-    if (it == handlers.end())
+    if (!handler)
         FATAL("memory> Mapping %p NOT FOUND", addr);
 
-    handler_sigsegv &handler = it->second;
+    handler->set_handler(fn);
 
-    // Check for overlaps
-    ASSERT(addr >= handler.start() && addr < handler.end(),
-           "memory> Invalid mapping for %p", addr);
+    if (addr == handler->start() && count == handler->size()) {
+        if (access_type == handler->protection())
+            return;
 
-    handler.set_handler(fn);
+        handler->set_protection(access_type);
+    } else {
+        // Pages of the range have different protections now. The next change
+        // of the whole range cannot be skipped
+        handler->set_protection(MEM_MIXED);
+    }
 
-    if (access_type == handler.protection())
+    // Changes that grant access rights are applied right away, since the
+    // caller is about to use them
+    if (BatchDepth > 0 && access_type != MEM_READ_WRITE) {
+        defer_protection(handler, addr, count, access_type);
         return;
+    }
 
-    handler.set_protection(access_type);
+    apply_pending();
+    apply_protection(handler, addr, count, access_type);
+}
 
-    int err = mprotect(align_addr, count, mem_access_to_prot(access_type));
-    DEBUG("memory> %p-%p -> %s", addr, addr + count,
+bool
+move_range(void *_addr, void *_src, size_t count, mem_access_type access_type)
+{
+    TRACE_FUNCTION();
+
+    myptr addr = myptr(_addr);
+    myptr src  = myptr(_src);
+
+    apply_pending();
+
+    ASSERT(size_t(addr) % PAGE_BYTES == 0 && size_t(src) % PAGE_BYTES == 0 && count % PAGE_BYTES == 0);
+
+    handler_sigsegv *handler = find_range(addr);
+
+    if (!handler)
+        FATAL("memory> Mapping %p NOT FOUND", addr);
+
+    // The pages of resident tiles are owned by the window
+    if (handler->window) return false;
+
+    if (Backend == fault_backend::userfaultfd) {
+        if (!uffd_move(handler, addr, src, count, access_type))
+            return false;
+    } else {
+        // The pages of the buffer replace the pages of the range in a single
+        // call, with their final protection
+        if (mprotect(src, count, mem_access_to_prot(access_type)) != 0)
+            return false;
+        if (mremap(src, count, count, MREMAP_MAYMOVE | MREMAP_FIXED, addr) == MAP_FAILED) {
+            DEBUG("memory> Error moving %p-%p to %p: %s", src, src + count, addr, strerror(errno));
+            mprotect(src, count, PROT_READ | PROT_WRITE);
+            return false;
+        }
+        if (mmap(src, count, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            FATAL("memory> Error refilling %p-%p: %s", src, src + count, strerror(errno));
+    }
+
+    if (addr <= handler->start() && addr + count >= handler->end())
+        handler->set_protection(access_type);
+    else
+        handler->set_protection(MEM_MIXED);
+
+    DEBUG("memory> %p-%p <- %p -> %s", addr, addr + count, src,
           to_string(access_type));
-    assert(err == 0);
+    return true;
+}
+
+// Remove a range from the page table and from the fault backend. Must be
+// called with RangesMutex held
+static void
+drop_range(handler_sigsegv *range)
+{
+    if (Backend == fault_backend::userfaultfd)
+        uffd_unregister(range);
+
+    uint64_t first = page_of(range->start());
+    uint64_t last  = page_of(range->end() - 1);
+    for (uint64_t page = first; page <= last; ++page) {
+        get_page_slot(page).store(nullptr, std::memory_order_release);
+    }
+
+    FreeRanges.push_back(range);
 }
 
 void
-register_range(void *_addr, size_t count)
+register_range(void *_addr, size_t count, size_t pageBytes)
 {
     TRACE_FUNCTION();
 
     myptr addr = myptr(_addr);
 
-    map_handler::iterator it = handlers.upper_bound(addr);
-    if (it != handlers.end() &&
-        (addr >= it->second.start() &&
-         addr <  it->second.end())) {
-        FATAL("memory> Mapping %p-%p overlaps with %p-%p", addr, addr + count, it->second.start(), it->second.end());
+    if (count == 0) return;
+
+    std::unique_lock<std::mutex> lock(RangesMutex);
+
+    uint64_t first = page_of(addr);
+    uint64_t last  = page_of(addr + count - 1);
+
+    size_t bytes = pageBytes != 0? pageBytes: PAGE_BYTES;
+
+    for (uint64_t page = first; page <= last; ++page) {
+        handler_sigsegv *other = get_page_slot(page).load(std::memory_order_relaxed);
+        if (other && other->parked) {
+            if (other->start() == addr && other->size() == count && other->page_bytes() == bytes) {
+                // The range has been registered before: it keeps its pages
+                // and its registration with the fault backend
+                DEBUG("memory> REGISTERING parked mapping %p-%p", addr, addr + count);
+                other->clear_handler();
+                other->set_protection(MEM_READ_WRITE);
+                other->parked = false;
+                return;
+            }
+            drop_range(other);
+        } else if (other) {
+            FATAL("memory> Mapping %p-%p overlaps with %p-%p", addr, addr + count, other->start(), other->end());
+        }
+    }
+
+    DEBUG("memory> REGISTERING mapping %p-%p", addr, addr + count);
+
+    handler_sigsegv *range;
+    if (!FreeRanges.empty()) {
+        range = FreeRanges.back();
+        FreeRanges.pop_back();
     } else {
-        DEBUG("memory> REGISTERING mapping %p-%p", addr, addr + count);
-        handlers.insert(map_handler::value_type(addr + count,
-                                                handler_sigsegv{addr, count, MEM_READ_WRITE}));
+        range = new handler_sigsegv();
+    }
+    range->reset(addr, count, bytes, MEM_READ_WRITE);
+    if (Backend == fault_backend::userfaultfd)
+        uffd_register(range);
+
+    for (uint64_t page = first; page <= last; ++page) {
+        get_page_slot(page).store(range, std::memory_order_release);
     }
 }
 
@@ -232,20 +1237,131 @@ unregister_range(void *_addr)
 
     myptr addr = myptr(_addr);
 
-    map_handler::iterator it = handlers.upper_bound(addr);
-    if (it == handlers.end())
+    std::unique_lock<std::mutex> lock(RangesMutex);
+
+    handler_sigsegv *handler = find_range(addr);
+    if (!handler || handler->parked) {
+        // Not found! Empty ranges are not registered
+        DEBUG("memory> Mapping %p NOT FOUND", addr);
+        return;
+    }
+
+    apply_pending();
+    // Tiles that are not resident are not loaded: their contents are lost
+    handler->window.reset();
+    protect_range(handler->start(), handler->size(), mem_access_type::MEM_READ_WRITE);
+
+    auto kept = KeptMappings.upper_bound(handler->start());
+    if (kept != KeptMappings.begin() && (--kept)->second >= handler->end()) {
+        DEBUG("memory> Parking mapping %p-%p", handler->start(), handler->end());
+        handler->clear_handler();
+        handler->parked = true;
+        return;
+    }
+
+    DEBUG("memory> Removing mapping %p-%p", handler->start(), handler->end());
+    drop_range(handler);
+}
+
+bool
+is_registered(const void *addr)
+{
+    std::unique_lock<std::mutex> lock(RangesMutex);
+
+    handler_sigsegv *handler = find_range(addr);
+    return handler && !handler->parked;
+}
+
+bool
+window_range(void *_addr, size_t tileBytes, size_t budgetBytes, tile_io_fn io)
+{
+    TRACE_FUNCTION();
+
+    myptr addr = myptr(_addr);
+
+    if (Backend != fault_backend::sigsegv) return false;
+
+    std::unique_lock<std::mutex> lock(RangesMutex);
+
+    handler_sigsegv *handler = find_range(addr);
+    if (!handler || handler->parked)
         FATAL("memory> Mapping %p NOT FOUND", addr);
+    if (handler->page_bytes() != PAGE_BYTES) return false;
 
-    handler_sigsegv &handler = it->second;
-    if (addr >= handler.start() && addr < handler.end()) {
-        protect_range(handler.start(), handler.size(), mem_access_type::MEM_READ_WRITE);
-        DEBUG("memory> Removing mapping %p-%p", handler.start(), handler.end());
+    ASSERT(tileBytes > 0 && tileBytes % PAGE_BYTES == 0, "Invalid tile size %zd", tileBytes);
+    ASSERT(handler->protection() != MEM_MIXED, "Windowed ranges must have a single protection");
 
-        handlers.erase(it);
-    } else {
-        // Not found!
-        // FATAL("Mapping %pp", it->second.start(), it->second.end());
-        //abort();
+    apply_pending();
+
+    range_window *window = new range_window();
+    window->first     = myptr(size_t(handler->start()) / PAGE_BYTES * PAGE_BYTES);
+    window->pages     = (size_t(handler->end() - window->first) + PAGE_BYTES - 1) / PAGE_BYTES;
+    window->tileBytes = tileBytes;
+    window->maxTiles  = std::max<size_t>(1, budgetBytes / tileBytes);
+    window->io        = io;
+    window->prots.reset(new uint8_t[window->pages]);
+    memset(window->prots.get(), int(handler->protection()), window->pages);
+
+    size_t tiles = (window->pages * PAGE_BYTES + tileBytes - 1) / tileBytes;
+    window->tiles.assign(tiles, range_window::ABSENT);
+    window->lruPos.resize(tiles);
+
+    size_t count = window->pages * PAGE_BYTES;
+    int err = mprotect(window->first, count, PROT_NONE);
+    ASSERT(err == 0);
+    err = madvise(window->first, count, MADV_DONTNEED);
+    ASSERT(err == 0);
+
+    DEBUG("memory> Windowing mapping %p-%p: %zd tiles of %zd bytes, %zd resident",
+          handler->start(), handler->end(), tiles, tileBytes, window->maxTiles);
+    handler->window.reset(window);
+    return true;
+}
+
+bool
+flush_window(void *_addr)
+{
+    TRACE_FUNCTION();
+
+    handler_sigsegv *handler = find_range(myptr(_addr));
+    if (!handler || !handler->window) return false;
+
+    range_window &window = *handler->window;
+    std::unique_lock<std::mutex> lock(window.mutex);
+
+    for (size_t tile : window.lru) {
+        if (window.tiles[tile] != range_window::DIRTY) continue;
+
+        window_store(window, tile);
+
+        size_t first, last;
+        window_tile_pages(window, tile, first, last);
+        window_apply(window, tile, first, last);
+    }
+    return true;
+}
+
+void
+keep_ranges(void *_addr, size_t count, bool keep)
+{
+    myptr addr = myptr(_addr);
+
+    std::unique_lock<std::mutex> lock(RangesMutex);
+
+    if (keep) {
+        KeptMappings[addr] = addr + count;
+        return;
+    }
+
+    KeptMappings.erase(addr);
+    if (count == 0) return;
+
+    // Parked ranges are removed before the mapping is unmapped
+    uint64_t last = page_of(addr + count - 1);
+    for (uint64_t page = page_of(addr); page <= last; ++page) {
+        handler_sigsegv *range = find_page_range(page);
+        if (range && range->parked)
+            drop_range(range);
     }
 }
 
@@ -279,6 +1395,38 @@ handler_sigsegv_restore()
     }
 }
 
+void
+handler_faults_install()
+{
+    TRACE_FUNCTION();
+
+    if (FAULT_BACKEND.value() == to_string(fault_backend::userfaultfd)) {
+        if (uffd_install()) {
+            Backend = fault_backend::userfaultfd;
+        } else {
+            INFO("memory> Using the SIGSEGV fault backend");
+        }
+    } else if (FAULT_BACKEND.value() != to_string(fault_backend::sigsegv)) {
+        FATAL("Invalid value for CUDARRAYS_FAULT_BACKEND: %s", FAULT_BACKEND.value().c_str());
+    }
+
+    DEBUG("- Fault backend: %s", to_string(Backend));
+
+    if (Backend == fault_backend::sigsegv)
+        handler_sigsegv_overload();
+}
+
+void
+handler_faults_uninstall()
+{
+    TRACE_FUNCTION();
+
+    if (Backend == fault_backend::userfaultfd)
+        uffd_uninstall();
+    else
+        handler_sigsegv_restore();
+}
+
 }
 
 /* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
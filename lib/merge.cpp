@@ -0,0 +1,263 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <algorithm>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/detail/dynarray/merge.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+#include "cudarrays/detail/utils/misc.hpp"
+
+namespace cudarrays {
+
+utils::option<size_t> MERGE_CHUNK{"CUDARRAYS_MERGE_CHUNK", size_t(4) << 20};
+
+namespace detail {
+
+// Size in bytes of the blocks compared at once, rounded to whole elements
+static const size_t MERGE_BLOCK = 256;
+// Blocks below which buffers are merged by a single thread
+static const size_t MERGE_PARALLEL_BLOCKS = 256;
+
+// Compare two buffers with the widest vectors available
+static inline bool
+equal_bytes(const char *a, const char *b, size_t bytes)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i diff = _mm256_setzero_si256();
+    for (; i + sizeof(__m256i) <= bytes; i += sizeof(__m256i)) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(va, vb));
+    }
+    if (!_mm256_testz_si256(diff, diff)) return false;
+#elif defined(__SSE2__)
+    __m128i diff = _mm_setzero_si128();
+    for (; i + sizeof(__m128i) <= bytes; i += sizeof(__m128i)) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        diff = _mm_or_si128(diff, _mm_xor_si128(va, vb));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xffff) return false;
+#endif
+    return memcmp(a + i, b + i, bytes - i) == 0;
+}
+
+// Merge a block whose elements are compared as integers. The original contents
+// of the block are kept aside, so that replicas are applied in order and the
+// loops are vectorized
+template <typename T>
+static inline void
+merge_block(char *dst, const char *const *replicas, unsigned first, unsigned count, size_t begin, size_t end)
+{
+    T orig[MERGE_BLOCK / sizeof(T)];
+    T *out = reinterpret_cast<T *>(dst + begin);
+    size_t elems = (end - begin) / sizeof(T);
+
+    memcpy(orig, out, end - begin);
+    for (unsigned r = first; r < count; ++r) {
+        const T *in = reinterpret_cast<const T *>(replicas[r] + begin);
+        for (size_t i = 0; i < elems; ++i)
+            out[i] = in[i] != orig[i]? in[i]: out[i];
+    }
+}
+
+static inline void
+merge_block(char *dst, const char *const *replicas, unsigned first, unsigned count, size_t begin, size_t end,
+            size_t elemBytes)
+{
+    for (size_t elem = begin; elem < end; elem += elemBytes) {
+        for (unsigned r = count; r-- > first; ) {
+            if (memcmp(replicas[r] + elem, dst + elem, elemBytes) != 0) {
+                memcpy(dst + elem, replicas[r] + elem, elemBytes);
+                break;
+            }
+        }
+    }
+}
+
+bool
+merge_replicas(void *_dst, const void *const *_replicas, unsigned count, size_t elemBytes, size_t bytes)
+{
+    char *dst = static_cast<char *>(_dst);
+    const char *const *replicas = reinterpret_cast<const char *const *>(_replicas);
+
+    size_t blockBytes = std::max<size_t>(1, MERGE_BLOCK / elemBytes) * elemBytes;
+    long blocks = long(utils::div_ceil(bytes, blockBytes));
+
+    bool changed = false;
+
+    #pragma omp parallel for reduction(||:changed) if (blocks >= long(MERGE_PARALLEL_BLOCKS))
+    for (long block = 0; block < blocks; ++block) {
+        size_t begin = size_t(block) * blockBytes;
+        size_t end   = std::min(bytes, begin + blockBytes);
+
+        unsigned first = 0;
+        while (first < count && equal_bytes(replicas[first] + begin, dst + begin, end - begin))
+            ++first;
+        if (first == count) continue;
+
+        // Replicas before the first one that differs are equal in the block
+        switch (elemBytes) {
+        case 1:  merge_block<uint8_t>(dst, replicas, first, count, begin, end); break;
+        case 2:  merge_block<uint16_t>(dst, replicas, first, count, begin, end); break;
+        case 4:  merge_block<uint32_t>(dst, replicas, first, count, begin, end); break;
+        case 8:  merge_block<uint64_t>(dst, replicas, first, count, begin, end); break;
+        default: merge_block(dst, replicas, first, count, begin, end, elemBytes);
+        }
+        changed = true;
+    }
+
+    return changed;
+}
+
+void
+merge_pipeline(void *_host, size_t bytes, size_t elemBytes, unsigned replicas,
+               const replica_copy_fn &fetch, const replica_copy_fn &upload, merge_buffers &buffers)
+{
+    char *host = static_cast<char *>(_host);
+
+    size_t chunkBytes = std::max(elemBytes, MERGE_CHUNK.value() / elemBytes * elemBytes);
+    size_t chunks = utils::div_ceil(bytes, chunkBytes);
+    if (chunks == 0) return;
+
+    // Two parts are in flight: one is fetched while the other is merged
+    size_t slots = std::min<size_t>(chunks, 2);
+    size_t slotBytes = std::min(chunkBytes, bytes) * replicas;
+    if (buffers.bytes < slots * slotBytes) {
+        buffers.data.reset(new char[slots * slotBytes]);
+        buffers.bytes = slots * slotBytes;
+    }
+
+    std::vector<const void *> staging(slots * replicas);
+    for (size_t slot = 0; slot < slots; ++slot)
+        for (unsigned r = 0; r < replicas; ++r)
+            staging[slot * replicas + r] = buffers.data.get() + slot * slotBytes + r * (slotBytes / replicas);
+
+    std::vector<uint8_t> changed(chunks, 0);
+
+    auto chunk_bounds = [&](size_t chunk, size_t &offset, size_t &count)
+    {
+        offset = chunk * chunkBytes;
+        count  = std::min(chunkBytes, bytes - offset);
+    };
+    auto fetch_chunk = [&](size_t chunk)
+    {
+        size_t offset, count;
+        chunk_bounds(chunk, offset, count);
+        for (unsigned r = 0; r < replicas; ++r)
+            fetch(r, offset, count, const_cast<void *>(staging[(chunk % slots) * replicas + r]));
+    };
+    auto merge_chunk = [&](size_t chunk)
+    {
+        size_t offset, count;
+        chunk_bounds(chunk, offset, count);
+        changed[chunk] = merge_replicas(host + offset, &staging[(chunk % slots) * replicas], replicas,
+                                        elemBytes, count);
+        DEBUG("merge> %zd-%zd %s", offset, offset + count, changed[chunk]? "changed": "unchanged");
+    };
+    // Replicas already hold the parts that did not change
+    auto upload_chunk = [&](size_t chunk)
+    {
+        if (!changed[chunk]) return;
+
+        size_t offset, count;
+        chunk_bounds(chunk, offset, count);
+        for (unsigned r = 0; r < replicas; ++r)
+            upload(r, offset, count, host + offset);
+    };
+
+    if (chunks == 1) {
+        fetch_chunk(0);
+        merge_chunk(0);
+        upload_chunk(0);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t fetched = 0;
+    size_t merged  = 0;
+
+    std::thread transfers([&]()
+    {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            // The slot is free once the part fetched two steps before is merged
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&]() { return merged + 1 >= chunk; });
+            }
+            if (chunk >= 2) upload_chunk(chunk - 2);
+            fetch_chunk(chunk);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                fetched = chunk + 1;
+            }
+            cond.notify_all();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return merged == chunks; });
+        }
+        upload_chunk(chunks - 2);
+        upload_chunk(chunks - 1);
+    });
+
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return fetched > chunk; });
+        }
+        merge_chunk(chunk);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            merged = chunk + 1;
+        }
+        cond.notify_all();
+    }
+
+    transfers.join();
+}
+
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
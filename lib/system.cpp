@@ -39,7 +39,9 @@ void init()
 
     int devices;
     err = cudaGetDeviceCount(&devices);
-    ASSERT(err == cudaSuccess);
+    // Nodes without accelerators can still run kernels through launch_cpu
+    if (err == cudaErrorNoDevice) devices = 0;
+    else ASSERT(err == cudaSuccess);
 
     if (MAX_GPUS.value() == 0)
         GPUS = devices;
@@ -0,0 +1,186 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <sched.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "cudarrays/detail/cpu/topology.hpp"
+#include "cudarrays/detail/utils/log.hpp"
+
+namespace cudarrays {
+
+namespace cpu {
+
+// Parse a list of CPUs in the kernel format (e.g. "0-3,8,10-11")
+static std::vector<unsigned>
+parse_cpu_list(const std::string &list)
+{
+    std::vector<unsigned> ret;
+
+    const char *pos = list.c_str();
+    while (*pos != '\0' && *pos != '\n') {
+        char *end;
+        unsigned first = unsigned(strtoul(pos, &end, 10));
+        if (end == pos) break;
+        unsigned last = first;
+        if (*end == '-') {
+            pos = end + 1;
+            last = unsigned(strtoul(pos, &end, 10));
+        }
+        for (unsigned cpu = first; cpu <= last; ++cpu)
+            ret.push_back(cpu);
+        pos = (*end == ',')? end + 1: end;
+    }
+
+    return ret;
+}
+
+// Usable cores of the process, paired with their NUMA node and sorted by node
+static const std::vector<std::pair<int, unsigned>> &
+get_cores()
+{
+    static std::vector<std::pair<int, unsigned>> cores;
+    static std::once_flag flag;
+
+    std::call_once(flag, []()
+    {
+        std::vector<unsigned> usable;
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+            for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &mask))
+                    usable.push_back(cpu);
+            }
+        }
+        if (usable.empty()) {
+            for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+                usable.push_back(cpu);
+        }
+
+        std::vector<int> nodes(CPU_SETSIZE, -1);
+
+        DIR *dir = opendir("/sys/devices/system/node");
+        if (dir != nullptr) {
+            while (struct dirent *entry = readdir(dir)) {
+                int node;
+                if (sscanf(entry->d_name, "node%d", &node) != 1) continue;
+
+                std::ifstream file(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+                std::string list;
+                if (!std::getline(file, list)) continue;
+
+                for (unsigned cpu : parse_cpu_list(list)) {
+                    if (cpu < CPU_SETSIZE)
+                        nodes[cpu] = node;
+                }
+            }
+            closedir(dir);
+        }
+
+        for (unsigned cpu : usable)
+            cores.emplace_back(nodes[cpu], cpu);
+        std::stable_sort(cores.begin(), cores.end());
+    });
+
+    return cores;
+}
+
+unsigned
+get_numa_nodes()
+{
+    const auto &cores = get_cores();
+
+    unsigned nodes = 1;
+    for (unsigned i = 1; i < cores.size(); ++i) {
+        if (cores[i].first != cores[i - 1].first)
+            ++nodes;
+    }
+
+    return nodes;
+}
+
+std::vector<core_set>
+get_core_sets(unsigned sets)
+{
+    const auto &cores = get_cores();
+
+    std::vector<core_set> ret(sets);
+
+    size_t n = cores.size();
+    for (unsigned s = 0; s < sets; ++s) {
+        size_t first, last;
+        if (sets <= n) {
+            first = n * s / sets;
+            last  = n * (s + 1) / sets;
+        } else {
+            first = s % n;
+            last  = first + 1;
+        }
+
+        ret[s].node = cores[first].first;
+        for (size_t c = first; c < last; ++c)
+            ret[s].cpus.push_back(cores[c].second);
+
+        DEBUG("cpu> core set %u: node %d, %zu cores", s, ret[s].node, ret[s].cpus.size());
+    }
+
+    return ret;
+}
+
+std::vector<core_set>
+get_node_core_sets()
+{
+    std::vector<core_set> ret;
+
+    for (auto &core : get_cores()) {
+        if (core.first < 0) return {};
+        if (ret.empty() || ret.back().node != core.first)
+            ret.push_back(core_set{core.first, {}});
+        ret.back().cpus.push_back(core.second);
+    }
+
+    return ret;
+}
+
+}
+
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
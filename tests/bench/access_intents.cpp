@@ -0,0 +1,177 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Transfers saved by declaring the access intents of the arrays of a kernel.
+// Every step the host writes two input vectors, a kernel computes an output
+// vector from them and the host post-processes the output in place. Without
+// intents the inputs are transferred back to the host before being written
+// again, and the output written by the host is transferred to the devices
+// before being overwritten by the kernel. Each configuration runs in a child
+// process, so that device memory is allocated in the same order. Kernels are
+// emulated by overwriting all the device memory when they are launched, and
+// the values read from the output must match across configurations. Device
+// memory is host memory of the stand-in of the CUDA runtime
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ELEMS = 4 * 1024 * 1024;
+static const unsigned STEPS = 8;
+
+// Intents declared on the views of the kernel
+static const char *MODES[] = { "none", "read", "write_discard", "both" };
+
+using vector_type = vector_view<float, noalign, reshape::x>;
+
+__global__ void
+add_kernel(vector_type, vector_type, vector_type)
+{
+    // Emulated by the stand-in
+}
+
+static int
+child(const std::string &mode)
+{
+    init_lib();
+    host_runtime_fill_on_launch(true);
+
+    unsigned gpus = system::gpu_count();
+
+    auto A = make_vector<float, reshape::x>({ELEMS});
+    auto B = make_vector<float, reshape::x>({ELEMS});
+    auto C = make_vector<float, reshape::x>({ELEMS});
+    A.distribute<1>({compute_conf<1>{compute::x, gpus}, {{0}}});
+    B.distribute<1>({compute_conf<1>{compute::x, gpus}, {{0}}});
+    C.distribute<1>({compute_conf<1>{compute::x, gpus}, {{0}}});
+
+    if (mode == "read" || mode == "both") {
+        A.set_access_intent(access_intent::read);
+        B.set_access_intent(access_intent::read);
+    }
+    if (mode == "write_discard" || mode == "both")
+        C.set_access_intent(access_intent::write_discard);
+
+    for (array_size_t i = 0; i < ELEMS; ++i)
+        C(i) = 0.f;
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    cuda_conf conf{1, 1};
+
+    unsigned long bytes = 0;
+    double ms = 0.0;
+    uint64_t checksum = 0;
+    for (unsigned step = 0; step < STEPS; ++step) {
+        HostRuntime.reset();
+        auto start = std::chrono::steady_clock::now();
+
+        for (array_size_t i = 0; i < ELEMS; ++i) {
+            A(i) = float(step) + float(i);
+            B(i) = float(step) * float(i);
+        }
+
+        launch(add_kernel, conf, gpuConf)(C, A, B);
+
+        for (array_size_t i = 0; i < ELEMS; ++i) {
+            float val = C(i);
+            uint32_t bits;
+            memcpy(&bits, &val, sizeof(bits));
+            checksum = checksum * 31 + bits;
+            C(i) = val * 0.5f;
+        }
+
+        ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bytes += HostRuntime.memcpyBytes;
+    }
+
+    printf("%lu %f %llu\n", bytes / STEPS, ms / STEPS, (unsigned long long)checksum);
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1) return child(argv[1]);
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("GPUs: %u, vectors: %zu floats, %u steps\n", system::gpu_count(), size_t(ELEMS), STEPS);
+    printf("%-14s %12s %10s\n", "intents", "MiB/step", "ms/step");
+
+    bool first = true;
+    unsigned long long reference = 0;
+    for (const char *mode : MODES) {
+        std::string cmd = std::string("'") + self + "' " + mode;
+        FILE *out = popen(cmd.c_str(), "r");
+        if (!out) {
+            perror("popen");
+            abort();
+        }
+
+        unsigned long bytes;
+        double ms;
+        unsigned long long checksum;
+        int n = fscanf(out, "%lu %lf %llu", &bytes, &ms, &checksum);
+        if (pclose(out) != 0 || n != 3) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+
+        if (first) reference = checksum;
+        first = false;
+
+        bool match = checksum == reference;
+        printf("%-14s %12.2f %10.3f%s\n", mode, double(bytes) / (1024 * 1024), ms, match? "": "  WRONG VALUES");
+        if (!match) return 1;
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,184 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Time to the first kernel on a grid stored on disk. The copy-in path reads
+// a raw file into a buffer with fread and copies it element by element into a
+// matrix. The mapped path creates the matrix over an array file, and its pages
+// are loaded when the first kernel transfers the matrix to the devices. Both
+// run with the files evicted from the page cache (cold) and cached (warm).
+// Linked against the host stand-in of the CUDA runtime, which copies the
+// matrix but does not run the kernel. The files are created in the directory
+// given as argument, or in the current one
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/array_file.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ROWS = 8192;
+static const array_size_t COLS = 8192;
+
+using matrix_array = matrix<float, layout::rmo, noalign, reshape_block::xy>;
+using matrix_type  = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+first_kernel(matrix_type)
+{
+    // Not executed by the stand-in
+}
+
+static float
+value(array_size_t i, array_size_t j)
+{
+    return float((i * 31 + j) % 1021);
+}
+
+// Write the contents of the file to the disk and drop its cached pages
+static void
+evict(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static void
+run_first_kernel(matrix_type &M)
+{
+    unsigned gpus = system::gpu_count();
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+    launch(first_kernel, cuda_conf{1, 1}, compute_conf<1>{compute::x, gpus})(M);
+}
+
+static bool
+check(matrix_type &M)
+{
+    for (array_size_t i = 0; i < ROWS; i += 127) {
+        for (array_size_t j = 0; j < COLS; j += 131) {
+            if (M(i, j) != value(i, j)) {
+                fprintf(stderr, "Wrong value at (%zd, %zd): %f\n", size_t(i), size_t(j), M(i, j));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = argc > 1? argv[1]: ".";
+    std::string raw  = dir + "/array_file_grid.raw";
+    std::string path = dir + "/array_file_grid.cuda";
+
+    init_lib();
+
+    // Datasets: raw grid and array file with the same contents
+    {
+        std::vector<float> grid(ROWS * COLS);
+        for (array_size_t i = 0; i < ROWS; ++i)
+            for (array_size_t j = 0; j < COLS; ++j)
+                grid[i * COLS + j] = value(i, j);
+
+        FILE *f = fopen(raw.c_str(), "wb");
+        if (!f || fwrite(grid.data(), sizeof(float), grid.size(), f) != grid.size()) {
+            perror(raw.c_str());
+            return 1;
+        }
+        fclose(f);
+
+        auto M = make_array_file<matrix_array>(path, {ROWS, COLS});
+        for (array_size_t i = 0; i < ROWS; ++i)
+            for (array_size_t j = 0; j < COLS; ++j)
+                M(i, j) = grid[i * COLS + j];
+    }
+
+    printf("GPUs: %u, grid: %zux%zu floats (%zu MiB)\n", system::gpu_count(), size_t(ROWS), size_t(COLS),
+           size_t(ROWS * COLS * sizeof(float)) >> 20);
+    printf("%-8s %-6s %12s %12s %14s\n", "path", "cache", "ready (ms)", "kernel (ms)", "to kernel (ms)");
+
+    for (bool cold : { true, false }) {
+        for (bool mapped : { false, true }) {
+            if (cold) {
+                evict(raw);
+                evict(path);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            matrix_type M = mapped? open_array_file<matrix_array>(path, file_mode::read_only):
+                                    make_matrix<float, layout::rmo, reshape_block::xy>({ROWS, COLS});
+            if (!mapped) {
+                std::vector<float> grid(ROWS * COLS);
+                FILE *f = fopen(raw.c_str(), "rb");
+                if (!f || fread(grid.data(), sizeof(float), grid.size(), f) != grid.size()) {
+                    perror(raw.c_str());
+                    return 1;
+                }
+                fclose(f);
+
+                for (array_size_t i = 0; i < ROWS; ++i)
+                    for (array_size_t j = 0; j < COLS; ++j)
+                        M(i, j) = grid[i * COLS + j];
+            }
+            auto ready = std::chrono::steady_clock::now();
+
+            run_first_kernel(M);
+            auto end = std::chrono::steady_clock::now();
+
+            if (!check(M)) return 1;
+
+            printf("%-8s %-6s %12.1f %12.1f %14.1f\n", mapped? "mapped": "copy-in", cold? "cold": "warm",
+                   std::chrono::duration<double, std::milli>(ready - start).count(),
+                   std::chrono::duration<double, std::milli>(end - ready).count(),
+                   std::chrono::duration<double, std::milli>(end - start).count());
+        }
+    }
+
+    unlink(raw.c_str());
+    unlink(path.c_str());
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
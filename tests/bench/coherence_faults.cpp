@@ -0,0 +1,219 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Transfers and time needed to read parts of arrays written by the GPUs, as a
+// function of the granularity of the transfers done on CPU faults. Each
+// granularity runs in a child process since it is read from the environment
+// at startup. Device memory is host memory of the stand-in of the CUDA
+// runtime. The values read with every granularity are checked against the
+// ones read when the whole array is transferred on the first fault
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t VECTOR_ELEMS = 8 * 1024 * 1024;
+static const array_size_t MATRIX_ROWS  = 2048;
+static const array_size_t MATRIX_COLS  = 4096;
+
+static const size_t GRANULARITIES[] = { 0, 4 * 1024, 64 * 1024, 1024 * 1024 };
+
+using vector_type = vector_view<float, noalign, reshape_block::x>;
+using matrix_type = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+write_kernel(vector_type, matrix_type)
+{
+    // Not executed by the stand-in: device memory is written when the
+    // kernel is launched (see host_runtime_fill_on_launch)
+}
+
+// Elements read by a pattern: count elements separated by step
+struct access_pattern {
+    const char *name;
+    array_size_t step;
+    array_size_t count;
+};
+
+template <typename F>
+static void
+run_pattern(const char *array, const access_pattern &pattern, F read)
+{
+    HostRuntime.reset();
+
+    uint64_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (array_size_t i = 0; i < pattern.count; ++i) {
+        float val = read(i * pattern.step);
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        checksum = checksum * 31 + bits;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s %s %lu %lu %f %llu\n", array, pattern.name,
+           (unsigned long)HostRuntime.memcpy, (unsigned long)HostRuntime.memcpyBytes,
+           ms, (unsigned long long)checksum);
+}
+
+static int
+child()
+{
+    init_lib();
+    host_runtime_fill_on_launch(true);
+
+    unsigned gpus = system::gpu_count();
+
+    auto V = make_vector<float, reshape_block::x>({VECTOR_ELEMS});
+    auto M = make_matrix<float, layout::rmo, reshape_block::xy>({MATRIX_ROWS, MATRIX_COLS});
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    V.distribute<1>({gpuConf, {{0}}});
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+
+    const array_size_t MATRIX_ELEMS = MATRIX_ROWS * MATRIX_COLS;
+
+    std::vector<access_pattern> vectorPatterns = {
+        { "probe", VECTOR_ELEMS / 64, 64 },
+        { "head",  1, VECTOR_ELEMS / 16 },
+        { "all",   1, VECTOR_ELEMS },
+    };
+    std::vector<access_pattern> matrixPatterns = {
+        { "probe",  MATRIX_ELEMS / 64, 64 },
+        { "head",   1, MATRIX_ELEMS / 16 },
+        { "column", MATRIX_COLS, MATRIX_ROWS },
+        { "all",    1, MATRIX_ELEMS },
+    };
+
+    cuda_conf conf{1, 1};
+
+    for (auto &pattern : vectorPatterns) {
+        launch(write_kernel, conf, gpuConf)(V, M);
+
+        run_pattern("vector", pattern, [&](array_size_t i) { return V(i); });
+    }
+    for (auto &pattern : matrixPatterns) {
+        launch(write_kernel, conf, gpuConf)(V, M);
+
+        run_pattern("matrix", pattern, [&](array_size_t i) { return M(i / MATRIX_COLS, i % MATRIX_COLS); });
+    }
+
+    return 0;
+}
+
+struct result {
+    std::string array;
+    std::string pattern;
+    unsigned long transfers;
+    unsigned long bytes;
+    double ms;
+    unsigned long long checksum;
+};
+
+static std::vector<result>
+run_child(const std::string &self, size_t granularity)
+{
+    std::string cmd = "CUDARRAYS_COHERENCE_FAULT_GRANULARITY=" + std::to_string(granularity) +
+                      " '" + self + "' child";
+    FILE *out = popen(cmd.c_str(), "r");
+    if (!out) {
+        perror("popen");
+        abort();
+    }
+
+    std::vector<result> results;
+    char array[32], pattern[32];
+    result r;
+    while (fscanf(out, "%31s %31s %lu %lu %lf %llu", array, pattern,
+                  &r.transfers, &r.bytes, &r.ms, &r.checksum) == 6) {
+        r.array = array;
+        r.pattern = pattern;
+        results.push_back(r);
+    }
+
+    if (pclose(out) != 0) {
+        fprintf(stderr, "Error running the benchmark with granularity %zu\n", granularity);
+        abort();
+    }
+
+    return results;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    std::vector<std::vector<result>> runs;
+    for (size_t granularity : GRANULARITIES)
+        runs.push_back(run_child(self, granularity));
+
+    printf("GPUs: %u, vector: %zu floats, matrix: %zux%zu floats\n", system::gpu_count(),
+           size_t(VECTOR_ELEMS), size_t(MATRIX_ROWS), size_t(MATRIX_COLS));
+    printf("%-7s %-7s %11s %10s %10s %10s\n", "array", "pattern", "granularity", "transfers", "MiB", "ms");
+
+    bool ok = true;
+    for (size_t i = 0; i < runs[0].size(); ++i) {
+        for (size_t g = 0; g < runs.size(); ++g) {
+            const result &r = runs[g][i];
+            std::string granularity = GRANULARITIES[g] == 0? "whole": std::to_string(GRANULARITIES[g] / 1024) + "K";
+            bool match = r.checksum == runs[0][i].checksum;
+            printf("%-7s %-7s %11s %10lu %10.2f %10.3f%s\n", r.array.c_str(), r.pattern.c_str(),
+                   granularity.c_str(), r.transfers, double(r.bytes) / (1024 * 1024), r.ms,
+                   match? "": "  WRONG VALUES");
+            ok = ok && match;
+        }
+    }
+
+    return ok? 0: 1;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
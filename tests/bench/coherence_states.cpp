@@ -0,0 +1,204 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+// Transfers done by the coherence protocol when the host updates a few
+// elements of arrays that are only read by the kernels. A replicated vector is
+// read alternately by kernels on one GPU and on all of them, so that only the
+// copies of the GPUs that run a kernel are updated, and a partitioned matrix
+// is read by kernels on all the GPUs. The bytes copied and avoided are taken
+// from the transition logs of the arrays. At the end the arrays are written
+// by a kernel and read back to check that no copy was left stale. Device
+// memory is host memory of the stand-in of the CUDA runtime
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t VECTOR_ELEMS = 4 * 1024 * 1024;
+static const array_size_t ROWS = 2048;
+static const array_size_t COLS = 4096;
+
+static const unsigned STEPS = 8;
+// Elements written by the host before every kernel
+static const array_size_t UPDATES = 64;
+
+using vector_type  = vector_view<float, noalign, replicate::none>;
+using vector_ctype = vector_cview<float, noalign, replicate::none>;
+using matrix_type  = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+using matrix_ctype = matrix_cview<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+read_vector(vector_ctype)
+{
+    // Not executed by the stand-in
+}
+
+__global__ void
+read_matrix(matrix_ctype)
+{
+    // Not executed by the stand-in
+}
+
+__global__ void
+write_arrays(vector_type, matrix_type)
+{
+    // Not executed by the stand-in
+}
+
+// Bytes copied and avoided according to the transition log of an array
+struct log_totals {
+    size_t copied;
+    size_t avoided;
+};
+
+template <typename Array>
+static log_totals
+get_totals(Array &A, size_t &seen)
+{
+    auto &policy = static_cast<default_coherence &>(A.get_coherence_policy());
+    auto &log = policy.get_transitions();
+
+    log_totals totals{0, 0};
+    for (size_t i = seen; i < log.size(); ++i) {
+        // Only the transfers to the devices
+        if (log[i].agent == coherence_transition::HOST) continue;
+        totals.copied  += log[i].copied;
+        totals.avoided += log[i].avoided;
+    }
+    seen = log.size();
+    return totals;
+}
+
+static void
+report(const char *array, unsigned gpus, const log_totals &totals)
+{
+    printf("%-7s %5u %10lu %10.2f %12.2f %12.2f\n", array, gpus, (unsigned long)HostRuntime.memcpy,
+           double(HostRuntime.memcpyBytes) / (1024 * 1024),
+           double(totals.copied) / (1024 * 1024), double(totals.avoided) / (1024 * 1024));
+}
+
+int main(int, char *argv[])
+{
+    // The log is configured at startup
+    if (!getenv("CUDARRAYS_COHERENCE_LOG")) {
+        setenv("CUDARRAYS_COHERENCE_LOG", "1048576", 1);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+
+    auto V = make_vector<float, replicate::none>({VECTOR_ELEMS});
+    auto M = make_matrix<float, layout::rmo, reshape_block::xy>({ROWS, COLS});
+    V.distribute<1>({compute_conf<1>{compute::x, gpus}, {{0}}});
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+
+    std::vector<float> expectedV(VECTOR_ELEMS);
+    std::vector<float> expectedM(ROWS * COLS);
+    for (array_size_t i = 0; i < VECTOR_ELEMS; ++i)
+        V(i) = expectedV[i] = float(i);
+    for (array_size_t i = 0; i < ROWS; ++i)
+        for (array_size_t j = 0; j < COLS; ++j)
+            M(i, j) = expectedM[i * COLS + j] = float(i + j);
+
+    cuda_conf conf{1, 1};
+    compute_conf<1> allConf{compute::x, gpus};
+    compute_conf<1> oneConf{compute::x, 1};
+    compute_conf<2> matrixConf{compute::xy, gpus};
+
+    printf("GPUs: %u, vector: %zu floats (replicated), matrix: %zux%zu floats, %zu updates per kernel\n", gpus,
+           size_t(VECTOR_ELEMS), size_t(ROWS), size_t(COLS), size_t(UPDATES));
+    printf("%-7s %5s %10s %10s %12s %12s\n", "array", "gpus", "copies", "MiB", "copied MiB", "avoided MiB");
+
+    size_t seenV = 0, seenM = 0;
+    for (unsigned step = 0; step < STEPS; ++step) {
+        for (array_size_t u = 0; u < UPDATES; ++u) {
+            array_size_t i = (step * 7919 + u * (VECTOR_ELEMS / UPDATES)) % VECTOR_ELEMS;
+            V(i) = expectedV[i] = float(step) - float(i);
+            array_size_t r = (step * 13 + u * (ROWS / UPDATES)) % ROWS;
+            M(r, step) = expectedM[r * COLS + step] = float(step) * float(r);
+        }
+
+        // Every other kernel runs on one GPU only
+        bool one = step % 2 == 0;
+        HostRuntime.reset();
+        if (one)
+            launch(read_vector, conf, oneConf)(V);
+        else
+            launch(read_vector, conf, allConf)(V);
+        report("vector", one? 1: gpus, get_totals(V, seenV));
+
+        HostRuntime.reset();
+        launch(read_matrix, conf, matrixConf)(M);
+        report("matrix", gpus, get_totals(M, seenM));
+    }
+
+    // The copies of the replicated vector are merged when it is read back
+    launch(write_arrays, conf, allConf)(V, M);
+
+    for (array_size_t i = 0; i < VECTOR_ELEMS; ++i) {
+        if (V(i) != expectedV[i]) {
+            fprintf(stderr, "Wrong value at V(%zd): %f (expected %f)\n", size_t(i), V(i), expectedV[i]);
+            return 1;
+        }
+    }
+    for (array_size_t i = 0; i < ROWS; ++i) {
+        for (array_size_t j = 0; j < COLS; ++j) {
+            if (M(i, j) != expectedM[i * COLS + j]) {
+                fprintf(stderr, "Wrong value at M(%zd, %zd): %f (expected %f)\n",
+                        size_t(i), size_t(j), M(i, j), expectedM[i * COLS + j]);
+                return 1;
+            }
+        }
+    }
+
+    auto &policy = static_cast<default_coherence &>(V.get_coherence_policy());
+    printf("Last transitions of the vector:\n");
+    auto &log = policy.get_transitions();
+    for (size_t i = log.size() > 8? log.size() - 8: 0; i < log.size(); ++i)
+        printf("  %s\n", to_string(log[i]).c_str());
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,176 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Bytes transferred to the GPUs when the host updates a few rows of a matrix
+// between kernels, with and without tracking the pages written by the host.
+// Each configuration runs in a child process since it is read from the
+// environment at startup. Device memory is host memory of the stand-in of the
+// CUDA runtime. After every kernel the matrix is read back and compared with
+// the values written by the host
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ROWS = 2048;
+static const array_size_t COLS = 4096;
+
+static const unsigned STEPS = 10;
+
+static const array_size_t UPDATED_ROWS[] = { 1, 16, 256, ROWS };
+
+using matrix_type = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+step_kernel(matrix_type)
+{
+    // Not executed by the stand-in
+}
+
+static int
+child()
+{
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+
+    auto M = make_matrix<float, layout::rmo, reshape_block::xy>({ROWS, COLS});
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+
+    std::vector<float> expected(ROWS * COLS, 0.f);
+    for (array_size_t i = 0; i < ROWS; ++i)
+        for (array_size_t j = 0; j < COLS; ++j)
+            M(i, j) = 0.f;
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    cuda_conf conf{1, 1};
+
+    // Initial transfer
+    launch(step_kernel, conf, gpuConf)(M);
+
+    for (array_size_t rows : UPDATED_ROWS) {
+        double writeMs = 0.0, releaseMs = 0.0;
+        unsigned long copies = 0, bytes = 0;
+
+        for (unsigned step = 0; step < STEPS; ++step) {
+            auto start = std::chrono::steady_clock::now();
+            for (array_size_t r = 0; r < rows; ++r) {
+                array_size_t i = (step * 7 + r * (ROWS / rows)) % ROWS;
+                for (array_size_t j = 0; j < COLS; ++j) {
+                    float val = float(step * rows + r) + float(j) * 0.5f;
+                    M(i, j) = val;
+                    expected[i * COLS + j] = val;
+                }
+            }
+            auto mid = std::chrono::steady_clock::now();
+
+            HostRuntime.reset();
+            launch(step_kernel, conf, gpuConf)(M);
+            auto end = std::chrono::steady_clock::now();
+
+            copies += HostRuntime.memcpy;
+            bytes  += HostRuntime.memcpyBytes;
+            writeMs   += std::chrono::duration<double, std::milli>(mid - start).count();
+            releaseMs += std::chrono::duration<double, std::milli>(end - mid).count();
+
+            // The values read are transferred back from the devices
+            for (array_size_t i = 0; i < ROWS; ++i) {
+                for (array_size_t j = 0; j < COLS; ++j) {
+                    if (M(i, j) != expected[i * COLS + j]) {
+                        fprintf(stderr, "Wrong value at (%zd, %zd): %f (expected %f)\n",
+                                size_t(i), size_t(j), M(i, j), expected[i * COLS + j]);
+                        return 1;
+                    }
+                }
+            }
+        }
+
+        printf("%zu %lu %lu %f %f\n", size_t(rows), copies / STEPS, bytes / STEPS,
+               writeMs / STEPS, releaseMs / STEPS);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("GPUs: %u, matrix: %zux%zu floats, %u steps\n", system::gpu_count(),
+           size_t(ROWS), size_t(COLS), STEPS);
+    printf("%-9s %6s %10s %10s %10s %10s\n", "tracking", "rows", "copies", "MiB", "write ms", "release ms");
+
+    for (bool tracking : { false, true }) {
+        std::string cmd = std::string("CUDARRAYS_COHERENCE_DIRTY_TRACKING=") + (tracking? "1": "0") +
+                          " '" + self + "' child";
+        FILE *out = popen(cmd.c_str(), "r");
+        if (!out) {
+            perror("popen");
+            abort();
+        }
+
+        size_t rows;
+        unsigned long copies, bytes;
+        double writeMs, releaseMs;
+        while (fscanf(out, "%zu %lu %lu %lf %lf", &rows, &copies, &bytes, &writeMs, &releaseMs) == 5) {
+            printf("%-9s %6zu %10lu %10.2f %10.3f %10.3f\n", tracking? "yes": "no", rows, copies,
+                   double(bytes) / (1024 * 1024), writeMs, releaseMs);
+        }
+
+        if (pclose(out) != 0) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,139 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+
+#include "stencil_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 4;
+
+static const array_size_t STENCIL_ELEMS = 2048;
+
+using storage = automatic::none;
+
+// Host work overlapped with the kernels: validate the previous result
+template <typename Array>
+static double
+checksum(Array &a)
+{
+    double sum = 0.0;
+    const float *data = static_cast<const float *>(a.host_addr());
+    for (array_size_t i = 0; i < a.size() / sizeof(float); ++i)
+        sum += data[i];
+    return sum;
+}
+
+template <typename Array>
+static void
+check(Array &a, double ref)
+{
+    if (checksum(a) != ref) {
+        fprintf(stderr, "stencil: wrong result\n");
+        abort();
+    }
+}
+
+static double
+elapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    init_lib();
+
+    if (argc > 1)
+        cpu::worker_pool::get().resize(unsigned(atoi(argv[1])));
+
+    static const array_size_t STENCIL_TOTAL = STENCIL_ELEMS + 2 * STENCIL;
+
+    auto SA = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SB = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SC = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+
+    for (array_size_t i = 0; i < STENCIL_TOTAL; ++i) {
+        for (array_size_t j = 0; j < STENCIL_TOTAL; ++j) {
+            SA(i, j) = float((i * 7 + j * 3) % 17);
+        }
+    }
+
+    cuda_conf confStencil{dim3(STENCIL_ELEMS / STENCIL_BLOCK_X, STENCIL_ELEMS / STENCIL_BLOCK_Y),
+                          dim3(STENCIL_BLOCK_X, STENCIL_BLOCK_Y)};
+
+    // Warm-up run
+    launch_cpu(stencil_kernel<storage, storage>, confStencil)(SB, SA);
+    double ref = checksum(SB);
+
+    // Synchronous launches followed by the host work
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep) {
+        launch_cpu(stencil_kernel<storage, storage>, confStencil)(SB, SA);
+        check(SB, ref);
+    }
+    double sync = elapsed(start) / REPETITIONS;
+
+    // Asynchronous launches overlapped with the host work. The output arrays
+    // alternate so that the host checks the result of the previous launch
+    unsigned pending = 0;
+    launch_cpu_future::times times;
+    start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep) {
+        auto &out  = (rep % 2 == 0)? SC: SB;
+        auto &prev = (rep % 2 == 0)? SB: SC;
+
+        auto future = launch_cpu_async(stencil_kernel<storage, storage>, confStencil)(out, SA);
+        if (rep > 0) check(prev, ref);
+        // The kernel is still running after the host work?
+        if (!future.ready())
+            ++pending;
+        times = future.get();
+    }
+    check(((REPETITIONS - 1) % 2 == 0)? SC: SB, ref);
+    double async = elapsed(start) / REPETITIONS;
+
+    printf("sync:  %9.3f ms/iteration\n", sync);
+    printf("async: %9.3f ms/iteration (kernel pending after host work: %u/%u)\n", async, pending, REPETITIONS);
+    printf("last launch: wall %.3f ms\n", times.wall);
+    for (unsigned w = 0; w < times.busy.size(); ++w)
+        printf("  worker %2u: busy %9.3f ms (%5.1f%%)\n", w, times.busy[w], 100.0 * times.busy[w] / times.wall);
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
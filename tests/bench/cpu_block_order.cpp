@@ -0,0 +1,152 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+
+#include "matrixmul_kernel.cuh"
+#include "stencil_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 3;
+
+static const array_size_t STENCIL_ELEMS   = 4096;
+static const array_size_t MATRIXMUL_ELEMS = 1024;
+
+using storage = automatic::none;
+
+static double
+time_launches(const std::function<void ()> &run)
+{
+    // Warm-up run: first touch of the arrays and computation of the block sequence
+    run();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep)
+        run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / REPETITIONS;
+}
+
+template <typename Array>
+static void
+check(const char *name, cpu::block_order order, Array &out, Array &ref)
+{
+    if (memcmp(out.host_addr(), ref.host_addr(), out.size()) != 0) {
+        fprintf(stderr, "%s (%s): wrong result\n", name, cpu::to_string(order));
+        abort();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    init_lib();
+
+    if (argc > 1)
+        cpu::worker_pool::get().resize(unsigned(atoi(argv[1])));
+
+    static const array_size_t STENCIL_TOTAL = STENCIL_ELEMS + 2 * STENCIL;
+
+    auto SA    = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SB    = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SBRef = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+
+    for (array_size_t i = 0; i < STENCIL_TOTAL; ++i) {
+        for (array_size_t j = 0; j < STENCIL_TOTAL; ++j) {
+            SA(i, j) = float((i * 7 + j * 3) % 17);
+        }
+    }
+
+    auto MA    = make_matrix<float, layout::cmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+    auto MB    = make_matrix<float, layout::rmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+    auto MC    = make_matrix<float, layout::cmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+    auto MCRef = make_matrix<float, layout::cmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+
+    for (array_size_t i = 0; i < MATRIXMUL_ELEMS; ++i) {
+        for (array_size_t j = 0; j < MATRIXMUL_ELEMS; ++j) {
+            MA(i, j) = float((i + j) % 5);
+            MB(i, j) = float((i * j) % 3);
+        }
+    }
+
+    cuda_conf confStencil{dim3(STENCIL_ELEMS / STENCIL_BLOCK_X, STENCIL_ELEMS / STENCIL_BLOCK_Y),
+                          dim3(STENCIL_BLOCK_X, STENCIL_BLOCK_Y)};
+    cuda_conf confMatrixmul{dim3(MATRIXMUL_ELEMS / (MATRIXMUL_TILE_N * MATRIXMUL_TILE_TB_HEIGHT),
+                                 MATRIXMUL_ELEMS / MATRIXMUL_TILE_N),
+                            dim3(MATRIXMUL_TILE_N, MATRIXMUL_TILE_TB_HEIGHT)};
+
+    // Reference results with the raster order
+    launch_cpu(stencil_kernel<storage, storage>, confStencil)
+        .set_block_order(cpu::block_order::raster)(SBRef, SA);
+    launch_cpu(matrixmul_kernel<storage, storage, storage>, confMatrixmul)
+        .set_block_order(cpu::block_order::raster)(MCRef, MA, MB);
+
+    // Bytes read and written by the stencil and flops of the matrix multiplication
+    double stencilBytes   = 2.0 * STENCIL_ELEMS * STENCIL_ELEMS * sizeof(float);
+    double matrixmulFlops = 2.0 * MATRIXMUL_ELEMS * MATRIXMUL_ELEMS * MATRIXMUL_ELEMS;
+
+    const cpu::block_order orders[] = {
+        cpu::block_order::raster,
+        cpu::block_order::tiled,
+        cpu::block_order::morton,
+        cpu::block_order::hilbert
+    };
+
+    printf("%-8s %12s %10s %12s %10s\n", "order", "stencil", "GB/s", "matrixmul", "GFLOP/s");
+
+    for (auto order : orders) {
+        double stencil = time_launches([&]() {
+            launch_cpu(stencil_kernel<storage, storage>, confStencil).set_block_order(order)(SB, SA);
+        });
+        check("stencil", order, SB, SBRef);
+
+        double matrixmul = time_launches([&]() {
+            launch_cpu(matrixmul_kernel<storage, storage, storage>, confMatrixmul).set_block_order(order)(MC, MA, MB);
+        });
+        check("matrixmul", order, MC, MCRef);
+
+        printf("%-8s %9.3f ms %10.2f %9.3f ms %10.2f\n", cpu::to_string(order),
+               stencil,   stencilBytes   / (stencil   * 1e6),
+               matrixmul, matrixmulFlops / (matrixmul * 1e6));
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
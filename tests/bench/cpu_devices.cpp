@@ -0,0 +1,156 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+
+#include "stencil_kernel.cuh"
+#include "vecadd_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 3;
+
+// Grids are not multiples of the number of devices, so that the last tiles are trimmed
+static const array_size_t STENCIL_ELEMS = 4000;
+static const array_size_t VECADD_BLOCK  = 256;
+static const array_size_t VECADD_ELEMS  = VECADD_BLOCK * 3907;
+
+using storage = automatic::none;
+
+static double
+time_launches(const std::function<void ()> &run)
+{
+    // Warm-up run: first touch of the arrays and binding of the workers
+    run();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep)
+        run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / REPETITIONS;
+}
+
+template <typename Array>
+static void
+check(const char *name, unsigned devices, const char *part, Array &out, Array &ref)
+{
+    if (memcmp(out.host_addr(), ref.host_addr(), out.size()) != 0) {
+        fprintf(stderr, "%s (%u devices, %s): wrong result\n", name, devices, part);
+        abort();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    init_lib();
+
+    if (argc > 1)
+        cpu::worker_pool::get().resize(unsigned(atoi(argv[1])));
+
+    static const array_size_t STENCIL_TOTAL = STENCIL_ELEMS + 2 * STENCIL;
+
+    auto SA    = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SB    = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+    auto SBRef = make_matrix<float>({STENCIL_TOTAL, STENCIL_TOTAL});
+
+    for (array_size_t i = 0; i < STENCIL_TOTAL; ++i) {
+        for (array_size_t j = 0; j < STENCIL_TOTAL; ++j) {
+            SA(i, j) = float((i * 7 + j * 3) % 17);
+        }
+    }
+
+    auto A    = make_vector<float>({VECADD_ELEMS});
+    auto B    = make_vector<float>({VECADD_ELEMS});
+    auto C    = make_vector<float>({VECADD_ELEMS});
+    auto CRef = make_vector<float>({VECADD_ELEMS});
+
+    for (array_size_t i = 0; i < VECADD_ELEMS; ++i) {
+        A(i) = float(i % 13);
+        B(i) = float(i % 7);
+    }
+
+    cuda_conf confStencil{dim3(STENCIL_ELEMS / STENCIL_BLOCK_X, STENCIL_ELEMS / STENCIL_BLOCK_Y),
+                          dim3(STENCIL_BLOCK_X, STENCIL_BLOCK_Y)};
+    cuda_conf confVector{dim3(VECADD_ELEMS / VECADD_BLOCK), dim3(VECADD_BLOCK)};
+
+    // Reference results with a single device
+    launch_cpu(stencil_kernel<storage, storage>, confStencil)(SBRef, SA);
+    launch_cpu(vecadd_kernel<storage, storage>, confVector)(CRef, A, B);
+
+    // Bytes read and written by the kernels
+    double stencilBytes = 2.0 * STENCIL_ELEMS * STENCIL_ELEMS * sizeof(float);
+    double vecaddBytes  = 3.0 * VECADD_ELEMS * sizeof(float);
+
+    struct partition_conf {
+        const char *name;
+        compute comp;
+    };
+
+    const partition_conf partitions[] = {
+        { "x",  compute::x  },
+        { "y",  compute::y  },
+        { "xy", compute::xy }
+    };
+
+    const unsigned devices[] = { 1, 2, 3, 4, 6, 8 };
+
+    printf("NUMA nodes: %u, workers: %u\n", cpu::get_numa_nodes(), cpu::worker_pool::get().size());
+    printf("%-7s %-4s %12s %10s %12s %10s\n", "devices", "part", "stencil", "GB/s", "vecadd", "GB/s");
+
+    for (unsigned n : devices) {
+        double vecadd = time_launches([&]() {
+            launch_cpu(vecadd_kernel<storage, storage>, confVector, compute_conf<1>{compute::x, n})(C, A, B);
+        });
+        check("vecadd", n, "x", C, CRef);
+
+        for (auto &part : partitions) {
+            double stencil = time_launches([&]() {
+                launch_cpu(stencil_kernel<storage, storage>, confStencil, compute_conf<2>{part.comp, n})(SB, SA);
+            });
+            check("stencil", n, part.name, SB, SBRef);
+
+            printf("%-7u %-4s %9.3f ms %10.2f %9.3f ms %10.2f\n", n, part.name,
+                   stencil, stencilBytes / (stencil * 1e6),
+                   vecadd,  vecaddBytes  / (vecadd  * 1e6));
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
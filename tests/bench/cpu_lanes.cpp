@@ -0,0 +1,152 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+
+#include "lanes_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 5;
+
+// Blocks of 100 threads leave partially filled lane groups at the end of each block
+// Not a multiple of the block size: the last block is guarded by the kernels
+static const array_size_t VECTOR_ELEMS  = 100 * 160 * 1024 + 37;
+static const array_size_t VECTOR_BLOCK  = 100;
+static const array_size_t STENCIL_ELEMS = 2048;
+
+template <unsigned W>
+using index_lanes = cpu::lanes<int, W>;
+
+static double
+time_launches(const std::function<void ()> &run)
+{
+    // Warm-up run: first touch of the arrays and worker creation
+    run();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep)
+        run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / REPETITIONS;
+}
+
+template <typename Array>
+static void
+check(const char *name, Array &out, Array &ref)
+{
+    if (memcmp(out.host_addr(), ref.host_addr(), out.size()) != 0) {
+        fprintf(stderr, "%s: wrong result\n", name);
+        abort();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    init_lib();
+
+    if (argc > 1)
+        cpu::worker_pool::get().resize(unsigned(atoi(argv[1])));
+
+    auto A    = make_vector<float>({VECTOR_ELEMS});
+    auto B    = make_vector<float>({VECTOR_ELEMS});
+    auto C    = make_vector<float>({VECTOR_ELEMS});
+    auto CRef = make_vector<float>({VECTOR_ELEMS});
+
+    for (array_size_t i = 0; i < VECTOR_ELEMS; ++i) {
+        A(i) = float(i);
+        B(i) = float(i + 1.f);
+    }
+
+    auto SA    = make_matrix<float>({STENCIL_ELEMS + 2 * LANES_STENCIL, STENCIL_ELEMS + 2 * LANES_STENCIL});
+    auto SB    = make_matrix<float>({STENCIL_ELEMS + 2 * LANES_STENCIL, STENCIL_ELEMS + 2 * LANES_STENCIL});
+    auto SBRef = make_matrix<float>({STENCIL_ELEMS + 2 * LANES_STENCIL, STENCIL_ELEMS + 2 * LANES_STENCIL});
+
+    for (array_size_t i = 0; i < SA.dim(0); ++i) {
+        for (array_size_t j = 0; j < SA.dim(1); ++j) {
+            SA(i, j) = float((i * 7 + j * 3) % 17);
+        }
+    }
+
+    cuda_conf confVector{(VECTOR_ELEMS + VECTOR_BLOCK - 1) / VECTOR_BLOCK, VECTOR_BLOCK};
+    cuda_conf confStencil{dim3(STENCIL_ELEMS / 64, STENCIL_ELEMS / 4), dim3(64, 4)};
+
+    struct benchmark {
+        const char *name;
+        std::function<void ()> scalar;
+        std::function<void ()> lanes8;
+        std::function<void ()> lanes16;
+        std::function<void ()> check;
+    };
+
+    std::vector<benchmark> benchmarks = {
+        { "vecadd",
+          [&]() { launch_cpu(vecadd_lanes_kernel<int>, confVector)(CRef, A, B); },
+          [&]() { launch_cpu_lanes<8>(vecadd_lanes_kernel<index_lanes<8>>, confVector)(C, A, B); },
+          [&]() { launch_cpu_lanes<16>(vecadd_lanes_kernel<index_lanes<16>>, confVector)(C, A, B); },
+          [&]() { check("vecadd", C, CRef); } },
+        { "saxpy",
+          [&]() { launch_cpu(saxpy_lanes_kernel<int>, confVector)(CRef, A, 2.f); },
+          [&]() { launch_cpu_lanes<8>(saxpy_lanes_kernel<index_lanes<8>>, confVector)(C, A, 2.f); },
+          [&]() { launch_cpu_lanes<16>(saxpy_lanes_kernel<index_lanes<16>>, confVector)(C, A, 2.f); },
+          [&]() { check("saxpy", C, CRef); } },
+        { "stencil",
+          [&]() { launch_cpu(stencil_lanes_kernel<int>, confStencil)(SBRef, SA); },
+          [&]() { launch_cpu_lanes<8>(stencil_lanes_kernel<index_lanes<8>>, confStencil)(SB, SA); },
+          [&]() { launch_cpu_lanes<16>(stencil_lanes_kernel<index_lanes<16>>, confStencil)(SB, SA); },
+          [&]() { check("stencil", SB, SBRef); } },
+    };
+
+    printf("%-10s %12s %12s %8s %12s %8s\n", "kernel", "scalar", "8 lanes", "speedup", "16 lanes", "speedup");
+
+    for (auto &b : benchmarks) {
+        double scalar = time_launches(b.scalar);
+        double lanes8 = time_launches(b.lanes8);
+        b.check();
+        double lanes16 = time_launches(b.lanes16);
+        b.check();
+
+        printf("%-10s %9.3f ms %9.3f ms %7.2fx %9.3f ms %7.2fx\n", b.name,
+               scalar, lanes8, scalar / lanes8, lanes16, scalar / lanes16);
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,182 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+
+#include "inc_kernel.cuh"
+#include "matrixadd_kernel.cuh"
+#include "matrixmul_kernel.cuh"
+#include "saxpy_kernel.cuh"
+#include "stencil_kernel.cuh"
+#include "vecadd_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 5;
+
+static const array_size_t VECTOR_ELEMS = 16 * 1024 * 1024;
+static const array_size_t VOLUME_ELEMS[3] = { 64, 256, 256 };
+static const array_size_t MATRIXMUL_ELEMS = 512;
+static const array_size_t STENCIL_ELEMS   = 2048;
+
+using storage = automatic::none;
+
+static double
+time_launches(const std::function<void ()> &run)
+{
+    // Warm-up run: first touch of the arrays and worker creation
+    run();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep)
+        run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / REPETITIONS;
+}
+
+static void
+report(const char *name, unsigned workers, double time, double base)
+{
+    printf("%-10s %4u %10.3f ms %6.2fx\n", name, workers, time, base / time);
+}
+
+int main(int argc, char *argv[])
+{
+    init_lib();
+
+    unsigned maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1)
+        maxWorkers = unsigned(atoi(argv[1]));
+
+    std::vector<unsigned> workers;
+    for (unsigned w = 1; w < maxWorkers; w *= 2)
+        workers.push_back(w);
+    workers.push_back(maxWorkers);
+
+    auto A = make_vector<float>({VECTOR_ELEMS});
+    auto B = make_vector<float>({VECTOR_ELEMS});
+    auto C = make_vector<float>({VECTOR_ELEMS});
+
+    for (array_size_t i = 0; i < VECTOR_ELEMS; ++i) {
+        A(i) = float(i);
+        B(i) = float(i + 1.f);
+    }
+
+    auto VA = make_volume<float>({VOLUME_ELEMS[0], VOLUME_ELEMS[1], VOLUME_ELEMS[2]});
+    auto VB = make_volume<float>({VOLUME_ELEMS[0], VOLUME_ELEMS[1], VOLUME_ELEMS[2]});
+    auto VC = make_volume<float>({VOLUME_ELEMS[0], VOLUME_ELEMS[1], VOLUME_ELEMS[2]});
+
+    auto MA = make_matrix<float, layout::cmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+    auto MB = make_matrix<float, layout::rmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+    auto MC = make_matrix<float, layout::cmo>({MATRIXMUL_ELEMS, MATRIXMUL_ELEMS});
+
+    for (array_size_t i = 0; i < MATRIXMUL_ELEMS; ++i) {
+        for (array_size_t j = 0; j < MATRIXMUL_ELEMS; ++j) {
+            MA(i, j) = float(i == j);
+            MB(i, j) = float(i + j);
+        }
+    }
+
+    auto SA = make_matrix<float>({STENCIL_ELEMS + 2 * STENCIL, STENCIL_ELEMS + 2 * STENCIL});
+    auto SB = make_matrix<float>({STENCIL_ELEMS + 2 * STENCIL, STENCIL_ELEMS + 2 * STENCIL});
+
+    cuda_conf confVector{VECTOR_ELEMS / 512, 512};
+    cuda_conf confVolume{dim3(VOLUME_ELEMS[2] / 8, VOLUME_ELEMS[1] / 8, VOLUME_ELEMS[0] / 8),
+                         dim3(8, 8, 8)};
+    // Kernels with __shared__ memory and __syncthreads()
+    cuda_conf confMatrixmul{dim3(MATRIXMUL_ELEMS / (MATRIXMUL_TILE_N * MATRIXMUL_TILE_TB_HEIGHT),
+                                 MATRIXMUL_ELEMS / MATRIXMUL_TILE_N),
+                            dim3(MATRIXMUL_TILE_N, MATRIXMUL_TILE_TB_HEIGHT)};
+    cuda_conf confStencil{dim3(STENCIL_ELEMS / STENCIL_BLOCK_X, STENCIL_ELEMS / STENCIL_BLOCK_Y),
+                          dim3(STENCIL_BLOCK_X, STENCIL_BLOCK_Y)};
+
+    struct benchmark {
+        const char *name;
+        std::function<void ()> run;
+    };
+
+    std::vector<benchmark> benchmarks = {
+        { "vecadd",    [&]() { launch_cpu(vecadd_kernel<storage, storage>, confVector)(C, A, B); } },
+        { "saxpy",     [&]() { launch_cpu(saxpy_kernel<storage, storage>, confVector)(C, A, 2.f); } },
+        { "inc",       [&]() { launch_cpu(inc_kernel<storage, storage>, confVector)(C, A, 1.f); } },
+        { "matrixadd", [&]() { launch_cpu(matrixadd_kernel<storage, storage, storage>, confVolume)(VC, VA, VB); } },
+        { "matrixmul", [&]() { launch_cpu(matrixmul_kernel<storage, storage, storage>, confMatrixmul)(MC, MA, MB); } },
+        { "stencil",   [&]() { launch_cpu(stencil_kernel<storage, storage>, confStencil)(SB, SA); } },
+    };
+
+    printf("%-10s %4s %13s %7s\n", "kernel", "thr", "time", "speedup");
+
+    for (auto &b : benchmarks) {
+        double base = 0.0;
+        for (unsigned w : workers) {
+            cpu::worker_pool::get().resize(w);
+
+            double time = time_launches(b.run);
+            if (w == workers[0]) base = time;
+
+            report(b.name, w, time, base);
+        }
+    }
+
+    // Validate the results of the matrixadd and matrixmul kernels
+    for (array_size_t i = 0; i < VOLUME_ELEMS[0]; ++i) {
+        for (array_size_t j = 0; j < VOLUME_ELEMS[1]; ++j) {
+            for (array_size_t k = 0; k < VOLUME_ELEMS[2]; ++k) {
+                if (VC(i, j, k) != VA(i, j, k) + VB(i, j, k)) {
+                    fprintf(stderr, "Wrong result at (%u, %u, %u)\n", unsigned(i), unsigned(j), unsigned(k));
+                    abort();
+                }
+            }
+        }
+    }
+
+    // A is the identity matrix
+    for (array_size_t i = 0; i < MATRIXMUL_ELEMS; ++i) {
+        for (array_size_t j = 0; j < MATRIXMUL_ELEMS; ++j) {
+            if (MC(i, j) != MB(i, j)) {
+                fprintf(stderr, "Wrong result at (%u, %u)\n", unsigned(i), unsigned(j));
+                abort();
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,270 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+// Throughput of the fault backends (SIGSEGV and userfaultfd) on the same
+// workloads: write and read faults on pages protected through the memory API,
+// and read and write faults on the pages of an array after a kernel, with
+// one-page transfers. Each backend runs in a child process since it is
+// selected at startup. Device memory is host memory of the stand-in of the
+// CUDA runtime. The values read with both backends are checked to be the same
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/memory.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const char *BACKENDS[] = { "sigsegv", "userfaultfd" };
+
+static const size_t RANGE_PAGES = 16384;
+static const unsigned ROUNDS = 4;
+
+static const array_size_t ROWS = 2048;
+static const array_size_t COLS = 4096;
+// Pages written by the host after the kernel. Less than a fourth of the pages
+// of the array, so that the written pages are still tracked one by one
+static const array_size_t WRITE_STRIDE = 8;
+
+using matrix_type = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+write_kernel(matrix_type)
+{
+    // Not executed by the stand-in: device memory is written when the
+    // kernel is launched (see host_runtime_fill_on_launch)
+}
+
+static void
+report(const char *workload, unsigned long faults, double ns, uint64_t checksum)
+{
+    printf("%s %lu %f %llu\n", workload, faults, ns / faults, (unsigned long long)checksum);
+}
+
+// Write faults on read-only pages and read faults on inaccessible pages. The
+// handlers unprotect the faulting page only
+static void
+run_range()
+{
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t bytes = RANGE_PAGES * page;
+
+    char *base = static_cast<char *>(mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        abort();
+    }
+    memset(base, 0, bytes);
+    register_range(base, bytes);
+
+    unsigned long faults = 0;
+    auto unprotect = [&](mem_access_type prot)
+    {
+        return [&faults, base, page, prot](bool, void *addr) -> bool
+               {
+                   ++faults;
+                   char *p = base + size_t(static_cast<char *>(addr) - base) / page * page;
+                   protect_range(p, page, prot);
+                   return true;
+               };
+    };
+
+    double writeNs = 0.0, readNs = 0.0;
+    uint64_t checksum = 0;
+    for (unsigned r = 0; r < ROUNDS; ++r) {
+        protect_range(base, bytes, MEM_READ, unprotect(MEM_READ_WRITE));
+        auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < RANGE_PAGES; ++p)
+            base[p * page] = char(p * 7 + r);
+        writeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        // The contents of the pages are preserved while they are inaccessible
+        protect_range(base, bytes, MEM_NONE, unprotect(MEM_READ));
+        start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < RANGE_PAGES; ++p)
+            checksum = checksum * 31 + uint8_t(base[p * page]);
+        readNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (faults != 2 * RANGE_PAGES * ROUNDS) {
+        fprintf(stderr, "Wrong number of faults: %lu (expected %zu)\n", faults, 2 * RANGE_PAGES * ROUNDS);
+        abort();
+    }
+
+    unregister_range(base);
+    munmap(base, bytes);
+
+    report("range-write", RANGE_PAGES * ROUNDS, writeNs, 0);
+    report("range-read", RANGE_PAGES * ROUNDS, readNs, checksum);
+}
+
+// Read faults that transfer a page from the devices and write faults that
+// record the pages written by the host
+static void
+run_array()
+{
+    unsigned gpus = system::gpu_count();
+
+    auto M = make_matrix<float, layout::rmo, reshape_block::xy>({ROWS, COLS});
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    cuda_conf conf{1, 1};
+
+    array_size_t pageElems = array_size_t(sysconf(_SC_PAGESIZE)) / sizeof(float);
+    array_size_t pages = ROWS * COLS / pageElems;
+
+    double readNs = 0.0, writeNs = 0.0;
+    uint64_t checksum = 0;
+    for (unsigned r = 0; r < ROUNDS; ++r) {
+        launch(write_kernel, conf, gpuConf)(M);
+
+        auto start = std::chrono::steady_clock::now();
+        for (array_size_t p = 0; p < pages; ++p) {
+            array_size_t i = p * pageElems;
+            float val = M(i / COLS, i % COLS);
+            uint32_t bits;
+            memcpy(&bits, &val, sizeof(bits));
+            checksum = checksum * 31 + bits;
+        }
+        readNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for (array_size_t p = 0; p < pages; p += WRITE_STRIDE) {
+            array_size_t i = p * pageElems;
+            M(i / COLS, i % COLS) = float(p);
+        }
+        writeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    report("array-read", (unsigned long)(pages * ROUNDS), readNs, checksum);
+    report("array-write", (unsigned long)(pages / WRITE_STRIDE * ROUNDS), writeNs, 0);
+}
+
+static int
+child()
+{
+    init_lib();
+    host_runtime_fill_on_launch(true);
+
+    printf("%s\n", to_string(get_fault_backend()));
+    run_range();
+    run_array();
+
+    return 0;
+}
+
+struct result {
+    std::string workload;
+    unsigned long faults;
+    double ns;
+    unsigned long long checksum;
+};
+
+static std::vector<result>
+run_child(const std::string &self, const char *backend, std::string &used)
+{
+    std::string cmd = std::string("CUDARRAYS_FAULT_BACKEND=") + backend +
+                      " CUDARRAYS_COHERENCE_FAULT_GRANULARITY=4096 '" + self + "' child";
+    FILE *out = popen(cmd.c_str(), "r");
+    if (!out) {
+        perror("popen");
+        abort();
+    }
+
+    char buf[256];
+    if (fscanf(out, "%255s", buf) == 1) used = buf;
+
+    std::vector<result> results;
+    result r;
+    unsigned long long checksum;
+    while (fscanf(out, "%255s %lu %lf %llu", buf, &r.faults, &r.ns, &checksum) == 4) {
+        r.workload = buf;
+        r.checksum = checksum;
+        results.push_back(r);
+    }
+
+    if (pclose(out) != 0) {
+        fprintf(stderr, "Error running the benchmark\n");
+        abort();
+    }
+
+    return results;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("GPUs: %u, range: %zu pages, matrix: %zux%zu floats, %u rounds\n", system::gpu_count(),
+           RANGE_PAGES, size_t(ROWS), size_t(COLS), ROUNDS);
+    printf("%-12s %-12s %10s %12s %12s\n", "backend", "workload", "faults", "ns/fault", "faults/s");
+
+    std::vector<std::vector<result>> runs;
+    for (const char *backend : BACKENDS) {
+        std::string used;
+        runs.push_back(run_child(self, backend, used));
+        if (used != backend)
+            printf("%-12s not available, %s used instead\n", backend, used.c_str());
+
+        for (size_t i = 0; i < runs.back().size(); ++i) {
+            const result &r = runs.back()[i];
+            bool match = r.checksum == runs[0][i].checksum;
+            printf("%-12s %-12s %10lu %12.1f %12.0f%s\n", used.c_str(), r.workload.c_str(), r.faults, r.ns,
+                   1e9 / r.ns, match? "": "  WRONG VALUES");
+            if (!match) return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
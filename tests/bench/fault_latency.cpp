@@ -0,0 +1,151 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Latency of the SIGSEGV-based coherence faults as a function of the number
+// of registered ranges, with and without other threads registering and
+// unregistering ranges concurrently
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/memory.hpp>
+
+using namespace cudarrays;
+
+static const unsigned ROUNDS = 8;
+// Ranges registered and unregistered by the background thread
+static const unsigned CHURN_RANGES = 64;
+
+static std::atomic<unsigned long> Faults{0};
+
+static char *
+map_pages(size_t pages, size_t page)
+{
+    void *ptr = mmap(nullptr, pages * page, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap");
+        abort();
+    }
+    return static_cast<char *>(ptr);
+}
+
+static void
+protect_pages(char *base, size_t pages, size_t page)
+{
+    for (size_t p = 0; p < pages; ++p) {
+        char *addr = base + p * page;
+        protect_range(addr, page, MEM_NONE, [addr, page](bool, void *) -> bool
+                      {
+                          ++Faults;
+                          protect_range(addr, page, MEM_READ_WRITE);
+                          return true;
+                      });
+    }
+}
+
+static void
+run(size_t ranges, bool churn)
+{
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+
+    char *base = map_pages(ranges, page);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < ranges; ++p)
+        register_range(base + p * page, page);
+    double registerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ranges;
+
+    std::atomic<bool> done{false};
+    std::atomic<unsigned long> churned{0};
+    std::thread churner;
+    if (churn) {
+        churner = std::thread([&]()
+        {
+            char *other = map_pages(CHURN_RANGES, page);
+            while (!done) {
+                for (unsigned p = 0; p < CHURN_RANGES; ++p)
+                    register_range(other + p * page, page);
+                for (unsigned p = 0; p < CHURN_RANGES; ++p)
+                    unregister_range(other + p * page);
+                churned += CHURN_RANGES;
+            }
+            munmap(other, CHURN_RANGES * page);
+        });
+    }
+
+    double faultNs = 0.0;
+    Faults = 0;
+    for (unsigned r = 0; r < ROUNDS; ++r) {
+        protect_pages(base, ranges, page);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < ranges; ++p)
+            base[p * page] = char(r);
+        faultNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    faultNs /= double(ranges) * ROUNDS;
+
+    done = true;
+    if (churn) churner.join();
+
+    if (Faults != ranges * ROUNDS) {
+        fprintf(stderr, "Wrong number of faults: %lu (expected %zu)\n", (unsigned long)Faults, ranges * ROUNDS);
+        abort();
+    }
+
+    for (size_t p = 0; p < ranges; ++p)
+        unregister_range(base + p * page);
+    munmap(base, ranges * page);
+
+    printf("%8zu %6s %12.1f ns %12.1f ns %10lu\n", ranges, churn? "yes": "no", faultNs, registerNs,
+           (unsigned long)churned);
+}
+
+int main()
+{
+    init_lib();
+
+    printf("%8s %6s %15s %15s %10s\n", "ranges", "churn", "fault", "register", "churned");
+    for (size_t ranges : { 1, 64, 4096, 65536 }) {
+        run(ranges, false);
+        run(ranges, true);
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
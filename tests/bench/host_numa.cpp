@@ -0,0 +1,166 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Memory bandwidth of host kernels on arrays placed in the NUMA nodes with
+// each policy of CUDARRAYS_HOST_NUMA. The arrays are initialized by a single
+// host thread, so with first-touch placement all their pages land in the node
+// of that thread. A vector addition then runs in the CPU launcher with one
+// virtual device per node. Reports where the pages of the output are placed.
+// Each configuration runs in a child process. Only meaningful on multi-socket
+// machines: with a single node every policy places the pages in it
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/host.hpp>
+
+#include <cudarrays/dynarray.hpp>
+#include <cudarrays/launch_cpu.hpp>
+#include <cudarrays/detail/cpu/topology.hpp>
+
+#include "vecadd_kernel.cuh"
+
+using namespace cudarrays;
+
+static const unsigned REPETITIONS = 5;
+
+static const array_size_t VECADD_BLOCK = 256;
+static const array_size_t VECADD_ELEMS = VECADD_BLOCK * 64 * 1024;
+
+static const char *MODES[] = { "first_touch", "interleave", "partition", "node:0" };
+
+using storage = automatic::none;
+
+// Percentage of the pages of a range placed in every node
+static std::string
+page_nodes(const void *addr, size_t bytes)
+{
+    size_t page  = size_t(sysconf(_SC_PAGESIZE));
+    size_t pages = bytes / page;
+
+    std::vector<void *> addrs(pages);
+    std::vector<int> status(pages, -1);
+    for (size_t p = 0; p < pages; ++p)
+        addrs[p] = (char *) addr + p * page;
+    if (syscall(SYS_move_pages, 0, pages, addrs.data(), nullptr, status.data(), 0) != 0)
+        return "unknown";
+
+    std::vector<size_t> counts;
+    for (int node : status) {
+        if (node < 0) continue;
+        if (size_t(node) >= counts.size()) counts.resize(size_t(node) + 1);
+        ++counts[size_t(node)];
+    }
+
+    std::string ret;
+    for (size_t node = 0; node < counts.size(); ++node) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%s%zu:%.0f%%", ret.empty()? "": " ", node, 100.0 * counts[node] / pages);
+        ret += buf;
+    }
+    return ret;
+}
+
+static int
+child()
+{
+    init_lib();
+
+    auto A = make_vector<float>({VECADD_ELEMS});
+    auto B = make_vector<float>({VECADD_ELEMS});
+    auto C = make_vector<float>({VECADD_ELEMS});
+
+    for (array_size_t i = 0; i < VECADD_ELEMS; ++i) {
+        A(i) = float(i % 13);
+        B(i) = float(i % 7);
+        C(i) = 0.f;
+    }
+
+    cuda_conf conf{dim3(VECADD_ELEMS / VECADD_BLOCK), dim3(VECADD_BLOCK)};
+    // One virtual device per node
+    compute_conf<1> gpuConf{compute::x, 0};
+
+    // Warm-up run: binding of the workers
+    launch_cpu(vecadd_kernel<storage, storage>, conf, gpuConf)(C, A, B);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned rep = 0; rep < REPETITIONS; ++rep)
+        launch_cpu(vecadd_kernel<storage, storage>, conf, gpuConf)(C, A, B);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() /
+                REPETITIONS;
+
+    for (array_size_t i = 0; i < VECADD_ELEMS; ++i) {
+        if (C(i) != float(i % 13 + i % 7)) {
+            fprintf(stderr, "%s: wrong result\n", HOST_NUMA.value().c_str());
+            return 1;
+        }
+    }
+
+    printf("%-12s %9.3f ms %10.2f   %s\n", HOST_NUMA.value().c_str(), ms,
+           3.0 * VECADD_ELEMS * sizeof(float) / (ms * 1e6), page_nodes(C.host_addr(), C.size()).c_str());
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("NUMA nodes: %u, vectors: %zu MiB\n", cpu::get_numa_nodes(),
+           size_t(VECADD_ELEMS * sizeof(float)) >> 20);
+    printf("%-12s %12s %10s   %s\n", "placement", "vecadd", "GB/s", "pages of the output per node");
+    fflush(stdout);
+
+    for (const char *mode : MODES) {
+        std::string cmd = std::string("CUDARRAYS_HOST_NUMA=") + mode + " '" + self + "' child";
+        if (::system(cmd.c_str()) != 0) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,192 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Host traversals and coherence faults of an array backed by base pages,
+// transparent huge pages and pages of the huge page pool
+// (CUDARRAYS_HOST_PAGES). The host initializes the array, gathers elements at
+// random positions and, after a kernel writes the array, reads it back on
+// faults. Each configuration runs in a child process. Kernels are emulated by
+// overwriting all the device memory when they are launched, and the values
+// read back must match across configurations. Hugetlb mappings fall back to
+// transparent huge pages if the pool (/proc/sys/vm/nr_hugepages) is exhausted
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/host.hpp>
+#include <cudarrays/memory.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ELEMS = 32 * 1024 * 1024;
+static const unsigned GATHERS = 16 * 1024 * 1024;
+
+static const char *MODES[] = { "base", "thp", "hugetlb" };
+
+// Keeps the reads of the host
+static volatile float Sink;
+
+using vector_type = vector_view<float, noalign, reshape::x>;
+
+__global__ void
+write_kernel(vector_type)
+{
+    // Emulated by the stand-in
+}
+
+static long
+minor_faults()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static double
+elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int
+child()
+{
+    init_lib();
+    host_runtime_fill_on_launch(true);
+
+    auto A = make_vector<float, reshape::x>({ELEMS});
+    compute_conf<1> gpuConf{compute::x, 1};
+    A.distribute<1>({gpuConf, {{0}}});
+
+    long faults = minor_faults();
+    auto start = std::chrono::steady_clock::now();
+    for (array_size_t i = 0; i < ELEMS; ++i)
+        A(i) = float(i);
+    double initMs = elapsed_ms(start);
+    faults = minor_faults() - faults;
+
+    // Random positions are generated beforehand
+    std::vector<uint32_t> idxs(GATHERS);
+    std::mt19937 gen(42);
+    for (auto &idx : idxs)
+        idx = uint32_t(gen() % ELEMS);
+
+    float *host = &A(0);
+    float sum = 0.f;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t idx : idxs)
+        sum += host[idx];
+    double gatherNs = elapsed_ms(start) * 1e6 / GATHERS;
+    Sink = sum;
+
+    launch(write_kernel, cuda_conf{1, 1}, gpuConf)(A);
+
+    fault_stats before = get_fault_stats();
+    uint64_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (array_size_t i = 0; i < ELEMS; ++i) {
+        uint32_t bits;
+        float val = A(i);
+        memcpy(&bits, &val, sizeof(bits));
+        checksum = checksum * 31 + bits;
+    }
+    double readMs = elapsed_ms(start);
+    fault_stats after = get_fault_stats();
+
+    printf("%zu %f %ld %f %f %llu %llu\n", A.host_page_size(), initMs, faults, gatherNs, readMs,
+           (unsigned long long) (after.readFaults - before.readFaults), (unsigned long long) checksum);
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("Array: %zu MiB, %u random reads, fault backend: %s\n", size_t(ELEMS * sizeof(float)) >> 20, GATHERS,
+           FAULT_BACKEND.value().c_str());
+    printf("%-8s %10s %10s %12s %12s %10s %8s\n",
+           "pages", "page", "init ms", "page faults", "gather ns", "read ms", "faults");
+
+    bool first = true;
+    unsigned long long reference = 0;
+    for (const char *mode : MODES) {
+        std::string cmd = std::string("CUDARRAYS_HOST_PAGES=") + mode + " '" + self + "' child";
+        FILE *out = popen(cmd.c_str(), "r");
+        if (!out) {
+            perror("popen");
+            abort();
+        }
+
+        size_t page;
+        double initMs, gatherNs, readMs;
+        long faults;
+        unsigned long long coherenceFaults, checksum;
+        int n = fscanf(out, "%zu %lf %ld %lf %lf %llu %llu", &page, &initMs, &faults, &gatherNs, &readMs,
+                       &coherenceFaults, &checksum);
+        if (pclose(out) != 0 || n != 7) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+
+        if (first) reference = checksum;
+        first = false;
+
+        bool match = checksum == reference;
+        printf("%-8s %8zuKB %10.2f %12ld %12.2f %10.2f %8llu%s\n", mode, page / 1024, initMs, faults, gatherNs, readMs,
+               coherenceFaults, match? "": "  WRONG VALUES");
+        if (!match) return 1;
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,133 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Cost of short-lived temporaries. Every iteration creates a matrix, writes
+// all its elements and destroys it, like the temporaries of an iterative
+// solver. Reports the time to create the matrix (mapping and registration),
+// the first write (page faults and zeroing of fresh pages) and the destruction
+// (unregistration and unmapping). Each configuration runs in a child process,
+// with the pool of host mappings (CUDARRAYS_HOST_POOL) disabled and enabled
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/host.hpp>
+#include <cudarrays/types.hpp>
+
+using namespace cudarrays;
+
+static const array_size_t COLS = 1024;
+static const array_size_t ROWS[] = { 4, 64, 1024, 16 * 1024 };
+// Floats written by every configuration
+static const size_t TOTAL_ELEMS = size_t(2) << 30;
+
+static const char *POOL_BYTES = "268435456";
+
+static double
+elapsed_us(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int
+child()
+{
+    init_lib();
+
+    for (array_size_t rows : ROWS) {
+        unsigned iters = unsigned(TOTAL_ELEMS / (rows * COLS));
+        if (iters > 20000) iters = 20000;
+
+        double allocUs = 0.0, writeUs = 0.0, freeUs = 0.0;
+        host_pool_stats before = get_host_pool_stats();
+
+        for (unsigned it = 0; it < iters; ++it) {
+            auto start = std::chrono::steady_clock::now();
+            auto *M = new matrix_view<float>(make_matrix<float>({rows, COLS}));
+            allocUs += elapsed_us(start);
+
+            start = std::chrono::steady_clock::now();
+            for (array_size_t i = 0; i < rows; ++i)
+                for (array_size_t j = 0; j < COLS; ++j)
+                    (*M)(i, j) = float(it + i + j);
+            writeUs += elapsed_us(start);
+
+            if ((*M)(rows - 1, COLS - 1) != float(it + rows - 1 + COLS - 1)) {
+                fprintf(stderr, "wrong result\n");
+                return 1;
+            }
+
+            start = std::chrono::steady_clock::now();
+            delete M;
+            freeUs += elapsed_us(start);
+        }
+
+        host_pool_stats after = get_host_pool_stats();
+        printf("%-5s %9zu KiB %7u %12.2f %12.2f %12.2f %8.1f%%\n",
+               HOST_POOL != 0? "pool": "mmap", size_t(rows * COLS * sizeof(float)) >> 10, iters,
+               allocUs / iters, writeUs / iters, freeUs / iters,
+               100.0 * double(after.hits - before.hits) / iters);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("Host pages: %s, pool: %s bytes\n", to_string(get_host_pages()), POOL_BYTES);
+    printf("%-5s %13s %7s %12s %12s %12s %9s\n", "host", "matrix", "iters", "create (us)", "write (us)",
+           "destroy (us)", "reused");
+    fflush(stdout);
+
+    for (const char *pool : { "0", POOL_BYTES }) {
+        std::string cmd = std::string("CUDARRAYS_HOST_POOL=") + pool + " '" + self + "' child";
+        if (::system(cmd.c_str()) != 0) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
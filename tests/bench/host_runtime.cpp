@@ -0,0 +1,405 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Host-memory implementation of the subset of the CUDA runtime used by the
+// library. Benchmarks link it instead of the CUDA libraries, so that they can
+// run on machines without GPUs. Device memory is host memory and all the
+// operations complete synchronously
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cuda_runtime_api.h>
+
+#include "host_runtime.hpp"
+
+host_runtime_counters HostRuntime;
+
+static thread_local int CurrentDevice = 0;
+
+// Kernels that must complete before the next operation of a stream or the
+// completion of an event. Only the direct predecessors are stored
+struct host_stream {
+    std::vector<unsigned long> frontier;
+};
+
+struct host_event {
+    std::vector<unsigned long> frontier;
+};
+
+static std::atomic<bool> TrackOrder{false};
+// Kernels emulated by filling the device memory, and number of them so far
+static std::atomic<bool> FillOnLaunch{false};
+static std::atomic<unsigned> FilledLaunches{0};
+static std::mutex KernelsMutex;
+// Direct predecessors of each kernel
+static std::vector<std::vector<unsigned long>> Kernels;
+
+// Device allocations are carved out of a single reserved range, so that
+// consecutive allocations are contiguous like in the virtual address space of
+// the GPUs. Storages that span several GPUs rely on it
+static const size_t ARENA_SIZE = size_t(1) << 36;
+static const size_t ALLOCATION_ALIGN = 256;
+
+static char *Arena = nullptr;
+static size_t ArenaUsed = 0;
+
+// Live device allocations: size and allocation order
+struct host_allocation {
+    size_t size;
+    unsigned long order;
+};
+
+static std::mutex AllocationsMutex;
+static std::map<void *, host_allocation> Allocations;
+static unsigned long NextAllocation = 0;
+
+void
+host_runtime_track_order(bool enable)
+{
+    TrackOrder = enable;
+}
+
+bool
+host_runtime_ordered(unsigned long before, unsigned long after)
+{
+    std::unique_lock<std::mutex> lock(KernelsMutex);
+
+    if (after >= Kernels.size() || before >= after) return false;
+
+    std::vector<char> visited(after + 1, 0);
+    std::vector<unsigned long> pending{after};
+    while (!pending.empty()) {
+        unsigned long k = pending.back();
+        pending.pop_back();
+        for (unsigned long pred : Kernels[k]) {
+            if (pred == before) return true;
+            if (pred > before && !visited[pred]) {
+                visited[pred] = 1;
+                pending.push_back(pred);
+            }
+        }
+    }
+
+    return false;
+}
+
+void
+host_runtime_fill_device(unsigned seed)
+{
+    std::unique_lock<std::mutex> lock(AllocationsMutex);
+
+    for (auto &a : Allocations) {
+        uint32_t *words = static_cast<uint32_t *>(a.first);
+        for (size_t i = 0; i < a.second.size / sizeof(uint32_t); ++i)
+            words[i] = uint32_t(seed * 2654435761u + a.second.order * 40503u + i);
+    }
+}
+
+void
+host_runtime_fill_on_launch(bool enable)
+{
+    FillOnLaunch = enable;
+}
+
+cudaError_t
+cudaGetDeviceCount(int *count)
+{
+    const char *gpus = getenv("HOST_RUNTIME_GPUS");
+    *count = gpus? atoi(gpus): 1;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaSetDevice(int device)
+{
+    ++HostRuntime.setDevice;
+    CurrentDevice = device;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaGetDevice(int *device)
+{
+    *device = CurrentDevice;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaDeviceCanAccessPeer(int *canAccessPeer, int /*device*/, int /*peerDevice*/)
+{
+    *canAccessPeer = 1;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaDeviceEnablePeerAccess(int /*peerDevice*/, unsigned /*flags*/)
+{
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaDeviceSynchronize()
+{
+    ++HostRuntime.deviceSynchronize;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaStreamCreate(cudaStream_t *stream)
+{
+    *stream = reinterpret_cast<cudaStream_t>(new host_stream);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaStreamDestroy(cudaStream_t stream)
+{
+    delete reinterpret_cast<host_stream *>(stream);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaStreamSynchronize(cudaStream_t /*stream*/)
+{
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaStreamWaitEvent(cudaStream_t stream, cudaEvent_t event, unsigned /*flags*/)
+{
+    ++HostRuntime.streamWaitEvent;
+
+    if (!TrackOrder) return cudaSuccess;
+
+    std::unique_lock<std::mutex> lock(KernelsMutex);
+    auto &frontier = reinterpret_cast<host_stream *>(stream)->frontier;
+    auto &waited   = reinterpret_cast<host_event *>(event)->frontier;
+    frontier.insert(frontier.end(), waited.begin(), waited.end());
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaEventCreate(cudaEvent_t *event)
+{
+    *event = reinterpret_cast<cudaEvent_t>(new host_event);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaEventCreateWithFlags(cudaEvent_t *event, unsigned /*flags*/)
+{
+    return cudaEventCreate(event);
+}
+
+cudaError_t
+cudaEventDestroy(cudaEvent_t event)
+{
+    delete reinterpret_cast<host_event *>(event);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaEventRecord(cudaEvent_t event, cudaStream_t stream)
+{
+    ++HostRuntime.eventRecord;
+
+    if (!TrackOrder) return cudaSuccess;
+
+    std::unique_lock<std::mutex> lock(KernelsMutex);
+    auto &frontier = reinterpret_cast<host_event *>(event)->frontier;
+    if (stream)
+        frontier = reinterpret_cast<host_stream *>(stream)->frontier;
+    else
+        frontier.clear();
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaEventSynchronize(cudaEvent_t /*event*/)
+{
+    ++HostRuntime.eventSynchronize;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaEventQuery(cudaEvent_t /*event*/)
+{
+    // Kernels are never reported complete by polling, so that all the
+    // dependencies tracked by the library show up in the kernel graph
+    return cudaErrorNotReady;
+}
+
+cudaError_t
+cudaEventElapsedTime(float *ms, cudaEvent_t /*start*/, cudaEvent_t /*end*/)
+{
+    *ms = 0.f;
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaMalloc(void **ptr, size_t size)
+{
+    std::unique_lock<std::mutex> lock(AllocationsMutex);
+
+    if (!Arena) {
+        void *arena = mmap(nullptr, ARENA_SIZE, PROT_NONE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena == MAP_FAILED) return cudaErrorMemoryAllocation;
+        Arena = static_cast<char *>(arena);
+    }
+
+    size_t bytes = (std::max(size, size_t(1)) + ALLOCATION_ALIGN - 1) / ALLOCATION_ALIGN * ALLOCATION_ALIGN;
+    if (ArenaUsed + bytes > ARENA_SIZE) return cudaErrorMemoryAllocation;
+
+    char *begin = Arena + ArenaUsed;
+    ArenaUsed += bytes;
+
+    // Pages can be shared by consecutive allocations
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    char *first = begin - size_t(begin) % page;
+    if (mprotect(first, begin + bytes - first, PROT_READ | PROT_WRITE) != 0)
+        return cudaErrorMemoryAllocation;
+
+    *ptr = begin;
+    Allocations[*ptr] = host_allocation{size, NextAllocation++};
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaFree(void *ptr)
+{
+    std::unique_lock<std::mutex> lock(AllocationsMutex);
+
+    auto it = Allocations.find(ptr);
+    if (it == Allocations.end()) return cudaSuccess;
+
+    // Return the pages not shared with other allocations. The addresses are not reused
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    size_t begin = (size_t(ptr) + page - 1) / page * page;
+    size_t end   = (size_t(ptr) + it->second.size) / page * page;
+    if (end > begin)
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+
+    Allocations.erase(it);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaMemset(void *ptr, int value, size_t count)
+{
+    memset(ptr, value, count);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaMemcpy(void *dst, const void *src, size_t count, cudaMemcpyKind /*kind*/)
+{
+    ++HostRuntime.memcpy;
+    HostRuntime.memcpyBytes += count;
+    memcpy(dst, src, count);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaMemcpyAsync(void *dst, const void *src, size_t count, cudaMemcpyKind kind, cudaStream_t /*stream*/)
+{
+    return cudaMemcpy(dst, src, count, kind);
+}
+
+cudaError_t
+cudaMemcpy3D(const cudaMemcpy3DParms *p)
+{
+    ++HostRuntime.memcpy;
+    HostRuntime.memcpyBytes += p->extent.width * p->extent.height * p->extent.depth;
+    // Linear memory only. Positions and widths are in bytes
+    for (size_t z = 0; z < p->extent.depth; ++z) {
+        for (size_t y = 0; y < p->extent.height; ++y) {
+            char *dst = static_cast<char *>(p->dstPtr.ptr) +
+                        ((p->dstPos.z + z) * p->dstPtr.ysize + p->dstPos.y + y) * p->dstPtr.pitch + p->dstPos.x;
+            const char *src = static_cast<const char *>(p->srcPtr.ptr) +
+                              ((p->srcPos.z + z) * p->srcPtr.ysize + p->srcPos.y + y) * p->srcPtr.pitch + p->srcPos.x;
+            memcpy(dst, src, p->extent.width);
+        }
+    }
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaMemcpy3DAsync(const cudaMemcpy3DParms *p, cudaStream_t /*stream*/)
+{
+    return cudaMemcpy3D(p);
+}
+
+cudaError_t
+cudaMemcpyToSymbol(const void *symbol, const void *src, size_t count, size_t offset, cudaMemcpyKind /*kind*/)
+{
+    ++HostRuntime.memcpyToSymbol;
+    // Constant symbols compiled by the host compiler are regular variables
+    memcpy(static_cast<char *>(const_cast<void *>(symbol)) + offset, src, count);
+    return cudaSuccess;
+}
+
+cudaError_t
+cudaLaunchKernel(const void * /*func*/, dim3 /*grid*/, dim3 /*block*/, void ** /*args*/,
+                 size_t /*shared*/, cudaStream_t stream)
+{
+    ++HostRuntime.launchKernel;
+
+    if (FillOnLaunch) host_runtime_fill_device(++FilledLaunches);
+
+    if (!TrackOrder) return cudaSuccess;
+
+    std::unique_lock<std::mutex> lock(KernelsMutex);
+    unsigned long id = Kernels.size();
+    if (stream) {
+        auto &frontier = reinterpret_cast<host_stream *>(stream)->frontier;
+        Kernels.push_back(frontier);
+        frontier.assign(1, id);
+    } else {
+        Kernels.emplace_back();
+    }
+    return cudaSuccess;
+}
+
+const char *
+cudaGetErrorString(cudaError_t /*error*/)
+{
+    return "host runtime error";
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
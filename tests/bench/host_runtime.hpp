@@ -0,0 +1,102 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#pragma once
+#ifndef CUDARRAYS_TESTS_BENCH_HOST_RUNTIME_HPP_
+#define CUDARRAYS_TESTS_BENCH_HOST_RUNTIME_HPP_
+
+#include <atomic>
+
+// Host-memory stand-in for the CUDA runtime (see host_runtime.cpp). Kernels
+// are not executed, so benchmarks linked against it only measure the host
+// overhead of the library. Counts the calls issued by the library
+struct host_runtime_counters {
+    std::atomic<unsigned long> setDevice;
+    std::atomic<unsigned long> deviceSynchronize;
+    std::atomic<unsigned long> eventRecord;
+    std::atomic<unsigned long> eventSynchronize;
+    std::atomic<unsigned long> streamWaitEvent;
+    std::atomic<unsigned long> memcpyToSymbol;
+    std::atomic<unsigned long> memcpy;
+    std::atomic<unsigned long> memcpyBytes;
+    std::atomic<unsigned long> launchKernel;
+
+    void reset()
+    {
+        setDevice = 0;
+        deviceSynchronize = 0;
+        eventRecord = 0;
+        eventSynchronize = 0;
+        streamWaitEvent = 0;
+        memcpyToSymbol = 0;
+        memcpy = 0;
+        memcpyBytes = 0;
+        launchKernel = 0;
+    }
+};
+
+extern host_runtime_counters HostRuntime;
+
+// Streams and events can be modeled, so that the order imposed on the kernels
+// can be checked. Kernels are identified by their launch order since the
+// tracking was enabled, starting from 0
+
+/**
+ * Enable or disable the tracking of the order of the kernels. Tracking
+ * allocates memory in every launch and is disabled by default
+ * @param enable Track the order of the kernels
+ */
+void host_runtime_track_order(bool enable);
+
+/**
+ * Check whether a kernel is ordered after another one through streams and
+ * events
+ * @param before Kernel launched first
+ * @param after Kernel launched later
+ * @return true if after cannot start before the completion of before
+ */
+bool host_runtime_ordered(unsigned long before, unsigned long after);
+
+/**
+ * Emulate kernels that write all the device memory. Every 4-byte word of the
+ * live allocations is overwritten with a value that depends on the seed, the
+ * order of the allocation and the position of the word in the allocation
+ * @param seed Seed of the written values
+ */
+void host_runtime_fill_device(unsigned seed);
+
+/**
+ * Emulate every kernel with host_runtime_fill_device when it is launched,
+ * seeded with the number of kernels emulated so far. Disabled by default
+ * @param enable Fill the device memory on every launch
+ */
+void host_runtime_fill_on_launch(bool enable);
+
+#endif
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,93 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#ifndef _KERNEL_LANES_H_
+#define _KERNEL_LANES_H_
+
+#include <cudarrays/types.hpp>
+#include <cudarrays/gpu.cuh>
+
+using namespace cudarrays;
+
+static const int LANES_STENCIL = 4;
+
+//
+// Kernels written against an Index type. They run on the scalar path when
+// instantiated with int and on the lane path when instantiated with
+// cpu::lanes<int, W>
+//
+template <typename Index>
+__global__ void
+vecadd_lanes_kernel( vector_view<float> C,
+                    vector_cview<float> A,
+                    vector_cview<float> B)
+{
+    Index idx = thread_idx_x<Index>() + int(blockIdx.x * blockDim.x);
+
+    if (idx < int(C.dim(0))) {
+        C(idx) = A(idx) + B(idx);
+    }
+}
+
+template <typename Index>
+__global__ void
+saxpy_lanes_kernel( vector_view<float> B,
+                   vector_cview<float> A,
+                   float c)
+{
+    Index idx = thread_idx_x<Index>() + int(blockIdx.x * blockDim.x);
+
+    if (idx < int(B.dim(0))) {
+        B(idx) = A(idx) * c;
+    }
+}
+
+template <typename Index>
+__global__ void
+stencil_lanes_kernel( matrix_view<float> B,
+                     matrix_cview<float> A)
+{
+    Index j = thread_idx_x<Index>() + int(blockIdx.x * blockDim.x + LANES_STENCIL);
+    int   i = threadIdx.y + blockIdx.y * blockDim.y + LANES_STENCIL;
+
+    if (i < int(B.dim(0)) - LANES_STENCIL &&
+        j < int(B.dim(1)) - LANES_STENCIL) {
+        typename cpu::lane_value<float, Index>::type val = A(i, j);
+
+        for (int k = 1; k <= LANES_STENCIL; ++k) {
+            val += 3.f * (A(i, j - k) + A(i, j + k)) +
+                   2.f * (A(i - k, j) + A(i + k, j));
+        }
+
+        B(i, j) = val;
+    }
+}
+
+#endif
+
+/* vim:set ft=cuda backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,129 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Host latency of the launch path for kernels with coherent array arguments,
+// and number of heap allocations performed per launch. Kernels run on the
+// host stand-in of the CUDA runtime, so only the work of the library is
+// measured
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static std::atomic<unsigned long> Allocations{0};
+
+void *operator new(size_t size)
+{
+    ++Allocations;
+    void *ret = malloc(size? size: 1);
+    if (!ret) throw std::bad_alloc();
+    return ret;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+static const unsigned LAUNCHES       = 100000;
+static const unsigned ASYNC_LAUNCHES = 10000;
+
+static const array_size_t ELEMS = 1024;
+
+__global__ void
+axpy_kernel(vector_view<float> Y, vector_view<float> X, float alpha)
+{
+    unsigned idx = blockIdx.x * blockDim.x + threadIdx.x;
+    Y(idx) += alpha * X(idx);
+}
+
+template <typename F>
+static void
+run(const char *name, unsigned launches, F fn)
+{
+    // Warm-up launch: streams, events and launch plan
+    fn();
+
+    unsigned long allocs = Allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < launches; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+    allocs = Allocations - allocs;
+
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / launches;
+
+    printf("%-8s %10.3f us %12.2f\n", name, us, double(allocs) / launches);
+}
+
+int main()
+{
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+
+    auto X = make_vector<float>({ELEMS});
+    auto Y = make_vector<float>({ELEMS});
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    X.distribute<1>({gpuConf, {{0}}});
+    Y.distribute<1>({gpuConf, {{0}}});
+
+    // Arguments are passed by address to the runtime
+    cuda_conf conf{ELEMS / 256, 256};
+    float alpha = 2.f;
+
+    printf("GPUs: %u, coherent arguments: %u\n", gpus,
+           argument_manager<vector_view<float>, vector_view<float>, float>::NumCoherent);
+    printf("%-8s %13s %12s\n", "launch", "latency", "allocations");
+
+    run("sync", LAUNCHES, [&]()
+        {
+            launch(axpy_kernel, conf, gpuConf)(Y, X, alpha);
+        });
+    run("async", ASYNC_LAUNCHES, [&]()
+        {
+            launch_async(axpy_kernel, conf, gpuConf)(Y, X, alpha).get();
+        });
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,91 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <cudarrays/common.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+// Time steps of the simulated time-stepping loop
+static const unsigned STEPS = 100000;
+
+__global__ void
+step_kernel(int /*step*/, float /*dt*/)
+{
+}
+
+static void
+run(const char *name, const cuda_conf &conf, compute_conf<2> gpuConf)
+{
+    // Arguments are passed by address to the runtime
+    int step = 0;
+    float dt = 0.1f;
+
+    // Warm-up launch: streams and launch plan
+    launch(step_kernel, conf, gpuConf)(step, dt);
+
+    HostRuntime.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    for (step = 0; step < int(STEPS); ++step)
+        launch(step_kernel, conf, gpuConf)(step, dt);
+    auto end = std::chrono::steady_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(end - start).count() / STEPS;
+
+    printf("%-8s %10.3f us %12.2f %12.2f %12.2f\n", name, us,
+           double(HostRuntime.memcpyToSymbol) / STEPS,
+           double(HostRuntime.launchKernel)   / STEPS,
+           double(HostRuntime.setDevice)      / STEPS);
+}
+
+int main()
+{
+    init_lib();
+
+    printf("Launch cache: %s, GPUs: %u\n", LAUNCH_CACHE? "enabled": "disabled", system::gpu_count());
+    printf("%-8s %13s %12s %12s %12s\n", "conf", "launch", "symbols", "kernels", "setDevice");
+
+    cuda_conf conf{dim3(64, 64), dim3(16, 16)};
+
+    run("none", conf, {compute::none, 1});
+    run("x",    conf, {compute::x,    0});
+    run("xy",   conf, {compute::xy,   0});
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,188 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Host overhead per iteration of a solver that launches a fixed sequence of
+// kernels, with direct launches and with a recorded launch_sequence. GPU
+// launches run on the host stand-in of the CUDA runtime, so only the work of
+// the library is measured. CPU launches also validate the results of the
+// replays against the direct launches
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+#include <cudarrays/launch_cpu.hpp>
+#include <cudarrays/launch_sequence.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const unsigned GPU_ITERATIONS = 20000;
+static const unsigned CPU_ITERATIONS = 2000;
+
+static const array_size_t ELEMS = 1024;
+
+__global__ void
+relax_kernel(vector_view<float> out, vector_cview<float> in, float alpha)
+{
+    unsigned idx = blockIdx.x * blockDim.x + threadIdx.x;
+    out(idx) = alpha * in(idx) + 1.f;
+}
+
+template <typename F>
+static double
+per_iteration(unsigned iterations, F fn)
+{
+    // Warm-up iteration: streams, events and launch plans
+    fn();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; ++i)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+static void
+report(const char *name, double direct, double replay)
+{
+    printf("%-8s %10.3f us %10.3f us %8.2fx\n", name, direct, replay, direct / replay);
+}
+
+int main()
+{
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+
+    auto X = make_vector<float>({ELEMS});
+    auto Y = make_vector<float>({ELEMS});
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    X.distribute<1>({gpuConf, {{0}}});
+    Y.distribute<1>({gpuConf, {{0}}});
+
+    for (unsigned i = 0; i < ELEMS; ++i)
+        X(i) = float(i);
+
+    cuda_conf conf{ELEMS / 256, 256};
+    float alpha = 0.5f;
+
+    printf("GPUs: %u, launches per iteration: 4\n", gpus);
+    printf("%-8s %13s %13s %9s\n", "backend", "direct", "replay", "speedup");
+
+    // GPU launches
+    double direct = per_iteration(GPU_ITERATIONS, [&]()
+    {
+        launch(relax_kernel, conf, gpuConf)(Y, X, alpha);
+        launch(relax_kernel, conf, gpuConf)(X, Y, alpha);
+        launch(relax_kernel, conf, gpuConf)(Y, X, alpha);
+        launch(relax_kernel, conf, gpuConf)(X, Y, alpha);
+    });
+
+    launch_sequence gpuSeq;
+    gpuSeq.add(launch(relax_kernel, conf, gpuConf), Y, X, alpha)
+          .add(launch(relax_kernel, conf, gpuConf), X, Y, alpha)
+          .add(launch(relax_kernel, conf, gpuConf), Y, X, alpha)
+          .add(launch(relax_kernel, conf, gpuConf), X, Y, alpha);
+
+    double replay = per_iteration(GPU_ITERATIONS, [&]()
+    {
+        if (!gpuSeq()) {
+            fprintf(stderr, "Error replaying the GPU sequence\n");
+            abort();
+        }
+    });
+
+    report("gpu", direct, replay);
+
+    // CPU launches. Both variants start from the same values
+    compute_conf<1> cpuConf{compute::x, 1};
+
+    auto run_cpu = [&](unsigned iterations, std::function<void()> fn) -> double
+    {
+        for (unsigned i = 0; i < ELEMS; ++i)
+            X(i) = float(i);
+        return per_iteration(iterations, fn);
+    };
+
+    direct = run_cpu(CPU_ITERATIONS, [&]()
+    {
+        launch_cpu(relax_kernel, conf, cpuConf)(Y, X, alpha);
+        launch_cpu(relax_kernel, conf, cpuConf)(X, Y, alpha);
+        launch_cpu(relax_kernel, conf, cpuConf)(Y, X, alpha);
+        launch_cpu(relax_kernel, conf, cpuConf)(X, Y, alpha);
+    });
+
+    std::vector<float> ref(ELEMS);
+    for (unsigned i = 0; i < ELEMS; ++i)
+        ref[i] = X(i);
+
+    launch_sequence cpuSeq;
+    cpuSeq.add(launch_cpu(relax_kernel, conf, cpuConf), Y, X, alpha)
+          .add(launch_cpu(relax_kernel, conf, cpuConf), X, Y, alpha)
+          .add(launch_cpu(relax_kernel, conf, cpuConf), Y, X, alpha)
+          .add(launch_cpu(relax_kernel, conf, cpuConf), X, Y, alpha);
+
+    replay = run_cpu(CPU_ITERATIONS, [&]()
+    {
+        cpuSeq();
+    });
+
+    report("cpu", direct, replay);
+
+    for (unsigned i = 0; i < ELEMS; ++i) {
+        if (X(i) != ref[i]) {
+            fprintf(stderr, "cpu: wrong result at %u: %f != %f\n", i, X(i), ref[i]);
+            abort();
+        }
+    }
+
+    // Arguments are bound by reference
+    alpha = 0.f;
+    cpuSeq();
+    for (unsigned i = 0; i < ELEMS; ++i) {
+        if (X(i) != 1.f) {
+            fprintf(stderr, "cpu: argument not updated at %u: %f\n", i, X(i));
+            abort();
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,203 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Sweeps of a grid 4 times larger than the memory budget of its host copy.
+// The windowed grid keeps only the budget resident: tiles are loaded from the
+// array file on first access and the least recently faulted ones are written
+// back to make room. The mapped grid maps the whole file. Every sweep visits
+// the grid in row order: the host writes it, reads it, a kernel transfers it
+// to the devices and writes it, and the host reads it back. The grid is then
+// destroyed, which writes it back to the file. Reports the time of every
+// phase and the peak resident size of the host copy, sampled during the
+// sweeps. Linked against the host stand-in of the CUDA runtime, which copies
+// the grid but does not run the kernel. The file is created in the directory
+// given as argument, or in the current one
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/array_file.hpp>
+#include <cudarrays/memory.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ROWS = 8192;
+static const array_size_t COLS = 8192;
+static const size_t BUDGET = size_t(ROWS * COLS * sizeof(float)) / 4;
+// Rows between samples of the resident size
+static const array_size_t SAMPLE_ROWS = 256;
+
+using matrix_array = matrix<float, layout::rmo, noalign, reshape_block::xy>;
+using matrix_type  = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+sweep_kernel(matrix_type)
+{
+    // Not executed by the stand-in
+}
+
+static float
+value(array_size_t i, array_size_t j)
+{
+    return float((i * 31 + j) % 1021);
+}
+
+// Resident size of the pages of a range, from the mappings of the process
+static size_t
+resident_bytes(const void *addr, size_t bytes)
+{
+    size_t begin = size_t(addr), end = begin + bytes;
+    size_t ret = 0;
+
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f) return 0;
+
+    char line[256];
+    bool inside = false;
+    while (fgets(line, sizeof(line), f)) {
+        size_t first, last, kb;
+        if (sscanf(line, "%zx-%zx ", &first, &last) == 2)
+            inside = first < end && begin < last;
+        else if (inside && sscanf(line, "Rss: %zu kB", &kb) == 1)
+            ret += kb << 10;
+    }
+    fclose(f);
+    return ret;
+}
+
+struct phase_timer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double lap()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return ms;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    std::string dir = argc > 1? argv[1]: ".";
+    std::string path = dir + "/out_of_core_grid.cuda";
+
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+    printf("GPUs: %u, grid: %zux%zu floats (%zu MiB), budget: %zu MiB\n", gpus, size_t(ROWS), size_t(COLS),
+           size_t(ROWS * COLS * sizeof(float)) >> 20, BUDGET >> 20);
+    printf("%-7s %10s %10s %11s %10s %12s %10s %10s %10s\n", "grid", "write (ms)", "read (ms)",
+           "kernel (ms)", "back (ms)", "destroy (ms)", "peak (MiB)", "loaded", "written");
+
+    for (bool windowed : { true, false }) {
+        fault_stats before = get_fault_stats();
+        size_t peak = 0;
+        double ms[5];
+
+        phase_timer timer;
+        {
+            matrix_type M = make_array_file<matrix_array>(path, {ROWS, COLS},
+                                                          host_window{windowed? BUDGET: 0, 0});
+            const void *host = &M(0, 0);
+            size_t bytes = size_t(ROWS * COLS * sizeof(float));
+            auto sample = [&]() { peak = std::max(peak, resident_bytes(host, bytes)); };
+
+            for (array_size_t i = 0; i < ROWS; ++i) {
+                for (array_size_t j = 0; j < COLS; ++j)
+                    M(i, j) = value(i, j);
+                if (i % SAMPLE_ROWS == 0) sample();
+            }
+            ms[0] = timer.lap();
+
+            double sum = 0;
+            for (array_size_t i = 0; i < ROWS; ++i) {
+                for (array_size_t j = 0; j < COLS; ++j)
+                    sum += M(i, j);
+                if (i % SAMPLE_ROWS == 0) sample();
+            }
+            ms[1] = timer.lap();
+
+            M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+            launch(sweep_kernel, cuda_conf{1, 1}, compute_conf<1>{compute::x, gpus})(M);
+            sample();
+            ms[2] = timer.lap();
+
+            double back = 0;
+            for (array_size_t i = 0; i < ROWS; ++i) {
+                for (array_size_t j = 0; j < COLS; ++j)
+                    back += M(i, j);
+                if (i % SAMPLE_ROWS == 0) sample();
+            }
+            ms[3] = timer.lap();
+
+            if (back != sum) {
+                fprintf(stderr, "Wrong sum: %f, expected %f\n", back, sum);
+                return 1;
+            }
+        }
+        ms[4] = timer.lap();
+
+        // The file holds the grid
+        {
+            matrix_type M = open_array_file<matrix_array>(path, file_mode::read_only, host_window{BUDGET, 0});
+            for (array_size_t i = 0; i < ROWS; i += 127) {
+                for (array_size_t j = 0; j < COLS; j += 131) {
+                    if (M(i, j) != value(i, j)) {
+                        fprintf(stderr, "Wrong value at (%zd, %zd): %f\n", size_t(i), size_t(j), M(i, j));
+                        return 1;
+                    }
+                }
+            }
+        }
+
+        fault_stats after = get_fault_stats();
+        printf("%-7s %10.1f %10.1f %11.1f %10.1f %12.1f %10zu %10llu %10llu\n", windowed? "window": "mapped",
+               ms[0], ms[1], ms[2], ms[3], ms[4], peak >> 20,
+               (unsigned long long) (after.tileLoads - before.tileLoads),
+               (unsigned long long) (after.tileStores - before.tileStores));
+    }
+
+    unlink(path.c_str());
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
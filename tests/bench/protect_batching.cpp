@@ -0,0 +1,174 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// System calls issued to protect the arrays of small, frequent launches.
+// Every step the host reads one element of each array and launches a kernel
+// that takes all of them. Releasing the arguments protects each array, and the
+// reads fault and unprotect them again. Each configuration runs in a child
+// process, with the protection changes of the launches applied one by one or
+// batched (CUDARRAYS_PROTECT_BATCHING). Arrays allocated one after another are
+// usually adjacent, so batched changes are merged into fewer system calls
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/memory.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ELEMS = 1024;
+static const unsigned STEPS = 20000;
+static const unsigned ARRAYS = 10;
+
+// Keeps the reads of the host
+static volatile float Sink;
+
+using vector_type = vector_view<float, noalign, reshape::x>;
+
+// Emulated by the stand-in
+__global__ void
+kernel1(vector_type)
+{
+}
+
+__global__ void
+kernel2(vector_type, vector_type)
+{
+}
+
+__global__ void
+kernel6(vector_type, vector_type, vector_type, vector_type, vector_type, vector_type)
+{
+}
+
+__global__ void
+kernel10(vector_type, vector_type, vector_type, vector_type, vector_type,
+         vector_type, vector_type, vector_type, vector_type, vector_type)
+{
+}
+
+static int
+child()
+{
+    init_lib();
+
+    unsigned gpus = system::gpu_count();
+    compute_conf<1> gpuConf{compute::x, gpus};
+    cuda_conf conf{1, 1};
+
+    std::vector<vector_type> V;
+    for (unsigned i = 0; i < ARRAYS; ++i) {
+        V.push_back(make_vector<float, reshape::x>({ELEMS}));
+        V.back().distribute<1>({gpuConf, {{0}}});
+        for (array_size_t j = 0; j < ELEMS; ++j)
+            V.back()(j) = float(j);
+    }
+
+    for (unsigned args : { 1u, 2u, 6u, 10u }) {
+        auto step = [&]()
+        {
+            if (args == 1)
+                launch(kernel1, conf, gpuConf)(V[0]);
+            else if (args == 2)
+                launch(kernel2, conf, gpuConf)(V[0], V[1]);
+            else if (args == 6)
+                launch(kernel6, conf, gpuConf)(V[0], V[1], V[2], V[3], V[4], V[5]);
+            else
+                launch(kernel10, conf, gpuConf)(V[0], V[1], V[2], V[3], V[4], V[5], V[6], V[7], V[8], V[9]);
+        };
+
+        // Warm-up launch: streams and launch plan
+        step();
+
+        double launchUs = 0.0;
+        uint64_t launchCalls = 0, hostCalls = 0;
+        float sum = 0.f;
+        for (unsigned s = 0; s < STEPS; ++s) {
+            uint64_t calls = get_fault_stats().protectCalls;
+            for (unsigned i = 0; i < args; ++i)
+                sum += V[i](s % ELEMS);
+            uint64_t read = get_fault_stats().protectCalls;
+
+            auto start = std::chrono::steady_clock::now();
+            step();
+            launchUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+            hostCalls   += read - calls;
+            launchCalls += get_fault_stats().protectCalls - read;
+        }
+
+        Sink = sum;
+
+        printf("%-9s %6u %10.3f us %14.2f %14.2f\n",
+               PROTECT_BATCHING? "batched": "separate", args, launchUs / STEPS,
+               double(launchCalls) / STEPS, double(hostCalls) / STEPS);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("GPUs: %u, arrays: %zu floats, %u steps\n", system::gpu_count(), size_t(ELEMS), STEPS);
+    printf("%-9s %6s %13s %14s %14s\n", "changes", "arrays", "launch", "calls/launch", "calls/reads");
+    fflush(stdout);
+
+    for (const char *batching : { "0", "1" }) {
+        std::string cmd = std::string("CUDARRAYS_PROTECT_BATCHING=") + batching + " '" + self + "' child";
+        if (::system(cmd.c_str()) != 0) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,212 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Merge of the replicas of an array in the devices into its host copy, as done
+// when a replicated array is transferred to the host. The baseline fetches
+// every replica whole into a temporary copy, compares it element by element
+// with the host copy into a second temporary copy that is then copied back to
+// the host, and uploads the whole host copy to every replica. The pipelined
+// merge fetches the next part of all the replicas while the current one is
+// merged in place with wide comparisons, and uploads only the parts that
+// changed. Replicas are written in three patterns: not at all, one disjoint
+// slice per replica, and a sparse set of elements. Reports the time of both
+// merges and the bytes they transfer. Linked against the host stand-in of the
+// CUDA runtime, in which device memory is host memory
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <cuda_runtime_api.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/detail/dynarray/merge.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+enum class pattern { none, partition, sparse };
+
+static const char *
+pattern_name(pattern p)
+{
+    return p == pattern::none? "none": p == pattern::partition? "partition": "sparse";
+}
+
+// Elements between consecutive writes of the sparse pattern
+static const size_t SPARSE_STRIDE = 4099;
+
+struct replicated_data {
+    size_t elems;
+    std::unique_ptr<float[]> host;
+    std::vector<float *> replicas;
+
+    replicated_data(size_t _elems, unsigned count) :
+        elems(_elems),
+        host(new float[_elems]),
+        replicas(count, nullptr)
+    {
+        for (auto &replica : replicas)
+            cudaMalloc(reinterpret_cast<void **>(&replica), elems * sizeof(float));
+    }
+
+    ~replicated_data()
+    {
+        for (auto replica : replicas)
+            cudaFree(replica);
+    }
+
+    // Write the host copy and the replicas as the kernels would leave them
+    void reset(pattern p)
+    {
+        #pragma omp parallel for
+        for (long i = 0; i < long(elems); ++i)
+            host[i] = float(i % 1021);
+
+        unsigned count = unsigned(replicas.size());
+        for (unsigned r = 0; r < count; ++r) {
+            float *replica = replicas[r];
+            memcpy(replica, host.get(), elems * sizeof(float));
+
+            if (p == pattern::partition) {
+                size_t begin = elems * r / count, end = elems * (r + 1) / count;
+                #pragma omp parallel for
+                for (long i = long(begin); i < long(end); ++i)
+                    replica[i] = float(i % 1021) + 1.f + r;
+            } else if (p == pattern::sparse) {
+                for (size_t i = r; i < elems; i += SPARSE_STRIDE * count)
+                    replica[i] = -float(r + 1);
+            }
+        }
+    }
+};
+
+static void
+merge_baseline(replicated_data &data)
+{
+    size_t bytes = data.elems * sizeof(float);
+    std::unique_ptr<float[]> tmp(new float[data.elems]);
+    std::unique_ptr<float[]> final(new float[data.elems]);
+
+    std::copy(data.host.get(), data.host.get() + data.elems, final.get());
+
+    for (float *replica : data.replicas) {
+        cudaMemcpy(tmp.get(), replica, bytes, cudaMemcpyDeviceToHost);
+
+        #pragma omp parallel for
+        for (long j = 0; j < long(data.elems); ++j) {
+            if (memcmp(tmp.get() + j, data.host.get() + j, sizeof(float)) != 0)
+                final[j] = tmp[j];
+        }
+    }
+
+    std::copy(final.get(), final.get() + data.elems, data.host.get());
+
+    for (float *replica : data.replicas)
+        cudaMemcpy(replica, data.host.get(), bytes, cudaMemcpyHostToDevice);
+}
+
+static void
+merge_pipelined(replicated_data &data, cudarrays::detail::merge_buffers &buffers)
+{
+    auto fetch = [&data](unsigned replica, size_t offset, size_t bytes, void *dst)
+    {
+        cudaMemcpy(dst, reinterpret_cast<const char *>(data.replicas[replica]) + offset, bytes,
+                   cudaMemcpyDeviceToHost);
+    };
+    auto upload = [&data](unsigned replica, size_t offset, size_t bytes, void *src)
+    {
+        cudaMemcpy(reinterpret_cast<char *>(data.replicas[replica]) + offset, src, bytes,
+                   cudaMemcpyHostToDevice);
+    };
+
+    cudarrays::detail::merge_pipeline(data.host.get(), data.elems * sizeof(float), sizeof(float),
+                           unsigned(data.replicas.size()), fetch, upload, buffers);
+}
+
+template <typename F>
+static double
+time_merge(replicated_data &data, pattern p, F merge, unsigned long &bytes)
+{
+    data.reset(p);
+    HostRuntime.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    merge();
+    auto end = std::chrono::steady_clock::now();
+
+    bytes = HostRuntime.memcpyBytes;
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    init_lib();
+
+    printf("Merge part: %zu KiB\n", MERGE_CHUNK.value() >> 10);
+    printf("%-8s %-8s %-10s %14s %14s %8s %14s %14s\n", "MiB", "replicas", "pattern",
+           "baseline (ms)", "pipeline (ms)", "speedup", "baseline (MiB)", "pipeline (MiB)");
+
+    for (size_t mib : { size_t(64), size_t(256) }) {
+        for (unsigned count : { 2u, 4u }) {
+            replicated_data data((mib << 20) / sizeof(float), count);
+            cudarrays::detail::merge_buffers buffers;
+
+            for (pattern p : { pattern::none, pattern::partition, pattern::sparse }) {
+                unsigned long baseBytes, pipeBytes;
+                double base = time_merge(data, p, [&]() { merge_baseline(data); }, baseBytes);
+                std::unique_ptr<float[]> expected(new float[data.elems]);
+                std::copy(data.host.get(), data.host.get() + data.elems, expected.get());
+
+                double pipe = time_merge(data, p, [&]() { merge_pipelined(data, buffers); }, pipeBytes);
+
+                if (memcmp(expected.get(), data.host.get(), data.elems * sizeof(float)) != 0) {
+                    fprintf(stderr, "Merged host copies differ (%s)\n", pattern_name(p));
+                    return 1;
+                }
+                for (float *replica : data.replicas) {
+                    if (memcmp(replica, data.host.get(), data.elems * sizeof(float)) != 0) {
+                        fprintf(stderr, "Replica differs from the merged host copy (%s)\n", pattern_name(p));
+                        return 1;
+                    }
+                }
+
+                printf("%-8zu %-8u %-10s %14.1f %14.1f %7.2fx %14lu %14lu\n", mib, count, pattern_name(p),
+                       base, pipe, base / pipe, baseBytes >> 20, pipeBytes >> 20);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
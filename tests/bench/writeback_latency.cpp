@@ -0,0 +1,183 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Time to the first CPU access and turnaround of a matrix written by a kernel,
+// with the lazy transfers done on CPU faults and with the eager transfers done
+// in the background once the kernel completes. After every kernel the host
+// waits for a while without touching the matrix (e.g. doing I/O), then reads
+// an element and finally an element of every page of the matrix. Each mode runs in a child process
+// since it is read from the environment at startup. Kernels are emulated by
+// filling the device memory when they are launched, and the values read must
+// match across modes. Device memory is host memory of the stand-in of the
+// CUDA runtime
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cudarrays/common.hpp>
+#include <cudarrays/types.hpp>
+
+#include <cudarrays/gpu.cuh>
+#include <cudarrays/launch.hpp>
+
+#include "host_runtime.hpp"
+
+using namespace cudarrays;
+
+static const array_size_t ROWS = 4096;
+static const array_size_t COLS = 4096;
+
+static const unsigned ROUNDS = 4;
+// Time the host does not touch the matrix after every kernel
+static const unsigned GAPS_MS[] = { 0, 10, 40 };
+
+using matrix_type = matrix_view<float, layout::rmo, noalign, reshape_block::xy>;
+
+__global__ void
+write_kernel(matrix_type)
+{
+    // Emulated by the stand-in
+}
+
+using clock_type = std::chrono::steady_clock;
+
+static int
+child()
+{
+    init_lib();
+    host_runtime_fill_on_launch(true);
+
+    unsigned gpus = system::gpu_count();
+
+    auto M = make_matrix<float, layout::rmo, reshape_block::xy>({ROWS, COLS});
+    M.distribute<2>({compute_conf<2>{compute::xy, gpus}, {{0, 1}}});
+    M.set_access_intent(access_intent::write_discard);
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    cuda_conf conf{1, 1};
+
+    array_size_t pageElems = array_size_t(sysconf(_SC_PAGESIZE)) / sizeof(float);
+    array_size_t pages = ROWS * COLS / pageElems;
+
+    for (unsigned gap : GAPS_MS) {
+        double firstUs = 0.0, readMs = 0.0, totalMs = 0.0;
+        uint64_t checksum = 0;
+
+        for (unsigned r = 0; r < ROUNDS; ++r) {
+            launch(write_kernel, conf, gpuConf)(M);
+            auto done = clock_type::now();
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(gap));
+
+            auto start = clock_type::now();
+            float first = M(0, 0);
+            auto firstEnd = clock_type::now();
+
+            uint32_t bits;
+            memcpy(&bits, &first, sizeof(bits));
+            checksum = checksum * 31 + bits;
+            for (array_size_t p = 0; p < pages; ++p) {
+                array_size_t i = p * pageElems + p % pageElems;
+                float val = M(i / COLS, i % COLS);
+                memcpy(&bits, &val, sizeof(bits));
+                checksum = checksum * 31 + bits;
+            }
+            auto end = clock_type::now();
+
+            firstUs += std::chrono::duration<double, std::micro>(firstEnd - start).count();
+            readMs  += std::chrono::duration<double, std::milli>(end - start).count();
+            totalMs += std::chrono::duration<double, std::milli>(end - done).count();
+        }
+
+        printf("%u %f %f %f %llu\n", gap, firstUs / ROUNDS, readMs / ROUNDS, totalMs / ROUNDS,
+               (unsigned long long)checksum);
+    }
+
+    return 0;
+}
+
+int main(int argc, char *[])
+{
+    if (argc > 1) return child();
+
+    char self[4096];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        abort();
+    }
+    self[len] = '\0';
+
+    printf("GPUs: %u, matrix: %zux%zu floats, %u rounds\n", system::gpu_count(),
+           size_t(ROWS), size_t(COLS), ROUNDS);
+    printf("%-6s %7s %14s %10s %14s\n", "mode", "gap ms", "first access us", "read ms", "turnaround ms");
+
+    std::vector<unsigned long long> reference;
+    for (bool eager : { false, true }) {
+        std::string cmd = std::string("CUDARRAYS_COHERENCE_EAGER_WRITEBACK=") + (eager? "1": "0") +
+                          " '" + self + "' child";
+        FILE *out = popen(cmd.c_str(), "r");
+        if (!out) {
+            perror("popen");
+            abort();
+        }
+
+        unsigned gap;
+        double firstUs, readMs, totalMs;
+        unsigned long long checksum;
+        size_t n = 0;
+        bool match = true;
+        while (fscanf(out, "%u %lf %lf %lf %llu", &gap, &firstUs, &readMs, &totalMs, &checksum) == 5) {
+            if (!eager)
+                reference.push_back(checksum);
+            else
+                match = n < reference.size() && reference[n] == checksum;
+            ++n;
+
+            printf("%-6s %7u %14.1f %10.3f %14.3f%s\n", eager? "eager": "lazy", gap, firstUs, readMs, totalMs,
+                   match? "": "  WRONG VALUES");
+            if (!match) break;
+        }
+
+        if (pclose(out) != 0 || !match || n != sizeof(GAPS_MS) / sizeof(GAPS_MS[0])) {
+            fprintf(stderr, "Error running the benchmark\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
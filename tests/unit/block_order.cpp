@@ -0,0 +1,104 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <vector>
+
+#include "common.hpp"
+
+#include "cudarrays/detail/cpu/block_order.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace cudarrays;
+
+class block_order_test :
+    public testing::Test {
+protected:
+    static void SetUpTestCase() {}
+    static void TearDownTestCase() {}
+};
+
+/**
+ * Check that the sequence of an order visits every block of the grid once
+ */
+static void
+check_permutation(cpu::block_order order, dim3 grid)
+{
+    size_t blocks = size_t(grid.x) * grid.y * grid.z;
+
+    auto seq = cpu::get_block_sequence(order, grid);
+    ASSERT_TRUE(bool(seq));
+    ASSERT_EQ(seq->size(), blocks);
+
+    std::vector<unsigned> hits(blocks, 0);
+    for (size_t id : *seq) {
+        ASSERT_LT(id, blocks);
+        ++hits[id];
+    }
+    for (unsigned h : hits)
+        ASSERT_EQ(h, 1u);
+}
+
+static void
+check_orders(dim3 grid)
+{
+    check_permutation(cpu::block_order::tiled,   grid);
+    check_permutation(cpu::block_order::morton,  grid);
+    check_permutation(cpu::block_order::hilbert, grid);
+}
+
+TEST_F(block_order_test, raster)
+{
+    ASSERT_FALSE(bool(cpu::get_block_sequence(cpu::block_order::raster, dim3(5, 3))));
+}
+
+TEST_F(block_order_test, permutation_1d)
+{
+    check_orders(dim3(1));
+    check_orders(dim3(13));
+    check_orders(dim3(1, 13));
+    check_orders(dim3(1, 1, 7));
+}
+
+TEST_F(block_order_test, permutation_2d)
+{
+    check_orders(dim3(4, 4));
+    check_orders(dim3(5, 3));
+    check_orders(dim3(3, 5));
+    check_orders(dim3(17, 9));
+    check_orders(dim3(100, 7));
+}
+
+TEST_F(block_order_test, permutation_3d)
+{
+    check_orders(dim3(5, 3, 2));
+    check_orders(dim3(1, 9, 3));
+    check_orders(dim3(9, 1, 3));
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
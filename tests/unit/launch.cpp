@@ -0,0 +1,127 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <vector>
+
+#include "common.hpp"
+
+#include "cudarrays/launch.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace cudarrays;
+
+class launch_test :
+    public testing::Test {
+protected:
+    static void SetUpTestCase() {}
+    static void TearDownTestCase() {}
+};
+
+/**
+ * Check that the tiles of a decomposition cover every block of the grid
+ * exactly once, and that only the partitioned dimensions are split
+ */
+template <unsigned Dims>
+static void
+check_tiling(unsigned gpus, compute c, dim3 total)
+{
+    compute_conf<Dims> conf{c, gpus};
+    grid_tiling tiling{gpus, conf, total};
+
+    std::vector<unsigned> hits(total.x * total.y * total.z, 0);
+    unsigned tiles = 0;
+
+    tiling.for_each_tile([&](unsigned gpu, dim3 off, dim3 local)
+    {
+        ASSERT_EQ(gpu, tiles);
+        ++tiles;
+
+        if (!(c & partition::X)) {
+            ASSERT_EQ(local.x, total.x);
+        }
+        if (!(c & partition::Y)) {
+            ASSERT_EQ(local.y, total.y);
+        }
+        if (!(c & partition::Z)) {
+            ASSERT_EQ(local.z, total.z);
+        }
+
+        for (unsigned z = off.z; z < off.z + local.z; ++z) {
+            for (unsigned y = off.y; y < off.y + local.y; ++y) {
+                for (unsigned x = off.x; x < off.x + local.x; ++x) {
+                    ASSERT_LT(x, total.x);
+                    ASSERT_LT(y, total.y);
+                    ASSERT_LT(z, total.z);
+                    ++hits[(z * total.y + y) * total.x + x];
+                }
+            }
+        }
+    });
+
+    ASSERT_EQ(tiles, gpus);
+    for (unsigned h : hits)
+        ASSERT_EQ(h, 1u);
+}
+
+TEST_F(launch_test, grid_tiling_x)
+{
+    check_tiling<1>(2, compute::x, dim3(7));
+    check_tiling<1>(3, compute::x, dim3(7));
+    check_tiling<1>(3, compute::x, dim3(2));
+    check_tiling<2>(2, compute::x, dim3(5, 3));
+    check_tiling<2>(3, compute::x, dim3(10, 3));
+    check_tiling<3>(2, compute::x, dim3(9, 2, 3));
+    check_tiling<3>(3, compute::x, dim3(11, 2, 3));
+}
+
+TEST_F(launch_test, grid_tiling_y)
+{
+    check_tiling<2>(2, compute::y, dim3(3, 5));
+    check_tiling<2>(3, compute::y, dim3(3, 7));
+    check_tiling<2>(3, compute::y, dim3(3, 4));
+    check_tiling<3>(2, compute::y, dim3(2, 9, 3));
+    check_tiling<3>(3, compute::y, dim3(2, 11, 3));
+}
+
+TEST_F(launch_test, grid_tiling_z)
+{
+    check_tiling<3>(2, compute::z, dim3(2, 3, 5));
+    check_tiling<3>(3, compute::z, dim3(2, 3, 7));
+    check_tiling<3>(3, compute::z, dim3(2, 3, 2));
+}
+
+TEST_F(launch_test, grid_tiling_xy)
+{
+    check_tiling<2>(2, compute::xy, dim3(5, 7));
+    check_tiling<2>(3, compute::xy, dim3(5, 7));
+    check_tiling<2>(6, compute::xy, dim3(5, 7));
+    check_tiling<3>(6, compute::xyz, dim3(5, 7, 3));
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
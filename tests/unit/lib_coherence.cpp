@@ -0,0 +1,279 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <sys/mman.h>
+
+#include <vector>
+
+#include "common.hpp"
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/detail/coherence/default.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace cudarrays;
+
+class lib_coherence_test :
+    public testing::Test {
+protected:
+    static void SetUpTestCase();
+    static void TearDownTestCase();
+};
+
+void
+lib_coherence_test::SetUpTestCase()
+{
+    init_lib();
+}
+
+void
+lib_coherence_test::TearDownTestCase()
+{
+    // The library cannot be initialized again once finalized, and other
+    // test cases use it: it is finalized at exit
+}
+
+static const size_t PAGE = 4096;
+
+// The tests assume the default parts of 16 pages. Up to a quarter of their
+// pages are tracked (DIRTY_TRACKING_FRACTION) and runs of dirty pages up to 8
+// pages apart are coalesced (DIRTY_RUN_GAP)
+static const size_t CHUNK_PAGES = 16;
+
+static bool
+default_tracking()
+{
+    return COHERENCE_DIRTY_TRACKING && COHERENCE_FAULT_GRANULARITY.value() == CHUNK_PAGES * PAGE;
+}
+
+/**
+ * Array of the host whose device copies are not transferred: the transfers
+ * to the devices are recorded instead
+ */
+class fake_array :
+    public coherent {
+public:
+    struct copy {
+        size_t offset;
+        size_t bytes;
+
+        bool operator==(const copy &other) const
+        {
+            return offset == other.offset && bytes == other.bytes;
+        }
+    };
+
+    // Transfers of parts of the array and of the whole array
+    std::vector<copy> uploads;
+    unsigned wholeUploads;
+
+    /**
+     * @param parts The array can transfer parts of it
+     */
+    fake_array(size_t pages, bool parts = true) :
+        wholeUploads(0),
+        parts_(parts),
+        bytes_(pages * PAGE)
+    {
+        addr_ = (char *) mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        policy_.bind(*this);
+    }
+
+    ~fake_array() noexcept
+    {
+        policy_.unbind();
+        munmap(addr_, bytes_);
+    }
+
+    /**
+     * Execute a kernel on the first device and return the array to the CPU.
+     * The transfers done up to now are forgotten
+     */
+    void kernel(access_intent intent)
+    {
+        policy_.release({0}, intent);
+        policy_.acquire();
+    }
+
+    void write(size_t page)
+    {
+        addr_[page * PAGE + 1] = 1;
+    }
+
+    void clear()
+    {
+        uploads.clear();
+        wholeUploads = 0;
+    }
+
+    coherence_policy &get_coherence_policy() noexcept override { return policy_; }
+    void set_current_gpu(unsigned) override {}
+
+    bool is_distributed() const override { return true; }
+    bool distribute(const std::vector<unsigned> &) override { return true; }
+
+    void to_device() override { ++wholeUploads; }
+    void to_host() override {}
+    bool to_host(size_t, size_t) override { return parts_; }
+    bool to_staging(size_t, size_t) override { return false; }
+
+    bool to_device(size_t offset, size_t bytes) override
+    {
+        if (!parts_) return false;
+        uploads.push_back(copy{offset, bytes});
+        return true;
+    }
+
+    // The copies of the devices are updated together
+    bool to_device(unsigned, size_t, size_t) override { return false; }
+
+    void *host_addr() noexcept override { return addr_; }
+    const void *host_addr() const noexcept override { return addr_; }
+    void *staging_addr() noexcept override { return nullptr; }
+    size_t size() const noexcept override { return bytes_; }
+    size_t host_page_size() const noexcept override { return PAGE; }
+
+private:
+    default_coherence policy_;
+    bool parts_;
+    char *addr_;
+    size_t bytes_;
+};
+
+using copies = std::vector<fake_array::copy>;
+
+static fake_array::copy
+pages(size_t first, size_t count)
+{
+    return fake_array::copy{first * PAGE, count * PAGE};
+}
+
+TEST_F(lib_coherence_test, dirty_runs_gap)
+{
+    if (!default_tracking()) return;
+
+    fake_array arr(4 * CHUNK_PAGES);
+    arr.kernel(access_intent::read_write);
+    ASSERT_EQ(arr.uploads, copies{pages(0, 4 * CHUNK_PAGES)});
+
+    // Just under the gap: the clean pages between the runs are transferred
+    arr.clear();
+    arr.write(2);
+    arr.write(10);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, copies{pages(2, 9)});
+
+    // Just over the gap
+    arr.clear();
+    arr.write(2);
+    arr.write(11);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, (copies{pages(2, 1), pages(11, 1)}));
+}
+
+TEST_F(lib_coherence_test, dirty_runs_adjacent)
+{
+    if (!default_tracking()) return;
+
+    fake_array arr(4 * CHUNK_PAGES);
+    arr.kernel(access_intent::read_write);
+
+    // Adjacent pages, and a page written twice
+    arr.clear();
+    arr.write(3);
+    arr.write(4);
+    arr.write(4);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, copies{pages(3, 2)});
+
+    // Runs in adjacent parts are merged in a single transfer
+    arr.clear();
+    arr.write(CHUNK_PAGES - 1);
+    arr.write(CHUNK_PAGES);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, copies{pages(CHUNK_PAGES - 1, 2)});
+
+    // Runs in different parts are not
+    arr.clear();
+    arr.write(1);
+    arr.write(2 * CHUNK_PAGES + 1);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, (copies{pages(1, 1), pages(2 * CHUNK_PAGES + 1, 1)}));
+}
+
+TEST_F(lib_coherence_test, dirty_tracking_fraction)
+{
+    if (!default_tracking()) return;
+
+    fake_array arr(4 * CHUNK_PAGES);
+    arr.kernel(access_intent::read_write);
+
+    // A quarter of the pages of the part are tracked
+    arr.clear();
+    arr.write(0);
+    arr.write(1);
+    arr.write(CHUNK_PAGES - 2);
+    arr.write(CHUNK_PAGES - 1);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, (copies{pages(0, 2), pages(CHUNK_PAGES - 2, 2)}));
+
+    // One more page transfers the whole part
+    arr.clear();
+    arr.write(0);
+    arr.write(1);
+    arr.write(2);
+    arr.write(CHUNK_PAGES - 2);
+    arr.write(CHUNK_PAGES - 1);
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.uploads, copies{pages(0, CHUNK_PAGES)});
+}
+
+TEST_F(lib_coherence_test, dirty_runs_whole_array)
+{
+    if (!default_tracking()) return;
+
+    // Arrays that cannot transfer parts transfer the whole array instead
+    fake_array arr(4 * CHUNK_PAGES, false);
+    arr.kernel(access_intent::read_write);
+    ASSERT_EQ(arr.wholeUploads, 1u);
+
+    arr.clear();
+    arr.write(2);
+    arr.write(CHUNK_PAGES + 2);
+    arr.kernel(access_intent::read);
+    ASSERT_TRUE(arr.uploads.empty());
+    ASSERT_EQ(arr.wholeUploads, 1u);
+
+    // The devices are up to date
+    arr.clear();
+    arr.kernel(access_intent::read);
+    ASSERT_EQ(arr.wholeUploads, 0u);
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
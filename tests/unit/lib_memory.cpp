@@ -0,0 +1,320 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+#include <sys/mman.h>
+
+#include "common.hpp"
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/memory.hpp"
+
+#include "gtest/gtest.h"
+
+class lib_memory_test :
+    public testing::Test {
+protected:
+    static void SetUpTestCase();
+    static void TearDownTestCase();
+};
+
+void
+lib_memory_test::SetUpTestCase()
+{
+    cudarrays::init_lib();
+}
+
+void
+lib_memory_test::TearDownTestCase()
+{
+    // The library cannot be initialized again once finalized, and other
+    // test cases use it: it is finalized at exit
+}
+
+static const size_t PAGE = 4096;
+
+// Spans covered by a leaf (4096 pages) and by a node (4096 leaves) of the
+// page table
+static const size_t LEAF_SPAN = PAGE << 12;
+static const size_t NODE_SPAN = LEAF_SPAN << 12;
+
+/**
+ * Reserve an inaccessible region of count bytes that contains an address
+ * aligned to align, and return that address
+ */
+static char *
+reserve_around(size_t align, size_t count, void *&base, size_t &bytes)
+{
+    bytes = align + count;
+    base = mmap(nullptr, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return nullptr;
+
+    return (char *)((size_t(base) + count / 2 + align - 1) / align * align);
+}
+
+static void
+check_range(char *addr, size_t count)
+{
+    cudarrays::register_range(addr, count);
+
+    ASSERT_TRUE(cudarrays::is_registered(addr));
+    ASSERT_TRUE(cudarrays::is_registered(addr + count / 2));
+    ASSERT_TRUE(cudarrays::is_registered(addr + count - 1));
+    ASSERT_FALSE(cudarrays::is_registered(addr - 1));
+    ASSERT_FALSE(cudarrays::is_registered(addr + count));
+
+    cudarrays::unregister_range(addr);
+
+    ASSERT_FALSE(cudarrays::is_registered(addr));
+    ASSERT_FALSE(cudarrays::is_registered(addr + count / 2));
+    ASSERT_FALSE(cudarrays::is_registered(addr + count - 1));
+}
+
+TEST_F(lib_memory_test, page_table_unregistered)
+{
+    int local;
+
+    ASSERT_FALSE(cudarrays::is_registered(nullptr));
+    ASSERT_FALSE(cudarrays::is_registered(&local));
+    ASSERT_FALSE(cudarrays::is_registered((void *) ~size_t(0)));
+    // Beyond 48-bit virtual addresses
+    ASSERT_FALSE(cudarrays::is_registered((void *) (size_t(1) << 50)));
+}
+
+TEST_F(lib_memory_test, page_table_leaf_boundary)
+{
+    void *base;
+    size_t bytes;
+    char *boundary = reserve_around(LEAF_SPAN, 8 * PAGE, base, bytes);
+    ASSERT_NE(boundary, nullptr);
+
+    check_range(boundary - 4 * PAGE, 8 * PAGE);
+    // Ranges that end and start at the boundary
+    check_range(boundary - 2 * PAGE, 2 * PAGE);
+    check_range(boundary, 2 * PAGE);
+
+    munmap(base, bytes);
+}
+
+TEST_F(lib_memory_test, page_table_node_boundary)
+{
+    void *base;
+    size_t bytes;
+    char *boundary = reserve_around(NODE_SPAN, 8 * PAGE, base, bytes);
+    if (boundary == nullptr) {
+        // The address space cannot hold the reservation
+        printf("Skipped: cannot reserve %zd bytes\n", NODE_SPAN);
+        return;
+    }
+
+    check_range(boundary - 4 * PAGE, 8 * PAGE);
+
+    munmap(base, bytes);
+}
+
+TEST_F(lib_memory_test, page_table_partial_pages)
+{
+    void *base;
+    size_t bytes;
+    char *boundary = reserve_around(LEAF_SPAN, 8 * PAGE, base, bytes);
+    ASSERT_NE(boundary, nullptr);
+
+    // Range that uses part of its first and last pages, which are in
+    // different leaves
+    char *first  = boundary - 2 * PAGE + 100;
+    char *second = boundary + 200;
+    cudarrays::register_range(first, size_t(second - first));
+
+    ASSERT_TRUE(cudarrays::is_registered(first));
+    ASSERT_TRUE(cudarrays::is_registered(second - 1));
+    ASSERT_FALSE(cudarrays::is_registered(first - 1));
+    ASSERT_FALSE(cudarrays::is_registered(second));
+
+    cudarrays::unregister_range(first);
+    ASSERT_FALSE(cudarrays::is_registered(first));
+
+    // Unregistering an unregistered address is ignored
+    cudarrays::unregister_range(first);
+    ASSERT_FALSE(cudarrays::is_registered(first));
+
+    munmap(base, bytes);
+}
+
+//
+// Coalescing of the protection changes deferred by protection_batch
+//
+static const size_t BATCH_PAGES = 8;
+
+// Registered range whose handler grants all the accesses
+struct batch_range {
+    char *addr;
+
+    batch_range()
+    {
+        addr = (char *) mmap(nullptr, BATCH_PAGES * PAGE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        cudarrays::register_range(addr, BATCH_PAGES * PAGE);
+    }
+
+    ~batch_range()
+    {
+        cudarrays::unregister_range(addr);
+        munmap(addr, BATCH_PAGES * PAGE);
+    }
+
+    void protect(size_t page, size_t pages, cudarrays::mem_access_type access_type)
+    {
+        char *base = addr;
+        cudarrays::protect_range(addr + page * PAGE, pages * PAGE, access_type,
+                                 [base](bool, void *)
+                                 {
+                                     cudarrays::protect_range(base, BATCH_PAGES * PAGE,
+                                                              cudarrays::MEM_READ_WRITE);
+                                     return true;
+                                 });
+    }
+
+    // Check if reading the page faults. The fault grants all the accesses
+    bool read_faults(size_t page)
+    {
+        uint64_t faults = cudarrays::get_fault_stats().readFaults;
+        volatile char val = *(volatile char *)(addr + page * PAGE);
+        (void) val;
+        return cudarrays::get_fault_stats().readFaults != faults;
+    }
+};
+
+static inline uint64_t
+protect_calls()
+{
+    return cudarrays::get_fault_stats().protectCalls;
+}
+
+TEST_F(lib_memory_test, batch_adjacent)
+{
+    if (!cudarrays::PROTECT_BATCHING) return;
+
+    batch_range range;
+    uint64_t calls = protect_calls();
+    {
+        cudarrays::protection_batch batch;
+        // Out of order: changes are sorted before merging them
+        range.protect(4, 2, cudarrays::MEM_NONE);
+        range.protect(0, 2, cudarrays::MEM_NONE);
+        range.protect(2, 2, cudarrays::MEM_NONE);
+        ASSERT_EQ(protect_calls(), calls);
+    }
+    ASSERT_EQ(protect_calls(), calls + 1);
+
+    ASSERT_TRUE(range.read_faults(5));
+}
+
+TEST_F(lib_memory_test, batch_not_mergeable)
+{
+    if (!cudarrays::PROTECT_BATCHING) return;
+
+    batch_range range;
+    uint64_t calls = protect_calls();
+    {
+        // Adjacent pages with different protections
+        cudarrays::protection_batch batch;
+        range.protect(0, 2, cudarrays::MEM_NONE);
+        range.protect(2, 2, cudarrays::MEM_READ);
+    }
+    ASSERT_EQ(protect_calls(), calls + 2);
+    ASSERT_FALSE(range.read_faults(2));
+    ASSERT_TRUE(range.read_faults(1));
+
+    calls = protect_calls();
+    {
+        // Pages with the same protection, one page apart
+        cudarrays::protection_batch batch;
+        range.protect(0, 1, cudarrays::MEM_NONE);
+        range.protect(2, 1, cudarrays::MEM_NONE);
+    }
+    ASSERT_EQ(protect_calls(), calls + 2);
+    ASSERT_TRUE(range.read_faults(2));
+}
+
+TEST_F(lib_memory_test, batch_overlapping)
+{
+    if (!cudarrays::PROTECT_BATCHING) return;
+
+    batch_range range;
+    uint64_t calls = protect_calls();
+    {
+        // The second change overlaps with the first one, which is applied
+        // first, so that the last change wins
+        cudarrays::protection_batch batch;
+        range.protect(0, 3, cudarrays::MEM_NONE);
+        ASSERT_EQ(protect_calls(), calls);
+        range.protect(2, 3, cudarrays::MEM_READ);
+        ASSERT_EQ(protect_calls(), calls + 1);
+    }
+    ASSERT_EQ(protect_calls(), calls + 2);
+
+    ASSERT_FALSE(range.read_faults(2));
+    ASSERT_TRUE(range.read_faults(0));
+}
+
+TEST_F(lib_memory_test, batch_grant)
+{
+    if (!cudarrays::PROTECT_BATCHING) return;
+
+    batch_range range;
+    uint64_t calls = protect_calls();
+    {
+        // Granting accesses applies the deferred changes and then itself
+        cudarrays::protection_batch batch;
+        range.protect(0, 2, cudarrays::MEM_NONE);
+        range.protect(4, 2, cudarrays::MEM_READ_WRITE);
+        ASSERT_EQ(protect_calls(), calls + 2);
+    }
+    ASSERT_EQ(protect_calls(), calls + 2);
+    ASSERT_TRUE(range.read_faults(0));
+}
+
+TEST_F(lib_memory_test, batch_nested)
+{
+    if (!cudarrays::PROTECT_BATCHING) return;
+
+    batch_range range;
+    uint64_t calls = protect_calls();
+    {
+        cudarrays::protection_batch outer;
+        range.protect(0, 2, cudarrays::MEM_NONE);
+        {
+            cudarrays::protection_batch inner;
+            range.protect(2, 2, cudarrays::MEM_NONE);
+        }
+        ASSERT_EQ(protect_calls(), calls);
+    }
+    ASSERT_EQ(protect_calls(), calls + 1);
+    ASSERT_TRUE(range.read_faults(3));
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */
@@ -0,0 +1,166 @@
+/*
+ * CUDArrays is a library for easy multi-GPU program development.
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013-2015 Barcelona Supercomputing Center and
+ *                         University of Illinois
+ *
+ *  Developed by: Javier Cabezas <javier.cabezas@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE. */
+
+// Tests of the launcher run on the host stand-in of the CUDA runtime of the
+// benchmarks (tests/bench/host_runtime.cpp). Kernels are not executed: the
+// stand-in records the streams and events used by each kernel
+
+#include "common.hpp"
+
+#include "cudarrays/common.hpp"
+#include "cudarrays/types.hpp"
+
+#include "cudarrays/gpu.cuh"
+#include "cudarrays/launch.hpp"
+
+#include "host_runtime.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace cudarrays;
+
+class runtime_launch_test :
+    public testing::Test {
+protected:
+    static void SetUpTestCase();
+    static void TearDownTestCase();
+};
+
+void
+runtime_launch_test::SetUpTestCase()
+{
+    host_runtime_track_order(true);
+    init_lib();
+}
+
+void
+runtime_launch_test::TearDownTestCase()
+{
+    host_runtime_track_order(false);
+}
+
+static const array_size_t ELEMS = 1024;
+
+__global__ void
+add_kernel( vector_view<float> C,
+           vector_cview<float> A,
+           vector_cview<float> B)
+{
+    unsigned idx = blockIdx.x * blockDim.x + threadIdx.x;
+    C(idx) = A(idx) + B(idx);
+}
+
+// Kernels issued by a launch. The kernel counter of the runtime is never reset,
+// so that it matches the kernel identifiers
+struct kernels {
+    unsigned long first, last;
+};
+
+static kernels
+run(vector_view<float> &C, vector_view<float> &A, vector_view<float> &B, unsigned gpus)
+{
+    cuda_conf conf{ELEMS / 256, 256};
+
+    kernels ret;
+    ret.first = HostRuntime.launchKernel;
+    bool status = launch(add_kernel, conf, compute_conf<1>{compute::x, gpus})(C, A, B);
+    EXPECT_TRUE(status);
+    ret.last = HostRuntime.launchKernel;
+
+    return ret;
+}
+
+// Number of kernels of after that are ordered after a kernel of before
+static unsigned
+ordered(const kernels &before, const kernels &after)
+{
+    unsigned ret = 0;
+    for (unsigned long k = after.first; k < after.last; ++k) {
+        for (unsigned long j = before.first; j < before.last; ++j) {
+            if (host_runtime_ordered(j, k)) {
+                ++ret;
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
+static unsigned
+count(const kernels &k)
+{
+    return unsigned(k.last - k.first);
+}
+
+TEST_F(runtime_launch_test, dependencies)
+{
+    unsigned gpus = system::gpu_count();
+
+    auto A = make_vector<float>({ELEMS});
+    auto B = make_vector<float>({ELEMS});
+    auto C = make_vector<float>({ELEMS});
+    auto D = make_vector<float>({ELEMS});
+    auto E = make_vector<float>({ELEMS});
+
+    compute_conf<1> gpuConf{compute::x, gpus};
+    A.distribute<1>({gpuConf, {{0}}});
+    B.distribute<1>({gpuConf, {{0}}});
+    C.distribute<1>({gpuConf, {{0}}});
+    D.distribute<1>({gpuConf, {{0}}});
+    E.distribute<1>({gpuConf, {{0}}});
+
+    for (unsigned i = 0; i < ELEMS; ++i) {
+        A(i) = float(i);
+        B(i) = float(i + 1.f);
+    }
+
+    kernels k0 = run(C, A, B, gpus); // C = A + B
+    kernels k1 = run(D, C, B, gpus); // D = C + B: reads C
+    kernels k2 = run(E, A, B, gpus); // E = A + B: disjoint output, shared inputs
+    kernels k3 = run(C, A, B, gpus); // C = A + B: overwrites C
+    kernels k4 = run(A, D, B, gpus); // A = D + B: overwrites an input of k0 and k2
+
+    // Read-after-write (C)
+    ASSERT_EQ(ordered(k0, k1), count(k1));
+    // Independent
+    ASSERT_EQ(ordered(k0, k2), 0u);
+    ASSERT_EQ(ordered(k1, k2), 0u);
+    ASSERT_EQ(ordered(k2, k3), 0u);
+    // Write-after-read (C)
+    ASSERT_EQ(ordered(k1, k3), count(k3));
+    // Write-after-write (C)
+    ASSERT_EQ(ordered(k0, k3), count(k3));
+    // Write-after-read (A)
+    ASSERT_EQ(ordered(k0, k4), count(k4));
+    ASSERT_EQ(ordered(k2, k4), count(k4));
+
+    // Ordering uses events instead of device synchronization
+    ASSERT_EQ(HostRuntime.deviceSynchronize.load(), 0ul);
+}
+
+/* vim:set ft=cpp backspace=2 tabstop=4 shiftwidth=4 textwidth=120 foldmethod=marker expandtab: */